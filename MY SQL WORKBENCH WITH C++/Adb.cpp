@@ -0,0 +1,169 @@
+// Adb.cpp
+// Running adb/fastboot commands and reading basic device state.
+
+#include "Adb.h"
+#include "Process.h"
+#include "RateLimiter.h"
+#include "Shutdown.h"
+#include "SingleFlight.h"
+#include "Trace.h"
+
+#include <sstream>
+
+using namespace std;
+
+static bool isAdbCommand(const string& cmd) {
+    size_t start = cmd.find_first_not_of(" \t");
+    return start != string::npos && cmd.compare(start, 4, "adb ") == 0;
+}
+
+static AdbRateLimiter::Permit admit(const string& cmd) {
+    if (!isAdbCommand(cmd)) return {};
+    return AdbRateLimiter::instance().acquire(adbServerFor(cmd), classifyAdbCommand(cmd));
+}
+
+// ===== Host shell quoting =====
+string hostQuote(const string& arg) {
+#ifdef _WIN32
+    return "\"" + arg + "\"";
+#else
+    string quoted = "'";
+    for (char c : arg) {
+        if (c == '\'') quoted += "'\\''";
+        else quoted += c;
+    }
+    return quoted + "'";
+#endif
+}
+
+// ===== Run shell command and capture output =====
+string runCommand(const string& cmd) {
+    string result;
+    runCommandStatus(cmd, result);
+    return result;
+}
+
+int runCommandStatus(const string& cmd, string& output) {
+    // Time spent queued at the limiter is not part of the command's span
+    AdbRateLimiter::Permit permit = admit(cmd);
+    TraceSpan span("exec", cmd);
+    output.clear();
+    int rc = runProcess(cmd, output);
+    if (!output.empty())
+        output.erase(output.find_last_not_of(" \n\r\t") + 1);
+    return rc;
+}
+
+static SingleFlight<string>& commandFlights() {
+    static SingleFlight<string> flights;
+    return flights;
+}
+
+string runCommandShared(const string& cmd, chrono::milliseconds cacheTtl) {
+    // Output of a cancelled run is empty and must not be cached
+    if (shutdownRequested()) cacheTtl = chrono::milliseconds::zero();
+    return commandFlights().run(cmd, [&cmd] { return runCommand(cmd); }, cacheTtl);
+}
+
+SharedCommandStats sharedCommandStats() {
+    SingleFlight<string>::Stats st = commandFlights().stats();
+    return { st.executions, st.shared, st.cacheHits };
+}
+
+int runCommandStreaming(const string& cmd, const function<bool(const char*, size_t)>& onData, int timeoutMs) {
+    AdbRateLimiter::Permit permit = admit(cmd);
+    TraceSpan span("exec", cmd);
+    return runProcessStreaming(cmd, onData, [&permit] { permit.release(); }, timeoutMs);
+}
+
+bool startCommandSession(ProcessSession& session, const string& cmd) {
+    AdbRateLimiter::Permit permit = admit(cmd);
+    TraceSpan span("exec", cmd);
+    return session.start(cmd);
+}
+
+// ===== Detect device =====
+vector<string> listDevices() {
+    vector<string> serials;
+    string devicesOutput = runCommand("adb devices");
+    istringstream ss(devicesOutput);
+    string line;
+    while (getline(ss, line)) {
+        line.erase(line.find_last_not_of(" \n\r\t") + 1);
+        if (line.find("\tdevice") != string::npos) {
+            serials.push_back(line.substr(0, line.find("\tdevice")));
+        }
+    }
+    return serials;
+}
+
+bool detectDevice(string& serial) {
+    vector<string> serials = listDevices();
+    if (serials.empty()) return false;
+    serial = serials.front();
+    return true;
+}
+
+// ===== Fetch Android property =====
+string getProp(const string& prop) {
+    return runCommand("adb shell getprop " + prop);
+}
+
+string getProp(const string& serial, const string& prop) {
+    return runCommand("adb -s " + serial + " shell getprop " + prop);
+}
+
+map<string, string> parseGetprop(const string& output) {
+    map<string, string> props;
+    istringstream ss(output);
+    string line;
+    while (getline(ss, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t keyEnd = line.find("]: [");
+        if (line.empty() || line[0] != '[' || keyEnd == string::npos) continue;
+        size_t valueEnd = line.rfind(']');
+        if (valueEnd < keyEnd + 4) continue;
+        props[line.substr(1, keyEnd - 1)] = line.substr(keyEnd + 4, valueEnd - keyEnd - 4);
+    }
+    return props;
+}
+
+map<string, string> getAllProps(const string& serial) {
+    return parseGetprop(runCommandShared("adb -s " + serial + " shell getprop"));
+}
+
+// ===== Fastboot =====
+vector<string> listFastbootDevices() {
+    vector<string> serials;
+    istringstream ss(runCommand("fastboot devices"));
+    string line;
+    while (getline(ss, line)) {
+        size_t tab = line.find('\t');
+        if (tab != string::npos && line.find("fastboot", tab) != string::npos)
+            serials.push_back(line.substr(0, tab));
+    }
+    return serials;
+}
+
+map<string, string> parseGetvarAll(const string& output) {
+    // (bootloader) partition-size:boot_a:0x4000000  ->  "partition-size:boot_a" = "0x4000000"
+    map<string, string> vars;
+    istringstream ss(output);
+    string line;
+    while (getline(ss, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.rfind("(bootloader) ", 0) != 0) continue;
+        line = line.substr(13);
+        size_t colon = line.rfind(':');
+        if (colon == string::npos) continue;
+        string value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(' '));
+        vars[line.substr(0, colon)] = value;
+    }
+    return vars;
+}
+
+map<string, string> getFastbootVars(const string& serial) {
+    // fastboot reports variables on stderr
+    return parseGetvarAll(runCommand("fastboot -s " + serial + " getvar all 2>&1"));
+}
@@ -0,0 +1,80 @@
+// Adb.h
+// Running adb/fastboot commands and reading basic device state.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+class ProcessSession;
+
+// Quote one argument for the host shell that runs commands (cmd.exe on
+// Windows, /bin/sh elsewhere), e.g. a local or remote path for push/pull.
+std::string hostQuote(const std::string& arg);
+
+// Run a shell command and capture its (right-trimmed) stdout.
+// adb commands go through AdbRateLimiter first; after shutdown has been
+// requested this returns "" without starting anything.
+std::string runCommand(const std::string& cmd);
+
+// runCommand that also reports the exit code (-1 if cancelled or not
+// started), for commands whose output does not tell success apart.
+int runCommandStatus(const std::string& cmd, std::string& output);
+
+// runCommand with single-flight deduplication: concurrent callers running the
+// same command line (which names the device with -s) share one child and its
+// output. With a non-zero `cacheTtl` the output is reused for that long.
+std::string runCommandShared(const std::string& cmd,
+    std::chrono::milliseconds cacheTtl = std::chrono::milliseconds::zero());
+
+struct SharedCommandStats {
+    uint64_t executions = 0;
+    uint64_t shared = 0;
+    uint64_t cacheHits = 0;
+};
+SharedCommandStats sharedCommandStats();
+
+// Binary-safe variant for "adb exec-out": stdout is passed to `onData` as it
+// streams in, untouched. Returns the exit code (-1 if cancelled). Streams can
+// run for hours (logcat, telemetry), so only their start is rate limited: the
+// in-flight slot is given back as soon as the child is running. `timeoutMs`
+// bounds the child's run time as in runProcessStreaming.
+int runCommandStreaming(const std::string& cmd,
+    const std::function<bool(const char* data, size_t size)>& onData, int timeoutMs = 0);
+
+// Start `cmd` as a request/response session (see ProcessSession). Like a
+// stream, only its start is rate limited.
+bool startCommandSession(ProcessSession& session, const std::string& cmd);
+
+// First device in "device" state.
+bool detectDevice(std::string& serial);
+
+// Every device in "device" state.
+std::vector<std::string> listDevices();
+
+// Android property of the default device.
+std::string getProp(const std::string& prop);
+
+// Android property of a specific device.
+std::string getProp(const std::string& serial, const std::string& prop);
+
+// Every property of a device in one adb round trip.
+std::map<std::string, std::string> getAllProps(const std::string& serial);
+
+// Parse "[key]: [value]" lines as printed by a bare "getprop".
+std::map<std::string, std::string> parseGetprop(const std::string& output);
+
+// Devices currently in fastboot (bootloader or fastbootd).
+std::vector<std::string> listFastbootDevices();
+
+// Every bootloader variable in one "fastboot getvar all" round trip, e.g.
+// "current-slot" -> "a", "is-logical:system_a" -> "yes".
+std::map<std::string, std::string> getFastbootVars(const std::string& serial);
+
+// Parse "(bootloader) name:value" lines as printed by "getvar all".
+std::map<std::string, std::string> parseGetvarAll(const std::string& output);
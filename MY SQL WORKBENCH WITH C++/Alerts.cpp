@@ -0,0 +1,136 @@
+// Alerts.cpp
+// Incremental alert evaluation and batched delivery.
+
+#include "Alerts.h"
+#include "Json.h"
+#include "Net.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+// ===== Evaluation =====
+static bool inScope(const DriftPlan& plan, const DriftRule& rule, const vector<string>& values,
+    const vector<char>& present) {
+    if (rule.scope < 0) return true;
+    const DriftScope& scope = plan.scopes[rule.scope];
+    return present[scope.field] && values[scope.field] == scope.value;
+}
+
+vector<AlertEvent> AlertEngine::update(const string& serial, const FieldMap& fields) {
+    int64_t now = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    lock_guard<mutex> lock(m);
+    counters.updates++;
+    auto [it, fresh] = devices.try_emplace(serial);
+    DeviceState& dev = it->second;
+    if (fresh) {
+        dev.values.resize(plan.fields.size());
+        dev.present.resize(plan.fields.size(), 0);
+        dev.firing.resize(plan.rules.size(), 0);
+    }
+
+    FieldDiff diff = diffFields(plan, fields, fresh, dev.values, dev.present);
+    const map<uint32_t, string>& previous = diff.previous;
+    counters.fieldsChanged += previous.size();
+
+    vector<AlertEvent> events;
+    for (uint32_t r : diff.rules) {
+        const DriftRule& rule = plan.rules[r];
+        counters.rulesEvaluated++;
+        bool applies = inScope(plan, rule, dev.values, dev.present);
+        AlertEvent e{ rule.name, serial, "", plan.fields[rule.field], dev.values[rule.field], "", rule.text, now };
+        if (rule.op == DriftRule::Op::Changed) {
+            auto old = previous.find(rule.field);
+            if (fresh || !applies || old == previous.end()) continue;  // only a scope field moved
+            e.state = "changed";
+            e.previous = old->second;
+        }
+        else {
+            bool firing = applies && ruleHolds(plan, rule, dev.values, dev.present);
+            if (firing == (dev.firing[r] != 0)) continue;
+            dev.firing[r] = firing;
+            e.state = firing ? "firing" : "resolved";
+        }
+        events.push_back(move(e));
+    }
+    counters.events += events.size();
+    return events;
+}
+
+vector<AlertEvent> AlertEngine::active() const {
+    lock_guard<mutex> lock(m);
+    vector<AlertEvent> out;
+    for (auto& [serial, dev] : devices)
+        for (uint32_t r = 0; r < dev.firing.size(); r++)
+            if (dev.firing[r]) {
+                const DriftRule& rule = plan.rules[r];
+                out.push_back({ rule.name, serial, "firing", plan.fields[rule.field], dev.values[rule.field], "", rule.text, 0 });
+            }
+    return out;
+}
+
+AlertStats AlertEngine::stats() const {
+    lock_guard<mutex> lock(m);
+    return counters;
+}
+
+// ===== Delivery =====
+string alertJson(const AlertEvent& e) {
+    string out = "{\"alert\":\"" + jsonEscape(e.alert) + "\",\"serial\":\"" + jsonEscape(e.serial) +
+        "\",\"state\":\"" + e.state + "\",\"field\":\"" + jsonEscape(e.field) +
+        "\",\"value\":\"" + jsonEscape(e.value) + "\"";
+    if (e.state == "changed") out += ",\"previous\":\"" + jsonEscape(e.previous) + "\"";
+    return out + ",\"rule\":\"" + jsonEscape(e.rule) + "\",\"time_ms\":" + to_string(e.timeMs) + "}";
+}
+
+AlertNotifier::AlertNotifier(const string& target, size_t maxBatch)
+    : target(target), maxBatch(maxBatch ? maxBatch : 1), queue("alert notifier") {}
+
+void AlertNotifier::add(const AlertEvent& e) {
+    if (target.empty()) return;
+    lock_guard<mutex> lock(m);
+    pending.push_back(e);
+    if (pending.size() < maxBatch) return;
+    vector<AlertEvent> batch;
+    batch.swap(pending);
+    if (!queue.submit([this, batch] { deliver(batch); })) deliver(batch);
+}
+
+void AlertNotifier::flush() {
+    lock_guard<mutex> lock(m);
+    if (pending.empty()) return;
+    vector<AlertEvent> batch;
+    batch.swap(pending);
+    if (!queue.submit([this, batch] { deliver(batch); })) deliver(batch);
+}
+
+void AlertNotifier::drain() {
+    flush();
+    queue.drain(ShutdownClock::time_point::max());
+}
+
+void AlertNotifier::deliver(const vector<AlertEvent>& batch) {
+    string error;
+    bool ok;
+    if (target.compare(0, 7, "http://") == 0) {
+        string body = "[";
+        for (size_t i = 0; i < batch.size(); i++) body += (i ? "," : "") + alertJson(batch[i]);
+        body += "]";
+        ok = httpPost(target, "application/json", body, error);
+    }
+    else {
+        ofstream out(target, ios::app);
+        for (const AlertEvent& e : batch) out << alertJson(e) << "\n";
+        ok = (bool)out;
+        if (!ok) error = "cannot write " + target;
+    }
+    // Runs on the queue worker, or on the caller once the queue is closed
+    if (ok) sent += batch.size();
+    else {
+        lost += batch.size();
+        cerr << "[FAIL] alerts: " << error << " (" << batch.size() << " event(s) dropped)\n";
+    }
+}
@@ -0,0 +1,95 @@
+// Alerts.h
+// Alert rules over per-device field updates. Rules use the drift rule
+// syntax (Drift.h) and usually carry a label:
+//   hot_battery: battery_temp_c > 45
+//   sdk_moved:   ro.build.version.sdk changed
+// A condition rule fires when it starts to hold for a device and resolves
+// when it stops; a "changed" rule fires on every change of its field. As
+// with drift, an update is diffed over the plan's fields only and just the
+// rules behind changed fields run, so cost follows changes, not fleet size
+// times rules. Events are batched to a local webhook or a JSON-lines file.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Drift.h"
+#include "WriteQueue.h"
+
+struct AlertEvent {
+    std::string alert;           // rule label
+    std::string serial;
+    std::string state;           // "firing", "resolved" or "changed"
+    std::string field;
+    std::string value;           // "" when the field is absent
+    std::string previous;        // "changed" events only
+    std::string rule;            // rule text
+    int64_t timeMs = 0;          // host wall clock
+};
+
+struct AlertStats {
+    uint64_t updates = 0;
+    uint64_t fieldsChanged = 0;
+    uint64_t rulesEvaluated = 0;
+    uint64_t events = 0;
+};
+
+class AlertEngine {
+public:
+    explicit AlertEngine(const DriftPlan& plan) : plan(plan) {}
+
+    // Apply a device's latest fields. The first update of a device can fire
+    // condition rules but never "changed" ones.
+    std::vector<AlertEvent> update(const std::string& serial, const FieldMap& fields);
+
+    // Condition alerts currently firing, by device.
+    std::vector<AlertEvent> active() const;
+    AlertStats stats() const;
+
+private:
+    struct DeviceState {
+        std::vector<std::string> values;   // by plan field
+        std::vector<char> present;
+        std::vector<char> firing;          // by rule
+    };
+
+    const DriftPlan& plan;
+    mutable std::mutex m;
+    std::map<std::string, DeviceState> devices;
+    AlertStats counters;
+};
+
+std::string alertJson(const AlertEvent& e);
+
+// Collects events and hands full batches to a background queue. The target
+// is an http:// URL (POSTed as a JSON array) or a file (one JSON object per
+// line, appended).
+class AlertNotifier {
+public:
+    explicit AlertNotifier(const std::string& target, size_t maxBatch = 100);
+
+    void add(const AlertEvent& e);
+    // Queue whatever is pending, even a partial batch.
+    void flush();
+    // flush() and wait until delivery finished.
+    void drain();
+
+    uint64_t delivered() const { return sent; }
+    uint64_t failed() const { return lost; }
+
+private:
+    void deliver(const std::vector<AlertEvent>& batch);
+
+    std::string target;
+    size_t maxBatch;
+    std::mutex m;
+    std::vector<AlertEvent> pending;
+    std::atomic<uint64_t> sent{ 0 };  // deliver() may run on the queue worker and a caller at once
+    std::atomic<uint64_t> lost{ 0 };
+    WriteQueue queue;
+};
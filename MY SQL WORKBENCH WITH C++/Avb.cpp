@@ -0,0 +1,515 @@
+// Avb.cpp
+// vbmeta parsing (libavb's big-endian structures), digest backends and the
+// parallel hash / hashtree checks.
+//
+// RSA signatures are not checked here: that is the bootloader's job. What
+// is checked is everything a bad image would break: the vbmeta header hash,
+// the keys chained partitions are signed with, and every image digest.
+
+#include "Avb.h"
+#include "MappedFile.h"
+#include "Sha256.h"
+#include "SharedLibrary.h"
+#include "Shutdown.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Data blocks per hashtree task: 16 MiB of 4 KiB blocks.
+static const uint64_t kBlocksPerTask = 4096;
+
+// ===== Digest backends =====
+namespace {
+struct LibCrypto {
+    using CtxNew = void* (*)();
+    using CtxFree = void (*)(void*);
+    using Md = const void* (*)();
+    using Init = int (*)(void*, const void*, void*);
+    using Update = int (*)(void*, const void*, size_t);
+    using Final = int (*)(void*, unsigned char*, unsigned int*);
+
+    SharedLibrary lib{
+#ifdef _WIN32
+        "libcrypto-3-x64.dll", "libcrypto-3.dll", "libcrypto-1_1-x64.dll", "libcrypto-1_1.dll"
+#else
+        "libcrypto.so.3", "libcrypto.so.1.1", "libcrypto.so", "libcrypto.3.dylib"
+#endif
+    };
+    CtxNew ctxNew = lib.function<CtxNew>("EVP_MD_CTX_new");
+    CtxFree ctxFree = lib.function<CtxFree>("EVP_MD_CTX_free");
+    Md sha1 = lib.function<Md>("EVP_sha1");
+    Md sha256 = lib.function<Md>("EVP_sha256");
+    Md sha512 = lib.function<Md>("EVP_sha512");
+    Init init = lib.function<Init>("EVP_DigestInit_ex");
+    Update update = lib.function<Update>("EVP_DigestUpdate");
+    Final final = lib.function<Final>("EVP_DigestFinal_ex");
+
+    bool usable() const { return ctxNew && ctxFree && sha1 && sha256 && sha512 && init && update && final; }
+
+    static const LibCrypto& get() {
+        static LibCrypto crypto;
+        return crypto;
+    }
+};
+
+// One hash computation at a time; reusable through init().
+class Digest {
+public:
+    explicit Digest(const string& algorithm) {
+        const LibCrypto& c = LibCrypto::get();
+        if (c.usable()) {
+            md = algorithm == "sha256" ? c.sha256() : algorithm == "sha512" ? c.sha512()
+                : algorithm == "sha1" ? c.sha1() : nullptr;
+            if (md) ctx = c.ctxNew();
+        } else if (algorithm == "sha256") {
+            builtin = true;
+        }
+        init();
+    }
+    ~Digest() {
+        if (ctx) LibCrypto::get().ctxFree(ctx);
+    }
+    Digest(const Digest&) = delete;
+    Digest& operator=(const Digest&) = delete;
+
+    bool valid() const { return builtin || ctx; }
+
+    void init() {
+        if (ctx) LibCrypto::get().init(ctx, md, nullptr);
+        else fallback.reset();
+    }
+    void update(const void* data, size_t size) {
+        if (ctx) LibCrypto::get().update(ctx, data, size);
+        else fallback.update(data, size);
+    }
+    string finish() {
+        if (ctx) {
+            unsigned char out[64];
+            unsigned int len = 0;
+            LibCrypto::get().final(ctx, out, &len);
+            return string((const char*)out, len);
+        }
+        Sha256::Digest d = fallback.finish();
+        return string((const char*)d.data(), d.size());
+    }
+
+private:
+    void* ctx = nullptr;
+    const void* md = nullptr;
+    bool builtin = false;
+    Sha256 fallback;
+};
+}
+
+const char* avbHashBackend() {
+    return LibCrypto::get().usable() ? "libcrypto" : "builtin";
+}
+
+static string toHex(const string& raw) {
+    static const char* digits = "0123456789abcdef";
+    string hex;
+    for (unsigned char c : raw) {
+        hex += digits[c >> 4];
+        hex += digits[c & 15];
+    }
+    return hex;
+}
+
+// ===== vbmeta structures =====
+static uint32_t be32(const uint8_t* p) { return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]; }
+static uint64_t be64(const uint8_t* p) { return (uint64_t)be32(p) << 32 | be32(p + 4); }
+
+static string fixedString(const uint8_t* p, size_t len) {
+    return string((const char*)p, strnlen((const char*)p, len));
+}
+
+namespace {
+struct Descriptor {
+    uint64_t tag;
+    const uint8_t* body;           // after the 16-byte tag/length header
+    uint64_t size;
+};
+
+struct Vbmeta {
+    string publicKey;
+    vector<Descriptor> descriptors;
+};
+
+enum DescriptorTag : uint64_t { kProperty = 0, kHashtree = 1, kHash = 2, kCmdline = 3, kChain = 4 };
+}
+
+// Header (256) | authentication block | auxiliary block; checks the header hash.
+static bool parseVbmeta(const uint8_t* p, uint64_t size, Vbmeta& out, string& error) {
+    if (size < 256 || memcmp(p, "AVB0", 4) != 0) {
+        error = "no vbmeta image (missing AVB0 magic)";
+        return false;
+    }
+    uint64_t authSize = be64(p + 12), auxSize = be64(p + 20);
+    uint32_t algorithm = be32(p + 28);
+    uint64_t hashOffset = be64(p + 32), hashSize = be64(p + 40);
+    uint64_t keyOffset = be64(p + 64), keySize = be64(p + 72);
+    uint64_t descOffset = be64(p + 96), descSize = be64(p + 104);
+    if (authSize > size - 256 || auxSize > size - 256 - authSize || hashOffset > authSize ||
+        hashSize > authSize - hashOffset || keyOffset > auxSize || keySize > auxSize - keyOffset ||
+        descOffset > auxSize || descSize > auxSize - descOffset) {
+        error = "vbmeta blocks out of range";
+        return false;
+    }
+    const uint8_t* auth = p + 256;
+    const uint8_t* aux = auth + authSize;
+
+    // SHA256_RSA* = 1..3, SHA512_RSA* = 4..6; NONE carries no hash
+    if (algorithm != 0) {
+        Digest d(algorithm <= 3 ? "sha256" : "sha512");
+        if (!d.valid()) {
+            error = "SHA-512 vbmeta needs libcrypto";
+            return false;
+        }
+        d.update(p, 256);
+        d.update(aux, (size_t)auxSize);
+        string expected((const char*)auth + hashOffset, (size_t)hashSize);
+        if (d.finish() != expected) {
+            error = "vbmeta header hash mismatch";
+            return false;
+        }
+    }
+    out.publicKey.assign((const char*)aux + keyOffset, (size_t)keySize);
+
+    const uint8_t* d = aux + descOffset;
+    const uint8_t* end = d + descSize;
+    while (end - d >= 16) {
+        uint64_t tag = be64(d), len = be64(d + 8);
+        if (len > (uint64_t)(end - d - 16)) {
+            error = "descriptor out of range";
+            return false;
+        }
+        out.descriptors.push_back({ tag, d + 16, len });
+        d += 16 + len;
+    }
+    return true;
+}
+
+// vbmeta of a whole file: standalone (vbmeta_system.img) or behind an AvbFooter.
+static bool vbmetaOfFile(const MappedFile& file, Vbmeta& out, string& error) {
+    const uint8_t* p = file.data();
+    uint64_t size = file.size();
+    if (size >= 4 && memcmp(p, "AVB0", 4) == 0) return parseVbmeta(p, size, out, error);
+    // Footer: "AVBf" | major | minor | original size | vbmeta offset | vbmeta size
+    if (size < 64 || memcmp(p + size - 64, "AVBf", 4) != 0) {
+        error = "no vbmeta and no AVB footer";
+        return false;
+    }
+    const uint8_t* f = p + size - 64;
+    uint64_t offset = be64(f + 20), length = be64(f + 28);
+    if (offset > size || length > size - offset) {
+        error = "AVB footer out of range";
+        return false;
+    }
+    return parseVbmeta(p + offset, length, out, error);
+}
+
+// ===== Cache =====
+namespace {
+struct CacheKey {
+    string image;
+    uint64_t size;
+    int64_t mtime;
+    string expected;               // hex digest from the descriptor
+
+    bool operator<(const CacheKey& o) const {
+        return tie(image, size, mtime, expected) < tie(o.image, o.size, o.mtime, o.expected);
+    }
+};
+}
+
+static set<CacheKey> loadCache(const fs::path& path) {
+    set<CacheKey> cache;
+    ifstream in(path);
+    string line;
+    while (getline(in, line)) {
+        istringstream fields(line);
+        string image, size, mtime, expected;
+        if (getline(fields, image, '\t') && getline(fields, size, '\t') && getline(fields, mtime, '\t') &&
+            getline(fields, expected))
+            cache.insert({ image, strtoull(size.c_str(), nullptr, 10), strtoll(mtime.c_str(), nullptr, 10), expected });
+    }
+    return cache;
+}
+
+static void saveCache(const fs::path& path, const set<CacheKey>& cache) {
+    {
+        ofstream out(path.string() + ".tmp", ios::trunc);
+        for (const CacheKey& k : cache)
+            out << k.image << "\t" << k.size << "\t" << k.mtime << "\t" << k.expected << "\n";
+    }
+    error_code ec;
+    fs::rename(path.string() + ".tmp", path, ec);
+}
+
+// ===== Jobs =====
+namespace {
+struct ImageJob {
+    AvbCheck check;
+    unique_ptr<MappedFile> file;
+    CacheKey key;
+    string algorithm;
+    string salt;
+    string expected;               // raw digest
+    uint64_t imageSize = 0;
+    // hashtree
+    uint32_t dataBlock = 0;
+    uint32_t hashBlock = 0;
+    size_t paddedDigest = 0;
+    vector<uint8_t> level0;
+    vector<future<bool>> parts;
+    // hash
+    future<string> digest;
+};
+}
+
+static bool hashRange(const string& algorithm, const string& salt, const uint8_t* data, uint64_t size, string& out) {
+    Digest d(algorithm);
+    if (!d.valid()) return false;
+    d.update(salt.data(), salt.size());
+    for (uint64_t off = 0; off < size; off += 1 << 20) {
+        if (shutdownRequested()) return false;
+        d.update(data + off, (size_t)min<uint64_t>(1 << 20, size - off));
+    }
+    out = d.finish();
+    return true;
+}
+
+// Level-0 digests of data blocks [first, last) into job.level0.
+static bool hashBlocks(ImageJob& job, uint64_t first, uint64_t last) {
+    Digest d(job.algorithm);
+    if (!d.valid()) return false;
+    vector<uint8_t> tail;
+    for (uint64_t b = first; b < last; b++) {
+        if ((b & 255) == 0 && shutdownRequested()) return false;
+        uint64_t off = b * job.dataBlock;
+        uint64_t n = min<uint64_t>(job.dataBlock, job.imageSize - off);
+        d.init();
+        d.update(job.salt.data(), job.salt.size());
+        if (n == job.dataBlock) {
+            d.update(job.file->data() + off, (size_t)n);
+        } else {  // last partial block is zero padded
+            tail.assign(job.dataBlock, 0);
+            memcpy(tail.data(), job.file->data() + off, (size_t)n);
+            d.update(tail.data(), tail.size());
+        }
+        string digest = d.finish();
+        memcpy(job.level0.data() + b * job.paddedDigest, digest.data(), digest.size());
+    }
+    return true;
+}
+
+// Upper levels and root, as avbtool's generate_hash_tree builds them.
+static string hashtreeRoot(ImageJob& job) {
+    Digest d(job.algorithm);
+    vector<uint8_t> level = move(job.level0);
+    while (level.size() > job.hashBlock) {
+        size_t blocks = level.size() / job.hashBlock;
+        vector<uint8_t> next(blocks * job.paddedDigest);
+        next.resize((next.size() + job.hashBlock - 1) / job.hashBlock * job.hashBlock, 0);
+        for (size_t b = 0; b < blocks; b++) {
+            d.init();
+            d.update(job.salt.data(), job.salt.size());
+            d.update(level.data() + b * job.hashBlock, job.hashBlock);
+            string digest = d.finish();
+            memcpy(next.data() + b * job.paddedDigest, digest.data(), digest.size());
+        }
+        level = move(next);
+    }
+    d.init();
+    d.update(job.salt.data(), job.salt.size());
+    d.update(level.data(), level.size());
+    return d.finish();
+}
+
+static size_t digestSize(const string& algorithm) {
+    return algorithm == "sha1" ? 20 : algorithm == "sha256" ? 32 : algorithm == "sha512" ? 64 : 0;
+}
+
+// ===== Verification =====
+bool verifyAvb(const string& imageDir, const AvbVerifyOptions& opts, vector<AvbCheck>& checks, string& error) {
+    checks.clear();
+    fs::path dir(imageDir);
+    MappedFile top;
+    if (!top.openRead((dir / "vbmeta.img").string(), error)) return false;
+
+    AvbCheck root;
+    root.partition = "vbmeta";
+    root.kind = "vbmeta";
+    root.image = (dir / "vbmeta.img").string();
+    Vbmeta vbmeta;
+    root.ok = parseVbmeta(top.data(), top.size(), vbmeta, root.error);
+    checks.push_back(root);
+    if (!root.ok) return true;
+
+    fs::path cachePath = dir / kAvbCacheName;
+    set<CacheKey> cache = opts.useCache ? loadCache(cachePath) : set<CacheKey>();
+    vector<unique_ptr<ImageJob>> jobs;
+    vector<unique_ptr<MappedFile>> chained;
+
+    // Walk descriptors breadth first, following chain_partition into the
+    // vbmeta of the chained image.
+    vector<Vbmeta> pending = { move(vbmeta) };
+    set<string> visited = { "vbmeta" };
+    while (!pending.empty()) {
+        Vbmeta current = move(pending.back());
+        pending.pop_back();
+        for (const Descriptor& desc : current.descriptors) {
+            const uint8_t* b = desc.body;
+            if (desc.tag == kChain && desc.size >= 76) {
+                uint32_t nameLen = be32(b + 4), keyLen = be32(b + 8);
+                if (76 + (uint64_t)nameLen + keyLen > desc.size) continue;
+                AvbCheck chain;
+                chain.kind = "chain";
+                chain.partition = string((const char*)b + 76, nameLen);
+                string key((const char*)b + 76 + nameLen, keyLen);
+                chain.image = (dir / (chain.partition + ".img")).string();
+                if (!visited.insert(chain.partition).second) continue;
+                chained.push_back(make_unique<MappedFile>());
+                Vbmeta sub;
+                if (!chained.back()->openRead(chain.image, chain.error)) chain.error = "missing " + chain.image;
+                else if (vbmetaOfFile(*chained.back(), sub, chain.error)) {
+                    if (sub.publicKey != key) chain.error = "signed with a different key than vbmeta expects";
+                    else {
+                        chain.ok = true;
+                        pending.push_back(move(sub));
+                    }
+                }
+                checks.push_back(chain);
+                continue;
+            }
+            if (desc.tag != kHash && desc.tag != kHashtree) continue;
+
+            auto job = make_unique<ImageJob>();
+            uint32_t nameLen, saltLen, digestLen;
+            size_t fixed;
+            if (desc.tag == kHash) {
+                // image_size | hash_algorithm[32] | name_len | salt_len | digest_len | flags | reserved[60]
+                if (desc.size < 116) continue;
+                job->check.kind = "hash";
+                job->imageSize = be64(b);
+                job->algorithm = fixedString(b + 8, 32);
+                nameLen = be32(b + 40);
+                saltLen = be32(b + 44);
+                digestLen = be32(b + 48);
+                fixed = 116;
+            } else {
+                // dm_verity_version | image_size | tree_offset | tree_size | data_block_size |
+                // hash_block_size | fec_num_roots | fec_offset | fec_size | hash_algorithm[32] |
+                // name_len | salt_len | root_digest_len | flags | reserved[60]
+                if (desc.size < 164) continue;
+                job->check.kind = "hashtree";
+                job->imageSize = be64(b + 4);
+                job->dataBlock = be32(b + 28);
+                job->hashBlock = be32(b + 32);
+                job->algorithm = fixedString(b + 56, 32);
+                nameLen = be32(b + 88);
+                saltLen = be32(b + 92);
+                digestLen = be32(b + 96);
+                fixed = 164;
+            }
+            if (fixed + (uint64_t)nameLen + saltLen + digestLen > desc.size) continue;
+            job->check.partition = string((const char*)b + fixed, nameLen);
+            job->salt.assign((const char*)b + fixed + nameLen, saltLen);
+            job->expected.assign((const char*)b + fixed + nameLen + saltLen, digestLen);
+            job->check.image = (dir / (job->check.partition + ".img")).string();
+            jobs.push_back(move(job));
+        }
+    }
+
+    // Open images, consult the cache and queue the hashing
+    ThreadPool pool(opts.threads > 0 ? (size_t)opts.threads : 0);
+    auto start = chrono::steady_clock::now();
+    for (auto& jobPtr : jobs) {
+        ImageJob& job = *jobPtr;
+        error_code ec;
+        job.key = { fs::path(job.check.image).filename().string(), fs::file_size(job.check.image, ec), 0,
+            job.check.kind + ":" + toHex(job.salt) + ":" + toHex(job.expected) };
+        if (ec) {
+            job.check.error = "missing " + job.check.image;
+            continue;
+        }
+        job.key.mtime = (int64_t)fs::last_write_time(job.check.image, ec).time_since_epoch().count();
+        if (cache.count(job.key)) {
+            job.check.ok = job.check.cached = true;
+            continue;
+        }
+        if (digestSize(job.algorithm) == 0 || !Digest(job.algorithm).valid()) {
+            job.check.error = "unsupported hash algorithm " + job.algorithm;
+            continue;
+        }
+        job.file = make_unique<MappedFile>();
+        if (!job.file->openRead(job.check.image, job.check.error)) continue;
+        if (job.imageSize > job.file->size()) {
+            job.check.error = "image smaller than its descriptor";
+            continue;
+        }
+        job.check.bytesHashed = job.imageSize;
+
+        if (job.check.kind == "hash") {
+            job.digest = pool.submit([&job] {
+                string out;
+                return hashRange(job.algorithm, job.salt, job.file->data(), job.imageSize, out) ? out : string();
+            });
+            continue;
+        }
+        if (job.dataBlock == 0 || job.hashBlock == 0) {
+            job.check.error = "bad hashtree block size";
+            continue;
+        }
+        job.paddedDigest = 1;
+        while (job.paddedDigest < digestSize(job.algorithm)) job.paddedDigest <<= 1;
+        uint64_t blocks = (job.imageSize + job.dataBlock - 1) / job.dataBlock;
+        size_t bytes = (size_t)(blocks * job.paddedDigest);
+        job.level0.assign((bytes + job.hashBlock - 1) / job.hashBlock * job.hashBlock, 0);
+        for (uint64_t first = 0; first < blocks; first += kBlocksPerTask) {
+            uint64_t last = min(blocks, first + kBlocksPerTask);
+            job.parts.push_back(pool.submit([&job, first, last] { return hashBlocks(job, first, last); }));
+        }
+    }
+
+    // Collect in order; each image finishes as soon as its own tasks do
+    bool cacheChanged = false;
+    for (auto& jobPtr : jobs) {
+        ImageJob& job = *jobPtr;
+        if (job.check.cached || !job.check.error.empty() || !job.file) {
+            checks.push_back(job.check);
+            continue;
+        }
+        string actual;
+        if (job.check.kind == "hash") {
+            actual = job.digest.get();
+        } else {
+            bool ok = true;
+            for (auto& part : job.parts) ok = part.get() && ok;
+            if (ok) actual = hashtreeRoot(job);
+        }
+        job.check.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (actual.empty()) job.check.error = shutdownRequested() ? "cancelled" : "hashing failed";
+        else if (actual != job.expected) job.check.error = job.check.kind == "hash" ? "digest mismatch" : "root digest mismatch";
+        else {
+            job.check.ok = true;
+            cache.insert(job.key);
+            cacheChanged = true;
+        }
+        job.file.reset();
+        checks.push_back(job.check);
+    }
+    if (opts.useCache && cacheChanged) saveCache(cachePath, cache);
+    return true;
+}
@@ -0,0 +1,41 @@
+// Avb.h
+// Android Verified Boot checks for a directory of firmware images: vbmeta
+// header hash, chain_partition keys, hash and hashtree descriptors. Images
+// are hashed in parallel (hashtree data blocks split across the pool) with
+// libcrypto when it can be loaded and the built-in SHA-256 otherwise.
+// Results are cached per image file and expected digest, so unchanged
+// images are not hashed again.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct AvbCheck {
+    std::string partition;
+    std::string kind;              // "vbmeta", "chain", "hash" or "hashtree"
+    std::string image;             // file that was checked
+    bool ok = false;
+    bool cached = false;           // verified earlier, not re-hashed
+    uint64_t bytesHashed = 0;
+    double seconds = 0.0;          // from the start of hashing until this image was done
+    std::string error;
+};
+
+struct AvbVerifyOptions {
+    int threads = 0;               // 0 = one per core
+    bool useCache = true;
+};
+
+// Cache file kept in the image directory.
+constexpr const char* kAvbCacheName = ".adfxt-avb-cache";
+
+// Verify <imageDir>/vbmeta.img and everything it describes, where
+// partition "x" is read from <imageDir>/x.img. False only if vbmeta.img
+// itself cannot be read; per-partition failures are reported in `checks`.
+bool verifyAvb(const std::string& imageDir, const AvbVerifyOptions& opts, std::vector<AvbCheck>& checks,
+    std::string& error);
+
+// "libcrypto" when OpenSSL's libcrypto was loaded, else "builtin".
+const char* avbHashBackend();
@@ -0,0 +1,215 @@
+// Bench.cpp
+// Launch loops, statistics and the benchmark table.
+
+#include "Bench.h"
+#include "Adb.h"
+#include "Shutdown.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <tuple>
+
+using namespace std;
+
+// ===== Launching =====
+bool parseAmStartOutput(const string& output, LaunchSample& sample) {
+    istringstream in(output);
+    string line, status;
+    bool haveTotal = false;
+    while (getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t colon = line.find(": ");
+        if (colon == string::npos) {
+            if (line.compare(0, 6, "Error:") == 0 && sample.error.empty()) sample.error = line.substr(6);
+            continue;
+        }
+        string key = line.substr(0, colon), value = line.substr(colon + 2);
+        if (key == "Status") status = value;
+        else if (key == "TotalTime") {
+            sample.totalMs = atoll(value.c_str());
+            haveTotal = true;
+        }
+        else if (key == "WaitTime") sample.waitMs = atoll(value.c_str());
+        else if (key == "LaunchState") sample.launchState = value;
+        else if (key == "Error" && sample.error.empty()) sample.error = value;
+    }
+    if (status == "ok" && haveTotal) return true;
+    if (sample.error.empty()) sample.error = status.empty() ? "no launch status" : "status " + status;
+    while (!sample.error.empty() && sample.error[0] == ' ') sample.error.erase(0, 1);
+    return false;
+}
+
+static void settle(int ms) {
+    for (int waited = 0; waited < ms && !shutdownRequested(); waited += 50)
+        this_thread::sleep_for(chrono::milliseconds(min(50, ms - waited)));
+}
+
+void runLaunchBenchmark(const string& serial, const string& model, const LaunchBenchOptions& opts,
+    const function<void(const LaunchSample&)>& onSample) {
+    string adb = "adb -s " + serial + " shell ";
+    for (const string& mode : opts.modes) {
+        // Warm and hot launches need the process alive: the warmup (or the
+        // first cold launch) leaves it running
+        for (int i = -opts.warmup; i < opts.launches && !shutdownRequested(); i++) {
+            if (mode != "cold") {
+                // BACK finishes the activity and keeps the process; HOME
+                // only stops it, so the next start just resumes it
+                runCommand(adb + "input keyevent " + (mode == "warm" ? "KEYCODE_BACK" : "KEYCODE_HOME"));
+                settle(opts.settleMs / 2);
+            }
+            string output = runCommand(adb + "am start -W" + (mode == "cold" ? " -S" : "") + " -n " +
+                hostQuote(opts.component));
+            LaunchSample sample;
+            sample.serial = serial;
+            sample.model = model;
+            sample.mode = mode;
+            sample.iteration = i;
+            if (!parseAmStartOutput(output, sample) && output.empty()) sample.error = "no output from am start";
+            // Releases that report the launch kind can tell us it was not
+            // the one timed (a launcher's root activity survives BACK on 12+)
+            string wanted = mode;
+            transform(wanted.begin(), wanted.end(), wanted.begin(), [](unsigned char c) { return (char)toupper(c); });
+            if (sample.error.empty() && !sample.launchState.empty() && sample.launchState != wanted)
+                sample.error = "launched " + sample.launchState + ", not " + wanted;
+            if (i >= 0) onSample(sample);
+            settle(opts.settleMs);
+        }
+    }
+}
+
+// ===== Statistics =====
+double percentileOf(const vector<double>& sorted, double pct) {
+    if (sorted.empty()) return 0;
+    double rank = pct / 100.0 * (sorted.size() - 1);
+    size_t lo = (size_t)rank;
+    if (lo + 1 >= sorted.size()) return sorted.back();
+    return sorted[lo] + (rank - lo) * (sorted[lo + 1] - sorted[lo]);
+}
+
+void medianInterval(const vector<double>& sorted, double& low, double& high) {
+    // The count of samples below the median is Binomial(n, 1/2); its normal
+    // approximation gives the ranks n/2 -+ 1.96 sqrt(n)/2 (1-based)
+    double n = (double)sorted.size();
+    if (sorted.empty()) {
+        low = high = 0;
+        return;
+    }
+    double half = 1.96 * sqrt(n) / 2;
+    long lo = lround(n / 2 - half), hi = lround(n / 2 + 1 + half);
+    lo = max(1L, lo);
+    hi = min((long)sorted.size(), hi);
+    low = sorted[lo - 1];
+    high = sorted[hi - 1];
+}
+
+vector<LaunchSummary> summarizeLaunches(const string& component, const vector<LaunchSample>& samples) {
+    map<tuple<string, string, string>, vector<double>> groups;
+    for (const LaunchSample& s : samples) {
+        if (!s.error.empty()) continue;
+        groups[{ s.model, s.mode, "total" }].push_back((double)s.totalMs);
+        if (s.waitMs) groups[{ s.model, s.mode, "wait" }].push_back((double)s.waitMs);
+    }
+
+    vector<LaunchSummary> out;
+    for (auto& [key, values] : groups) {
+        sort(values.begin(), values.end());
+        LaunchSummary s;
+        s.component = component;
+        tie(s.model, s.mode, s.metric) = key;
+        s.n = values.size();
+        for (double v : values) s.mean += v;
+        s.mean /= s.n;
+        for (double v : values) s.stddev += (v - s.mean) * (v - s.mean);
+        s.stddev = s.n > 1 ? sqrt(s.stddev / (s.n - 1)) : 0;
+        s.p50 = percentileOf(values, 50);
+        s.p90 = percentileOf(values, 90);
+        s.p99 = percentileOf(values, 99);
+        medianInterval(values, s.ciLow, s.ciHigh);
+        out.push_back(s);
+    }
+    return out;
+}
+
+// ===== Benchmark table =====
+static const char* kTableHeader = "run\tcomponent\tmodel\tmode\tmetric\tn\tmean\tstddev\tp50\tp90\tp99\tci_low\tci_high";
+static const char* kSamplesHeader = "run\tserial\tmodel\tmode\titeration\ttotal_ms\twait_ms\tlaunch_state\terror";
+
+static bool appendRows(const string& path, const char* header, const vector<string>& rows, string& error) {
+    bool fresh = !ifstream(path).good();
+    ofstream out(path, ios::app);
+    if (fresh) out << header << "\n";
+    for (const string& row : rows) out << row << "\n";
+    out.close();
+    if (!out) {
+        error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
+
+static string fixed1(double v) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.1f", v);
+    return buf;
+}
+
+bool appendBenchTable(const string& path, const string& run, const vector<LaunchSummary>& rows, string& error) {
+    vector<string> lines;
+    for (const LaunchSummary& s : rows)
+        lines.push_back(run + "\t" + s.component + "\t" + s.model + "\t" + s.mode + "\t" + s.metric + "\t" +
+            to_string(s.n) + "\t" + fixed1(s.mean) + "\t" + fixed1(s.stddev) + "\t" + fixed1(s.p50) + "\t" +
+            fixed1(s.p90) + "\t" + fixed1(s.p99) + "\t" + fixed1(s.ciLow) + "\t" + fixed1(s.ciHigh));
+    return appendRows(path, kTableHeader, lines, error);
+}
+
+bool appendLaunchSamples(const string& path, const string& run, const vector<LaunchSample>& samples, string& error) {
+    vector<string> lines;
+    for (const LaunchSample& s : samples)
+        lines.push_back(run + "\t" + s.serial + "\t" + s.model + "\t" + s.mode + "\t" + to_string(s.iteration) + "\t" +
+            to_string(s.totalMs) + "\t" + to_string(s.waitMs) + "\t" + s.launchState + "\t" + s.error);
+    return appendRows(path, kSamplesHeader, lines, error);
+}
+
+string benchKey(const LaunchSummary& s) {
+    return s.model + "/" + s.mode + "/" + s.metric;
+}
+
+map<string, LaunchSummary> loadBenchBaseline(const string& path, const string& component) {
+    map<string, LaunchSummary> latest;
+    ifstream in(path);
+    string line;
+    getline(in, line);  // header
+    while (getline(in, line)) {
+        vector<string> f;
+        istringstream fields(line);
+        string field;
+        while (getline(fields, field, '\t')) f.push_back(field);
+        if (f.size() < 13 || f[1] != component) continue;
+        LaunchSummary s;
+        s.component = f[1];
+        s.model = f[2];
+        s.mode = f[3];
+        s.metric = f[4];
+        s.n = (size_t)atoll(f[5].c_str());
+        s.mean = atof(f[6].c_str());
+        s.stddev = atof(f[7].c_str());
+        s.p50 = atof(f[8].c_str());
+        s.p90 = atof(f[9].c_str());
+        s.p99 = atof(f[10].c_str());
+        s.ciLow = atof(f[11].c_str());
+        s.ciHigh = atof(f[12].c_str());
+        latest[benchKey(s)] = s;  // rows are in run order
+    }
+    return latest;
+}
+
+string compareToBaseline(const LaunchSummary& now, const LaunchSummary& base) {
+    if (now.ciLow > base.ciHigh) return "regression";
+    if (now.ciHigh < base.ciLow) return "improvement";
+    return "unchanged";
+}
@@ -0,0 +1,83 @@
+// Bench.h
+// App launch benchmarks. Each device launches an activity with
+// "am start -W", cold (process stopped first, "-S"), warm (activity
+// finished with BACK, process kept) and hot (sent to the home screen, then
+// brought back), and reports TotalTime and WaitTime. A launch the device
+// reports as another kind is recorded as failed.
+// Samples are pooled per device model. A summary holds percentiles and a
+// distribution-free 95% confidence interval of the median (launch times are
+// skewed, so no normality is assumed). Summaries are appended to a TSV
+// benchmark table, and each run is compared against the previous one.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+struct LaunchSample {
+    std::string serial;
+    std::string model;
+    std::string mode;            // cold, warm, hot
+    int iteration = 0;
+    int64_t totalMs = 0;         // TotalTime: until the first frame is drawn
+    int64_t waitMs = 0;          // WaitTime: including the system's own work
+    std::string launchState;     // COLD, WARM, HOT as reported by newer releases
+    std::string error;           // set when the launch did not complete
+};
+
+struct LaunchBenchOptions {
+    std::string component;       // "com.example/.MainActivity"
+    int launches = 10;           // recorded launches per mode and device
+    int warmup = 1;              // discarded launches before each mode
+    std::vector<std::string> modes = { "cold", "warm" };
+    int settleMs = 1000;         // pause after each launch
+};
+
+// Fields of "am start -W" output. False unless "Status: ok" with a TotalTime.
+bool parseAmStartOutput(const std::string& output, LaunchSample& sample);
+
+// Run every mode on one device; each launch (failed ones included) goes to
+// `onSample`. Stops early on shutdown.
+void runLaunchBenchmark(const std::string& serial, const std::string& model, const LaunchBenchOptions& opts,
+    const std::function<void(const LaunchSample&)>& onSample);
+
+struct LaunchSummary {
+    std::string component;
+    std::string model;
+    std::string mode;
+    std::string metric;          // total, wait
+    size_t n = 0;
+    double mean = 0;
+    double stddev = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double ciLow = 0;            // 95% interval of the median
+    double ciHigh = 0;
+};
+
+// One summary per model, mode and metric over the successful samples.
+std::vector<LaunchSummary> summarizeLaunches(const std::string& component, const std::vector<LaunchSample>& samples);
+
+// Percentile (0..100) of sorted values, interpolated between ranks.
+double percentileOf(const std::vector<double>& sorted, double pct);
+
+// Order-statistic bounds of the median's 95% interval for sorted values.
+void medianInterval(const std::vector<double>& sorted, double& low, double& high);
+
+// Benchmark table: one row per summary, tab separated, with a header.
+bool appendBenchTable(const std::string& path, const std::string& run, const std::vector<LaunchSummary>& rows,
+    std::string& error);
+bool appendLaunchSamples(const std::string& path, const std::string& run, const std::vector<LaunchSample>& samples,
+    std::string& error);
+
+// Latest row of `component` per "model/mode/metric" from earlier runs.
+std::map<std::string, LaunchSummary> loadBenchBaseline(const std::string& path, const std::string& component);
+std::string benchKey(const LaunchSummary& s);
+
+// "regression" when the new median's interval lies wholly above the
+// baseline's, "improvement" when wholly below, else "unchanged".
+std::string compareToBaseline(const LaunchSummary& now, const LaunchSummary& base);
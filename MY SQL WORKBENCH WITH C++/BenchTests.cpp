@@ -0,0 +1,72 @@
+// BenchTests.cpp
+// Launch statistics (percentiles, the median's interval) and "am start -W"
+// parsing.
+
+#include "Bench.h"
+#include "SelfTest.h"
+
+using namespace std;
+
+static vector<double> oneTo(int n) {
+    vector<double> values;
+    for (int i = 1; i <= n; i++) values.push_back(i);
+    return values;
+}
+
+SELFTEST(bench_percentile_interpolates) {
+    vector<double> values = { 10, 20, 30, 40 };
+    CHECK_EQ(percentileOf(values, 0), 10.0);
+    CHECK_EQ(percentileOf(values, 50), 25.0);
+    CHECK_EQ(percentileOf(values, 90), 37.0);
+    CHECK_EQ(percentileOf(values, 100), 40.0);
+    CHECK_EQ(percentileOf({ 7 }, 99), 7.0);
+    CHECK_EQ(percentileOf({}, 50), 0.0);
+}
+
+SELFTEST(bench_median_interval_ranks) {
+    double low, high;
+    // The binomial tables give ranks 40 and 61 for n = 100
+    medianInterval(oneTo(100), low, high);
+    CHECK_EQ(low, 40.0);
+    CHECK_EQ(high, 61.0);
+    medianInterval(oneTo(10), low, high);
+    CHECK_EQ(low, 2.0);
+    CHECK_EQ(high, 9.0);
+}
+
+SELFTEST(bench_median_interval_small_samples) {
+    double low, high;
+    medianInterval({ 5 }, low, high);
+    CHECK_EQ(low, 5.0);
+    CHECK_EQ(high, 5.0);
+    medianInterval({ 1, 2 }, low, high);
+    CHECK_EQ(low, 1.0);
+    CHECK_EQ(high, 2.0);
+    medianInterval({}, low, high);
+    CHECK_EQ(low, 0.0);
+    CHECK_EQ(high, 0.0);
+}
+
+SELFTEST(bench_median_interval_contains_median) {
+    for (int n = 1; n <= 200; n++) {
+        vector<double> values = oneTo(n);
+        double low, high;
+        medianInterval(values, low, high);
+        double median = percentileOf(values, 50);
+        CHECK(low <= median && median <= high);
+    }
+}
+
+SELFTEST(bench_parse_am_start) {
+    LaunchSample sample;
+    CHECK(parseAmStartOutput("Starting: Intent { cmp=com.example/.Main }\nStatus: ok\nLaunchState: WARM\n"
+        "Activity: com.example/.Main\nTotalTime: 412\nWaitTime: 430\nComplete\n", sample));
+    CHECK_EQ(sample.totalMs, 412);
+    CHECK_EQ(sample.waitMs, 430);
+    CHECK_EQ(sample.launchState, "WARM");
+
+    LaunchSample failed;
+    CHECK(!parseAmStartOutput("Starting: Intent { cmp=com.example/.Nope }\nError type 3\n"
+        "Error: Activity class {com.example/.Nope} does not exist.\n", failed));
+    CHECK_EQ(failed.error, "Activity class {com.example/.Nope} does not exist.");
+}
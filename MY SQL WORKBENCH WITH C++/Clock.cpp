@@ -0,0 +1,236 @@
+// Clock.cpp
+// Timestamp exchanges, the offset/drift fit and background tracking.
+
+#include "Clock.h"
+#include "Adb.h"
+#include "CivilDate.h"
+#include "Shutdown.h"
+#include "Telemetry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+
+using namespace std;
+
+// A reply slower than this means the shell is stuck, not just slow
+static const int kReplyTimeoutMs = 5000;
+
+int64_t hostSteadyNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ===== Model =====
+int64_t ClockFit::toHost(int64_t deviceNs) const {
+    return deviceNs + offsetNs + (int64_t)(drift * (double)(deviceNs - refDeviceNs));
+}
+
+int64_t ClockModel::toHostNs(DeviceClock clock, int64_t deviceNs) const {
+    switch (clock) {
+    case DeviceClock::Boottime: return boottime.toHost(deviceNs);
+    case DeviceClock::Local: return realtime.toHost(deviceNs - (int64_t)utcOffsetSec * 1000000000);
+    default: return realtime.toHost(deviceNs);
+    }
+}
+
+static ClockFit fitLine(const vector<const ClockExchange*>& used, int64_t ClockExchange::*deviceNs) {
+    // y = host midpoint - device; fitted against the device time, centred
+    // for precision
+    ClockFit fit;
+    double n = (double)used.size();
+    double meanX = 0, meanY = 0;
+    int64_t x0 = used.front()->*deviceNs;
+    int64_t y0 = (used.front()->hostSendNs + used.front()->hostRecvNs) / 2 - x0;
+    for (const ClockExchange* e : used) {
+        meanX += (double)(e->*deviceNs - x0);
+        meanY += (double)((e->hostSendNs + e->hostRecvNs) / 2 - e->*deviceNs - y0);
+    }
+    meanX /= n;
+    meanY /= n;
+    double sxx = 0, sxy = 0, syy = 0;
+    for (const ClockExchange* e : used) {
+        double x = (double)(e->*deviceNs - x0) - meanX;
+        double y = (double)((e->hostSendNs + e->hostRecvNs) / 2 - e->*deviceNs - y0) - meanY;
+        sxx += x * x;
+        sxy += x * y;
+        syy += y * y;
+    }
+    fit.refDeviceNs = x0 + (int64_t)meanX;
+    fit.offsetNs = y0 + (int64_t)meanY;
+    if (used.size() < 3 || sxx <= 0) return fit;
+    // Over a short window the slope is mostly round-trip noise: keep it only
+    // when its standard error is below 20 ppm
+    double slope = sxy / sxx;
+    double residual = max(0.0, syy - slope * sxy) / (n - 2);
+    if (sqrt(residual / sxx) < 20e-6) fit.drift = slope;
+    return fit;
+}
+
+ClockModel fitClockModel(const string& serial, const vector<ClockExchange>& exchanges) {
+    ClockModel model;
+    model.serial = serial;
+    model.exchanges = exchanges.size();
+    if (exchanges.empty()) return model;
+
+    // Long round trips were delayed on one leg or the other; only the
+    // shortest ones (within twice the best, or the best quarter) are used
+    vector<int64_t> rtts;
+    for (const ClockExchange& e : exchanges) rtts.push_back(e.hostRecvNs - e.hostSendNs);
+    vector<int64_t> sorted = rtts;
+    sort(sorted.begin(), sorted.end());
+    model.minRttNs = sorted.front();
+    int64_t limit = max(2 * sorted.front(), sorted[sorted.size() / 4]);
+    vector<const ClockExchange*> used;
+    for (size_t i = 0; i < exchanges.size(); i++)
+        if (rtts[i] <= limit) used.push_back(&exchanges[i]);
+
+    model.used = used.size();
+    model.realtime = fitLine(used, &ClockExchange::deviceRealNs);
+    model.boottime = fitLine(used, &ClockExchange::deviceBootNs);
+    model.utcOffsetSec = exchanges.back().utcOffsetSec;
+    model.valid = true;
+    return model;
+}
+
+// ===== Session =====
+bool ClockSession::open(string& error) {
+    string adb = "adb -s " + serial + " shell -T ";
+    string probeError;
+    if (ensureProbe(serial, probeError) && startCommandSession(shell, adb + kProbeDevicePath + " --clock")) kind = "helper";
+    else {
+        // Forks date/cat per request: slower and /proc/uptime only has 10 ms
+        // steps, but needs nothing on the device
+        shell.finish();
+        if (!startCommandSession(shell, adb + hostQuote("while read l; do echo $l $(date +%s%N) $(cat /proc/uptime) $(date +%z); done"))) {
+            error = "cannot start adb shell for " + serial;
+            return false;
+        }
+        kind = "shell";
+    }
+    return true;
+}
+
+// "<id> <real_ns> <boot_ns> <utc_offset_sec>" from the helper, or
+// "<id> <real_ns> <uptime_sec> <idle_sec> <+hhmm>" from the shell loop.
+static bool parseClockReply(const string& line, uint64_t& id, ClockExchange& e) {
+    istringstream in(line);
+    vector<string> f;
+    string word;
+    while (in >> word) f.push_back(word);
+    if ((f.size() != 4 && f.size() != 5) || f[1].find_first_not_of("0123456789") != string::npos) return false;
+    id = strtoull(f[0].c_str(), nullptr, 10);
+    e.deviceRealNs = strtoll(f[1].c_str(), nullptr, 10);
+    if (f.size() == 4) {
+        e.deviceBootNs = strtoll(f[2].c_str(), nullptr, 10);
+        e.utcOffsetSec = atoi(f[3].c_str());
+        return true;
+    }
+    e.deviceBootNs = (int64_t)(atof(f[2].c_str()) * 1e9);
+    const string& zone = f[4];
+    if (zone.size() != 5 || (zone[0] != '+' && zone[0] != '-')) return false;
+    int minutes = atoi(zone.substr(1, 2).c_str()) * 60 + atoi(zone.substr(3, 2).c_str());
+    e.utcOffsetSec = (zone[0] == '-' ? -minutes : minutes) * 60;
+    return true;
+}
+
+bool ClockSession::burst(int count, int spacingMs, string& error) {
+    for (int i = 0; i < count && !shutdownRequested(); i++) {
+        if (i > 0) this_thread::sleep_for(chrono::milliseconds(spacingMs));
+        uint64_t id = nextId++;
+        ClockExchange e;
+        e.hostSendNs = hostSteadyNs();
+        if (!shell.writeLine(to_string(id))) {
+            error = "clock shell on " + serial + " closed";
+            return false;
+        }
+        string line;
+        uint64_t got = 0;
+        // Skip anything that is not the answer to this request (a shell's
+        // greeting, a late reply)
+        while (got != id) {
+            if (!shell.readLine(line, kReplyTimeoutMs)) {
+                error = "clock shell on " + serial + (shell.finish() == kProcessTimedOut ? " stopped answering" : " closed");
+                return false;
+            }
+            if (!parseClockReply(line, got, e)) got = 0;
+        }
+        e.hostRecvNs = hostSteadyNs();
+        samples.push_back(e);
+    }
+    return true;
+}
+
+// ===== Tracker =====
+void ClockTracker::start(const vector<string>& serials) {
+    lock_guard<mutex> lock(m);
+    for (const string& serial : serials) {
+        devices.push_back(make_unique<Device>());
+        Device* device = devices.back().get();
+        device->serial = serial;
+        device->worker = thread(&ClockTracker::run, this, device);
+    }
+}
+
+void ClockTracker::run(Device* device) {
+    ClockSession session(device->serial);
+    string error;
+    if (!session.open(error)) return;
+    {
+        lock_guard<mutex> lock(m);
+        device->source = session.source();
+    }
+    // The burst after stop() pins the end of the run, which is what the
+    // drift estimate needs most
+    for (bool last = false;;) {
+        size_t before = session.exchanges().size();
+        bool ok = session.burst(8, 20, error);
+        unique_lock<mutex> lock(m);
+        device->exchanges.insert(device->exchanges.end(), session.exchanges().begin() + before,
+            session.exchanges().end());
+        if (!ok || last) break;
+        last = wake.wait_for(lock, chrono::milliseconds(periodMs), [&] { return stopping; });
+    }
+    session.close();
+}
+
+void ClockTracker::stop() {
+    {
+        lock_guard<mutex> lock(m);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& device : devices)
+        if (device->worker.joinable()) device->worker.join();
+}
+
+map<string, ClockModel> ClockTracker::models() const {
+    lock_guard<mutex> lock(m);
+    map<string, ClockModel> out;
+    for (auto& device : devices) {
+        ClockModel model = fitClockModel(device->serial, device->exchanges);
+        model.source = device->source;
+        out[device->serial] = model;
+    }
+    return out;
+}
+
+// ===== Logcat stamps =====
+bool logcatLocalTimeNs(const string& line, int64_t& localNs) {
+    int month, day, hour, minute, second, millis;
+    if (line.size() < 18 || sscanf(line.c_str(), "%2d-%2d %2d:%2d:%2d.%3d", &month, &day, &hour, &minute, &second,
+        &millis) != 6)
+        return false;
+    int64_t nowSec = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+    int64_t year = 1970 + nowSec / 31556952;  // mean Gregorian year
+    while (daysFromCivil(year, 1, 1) * 86400 > nowSec) year--;
+    while (daysFromCivil(year + 1, 1, 1) * 86400 <= nowSec) year++;
+    auto stamp = [&](int64_t y) {
+        return ((daysFromCivil(y, month, day) * 24 + hour) * 60 + minute) * 60 + second;
+    };
+    int64_t sec = stamp(year);
+    if (sec > nowSec + 86400) sec = stamp(year - 1);
+    localNs = sec * 1000000000 + (int64_t)millis * 1000000;
+    return true;
+}
@@ -0,0 +1,121 @@
+// Clock.h
+// Host/device clock alignment. One persistent "adb shell" per device runs the
+// helper in --clock mode (or a shell loop when the helper is unavailable) and
+// answers timestamp requests. Each round trip pins the device clocks to a
+// host time known to within half the round trip. The exchanges with the
+// shortest round trips are fitted to an offset and a drift per device clock,
+// which then map device timestamps onto the host steady clock.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Process.h"
+
+enum class DeviceClock {
+    Realtime,   // CLOCK_REALTIME: logcat -v epoch, wall clock stamps
+    Boottime,   // CLOCK_BOOTTIME: helper telemetry, perfetto's default
+    Local       // device local wall time: logcat -v threadtime
+};
+
+// Host steady clock in ns, the timeline everything is mapped onto.
+int64_t hostSteadyNs();
+
+struct ClockExchange {
+    int64_t hostSendNs = 0;
+    int64_t hostRecvNs = 0;
+    int64_t deviceRealNs = 0;
+    int64_t deviceBootNs = 0;
+    int utcOffsetSec = 0;
+};
+
+// host = device + offsetNs + drift * (device - refDeviceNs)
+struct ClockFit {
+    int64_t offsetNs = 0;
+    double drift = 0;
+    int64_t refDeviceNs = 0;
+
+    int64_t toHost(int64_t deviceNs) const;
+};
+
+struct ClockModel {
+    std::string serial;
+    ClockFit realtime;
+    ClockFit boottime;
+    int utcOffsetSec = 0;
+    int64_t minRttNs = 0;       // the mapping is good to about half of this
+    size_t exchanges = 0;
+    size_t used = 0;            // exchanges that made it into the fit
+    std::string source;         // helper, shell
+    bool valid = false;
+
+    int64_t toHostNs(DeviceClock clock, int64_t deviceNs) const;
+};
+
+// Least-squares fit of offset and drift over the exchanges with the shortest
+// round trips. Drift stays 0 until it is known to within 20 ppm, which takes
+// a span of seconds to minutes depending on the round-trip jitter.
+ClockModel fitClockModel(const std::string& serial, const std::vector<ClockExchange>& exchanges);
+
+// One persistent shell answering timestamp requests.
+class ClockSession {
+public:
+    explicit ClockSession(const std::string& serial) : serial(serial) {}
+
+    // Helper first, shell loop second.
+    bool open(std::string& error);
+    // `count` round trips `spacingMs` apart, appended to exchanges().
+    bool burst(int count, int spacingMs, std::string& error);
+    void close() { shell.finish(); }
+
+    const std::vector<ClockExchange>& exchanges() const { return samples; }
+    const std::string& source() const { return kind; }
+
+private:
+    std::string serial;
+    std::string kind;
+    ProcessSession shell;
+    std::vector<ClockExchange> samples;
+    uint64_t nextId = 1;
+};
+
+// Alignment of several devices for the length of a run: a burst when a
+// device is added, another every `periodMs`, and a last one at stop().
+class ClockTracker {
+public:
+    explicit ClockTracker(int periodMs = 5000) : periodMs(periodMs) {}
+    ~ClockTracker() { stop(); }
+
+    void start(const std::vector<std::string>& serials);
+    void stop();
+    // Fits over what has been exchanged so far; usable before stop().
+    std::map<std::string, ClockModel> models() const;
+
+private:
+    struct Device {
+        std::string serial;
+        std::vector<ClockExchange> exchanges;
+        std::string source;
+        std::thread worker;
+    };
+
+    void run(Device* device);
+
+    int periodMs;
+    mutable std::mutex m;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::vector<std::unique_ptr<Device>> devices;
+};
+
+// "MM-DD HH:MM:SS.mmm" at the start of a logcat threadtime line, as device
+// local time in ns since the epoch. The year is the host's current one (the
+// previous one if that would put the line in the future).
+bool logcatLocalTimeNs(const std::string& line, int64_t& localNs);
@@ -0,0 +1,95 @@
+// ClockTests.cpp
+// fitClockModel on synthetic exchanges with a known offset and drift, and
+// the session read deadline that keeps a stuck shell from hanging a tracker.
+
+#include "Clock.h"
+#include "SelfTest.h"
+
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+static const int64_t kSec = 1000000000;
+
+// Exchanges every `spacingNs` with a fixed round trip. The device realtime
+// clock runs `ppm` slow and is 3 s behind the host; boottime is 7 s behind.
+static vector<ClockExchange> exchanges(int count, int64_t spacingNs, int64_t rttNs, double ppm) {
+    vector<ClockExchange> out;
+    for (int i = 0; i < count; i++) {
+        ClockExchange e;
+        e.hostSendNs = 1000 * kSec + i * spacingNs;
+        e.hostRecvNs = e.hostSendNs + rttNs;
+        int64_t mid = e.hostSendNs + rttNs / 2;
+        int64_t elapsed = (int64_t)i * spacingNs;
+        e.deviceRealNs = mid - 3 * kSec - (int64_t)llround(elapsed * ppm * 1e-6);
+        e.deviceBootNs = e.deviceRealNs - 4 * kSec;
+        e.utcOffsetSec = 7200;
+        out.push_back(e);
+    }
+    return out;
+}
+
+SELFTEST(clock_fit_without_exchanges_is_invalid) {
+    ClockModel model = fitClockModel("S", {});
+    CHECK(!model.valid);
+    CHECK_EQ(model.exchanges, (size_t)0);
+}
+
+SELFTEST(clock_fit_recovers_offset) {
+    ClockModel model = fitClockModel("S", exchanges(10, 20000000, 1000000, 0));
+    CHECK(model.valid);
+    CHECK_EQ(model.realtime.offsetNs, 3 * kSec);
+    CHECK_EQ(model.boottime.offsetNs, 7 * kSec);
+    CHECK_EQ(model.realtime.drift, 0.0);
+    CHECK_EQ(model.minRttNs, (int64_t)1000000);
+    CHECK_EQ(model.utcOffsetSec, 7200);
+    int64_t device = 998 * kSec;
+    CHECK_EQ(model.toHostNs(DeviceClock::Realtime, device), device + 3 * kSec);
+    CHECK_EQ(model.toHostNs(DeviceClock::Local, device + 7200 * kSec), device + 3 * kSec);
+    CHECK_EQ(model.toHostNs(DeviceClock::Boottime, device), device + 7 * kSec);
+}
+
+SELFTEST(clock_fit_skips_slow_round_trips) {
+    vector<ClockExchange> ex = exchanges(10, 20000000, 1000000, 0);
+    // Delayed on the way back: its midpoint is 25 ms late
+    ClockExchange late = ex[4];
+    late.hostRecvNs += 50000000;
+    ex.push_back(late);
+    ClockModel model = fitClockModel("S", ex);
+    CHECK_EQ(model.exchanges, (size_t)11);
+    CHECK_EQ(model.used, (size_t)10);
+    CHECK_EQ(model.realtime.offsetNs, 3 * kSec);
+}
+
+SELFTEST(clock_fit_measures_drift_over_a_long_span) {
+    // 50 ppm over 100 s
+    vector<ClockExchange> ex = exchanges(101, kSec, 1000000, 50);
+    ClockModel model = fitClockModel("S", ex);
+    CHECK(fabs(model.realtime.drift - 50e-6) < 1e-7);
+    for (const ClockExchange& e : { ex.front(), ex.back() }) {
+        int64_t mid = (e.hostSendNs + e.hostRecvNs) / 2;
+        CHECK(llabs(model.realtime.toHost(e.deviceRealNs) - mid) < 1000);
+    }
+}
+
+SELFTEST(clock_fit_ignores_drift_lost_in_jitter) {
+    // 80 ms of exchanges with 0.2 ms of jitter say nothing about 50 ppm
+    vector<ClockExchange> ex = exchanges(5, 20000000, 1000000, 50);
+    for (size_t i = 0; i < ex.size(); i++) ex[i].deviceRealNs += i % 2 ? 200000 : -200000;
+    ClockModel model = fitClockModel("S", ex);
+    CHECK_EQ(model.realtime.drift, 0.0);
+    CHECK(llabs(model.realtime.offsetNs - 3 * kSec) < 300000);
+}
+
+#ifndef _WIN32
+SELFTEST(clock_session_read_times_out) {
+    ProcessSession shell;
+    CHECK(shell.start("sleep 30"));
+    auto t0 = chrono::steady_clock::now();
+    string line;
+    CHECK(!shell.readLine(line, 200));
+    CHECK_EQ(shell.finish(), kProcessTimedOut);
+    CHECK(chrono::steady_clock::now() - t0 < chrono::seconds(5));
+}
+#endif
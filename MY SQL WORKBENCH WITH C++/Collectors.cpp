@@ -0,0 +1,202 @@
+// Collectors.cpp
+// Collector registry, script composition and output demultiplexing.
+//
+// Scripts are passed to "adb shell" inside double quotes through the host
+// shell (cmd.exe or sh), so collector snippets must not contain '"', '$'
+// or '%'.
+
+#include "Collectors.h"
+#include "Adb.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <sstream>
+
+using namespace std;
+
+static const char* kBegin = "@@ADFXT:BEGIN:";
+static const char* kEnd = "@@ADFXT:END:";
+
+struct Collector {
+    string name;
+    string snippet;
+    function<void(const string& body, DeviceSnapshot& snap)> parse;
+};
+
+// ===== Parsers =====
+static string trimmed(const string& s) {
+    size_t a = s.find_first_not_of(" \t\r\n");
+    if (a == string::npos) return "";
+    size_t b = s.find_last_not_of(" \t\r\n");
+    return s.substr(a, b - a + 1);
+}
+
+// "key: value" lines, as printed by dumpsys battery
+static map<string, string> parseColonLines(const string& body) {
+    map<string, string> out;
+    istringstream ss(body);
+    string line;
+    while (getline(ss, line)) {
+        size_t colon = line.find(':');
+        if (colon == string::npos) continue;
+        out[trimmed(line.substr(0, colon))] = trimmed(line.substr(colon + 1));
+    }
+    return out;
+}
+
+static void parseStorage(const string& body, DeviceSnapshot& snap) {
+    // Filesystem 1K-blocks Used Available Use% Mounted on
+    // /dev/block/dm-8  115035164 5262628 109641464 5% /data
+    istringstream ss(body);
+    string line, last;
+    while (getline(ss, line))
+        if (!trimmed(line).empty()) last = line;
+    istringstream fields(last);
+    string fs;
+    int64_t total, used, avail;
+    if (fields >> fs >> total >> used >> avail) {
+        snap.dataTotalKb = total;
+        snap.dataUsedKb = used;
+        snap.dataAvailKb = avail;
+    }
+}
+
+static void parseBattery(const string& body, DeviceSnapshot& snap) {
+    map<string, string> kv = parseColonLines(body);
+    auto num = [&](const char* key, auto& out) {
+        auto it = kv.find(key);
+        if (it != kv.end() && !it->second.empty()) out = atoi(it->second.c_str());
+    };
+    num("level", snap.batteryLevel);
+    num("temperature", snap.batteryTempDeciC);
+    num("voltage", snap.batteryVoltageMv);
+    num("status", snap.batteryStatus);
+}
+
+static const vector<Collector>& registry() {
+    static const vector<Collector> collectors = {
+        { "props", "getprop",
+            [](const string& body, DeviceSnapshot& snap) { snap.props = parseGetprop(body); } },
+        { "storage", "df -k /data",
+            parseStorage },
+        { "battery", "dumpsys battery",
+            parseBattery },
+        { "uptime", "cat /proc/uptime",
+            [](const string& body, DeviceSnapshot& snap) { snap.uptimeSec = atof(body.c_str()); } },
+        { "kernel", "uname -r",
+            [](const string& body, DeviceSnapshot& snap) { snap.kernelVersion = trimmed(body); } },
+        { "selinux", "getenforce",
+            [](const string& body, DeviceSnapshot& snap) { snap.selinux = trimmed(body); } },
+    };
+    return collectors;
+}
+
+static const Collector* findCollector(const string& name) {
+    for (const Collector& c : registry())
+        if (c.name == name) return &c;
+    return nullptr;
+}
+
+// ===== Public API =====
+const vector<string>& collectorNames() {
+    static const vector<string> names = [] {
+        vector<string> out;
+        for (const Collector& c : registry()) out.push_back(c.name);
+        return out;
+    }();
+    return names;
+}
+
+bool collectorExists(const string& name) {
+    return findCollector(name) != nullptr;
+}
+
+string buildCollectorScript(const vector<string>& enabled) {
+    string script;
+    for (const string& name : enabled) {
+        const Collector* c = findCollector(name);
+        if (!c) continue;
+        if (!script.empty()) script += "; ";
+        script += string("echo ") + kBegin + c->name + "; ";
+        script += c->snippet + " 2>/dev/null; ";
+        script += string("echo ") + kEnd + c->name;
+    }
+    return script;
+}
+
+void demuxCollectorOutput(const string& output, const vector<string>& enabled, DeviceSnapshot& snap) {
+    map<string, string> sections;
+    istringstream ss(output);
+    string line, current, body;
+    bool inSection = false;
+    while (getline(ss, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.rfind(kBegin, 0) == 0) {
+            current = line.substr(strlen(kBegin));
+            body.clear();
+            inSection = true;
+        }
+        else if (inSection && line == kEnd + current) {
+            sections[current] = body;
+            inSection = false;
+        }
+        else if (inSection) {
+            body += line;
+            body += '\n';
+        }
+    }
+
+    for (const string& name : enabled) {
+        const Collector* c = findCollector(name);
+        auto it = sections.find(name);
+        if (!c || it == sections.end()) {
+            snap.missing.push_back(name);
+            continue;
+        }
+        c->parse(it->second, snap);
+    }
+}
+
+DeviceSnapshot collectDevice(const string& serial, const vector<string>& enabled) {
+    DeviceSnapshot snap;
+    snap.serial = serial;
+    string script = buildCollectorScript(enabled);
+    if (script.empty()) return snap;
+    string output = runCommandShared("adb -s " + serial + " shell \"" + script + "\"");
+    demuxCollectorOutput(output, enabled, snap);
+    return snap;
+}
+
+// ===== Flat field view =====
+FieldMap snapshotFields(const DeviceSnapshot& snap) {
+    FieldMap fields = snap.props;
+    auto put = [&](const char* name, int64_t v) {
+        if (v != -1) fields[name] = to_string(v);
+    };
+    put("data_total_kb", snap.dataTotalKb);
+    put("data_used_kb", snap.dataUsedKb);
+    put("data_avail_kb", snap.dataAvailKb);
+    put("battery_level", snap.batteryLevel);
+    put("battery_voltage_mv", snap.batteryVoltageMv);
+    put("battery_status", snap.batteryStatus);
+    if (snap.batteryTempDeciC != INT32_MIN) {
+        char temp[16];
+        snprintf(temp, sizeof(temp), "%.1f", snap.batteryTempDeciC / 10.0);
+        fields["battery_temp_c"] = temp;
+    }
+    if (snap.uptimeSec >= 0) fields["uptime_sec"] = to_string((int64_t)snap.uptimeSec);
+    if (!snap.kernelVersion.empty()) fields["kernel_version"] = snap.kernelVersion;
+    if (!snap.selinux.empty()) fields["selinux"] = snap.selinux;
+    return fields;
+}
+
+string collectorForField(const string& field) {
+    if (field.compare(0, 5, "data_") == 0) return "storage";
+    if (field.compare(0, 8, "battery_") == 0) return "battery";
+    if (field == "uptime_sec") return "uptime";
+    if (field == "kernel_version") return "kernel";
+    if (field == "selinux") return "selinux";
+    return "props";
+}
@@ -0,0 +1,59 @@
+// Collectors.h
+// Device collectors composed into one on-device shell script, so collecting
+// any number of them costs a single "adb shell" round trip per device.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// ===== Typed result of one collection pass =====
+struct DeviceSnapshot {
+    std::string serial;
+    std::map<std::string, std::string> props;  // "props"
+
+    int64_t dataTotalKb = -1;                   // "storage" (df -k /data)
+    int64_t dataUsedKb = -1;
+    int64_t dataAvailKb = -1;
+
+    int batteryLevel = -1;                      // "battery" (dumpsys battery)
+    int batteryTempDeciC = INT32_MIN;           // tenths of a degree C
+    int batteryVoltageMv = -1;
+    int batteryStatus = -1;                     // BatteryManager.BATTERY_STATUS_*
+
+    double uptimeSec = -1.0;                    // "uptime" (/proc/uptime)
+    std::string kernelVersion;                  // "kernel" (uname -r)
+    std::string selinux;                        // "selinux" (getenforce)
+
+    std::vector<std::string> missing;           // enabled collectors with no section
+};
+
+// Every collector name, in script order.
+const std::vector<std::string>& collectorNames();
+
+bool collectorExists(const std::string& name);
+
+// The framed script for the enabled collectors. Each section is wrapped in
+// "@@ADFXT:BEGIN:<name>" / "@@ADFXT:END:<name>" marker lines.
+std::string buildCollectorScript(const std::vector<std::string>& enabled);
+
+// Split the script output back into sections and parse each into `snap`.
+void demuxCollectorOutput(const std::string& output, const std::vector<std::string>& enabled,
+    DeviceSnapshot& snap);
+
+// Run the enabled collectors on one device in a single adb shell.
+DeviceSnapshot collectDevice(const std::string& serial, const std::vector<std::string>& enabled);
+
+// ===== Flat field view =====
+// One name -> value map per snapshot, for rule engines that compare fields
+// by name. Properties keep their own names ("ro.build.fingerprint"); typed
+// values use the batch output names (battery_level, data_avail_kb,
+// kernel_version, ...). Values that were not collected are left out.
+using FieldMap = std::map<std::string, std::string>;
+
+FieldMap snapshotFields(const DeviceSnapshot& snap);
+
+// Collector that produces a field ("props" for property names).
+std::string collectorForField(const std::string& field);
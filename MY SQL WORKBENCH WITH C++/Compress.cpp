@@ -0,0 +1,114 @@
+// Compress.cpp
+// Sequence = token (literal length << 4 | match length - 4), extra length
+// bytes (255 = continue), literals, 16-bit little-endian offset, extra match
+// length bytes. The last sequence has literals only.
+
+#include "Compress.h"
+
+#include <cstring>
+
+using namespace std;
+
+static const int kHashBits = 14;
+static const size_t kMinMatch = 4;
+static const size_t kMaxOffset = 65535;
+static const size_t kTailLiterals = 12;  // never start a match this close to the end
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+static void putLength(vector<uint8_t>& out, size_t len) {
+    while (len >= 255) {
+        out.push_back(255);
+        len -= 255;
+    }
+    out.push_back((uint8_t)len);
+}
+
+static void emit(vector<uint8_t>& out, const uint8_t* literals, size_t litLen, size_t offset, size_t matchLen) {
+    size_t ml = matchLen ? matchLen - kMinMatch : 0;
+    out.push_back((uint8_t)((litLen < 15 ? litLen : 15) << 4 | (ml < 15 ? ml : 15)));
+    if (litLen >= 15) putLength(out, litLen - 15);
+    out.insert(out.end(), literals, literals + litLen);
+    if (!matchLen) return;
+    out.push_back((uint8_t)offset);
+    out.push_back((uint8_t)(offset >> 8));
+    if (ml >= 15) putLength(out, ml - 15);
+}
+
+vector<uint8_t> lzCompress(const uint8_t* data, size_t size) {
+    vector<uint8_t> out;
+    out.reserve(size / 2 + 16);
+    vector<uint32_t> table(1 << kHashBits, 0);
+    size_t anchor = 0, pos = 0;
+    while (size > kTailLiterals && pos < size - kTailLiterals) {
+        uint32_t v = read32(data + pos);
+        uint32_t h = hash4(v);
+        size_t candidate = table[h];
+        table[h] = (uint32_t)pos;
+        if (candidate >= pos || pos - candidate > kMaxOffset || read32(data + candidate) != v) {
+            pos++;
+            continue;
+        }
+        size_t len = kMinMatch;
+        size_t limit = size - kTailLiterals;
+        while (pos + len < limit && data[candidate + len] == data[pos + len]) len++;
+        // Extend backwards over literals that also match
+        while (pos > anchor && candidate > 0 && data[pos - 1] == data[candidate - 1]) {
+            pos--;
+            candidate--;
+            len++;
+        }
+        emit(out, data + anchor, pos - anchor, pos - candidate, len);
+        pos += len;
+        anchor = pos;
+    }
+    emit(out, data + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+static bool readLength(const uint8_t*& p, const uint8_t* end, size_t& len) {
+    uint8_t b;
+    do {
+        if (p >= end) return false;
+        b = *p++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+bool lzDecompress(const uint8_t* data, size_t size, uint8_t* out, size_t rawSize) {
+    const uint8_t* p = data;
+    const uint8_t* end = data + size;
+    size_t o = 0;
+    while (p < end) {
+        uint8_t token = *p++;
+        size_t lit = token >> 4;
+        if (lit == 15 && !readLength(p, end, lit)) return false;
+        if (lit > (size_t)(end - p) || lit > rawSize - o) return false;
+        memcpy(out + o, p, lit);
+        p += lit;
+        o += lit;
+        if (p == end) break;  // final literal-only sequence
+
+        if (end - p < 2) return false;
+        size_t offset = p[0] | (size_t)p[1] << 8;
+        p += 2;
+        size_t len = (token & 15);
+        if (len == 15 && !readLength(p, end, len)) return false;
+        len += kMinMatch;
+        if (offset == 0 || offset > o || len > rawSize - o) return false;
+        const uint8_t* from = out + o - offset;
+        if (offset >= len) memcpy(out + o, from, len);
+        else for (size_t i = 0; i < len; i++) out[o + i] = from[i];
+        o += len;
+    }
+    return o == rawSize;
+}
@@ -0,0 +1,17 @@
+// Compress.h
+// Small LZ77 block codec (LZ4-style sequences) for data the tool writes and
+// reads back itself, e.g. log segments. Tuned for decode speed; no external
+// library needed.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Compress `size` bytes; the result is only meaningful to lzDecompress.
+std::vector<uint8_t> lzCompress(const uint8_t* data, size_t size);
+
+// Decompress into exactly `rawSize` bytes. False on corrupt input.
+bool lzDecompress(const uint8_t* data, size_t size, uint8_t* out, size_t rawSize);
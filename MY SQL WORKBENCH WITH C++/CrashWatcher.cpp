@@ -0,0 +1,269 @@
+// CrashWatcher.cpp
+// Polling, incremental pulls and signature indexing for tombstones/ANRs.
+
+#include "CrashWatcher.h"
+#include "Adb.h"
+#include "SerialDir.h"
+#include "ThreadPool.h"
+
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static const char* kCrashDirs = "/data/tombstones /data/anr";
+
+// ===== Listing =====
+CrashListing parseCrashListing(const string& output) {
+    // /data/tombstones:
+    // -rw-rw---- 1 1000 1007 291810 2024-05-01 10:20:30.123456789 +0000 tombstone_00
+    CrashListing listing;
+    istringstream ss(output);
+    string line, dir;
+    while (getline(ss, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line.rfind("total", 0) == 0) continue;
+        if (line.back() == ':' && line[0] == '/') {
+            dir = line.substr(0, line.size() - 1);
+            continue;
+        }
+        if (line[0] != '-' || dir.empty()) continue;  // regular files only
+
+        istringstream fields(line);
+        string perms, links, uid, gid, size, date, time, tz;
+        if (!(fields >> perms >> links >> uid >> gid >> size >> date >> time >> tz)) continue;
+        string name;
+        getline(fields, name);
+        name.erase(0, name.find_first_not_of(' '));
+        if (name.empty() || name.find('/') != string::npos) continue;
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, ".pb") == 0) continue;  // text copy is enough
+        listing[dir + "/" + name] = date + "T" + time + " " + size;
+    }
+    return listing;
+}
+
+// Tombstone slots (tombstone_00..31) are reused, so the local name carries
+// the mtime: "tombstone_03" modified 2024-05-01 10:20:30 -> "tombstone_03_20240501102030".
+static string localNameFor(const string& remote, const string& fingerprint) {
+    string name = fs::path(remote).filename().string() + "_";
+    for (char c : fingerprint.substr(0, fingerprint.find('.'))) {
+        if (c == ' ') break;
+        if (isdigit((unsigned char)c)) name += c;
+    }
+    return name;
+}
+
+// ===== Signatures =====
+static uint64_t fnv1a64(const string& s) {
+    uint64_t h = 1469598103934665603ull;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static string afterPrefix(const string& line, const string& prefix) {
+    size_t at = line.find(prefix);
+    if (at == string::npos) return "";
+    string rest = line.substr(at + prefix.size());
+    while (!rest.empty() && (rest.back() == '\r' || rest.back() == ' ')) rest.pop_back();
+    return rest;
+}
+
+// "      #00 pc 000000000004e8ac  /apex/.../libc.so (abort+164) (BuildId: ...)"
+// -> "libc.so (abort)": library basename and symbol without offset.
+static string frameKey(const string& line) {
+    size_t pc = line.find(" pc ");
+    if (pc == string::npos) return "";
+    istringstream fields(line.substr(pc + 4));
+    string addr, lib;
+    fields >> addr >> lib;
+    size_t slash = lib.rfind('/');
+    if (slash != string::npos) lib = lib.substr(slash + 1);
+    string rest;
+    getline(fields, rest);
+    size_t buildId = rest.find("(BuildId");
+    if (buildId != string::npos) rest.erase(buildId);
+    size_t open = rest.find('(');
+    size_t close = rest.rfind(')');
+    if (open != string::npos && close != string::npos && close > open) {
+        string symbol = rest.substr(open + 1, close - open - 1);
+        size_t plus = symbol.rfind('+');
+        if (plus != string::npos) symbol.erase(plus);
+        lib += " (" + symbol + ")";
+    }
+    return lib;
+}
+
+string crashSignature(const string& kind, const string& contents) {
+    istringstream ss(contents);
+    string line, process, reason;
+    vector<string> frames;
+    bool inMainThread = true;  // ANR traces: only the first ("main") thread
+
+    while (getline(ss, line) && frames.size() < 3) {
+        if (kind == "tombstone") {
+            if (process.empty()) {
+                string p = afterPrefix(line, ">>> ");
+                if (!p.empty()) process = p.substr(0, p.find(" <<<"));
+            }
+            if (reason.empty()) {
+                string sig = afterPrefix(line, "signal ");
+                if (!sig.empty()) reason = "signal " + sig.substr(0, sig.find(','));
+            }
+            string abortMsg = afterPrefix(line, "Abort message: ");
+            if (!abortMsg.empty()) reason += " abort";
+            if (line.find("#0") != string::npos && line.find(" pc ") != string::npos)
+                frames.push_back(frameKey(line));
+        }
+        else {
+            if (process.empty()) process = afterPrefix(line, "Cmd line: ");
+            if (reason.empty()) reason = afterPrefix(line, "Subject: ");
+            if (line.rfind("\"", 0) == 0 && !frames.empty()) inMainThread = false;
+            if (inMainThread && line.find("  at ") != string::npos) {
+                string frame = afterPrefix(line, "  at ");
+                frames.push_back(frame.substr(0, frame.find('(')));
+            }
+            if (inMainThread && line.find(" native: #") != string::npos)
+                frames.push_back(frameKey(line));
+        }
+    }
+
+    string sig = kind + " | " + (process.empty() ? "?" : process) + " | " + (reason.empty() ? "?" : reason);
+    for (const string& f : frames) sig += " | " + f;
+    return sig;
+}
+
+// ===== Watcher =====
+CrashWatcher::CrashWatcher(const string& dir, int pulls) : outputDir(dir), pullsPerDevice(max(1, pulls)) {
+    error_code ec;
+    fs::create_directories(outputDir, ec);
+    loadIndex();
+}
+
+void CrashWatcher::loadState(const string& serial) {
+    if (seen.count(serial)) return;
+    CrashListing& state = seen[serial];
+    ifstream in(fs::path(outputDir) / serialDirName(serial) / ".state");
+    string line;
+    while (getline(in, line)) {
+        size_t tab = line.find('\t');
+        if (tab != string::npos) state[line.substr(0, tab)] = line.substr(tab + 1);
+    }
+}
+
+void CrashWatcher::saveState(const string& serial) {
+    fs::path path = fs::path(outputDir) / serialDirName(serial) / ".state";
+    {
+        ofstream out(path.string() + ".tmp", ios::trunc);
+        for (auto& [remote, fp] : seen[serial]) out << remote << "\t" << fp << "\n";
+    }
+    error_code ec;
+    fs::rename(path.string() + ".tmp", path, ec);
+}
+
+void CrashWatcher::loadIndex() {
+    ifstream in(fs::path(outputDir) / "index.tsv");
+    string line;
+    while (getline(in, line)) {
+        istringstream fields(line);
+        string hash, count, file, text;
+        if (!getline(fields, hash, '\t') || !getline(fields, count, '\t') ||
+            !getline(fields, file, '\t') || !getline(fields, text)) continue;
+        Signature& s = index[strtoull(hash.c_str(), nullptr, 16)];
+        s.count = atoi(count.c_str());
+        s.lastFile = file;
+        s.text = text;
+    }
+}
+
+void CrashWatcher::saveIndex() {
+    fs::path path = fs::path(outputDir) / "index.tsv";
+    {
+        ofstream out(path.string() + ".tmp", ios::trunc);
+        for (auto& [hash, s] : index) {
+            char hex[17];
+            snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+            out << hex << "\t" << s.count << "\t" << s.lastFile << "\t" << s.text << "\n";
+        }
+    }
+    error_code ec;
+    fs::rename(path.string() + ".tmp", path, ec);
+}
+
+vector<CrashFile> CrashWatcher::poll(const string& serial) {
+    CrashListing listing = parseCrashListing(
+        runCommand("adb -s " + serial + " shell ls -ln --full-time " + kCrashDirs));
+
+    vector<pair<string, string>> fresh;  // remote path, fingerprint
+    {
+        lock_guard<mutex> lock(m);
+        loadState(serial);
+        const CrashListing& state = seen[serial];
+        for (auto& [remote, fp] : listing) {
+            auto it = state.find(remote);
+            if (it == state.end() || it->second != fp) fresh.push_back({ remote, fp });
+        }
+    }
+    if (fresh.empty()) return {};
+
+    fs::path deviceDir = fs::path(outputDir) / serialDirName(serial);
+    error_code ec;
+    fs::create_directories(deviceDir, ec);
+
+    // Pull concurrently; the limiter still caps transfers per adb server
+    ThreadPool pool(min((size_t)pullsPerDevice, fresh.size()));
+    vector<future<bool>> pulls;
+    for (auto& [remote, fp] : fresh) {
+        string local = (deviceDir / localNameFor(remote, fp)).string();
+        pulls.push_back(pool.submit([serial, remote = remote, local] {
+            string output;
+            if (runCommandStatus("adb -s " + serial + " pull " + hostQuote(remote) + " " + hostQuote(local), output) == 0)
+                return true;
+            // Leave no partial copy behind; the next poll pulls it again
+            error_code ec;
+            fs::remove(local, ec);
+            return false;
+        }));
+    }
+
+    vector<CrashFile> captured;
+    for (size_t i = 0; i < fresh.size(); i++) {
+        if (!pulls[i].get()) continue;
+        const string& remote = fresh[i].first;
+
+        CrashFile cf;
+        cf.serial = serial;
+        cf.remotePath = remote;
+        cf.localPath = (deviceDir / localNameFor(remote, fresh[i].second)).string();
+        cf.kind = remote.rfind("/data/anr/", 0) == 0 ? "anr" : "tombstone";
+
+        ifstream in(cf.localPath, ios::binary);
+        string head(64 * 1024, '\0');
+        in.read(&head[0], (streamsize)head.size());
+        head.resize((size_t)in.gcount());
+        cf.signature = crashSignature(cf.kind, head);
+        cf.signatureHash = fnv1a64(cf.signature);
+        captured.push_back(cf);
+    }
+
+    lock_guard<mutex> lock(m);
+    for (size_t i = 0; i < fresh.size(); i++) {
+        if (fs::exists(deviceDir / localNameFor(fresh[i].first, fresh[i].second)))
+            seen[serial][fresh[i].first] = fresh[i].second;
+    }
+    for (CrashFile& cf : captured) {
+        Signature& s = index[cf.signatureHash];
+        s.count++;
+        s.lastFile = cf.localPath;
+        s.text = cf.signature;
+        cf.occurrences = s.count;
+    }
+    saveState(serial);
+    saveIndex();
+    return captured;
+}
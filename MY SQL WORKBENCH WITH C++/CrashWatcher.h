@@ -0,0 +1,63 @@
+// CrashWatcher.h
+// Incremental tombstone/ANR capture. Each poll lists /data/tombstones and
+// /data/anr in one adb shell, compares size+mtime fingerprints with what was
+// already pulled, pulls only new or changed files concurrently (adb pull,
+// i.e. the sync protocol) and indexes them by crash signature.
+//
+// Layout under the output directory:
+//   <serial>/<file>      pulled tombstones and traces
+//   <serial>/.state      fingerprints, so restarts do not re-pull
+//   index.tsv            signature hash, count, last file, signature
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct CrashFile {
+    std::string serial;
+    std::string remotePath;
+    std::string localPath;
+    std::string kind;          // "tombstone" or "anr"
+    std::string signature;     // process + signal/subject + top frames
+    uint64_t signatureHash = 0;
+    int occurrences = 0;       // times this signature has been seen
+};
+
+// Listing entry: remote path -> "mtime size" fingerprint.
+using CrashListing = std::map<std::string, std::string>;
+
+// Parse "ls -ln --full-time <dirs>" output.
+CrashListing parseCrashListing(const std::string& output);
+
+// Signature of a tombstone or ANR trace from its contents.
+std::string crashSignature(const std::string& kind, const std::string& contents);
+
+class CrashWatcher {
+public:
+    explicit CrashWatcher(const std::string& outputDir, int pullsPerDevice = 4);
+
+    // One poll of one device; returns newly captured files.
+    std::vector<CrashFile> poll(const std::string& serial);
+
+private:
+    struct Signature {
+        int count = 0;
+        std::string lastFile;
+        std::string text;
+    };
+
+    void loadState(const std::string& serial);
+    void saveState(const std::string& serial);
+    void loadIndex();
+    void saveIndex();
+
+    std::string outputDir;
+    int pullsPerDevice;
+    std::mutex m;
+    std::map<std::string, CrashListing> seen;   // serial -> pulled fingerprints
+    std::map<uint64_t, Signature> index;
+};
@@ -0,0 +1,53 @@
+// Crc32.cpp
+// Eight 256-entry tables let the loop consume 8 bytes per step with
+// independent lookups instead of one table walk per byte.
+
+#include "Crc32.h"
+
+#include <cstring>
+
+using namespace std;
+
+namespace {
+struct Crc32Tables {
+    uint32_t t[8][256];
+
+    Crc32Tables() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; i++)
+            for (int s = 1; s < 8; s++) t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xff];
+    }
+};
+}
+
+static const Crc32Tables tables;
+
+uint32_t crc32Update(uint32_t crc, const void* data, size_t size) {
+    const uint8_t* p = (const uint8_t*)data;
+    crc = ~crc;
+    while (size && ((uintptr_t)p & 7)) {
+        crc = tables.t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        size--;
+    }
+    while (size >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        lo = __builtin_bswap32(lo);
+        hi = __builtin_bswap32(hi);
+#endif
+        lo ^= crc;
+        crc = tables.t[7][lo & 0xff] ^ tables.t[6][(lo >> 8) & 0xff] ^ tables.t[5][(lo >> 16) & 0xff] ^
+            tables.t[4][lo >> 24] ^ tables.t[3][hi & 0xff] ^ tables.t[2][(hi >> 8) & 0xff] ^
+            tables.t[1][(hi >> 16) & 0xff] ^ tables.t[0][hi >> 24];
+        p += 8;
+        size -= 8;
+    }
+    while (size--) crc = tables.t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
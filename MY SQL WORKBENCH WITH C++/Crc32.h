@@ -0,0 +1,10 @@
+// Crc32.h
+// CRC-32 (IEEE 802.3, as used by zip and gzip), slicing-by-8.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Continue a CRC: crc32Update(0, data, n) for a fresh one.
+uint32_t crc32Update(uint32_t crc, const void* data, size_t size);
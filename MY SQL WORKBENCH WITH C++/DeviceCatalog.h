@@ -0,0 +1,89 @@
+// DeviceCatalog.h
+// Codename enrichment through a perfect-hash table built entirely at compile
+// time from DeviceCatalog.def. A lookup is one hash, one table load and one
+// string compare; nothing is built or allocated at runtime.
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+struct DeviceEnrichment {
+    std::string_view codename;
+    std::string_view marketingName;
+    std::string_view soc;
+    int releaseYear;
+};
+
+namespace device_catalog {
+
+#define DEVICE(codename, name, soc, year) DeviceEnrichment{ codename, name, soc, year },
+inline constexpr DeviceEnrichment kEntries[] = {
+#include "DeviceCatalog.def"
+};
+#undef DEVICE
+
+inline constexpr size_t kCount = sizeof(kEntries) / sizeof(kEntries[0]);
+static_assert(kCount < 255, "slot table stores uint8_t indices");
+
+// Sparse power-of-two table (8x the entry count) so a collision-free seed
+// turns up within a handful of tries.
+constexpr size_t slotCountFor(size_t n) {
+    size_t m = 1;
+    while (m < n * 8) m <<= 1;
+    return m;
+}
+inline constexpr size_t kSlots = slotCountFor(kCount);
+inline constexpr uint8_t kEmpty = 0xFF;
+
+// Seeded FNV-1a
+constexpr uint32_t hash(uint32_t seed, std::string_view s) {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : s) {
+        h ^= (uint8_t)c;
+        h *= 16777619u;
+    }
+    h ^= h >> 15;  // FNV's low bits mix poorly for short keys
+    return h;
+}
+
+struct Table {
+    uint32_t seed = 0;
+    bool found = false;
+    uint8_t slots[kSlots] = {};
+};
+
+constexpr Table build() {
+    Table t;
+    for (uint32_t seed = 1; seed < 10000; seed++) {
+        for (size_t i = 0; i < kSlots; i++) t.slots[i] = kEmpty;
+        bool ok = true;
+        for (size_t i = 0; i < kCount && ok; i++) {
+            size_t slot = hash(seed, kEntries[i].codename) & (kSlots - 1);
+            if (t.slots[slot] != kEmpty) ok = false;
+            else t.slots[slot] = (uint8_t)i;
+        }
+        if (ok) {
+            t.seed = seed;
+            t.found = true;
+            return t;
+        }
+    }
+    return t;
+}
+
+inline constexpr Table kTable = build();
+static_assert(kTable.found, "no perfect-hash seed for DeviceCatalog.def; raise the seed limit");
+
+} // namespace device_catalog
+
+// Enrichment for a ro.product.device codename, or nullptr when unknown.
+constexpr const DeviceEnrichment* lookupDevice(std::string_view codename) {
+    using namespace device_catalog;
+    uint8_t index = kTable.slots[hash(kTable.seed, codename) & (kSlots - 1)];
+    if (index == kEmpty || kEntries[index].codename != codename) return nullptr;
+    return &kEntries[index];
+}
+
+static_assert(lookupDevice("blueline") && lookupDevice("blueline")->releaseYear == 2018,
+    "device catalog self-check");
@@ -0,0 +1,262 @@
+// DirPull.cpp
+// Remote listing, stream sharding and tar extraction for directory pulls.
+
+#include "DirPull.h"
+#include "Adb.h"
+#include "RateLimiter.h"
+#include "Shutdown.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Keep each adb command line well under cmd.exe's 8191 character limit.
+static const size_t kMaxTarCommand = 7000;
+static const size_t kWriteBuffer = 1 << 20;
+
+// ===== Listing =====
+PullListing parsePullListing(const string& output) {
+    // -rw-rw---- 1 1023 1023 4096 2024-05-01 10:20:30.123456789 +0000 ./Camera/IMG_1.jpg
+    PullListing listing;
+    istringstream ss(output);
+    string line;
+    while (getline(ss, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] != '-') continue;
+        istringstream fields(line);
+        string perms, links, uid, gid, size, date, time, tz;
+        if (!(fields >> perms >> links >> uid >> gid >> size >> date >> time >> tz)) continue;
+        string name;
+        getline(fields, name);
+        name.erase(0, name.find_first_not_of(' '));
+        if (name.rfind("./", 0) == 0) name = name.substr(2);
+        if (!name.empty()) listing.push_back({ name, strtoull(size.c_str(), nullptr, 10) });
+    }
+    return listing;
+}
+
+// ===== TarExtractor =====
+TarExtractor::TarExtractor(const string& root) : root(root), outBuffer(kWriteBuffer) {}
+
+TarExtractor::~TarExtractor() {
+    closeEntry();
+}
+
+static uint64_t tarNumber(const char* field, size_t len) {
+    if ((unsigned char)field[0] & 0x80) {  // GNU base-256 for sizes >= 8 GiB
+        uint64_t v = (unsigned char)field[0] & 0x7f;
+        for (size_t i = 1; i < len; i++) v = (v << 8) | (unsigned char)field[i];
+        return v;
+    }
+    uint64_t v = 0;
+    for (size_t i = 0; i < len && field[i]; i++) {
+        if (field[i] == ' ') continue;
+        if (field[i] < '0' || field[i] > '7') break;
+        v = v * 8 + (field[i] - '0');
+    }
+    return v;
+}
+
+static string tarString(const char* field, size_t len) {
+    return string(field, strnlen(field, len));
+}
+
+static bool safeRelative(const string& name) {
+    if (name.empty() || name[0] == '/' || name.find(':') != string::npos) return false;
+    for (const auto& part : fs::path(name))
+        if (part == "..") return false;
+    return true;
+}
+
+bool TarExtractor::startEntry() {
+    bool zero = all_of(header, header + 512, [](char c) { return c == 0; });
+    if (zero) {
+        ended = true;
+        return true;
+    }
+    type = header[156];
+    remaining = tarNumber(header + 124, 12);
+    padding = (512 - remaining % 512) % 512;
+    meta.clear();
+    if (type == 'L' || type == 'x' || type == 'g') return true;  // data is metadata
+
+    string name = longName;
+    longName.clear();
+    if (name.empty()) {
+        name = tarString(header, 100);
+        if (memcmp(header + 257, "ustar", 5) == 0 && header[345])
+            name = tarString(header + 345, 155) + "/" + name;
+    }
+    if (name.rfind("./", 0) == 0) name = name.substr(2);
+    if (type != '0' && type != '\0') return true;  // directories, links: data skipped
+    if (!safeRelative(name)) {
+        error = "unsafe path in archive: " + name;
+        return false;
+    }
+
+    fs::path target = fs::path(root) / fs::u8path(name);
+    error_code ec;
+    fs::create_directories(target.parent_path(), ec);
+    out = fopen(target.string().c_str(), "wb");
+    if (!out) {
+        error = "cannot create " + target.string();
+        return false;
+    }
+    setvbuf(out, outBuffer.data(), _IOFBF, outBuffer.size());
+    files++;
+    return true;
+}
+
+void TarExtractor::closeEntry() {
+    if (out) fclose(out);
+    out = nullptr;
+}
+
+bool TarExtractor::feed(const char* data, size_t size) {
+    while (size > 0) {
+        if (ended) return true;  // trailing zero blocks
+        if (remaining > 0) {
+            size_t n = (size_t)min<uint64_t>(remaining, size);
+            if (out) {
+                if (fwrite(data, 1, n, out) != n) {
+                    error = "write failed";
+                    return false;
+                }
+                bytes += n;
+            } else if (type == 'L' || type == 'x') {
+                meta.append(data, n);
+            }
+            data += n;
+            size -= n;
+            remaining -= n;
+            if (remaining > 0) continue;
+            closeEntry();
+            if (type == 'L') {
+                longName = meta.c_str();
+            } else if (type == 'x') {
+                // "<len> path=<name>\n" records
+                size_t at = meta.find(" path=");
+                if (at != string::npos) longName = meta.substr(at + 6, meta.find('\n', at) - at - 6);
+            }
+            continue;
+        }
+        if (padding > 0) {
+            size_t n = (size_t)min<uint64_t>(padding, size);
+            data += n;
+            size -= n;
+            padding -= n;
+            continue;
+        }
+        size_t n = min(size, sizeof(header) - headerFill);
+        memcpy(header + headerFill, data, n);
+        headerFill += n;
+        data += n;
+        size -= n;
+        if (headerFill < sizeof(header)) continue;
+        headerFill = 0;
+        if (!startEntry()) return false;
+        if (remaining == 0) closeEntry();  // empty file
+    }
+    return true;
+}
+
+// ===== Pull =====
+// Names that survive both the host shell's double quotes and the device
+// shell's single quotes; anything else falls back to a plain adb pull.
+static bool streamable(const string& name) {
+    return name.find_first_of("\"$%`'\\\n") == string::npos;
+}
+
+PullResult pullDirectory(const string& serial, const string& remoteDir, const string& localDir,
+    int streams, BandwidthLimiter* cap) {
+    PullResult result;
+    result.serial = serial;
+    auto start = chrono::steady_clock::now();
+    if (!streamable(remoteDir)) {
+        result.error = "remote directory contains shell metacharacters";
+        return result;
+    }
+
+    PullListing listing = parsePullListing(runCommand("adb -s " + serial + " shell \"cd '" + remoteDir +
+        "' && find . -type f -exec ls -ln --full-time {} +\""));
+    result.files = listing.size();
+
+    // Largest first onto the least loaded stream, so streams finish together
+    sort(listing.begin(), listing.end(), [](auto& a, auto& b) { return a.second > b.second; });
+    streams = max(1, streams);
+    vector<vector<string>> shards(streams);
+    vector<uint64_t> load(streams, 0);
+    vector<string> fallback;
+    for (auto& [name, size] : listing) {
+        if (!streamable(name)) {
+            fallback.push_back(name);
+            continue;
+        }
+        size_t i = min_element(load.begin(), load.end()) - load.begin();
+        shards[i].push_back(name);
+        load[i] += size + 512;
+    }
+
+    struct StreamTotals {
+        size_t files = 0;
+        uint64_t bytes = 0;
+        string error;
+    };
+    ThreadPool pool(streams);
+    vector<future<StreamTotals>> running;
+    for (auto& shard : shards) {
+        if (shard.empty()) continue;
+        running.push_back(pool.submit([&, shard = move(shard)] {
+            // One tar per command-line-sized batch, back to back on this stream
+            StreamTotals totals;
+            size_t next = 0;
+            while (next < shard.size() && totals.error.empty() && !shutdownRequested()) {
+                string cmd = "adb -s " + serial + " exec-out \"cd '" + remoteDir + "' && tar -cf -";
+                for (; next < shard.size(); next++) {
+                    string arg = " './" + shard[next] + "'";
+                    if (cmd.size() + arg.size() > kMaxTarCommand && cmd.back() != '-') break;
+                    cmd += arg;
+                }
+                cmd += "\"";
+                TarExtractor tar(localDir);
+                runCommandStreaming(cmd, [&](const char* data, size_t size) {
+                    if (cap) cap->consume(size);
+                    return tar.feed(data, size) && !shutdownRequested();
+                });
+                totals.files += tar.files;
+                totals.bytes += tar.bytes;
+                totals.error = tar.error;
+            }
+            return totals;
+        }));
+    }
+    for (const string& name : fallback) {
+        fs::path local = fs::path(localDir) / fs::u8path(name);
+        error_code ec;
+        fs::create_directories(local.parent_path(), ec);
+        runCommand("adb -s " + serial + " pull " + hostQuote(remoteDir + "/" + name) + " " + hostQuote(local.string()));
+        if (fs::exists(local, ec)) {
+            result.pulled++;
+            result.bytes += fs::file_size(local, ec);
+        }
+    }
+    for (auto& f : running) {
+        StreamTotals totals = f.get();
+        result.pulled += totals.files;
+        result.bytes += totals.bytes;
+        if (!totals.error.empty()) result.error = totals.error;
+    }
+
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (result.error.empty() && result.pulled < result.files)
+        result.error = to_string(result.files - result.pulled) + " files not pulled";
+    result.ok = result.error.empty();
+    return result;
+}
@@ -0,0 +1,71 @@
+// DirPull.h
+// Pipelined directory pull. Instead of one "adb pull" round trip per file,
+// the device tars batches of files straight into "adb exec-out" and several
+// such streams run per device; the host unpacks them as they arrive with
+// large buffered writes. A shared BandwidthLimiter caps the total rate.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+class BandwidthLimiter;
+
+// Remote file (relative to the pulled directory) and its size.
+using PullListing = std::vector<std::pair<std::string, uint64_t>>;
+
+// Parse "find . -type f -exec ls -ln --full-time {} +" output.
+PullListing parsePullListing(const std::string& output);
+
+// Streaming ustar/GNU/pax extractor. Entries are written below `root`;
+// absolute names and ".." components are rejected.
+class TarExtractor {
+public:
+    explicit TarExtractor(const std::string& root);
+    ~TarExtractor();
+
+    TarExtractor(const TarExtractor&) = delete;
+    TarExtractor& operator=(const TarExtractor&) = delete;
+
+    // Feed the next chunk of the archive; false on a malformed stream.
+    bool feed(const char* data, size_t size);
+    // True once the end-of-archive block was seen and no entry is open.
+    bool finished() const { return ended && !out; }
+
+    size_t files = 0;
+    uint64_t bytes = 0;
+    std::string error;
+
+private:
+    bool startEntry();
+    void closeEntry();
+
+    std::string root;
+    char header[512];
+    size_t headerFill = 0;
+    uint64_t remaining = 0;      // data bytes left in the current entry
+    uint64_t padding = 0;        // block padding after the data
+    char type = 0;
+    std::string meta;            // GNU long name / pax header being collected
+    std::string longName;        // name carried over to the next entry
+    std::FILE* out = nullptr;
+    std::vector<char> outBuffer;
+    bool ended = false;
+};
+
+struct PullResult {
+    std::string serial;
+    size_t files = 0;          // files listed on the device
+    size_t pulled = 0;         // files written locally
+    uint64_t bytes = 0;
+    double seconds = 0.0;
+    bool ok = false;
+    std::string error;
+};
+
+// Pull `remoteDir` from one device into `localDir`, with `streams` tar
+// streams in flight. `cap` may be shared between devices (nullptr = no cap).
+PullResult pullDirectory(const std::string& serial, const std::string& remoteDir,
+    const std::string& localDir, int streams, BandwidthLimiter* cap);
@@ -0,0 +1,213 @@
+// DirSync.cpp
+// Host manifest, device hash diff and batched pushes.
+
+#include "DirSync.h"
+#include "Adb.h"
+#include "Sha256.h"
+#include "ThreadPool.h"
+
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Keep each adb command line well under cmd.exe's 8191 character limit.
+static const size_t kMaxPushCommand = 7000;
+
+// ===== Host manifest =====
+static SyncManifest loadManifestCache(const fs::path& dir) {
+    SyncManifest cache;
+    ifstream in(dir / kManifestCacheName);
+    string line;
+    while (getline(in, line)) {
+        istringstream fields(line);
+        string rel, size, mtime, hash;
+        if (getline(fields, rel, '\t') && getline(fields, size, '\t') &&
+            getline(fields, mtime, '\t') && getline(fields, hash))
+            cache[rel] = { strtoull(size.c_str(), nullptr, 10), strtoll(mtime.c_str(), nullptr, 10), hash };
+    }
+    return cache;
+}
+
+static void saveManifestCache(const fs::path& dir, const SyncManifest& manifest) {
+    fs::path path = dir / kManifestCacheName;
+    {
+        ofstream out(path.string() + ".tmp", ios::trunc);
+        for (auto& [rel, e] : manifest)
+            out << rel << "\t" << e.size << "\t" << e.mtime << "\t" << e.sha256 << "\n";
+    }
+    error_code ec;
+    fs::rename(path.string() + ".tmp", path, ec);
+}
+
+SyncManifest buildHostManifest(const string& localDir) {
+    fs::path root(localDir);
+    SyncManifest cache = loadManifestCache(root);
+    SyncManifest manifest;
+    vector<string> toHash;
+
+    error_code ec;
+    for (auto it = fs::recursive_directory_iterator(root, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (!it->is_regular_file()) continue;
+        string rel = fs::relative(it->path(), root).generic_string();
+        if (rel == kManifestCacheName || rel == string(kManifestCacheName) + ".tmp") continue;
+
+        SyncManifestEntry e;
+        e.size = it->file_size();
+        e.mtime = (int64_t)it->last_write_time().time_since_epoch().count();
+        auto cached = cache.find(rel);
+        if (cached != cache.end() && cached->second.size == e.size && cached->second.mtime == e.mtime)
+            e.sha256 = cached->second.sha256;
+        else
+            toHash.push_back(rel);
+        manifest[rel] = e;
+    }
+
+    ThreadPool pool;
+    vector<future<string>> hashes;
+    for (const string& rel : toHash)
+        hashes.push_back(pool.submit([path = (root / rel).string()] { return sha256File(path); }));
+    for (size_t i = 0; i < toHash.size(); i++)
+        manifest[toHash[i]].sha256 = hashes[i].get();
+
+    if (!toHash.empty() || manifest.size() != cache.size()) saveManifestCache(root, manifest);
+    return manifest;
+}
+
+// ===== Device side =====
+map<string, string> parseDeviceHashes(const string& output) {
+    map<string, string> hashes;
+    istringstream ss(output);
+    string line;
+    while (getline(ss, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.size() < 67 || line[64] != ' ') continue;
+        string rel = line.substr(66);
+        if (rel.rfind("./", 0) == 0) rel = rel.substr(2);
+        hashes[rel] = line.substr(0, 64);
+    }
+    return hashes;
+}
+
+static string parentOf(const string& rel) {
+    size_t slash = rel.rfind('/');
+    return slash == string::npos ? "" : rel.substr(0, slash);
+}
+
+// Single-quoted for the device shell. The whole device command then goes
+// through hostQuote as one argument, so the host shell expands nothing.
+static string deviceQuote(const string& arg) {
+    string quoted = "'";
+    for (char c : arg) {
+        if (c == '\'') quoted += "'\\''";
+        else quoted += c;
+    }
+    return quoted + "'";
+}
+
+// sha256sum escapes names with '\' or newlines, so they would never
+// verify; cmd.exe has no way to quote '"' or '%'.
+static bool syncableName(const string& name) {
+#ifdef _WIN32
+    if (name.find_first_of("\"%") != string::npos) return false;
+#endif
+    return name.find_first_of("\\\n\r") == string::npos;
+}
+
+static string deviceShell(const string& serial, const string& command) {
+    return "adb -s " + serial + " shell " + hostQuote(command);
+}
+
+SyncResult syncToDevice(const string& serial, const string& localDir, const string& remoteDir,
+    const SyncManifest& manifest) {
+    SyncResult result;
+    result.serial = serial;
+    result.files = manifest.size();
+    if (!syncableName(remoteDir)) {
+        result.error = "cannot quote remote directory " + remoteDir;
+        return result;
+    }
+    for (auto& [rel, e] : manifest)
+        if (!syncableName(rel)) {
+            result.error = "cannot quote file name " + rel;
+            return result;
+        }
+
+    // One round trip: create the target and hash everything already there
+    string out = runCommand(deviceShell(serial, "mkdir -p " + deviceQuote(remoteDir) + " && cd " +
+        deviceQuote(remoteDir) + " && find . -type f -exec sha256sum {} +"));
+    map<string, string> deviceHashes = parseDeviceHashes(out);
+
+    map<string, vector<string>> byDir;  // remote subdir -> changed relative paths
+    for (auto& [rel, e] : manifest) {
+        auto it = deviceHashes.find(rel);
+        if (it != deviceHashes.end() && it->second == e.sha256) continue;
+        byDir[parentOf(rel)].push_back(rel);
+        result.changed++;
+    }
+    for (auto& [rel, hash] : deviceHashes)
+        if (!manifest.count(rel)) result.extraOnDevice++;
+
+    if (byDir.empty()) {
+        result.ok = true;
+        return result;
+    }
+
+    // Subdirectories in one batched mkdir
+    string mkdirs;
+    for (auto& [dir, files] : byDir)
+        if (!dir.empty()) mkdirs += " " + deviceQuote(remoteDir + "/" + dir);
+    if (!mkdirs.empty()) runCommand(deviceShell(serial, "mkdir -p" + mkdirs));
+
+    // Many files per adb push: one sync session streams them back to back
+    fs::path root(localDir);
+    for (auto& [dir, files] : byDir) {
+        string target = remoteDir + (dir.empty() ? "" : "/" + dir) + "/";
+        string prefix = "adb -s " + serial + " push";
+        string cmd = prefix;
+        for (size_t i = 0; i < files.size(); i++) {
+            string arg = " " + hostQuote((root / files[i]).string());
+            if (cmd.size() > prefix.size() && cmd.size() + arg.size() + target.size() > kMaxPushCommand) {
+                runCommand(cmd + " " + hostQuote(target));
+                cmd = prefix;
+            }
+            cmd += arg;
+            result.bytesPushed += manifest.at(files[i]).size;
+        }
+        runCommand(cmd + " " + hostQuote(target));
+    }
+
+    // Re-hash every pushed file, in as few shell calls as the length limit allows
+    map<string, string> after;
+    string verifyPrefix = "cd " + deviceQuote(remoteDir) + " && sha256sum", verify;
+    auto flushVerify = [&] {
+        if (verify.empty()) return;
+        for (auto& [rel, hash] : parseDeviceHashes(runCommand(deviceShell(serial, verifyPrefix + verify))))
+            after[rel] = hash;
+        verify.clear();
+    };
+    for (auto& [dir, files] : byDir) {
+        for (const string& rel : files) {
+            string arg = " " + deviceQuote("./" + rel);
+            if (!verify.empty() && deviceShell(serial, verifyPrefix + verify + arg).size() > kMaxPushCommand)
+                flushVerify();
+            verify += arg;
+        }
+    }
+    flushVerify();
+    for (auto& [dir, files] : byDir) {
+        for (const string& rel : files) {
+            auto it = after.find(rel);
+            if (it == after.end() || it->second != manifest.at(rel).sha256) {
+                result.error = "verification failed for " + rel;
+                return result;
+            }
+        }
+    }
+    result.ok = true;
+    return result;
+}
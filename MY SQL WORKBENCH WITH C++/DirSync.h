@@ -0,0 +1,42 @@
+// DirSync.h
+// Incremental host -> device directory sync. The device hashes its copy in
+// one batched shell call, the result is diffed against the host manifest and
+// only missing or changed files are pushed, several per adb push.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+struct SyncManifestEntry {
+    uint64_t size = 0;
+    int64_t mtime = 0;       // host file_time ticks, only used for caching
+    std::string sha256;
+};
+
+// Relative path ('/' separated) -> entry.
+using SyncManifest = std::map<std::string, SyncManifestEntry>;
+
+// Name of the host-side hash cache kept inside the synced directory.
+constexpr const char* kManifestCacheName = ".adfxt-manifest";
+
+// Hash every file under `localDir`, in parallel, reusing cached hashes for
+// files whose size and mtime are unchanged. Updates the cache file.
+SyncManifest buildHostManifest(const std::string& localDir);
+
+// "sha256sum" output ("<hash>  ./rel/path") -> relative path -> hash.
+std::map<std::string, std::string> parseDeviceHashes(const std::string& output);
+
+struct SyncResult {
+    std::string serial;
+    size_t files = 0;          // files in the host manifest
+    size_t changed = 0;        // missing or different on the device
+    uint64_t bytesPushed = 0;
+    size_t extraOnDevice = 0;  // present on the device only (left alone)
+    bool ok = false;
+    std::string error;
+};
+
+SyncResult syncToDevice(const std::string& serial, const std::string& localDir,
+    const std::string& remoteDir, const SyncManifest& manifest);
@@ -0,0 +1,291 @@
+// Drift.cpp
+// Rule compilation and incremental evaluation.
+
+#include "Drift.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+// ===== Compilation =====
+static string trimmed(const string& s) {
+    size_t a = s.find_first_not_of(" \t\r\n");
+    if (a == string::npos) return "";
+    size_t b = s.find_last_not_of(" \t\r\n");
+    return s.substr(a, b - a + 1);
+}
+
+static bool parseNumber(const string& text, double& out) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    out = strtod(text.c_str(), &end);
+    return *end == '\0';
+}
+
+static uint32_t internField(DriftPlan& plan, map<string, uint32_t>& ids, const string& name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) return it->second;
+    uint32_t id = (uint32_t)plan.fields.size();
+    ids[name] = id;
+    plan.fields.push_back(name);
+    plan.dependents.emplace_back();
+    return id;
+}
+
+bool compileDriftRules(const string& text, DriftPlan& plan, string& error) {
+    static const vector<pair<string, DriftRule::Op>> symbols = {
+        { "==", DriftRule::Op::Equal }, { "!=", DriftRule::Op::NotEqual },
+        { "<=", DriftRule::Op::LessEqual }, { ">=", DriftRule::Op::GreaterEqual },
+        { "=", DriftRule::Op::Equal }, { "<", DriftRule::Op::Less },
+        { ">", DriftRule::Op::Greater }, { "~", DriftRule::Op::Match } };
+    static const vector<pair<string, DriftRule::Op>> words = {
+        { "in", DriftRule::Op::In }, { "exists", DriftRule::Op::Exists }, { "absent", DriftRule::Op::Absent },
+        { "changed", DriftRule::Op::Changed } };
+
+    plan = DriftPlan();
+    map<string, uint32_t> ids;
+    int scope = -1;
+    istringstream in(text);
+    string raw;
+    for (int lineNo = 1; getline(in, raw); lineNo++) {
+        string line = trimmed(raw.substr(0, raw.find('#')));
+        if (line.empty()) continue;
+        auto fail = [&](const string& why) {
+            error = "line " + to_string(lineNo) + ": " + why;
+            return false;
+        };
+
+        if (line.front() == '[') {
+            if (line.back() != ']') return fail("unterminated scope");
+            string body = trimmed(line.substr(1, line.size() - 2));
+            if (body == "*") {
+                scope = -1;
+                continue;
+            }
+            size_t eq = body.find('=');
+            if (eq == string::npos || trimmed(body.substr(0, eq)).empty()) return fail("scope must be [FIELD = VALUE] or [*]");
+            plan.scopes.push_back({ internField(plan, ids, trimmed(body.substr(0, eq))), trimmed(body.substr(eq + 1)) });
+            scope = (int)plan.scopes.size() - 1;
+            continue;
+        }
+
+        DriftRule rule;
+        rule.text = line;
+        rule.line = lineNo;
+        rule.scope = scope;
+        size_t label = line.find_first_of(" \t");
+        if (label != string::npos && label > 1 && line[label - 1] == ':') {
+            rule.name = line.substr(0, label - 1);
+            line = trimmed(line.substr(label));
+        }
+        size_t at = line.find_first_of(" \t=!<>~");
+        if (at == 0 || at == string::npos) return fail("expected FIELD OP [VALUE]");
+        string field = line.substr(0, at);
+        at = line.find_first_not_of(" \t", at);
+        bool found = false;
+        for (auto& [sym, op] : symbols)
+            if (line.compare(at, sym.size(), sym) == 0) {
+                rule.op = op;
+                at += sym.size();
+                found = true;
+                break;
+            }
+        for (size_t w = 0; !found && w < words.size(); w++) {
+            const string& word = words[w].first;
+            if (line.compare(at, word.size(), word) == 0 &&
+                (at + word.size() == line.size() || isspace((unsigned char)line[at + word.size()]))) {
+                rule.op = words[w].second;
+                at += word.size();
+                found = true;
+            }
+        }
+        if (!found) return fail("unknown operator");
+        rule.value = trimmed(line.substr(at));
+        if (rule.name.empty()) rule.name = line;
+
+        switch (rule.op) {
+        case DriftRule::Op::Exists:
+        case DriftRule::Op::Absent:
+        case DriftRule::Op::Changed:
+            if (!rule.value.empty()) return fail("exists/absent/changed take no value");
+            break;
+        case DriftRule::Op::Less:
+        case DriftRule::Op::LessEqual:
+        case DriftRule::Op::Greater:
+        case DriftRule::Op::GreaterEqual:
+            if (!parseNumber(rule.value, rule.number)) return fail("numeric comparison needs a number");
+            break;
+        case DriftRule::Op::In: {
+            istringstream list(rule.value);
+            string choice;
+            while (getline(list, choice, ','))
+                if (!trimmed(choice).empty()) rule.choices.push_back(trimmed(choice));
+            if (rule.choices.empty()) return fail("'in' needs a comma separated list");
+            break;
+        }
+        case DriftRule::Op::Match:
+            try {
+                rule.pattern = make_shared<regex>(rule.value, regex::ECMAScript | regex::optimize);
+            } catch (const regex_error& e) {
+                return fail(string("bad regex: ") + e.what());
+            }
+            break;
+        default:
+            break;
+        }
+
+        uint32_t index = (uint32_t)plan.rules.size();
+        rule.field = internField(plan, ids, field);
+        plan.dependents[rule.field].push_back(index);
+        // A scope change can switch the rule on or off
+        if (scope >= 0 && plan.scopes[scope].field != rule.field)
+            plan.dependents[plan.scopes[scope].field].push_back(index);
+        plan.rules.push_back(move(rule));
+    }
+    if (plan.rules.empty()) {
+        error = "no rules";
+        return false;
+    }
+    return true;
+}
+
+bool loadDriftRules(const string& path, DriftPlan& plan, string& error) {
+    ifstream in(path);
+    if (!in) {
+        error = "cannot read " + path;
+        return false;
+    }
+    stringstream text;
+    text << in.rdbuf();
+    if (!compileDriftRules(text.str(), plan, error)) {
+        error = path + ": " + error;
+        return false;
+    }
+    return true;
+}
+
+vector<string> DriftPlan::collectors() const {
+    vector<string> needed;
+    for (const string& name : collectorNames())
+        for (const string& field : fields)
+            if (collectorForField(field) == name) {
+                needed.push_back(name);
+                break;
+            }
+    return needed;
+}
+
+// ===== Evaluation =====
+bool ruleHolds(const DriftPlan& plan, const DriftRule& rule, const vector<string>& values, const vector<char>& present) {
+    if (rule.scope >= 0) {
+        const DriftScope& scope = plan.scopes[rule.scope];
+        if (!present[scope.field] || values[scope.field] != scope.value) return true;  // not applicable
+    }
+    bool has = present[rule.field] != 0;
+    const string& v = values[rule.field];
+    double number;
+    switch (rule.op) {
+    case DriftRule::Op::Changed: return true;
+    case DriftRule::Op::Exists: return has;
+    case DriftRule::Op::Absent: return !has;
+    case DriftRule::Op::Equal: return has && v == rule.value;
+    case DriftRule::Op::NotEqual: return !has || v != rule.value;
+    case DriftRule::Op::In: return has && find(rule.choices.begin(), rule.choices.end(), v) != rule.choices.end();
+    case DriftRule::Op::Match: return has && regex_search(v, *rule.pattern);
+    case DriftRule::Op::Less: return has && parseNumber(v, number) && number < rule.number;
+    case DriftRule::Op::LessEqual: return has && parseNumber(v, number) && number <= rule.number;
+    case DriftRule::Op::Greater: return has && parseNumber(v, number) && number > rule.number;
+    case DriftRule::Op::GreaterEqual: return has && parseNumber(v, number) && number >= rule.number;
+    }
+    return false;
+}
+
+FieldDiff diffFields(const DriftPlan& plan, const FieldMap& fields, bool fresh,
+    vector<string>& values, vector<char>& present) {
+    FieldDiff diff;
+    vector<char> queued(plan.rules.size(), 0);
+    for (uint32_t f = 0; f < plan.fields.size(); f++) {
+        auto found = fields.find(plan.fields[f]);
+        bool has = found != fields.end();
+        if (!fresh && has == (present[f] != 0) && (!has || found->second == values[f])) continue;
+        diff.previous[f] = present[f] ? values[f] : string();
+        present[f] = has;
+        values[f] = has ? found->second : string();
+        for (uint32_t r : plan.dependents[f])
+            if (!queued[r]) {
+                queued[r] = 1;
+                diff.rules.push_back(r);
+            }
+    }
+    sort(diff.rules.begin(), diff.rules.end());
+    return diff;
+}
+
+vector<DriftChange> DriftEngine::update(const string& serial, const FieldMap& fields) {
+    lock_guard<mutex> lock(m);
+    counters.updates++;
+    auto [it, fresh] = devices.try_emplace(serial);
+    DeviceState& dev = it->second;
+    if (fresh) {
+        dev.values.resize(plan.fields.size());
+        dev.present.resize(plan.fields.size(), 0);
+        dev.failing.resize(plan.rules.size(), 0);
+    }
+
+    FieldDiff diff = diffFields(plan, fields, fresh, dev.values, dev.present);
+    counters.fieldsChanged += diff.previous.size();
+
+    vector<DriftChange> changes;
+    for (uint32_t r : diff.rules) {
+        counters.rulesEvaluated++;
+        bool failing = !ruleHolds(plan, plan.rules[r], dev.values, dev.present);
+        if (failing == (dev.failing[r] != 0)) continue;  // a fresh device starts all-passing
+        dev.failing[r] = failing;
+        if (failing) dev.failCount++;
+        else dev.failCount--;
+        uint32_t f = plan.rules[r].field;
+        changes.push_back({ serial, r, failing, dev.values[f], dev.present[f] != 0 });
+    }
+    if (dev.failCount) failingDevices.insert(serial);
+    else failingDevices.erase(serial);
+    return changes;
+}
+
+void DriftEngine::remove(const string& serial) {
+    lock_guard<mutex> lock(m);
+    devices.erase(serial);
+    failingDevices.erase(serial);
+}
+
+bool DriftEngine::compliant(const string& serial) const {
+    lock_guard<mutex> lock(m);
+    return devices.count(serial) && !failingDevices.count(serial);
+}
+
+set<string> DriftEngine::nonCompliant() const {
+    lock_guard<mutex> lock(m);
+    return failingDevices;
+}
+
+vector<uint32_t> DriftEngine::violations(const string& serial) const {
+    lock_guard<mutex> lock(m);
+    vector<uint32_t> out;
+    auto it = devices.find(serial);
+    if (it == devices.end()) return out;
+    for (uint32_t r = 0; r < it->second.failing.size(); r++)
+        if (it->second.failing[r]) out.push_back(r);
+    return out;
+}
+
+size_t DriftEngine::deviceCount() const {
+    lock_guard<mutex> lock(m);
+    return devices.size();
+}
+
+DriftStats DriftEngine::stats() const {
+    lock_guard<mutex> lock(m);
+    return counters;
+}
@@ -0,0 +1,132 @@
+// Drift.h
+// Fleet configuration drift against a golden rule set. Rules are compiled
+// once into a plan that maps each referenced field to the rules reading it.
+// Each new snapshot is compared against the device's previous values for
+// those fields only, and only the rules behind a changed field are
+// re-evaluated. The engine keeps the set of non-compliant devices current
+// as it goes, so compliance queries are lookups.
+//
+// Rules file, one rule per line ('#' starts a comment):
+//   ro.build.fingerprint = google/blueline/blueline:12/SP1A.210812.016/7679548:user/release-keys
+//   ro.build.version.sdk >= 31          (<, <=, >, >= compare numerically)
+//   ro.debuggable != 1
+//   ro.product.model in Pixel 3, Pixel 3 XL
+//   kernel_version ~ ^4\.9\.            (ECMAScript regex, searched)
+//   ro.boot.verifiedbootstate exists    (or: absent)
+//   ro.build.version.sdk changed        (alerts only: the value moved;
+//                                        the drift command rejects it)
+// A rule may start with a "name:" label. A "[FIELD = VALUE]" line scopes
+// the rules after it to devices where FIELD equals VALUE; "[*]" returns to
+// every device. Field names are those of snapshotFields().
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Collectors.h"
+
+struct DriftRule {
+    enum class Op { Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual, In, Match, Exists, Absent, Changed };
+
+    std::string name;            // label, or the rule text without one
+    std::string text;            // the rule line, for reports
+    int line = 0;
+    uint32_t field = 0;          // index into DriftPlan::fields
+    Op op = Op::Equal;
+    std::string value;
+    double number = 0;           // for the numeric comparisons
+    std::vector<std::string> choices;
+    std::shared_ptr<std::regex> pattern;
+    int scope = -1;              // index into DriftPlan::scopes, -1 = every device
+};
+
+struct DriftScope {
+    uint32_t field = 0;
+    std::string value;
+};
+
+struct DriftPlan {
+    std::vector<std::string> fields;              // every field a rule or scope reads
+    std::vector<DriftRule> rules;
+    std::vector<DriftScope> scopes;
+    std::vector<std::vector<uint32_t>> dependents;  // field -> rules to re-evaluate
+
+    // Collectors needed to produce every field.
+    std::vector<std::string> collectors() const;
+};
+
+bool compileDriftRules(const std::string& text, DriftPlan& plan, std::string& error);
+bool loadDriftRules(const std::string& path, DriftPlan& plan, std::string& error);
+
+// Whether `rule` holds for field values indexed like plan.fields. Rules out
+// of their scope hold; "changed" is an event, not a state, and always holds.
+bool ruleHolds(const DriftPlan& plan, const DriftRule& rule,
+    const std::vector<std::string>& values, const std::vector<char>& present);
+
+// Result of diffing a device's stored field values against a new snapshot.
+struct FieldDiff {
+    std::map<uint32_t, std::string> previous;  // changed field -> old value ("" if absent)
+    std::vector<uint32_t> rules;               // rules reading a changed field, ascending
+};
+
+// Diff only the plan's fields, updating `values`/`present` (indexed like
+// plan.fields) in place. With `fresh` every field counts as changed. Shared
+// by the drift and alert engines so both evaluate just the rules behind
+// changed fields.
+FieldDiff diffFields(const DriftPlan& plan, const FieldMap& fields, bool fresh,
+    std::vector<std::string>& values, std::vector<char>& present);
+
+// A rule whose outcome flipped for a device.
+struct DriftChange {
+    std::string serial;
+    uint32_t rule = 0;
+    bool failing = false;
+    std::string actual;          // "" when the field is absent
+    bool present = false;
+};
+
+struct DriftStats {
+    uint64_t updates = 0;
+    uint64_t fieldsChanged = 0;
+    uint64_t rulesEvaluated = 0;
+};
+
+class DriftEngine {
+public:
+    explicit DriftEngine(const DriftPlan& plan) : plan(plan) {}
+
+    // Apply a device's latest snapshot. The first update of a device
+    // reports failing rules only; later ones report every flip.
+    std::vector<DriftChange> update(const std::string& serial, const FieldMap& fields);
+
+    // Forget a device (e.g. it left the fleet).
+    void remove(const std::string& serial);
+
+    bool compliant(const std::string& serial) const;
+    std::set<std::string> nonCompliant() const;
+    // Failing rule indexes of a device.
+    std::vector<uint32_t> violations(const std::string& serial) const;
+    size_t deviceCount() const;
+    DriftStats stats() const;
+
+private:
+    struct DeviceState {
+        std::vector<std::string> values;   // by plan field
+        std::vector<char> present;
+        std::vector<char> failing;         // by rule
+        uint32_t failCount = 0;
+    };
+
+    const DriftPlan& plan;
+    mutable std::mutex m;
+    std::map<std::string, DeviceState> devices;
+    std::set<std::string> failingDevices;
+    DriftStats counters;
+};
@@ -0,0 +1,153 @@
+// DriftTests.cpp
+// compileDriftRules parsing and errors, and DriftEngine re-evaluating only
+// the rules behind changed fields while keeping compliance current.
+
+#include "Drift.h"
+#include "SelfTest.h"
+
+using namespace std;
+
+static const char kRules[] =
+    "# golden rules\n"
+    "sdk: ro.build.version.sdk >= 31\n"
+    "ro.debuggable != 1\n"
+    "ro.product.model in Pixel 3, Pixel 3 XL   # trailing comment\n"
+    "[ro.product.model = Pixel 3]\n"
+    "kernel_version ~ ^4\\.9\\.\n"
+    "[*]\n"
+    "ro.boot.verifiedbootstate exists\n";
+
+static DriftPlan compiled(const string& text) {
+    DriftPlan plan;
+    string error;
+    CHECK(compileDriftRules(text, plan, error));
+    CHECK_EQ(error, "");
+    return plan;
+}
+
+static string compileError(const string& text) {
+    DriftPlan plan;
+    string error;
+    CHECK(!compileDriftRules(text, plan, error));
+    return error;
+}
+
+static FieldMap pixel3() {
+    return { { "ro.build.version.sdk", "31" }, { "ro.debuggable", "0" }, { "ro.product.model", "Pixel 3" },
+        { "kernel_version", "4.9.270-g1" }, { "ro.boot.verifiedbootstate", "green" } };
+}
+
+SELFTEST(drift_compile_parses_rules) {
+    DriftPlan plan = compiled(kRules);
+    CHECK_EQ(plan.rules.size(), (size_t)5);
+    CHECK_EQ(plan.fields.size(), (size_t)5);
+    CHECK_EQ(plan.scopes.size(), (size_t)1);
+
+    const DriftRule& sdk = plan.rules[0];
+    CHECK_EQ(sdk.name, "sdk");
+    CHECK_EQ(sdk.line, 2);
+    CHECK(sdk.op == DriftRule::Op::GreaterEqual);
+    CHECK_EQ(sdk.number, 31.0);
+    CHECK_EQ(plan.fields[sdk.field], "ro.build.version.sdk");
+
+    const DriftRule& models = plan.rules[2];
+    CHECK_EQ(models.name, "ro.product.model in Pixel 3, Pixel 3 XL");
+    CHECK(models.op == DriftRule::Op::In);
+    CHECK(models.choices == vector<string>({ "Pixel 3", "Pixel 3 XL" }));
+
+    const DriftRule& kernel = plan.rules[3];
+    CHECK(kernel.op == DriftRule::Op::Match);
+    CHECK_EQ(kernel.scope, 0);
+    CHECK_EQ(plan.scopes[0].value, "Pixel 3");
+    CHECK_EQ(plan.rules[4].scope, -1);
+
+    // The scope's field also re-evaluates the scoped rule
+    uint32_t model = models.field;
+    CHECK(plan.dependents[model] == vector<uint32_t>({ 2, 3 }));
+    CHECK(plan.dependents[kernel.field] == vector<uint32_t>({ 3 }));
+}
+
+SELFTEST(drift_compile_rejects_bad_rules) {
+    CHECK_EQ(compileError("# nothing\n\n"), "no rules");
+    CHECK_EQ(compileError("ro.a = 1\n[ro.b = 2\n"), "line 2: unterminated scope");
+    CHECK_EQ(compileError("[ro.b]\n"), "line 1: scope must be [FIELD = VALUE] or [*]");
+    CHECK_EQ(compileError("ro.a\n"), "line 1: expected FIELD OP [VALUE]");
+    CHECK_EQ(compileError("ro.a like 1\n"), "line 1: unknown operator");
+    CHECK_EQ(compileError("ro.a existsx\n"), "line 1: unknown operator");
+    CHECK_EQ(compileError("ro.a exists 1\n"), "line 1: exists/absent/changed take no value");
+    CHECK_EQ(compileError("ro.a >= new\n"), "line 1: numeric comparison needs a number");
+    CHECK_EQ(compileError("ro.a in , ,\n"), "line 1: 'in' needs a comma separated list");
+    CHECK(compileError("ro.a ~ (\n").rfind("line 1: bad regex: ", 0) == 0);
+}
+
+SELFTEST(drift_engine_reports_only_flips) {
+    DriftPlan plan = compiled(kRules);
+    DriftEngine engine(plan);
+    FieldMap fields = pixel3();
+    fields["ro.debuggable"] = "1";
+    vector<DriftChange> changes = engine.update("A", fields);
+    CHECK_EQ(changes.size(), (size_t)1);
+    CHECK_EQ(changes[0].rule, 1u);
+    CHECK(changes[0].failing);
+    CHECK_EQ(changes[0].actual, "1");
+    CHECK(!engine.compliant("A"));
+    CHECK_EQ(engine.stats().rulesEvaluated, (uint64_t)5);
+
+    // Nothing changed: no rule is looked at again
+    CHECK(engine.update("A", fields).empty());
+    CHECK_EQ(engine.stats().rulesEvaluated, (uint64_t)5);
+
+    fields["ro.debuggable"] = "0";
+    fields["ro.build.version.sdk"] = "30";
+    changes = engine.update("A", fields);
+    CHECK_EQ(changes.size(), (size_t)2);
+    CHECK(changes[0].rule == 0 && changes[0].failing);
+    CHECK(changes[1].rule == 1 && !changes[1].failing);
+    CHECK_EQ(engine.stats().rulesEvaluated, (uint64_t)7);
+    CHECK(engine.violations("A") == vector<uint32_t>({ 0 }));
+
+    fields.erase("ro.boot.verifiedbootstate");
+    changes = engine.update("A", fields);
+    CHECK_EQ(changes.size(), (size_t)1);
+    CHECK(changes[0].rule == 4 && changes[0].failing && !changes[0].present);
+    CHECK(engine.violations("A") == vector<uint32_t>({ 0, 4 }));
+}
+
+SELFTEST(drift_engine_scoped_rules) {
+    DriftPlan plan = compiled(kRules);
+    DriftEngine engine(plan);
+    FieldMap fields = pixel3();
+    fields["kernel_version"] = "5.4.0";
+    fields["ro.product.model"] = "Pixel 3 XL";
+    // Out of the kernel rule's scope
+    CHECK(engine.update("A", fields).empty());
+    CHECK(engine.compliant("A"));
+
+    // Moving into the scope re-evaluates the kernel rule
+    fields["ro.product.model"] = "Pixel 3";
+    vector<DriftChange> changes = engine.update("A", fields);
+    CHECK_EQ(changes.size(), (size_t)1);
+    CHECK_EQ(changes[0].rule, 3u);
+    CHECK_EQ(changes[0].actual, "5.4.0");
+    CHECK(engine.nonCompliant() == set<string>({ "A" }));
+}
+
+SELFTEST(drift_engine_tracks_fleet_compliance) {
+    DriftPlan plan = compiled(kRules);
+    DriftEngine engine(plan);
+    FieldMap bad = pixel3();
+    bad["ro.product.model"] = "Pixel 4";
+    engine.update("A", pixel3());
+    engine.update("B", bad);
+    engine.update("C", bad);
+    CHECK_EQ(engine.deviceCount(), (size_t)3);
+    CHECK(engine.nonCompliant() == set<string>({ "B", "C" }));
+
+    engine.update("B", pixel3());
+    engine.remove("C");
+    CHECK(engine.nonCompliant().empty());
+    CHECK(engine.compliant("B"));
+    CHECK(!engine.compliant("C"));  // unknown devices are not compliant
+    CHECK(engine.violations("C").empty());
+    CHECK_EQ(engine.deviceCount(), (size_t)2);
+}
@@ -0,0 +1,234 @@
+// FlashPlanner.cpp
+// Mode grouping, slot handling, estimates and plan execution.
+//
+// Only bootloader and radio images need the bootloader itself. Dynamic (logical) partitions need
+// fastbootd. Every other physical partition can be written from either,
+// so it goes wherever the device already is.
+
+#include "FlashPlanner.h"
+#include "Adb.h"
+#include "Process.h"
+#include "Shutdown.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <sstream>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Observed on Pixel-class devices; only used for estimates.
+static const double kRebootBootloaderSec = 8.0;
+static const double kRebootFastbootSec = 15.0;
+static const double kSetActiveSec = 0.5;
+static const double kRebootSec = 2.0;
+
+// Step timeouts: generous multiples of the estimate, plus time for the
+// device to re-enumerate after a reboot.
+static const double kTimeoutFactor = 4.0;
+static const double kTimeoutSlackSec = 60.0;
+
+// ===== Manifest =====
+bool loadFlashManifest(const string& dir, vector<FlashImage>& images, vector<string>& boards, string& error) {
+    images.clear();
+    boards.clear();
+    error_code ec;
+    map<string, FlashImage> byPartition;
+    for (auto it = fs::recursive_directory_iterator(dir, ec); !ec && it != fs::recursive_directory_iterator();
+        it.increment(ec)) {
+        if (!it->is_regular_file()) continue;
+        fs::path path = it->path();
+        if (path.filename() == "android-info.txt") {
+            ifstream in(path);
+            string line;
+            while (getline(in, line)) {
+                if (line.rfind("require board=", 0) != 0) continue;
+                istringstream list(line.substr(14));
+                string board;
+                while (getline(list, board, '|'))
+                    if (!board.empty()) boards.push_back(board);
+            }
+            continue;
+        }
+        if (path.extension() != ".img") continue;
+        string partition = path.stem().string();
+        if (byPartition.count(partition)) {
+            error = "two images for partition " + partition;
+            return false;
+        }
+        byPartition[partition] = { partition, path.string(), it->file_size() };
+    }
+    if (ec) {
+        error = "cannot read " + dir;
+        return false;
+    }
+    for (auto& [name, image] : byPartition) images.push_back(image);
+    if (images.empty()) error = "no .img files in " + dir;
+    return !images.empty();
+}
+
+// ===== Planning =====
+static bool isYes(const map<string, string>& vars, const string& key) {
+    auto it = vars.find(key);
+    return it != vars.end() && it->second == "yes";
+}
+
+static string varOr(const map<string, string>& vars, const string& key, const string& fallback) {
+    auto it = vars.find(key);
+    return it == vars.end() ? fallback : it->second;
+}
+
+vector<string> flashTargets(const vector<string>& serials, bool all, const function<vector<string>()>& listFastboot) {
+    return all || serials.empty() ? listFastboot() : serials;
+}
+
+FlashPlan planFlash(const string& serial, const vector<FlashImage>& images, const map<string, string>& vars,
+    const vector<string>& boards, const FlashPlanOptions& opts) {
+    FlashPlan plan;
+    plan.serial = serial;
+    if (vars.empty()) {
+        plan.ok = false;
+        plan.warnings.push_back("no getvar output; is the device in fastboot?");
+        return plan;
+    }
+
+    string product = varOr(vars, "product", "");
+    if (!boards.empty() && find(boards.begin(), boards.end(), product) == boards.end()) {
+        plan.ok = false;
+        plan.warnings.push_back("images are for " + boards.front() + ", device is " + product);
+    }
+
+    string current = varOr(vars, "current-slot", "");
+    if (current.rfind("_", 0) == 0) current = current.substr(1);
+    string target = opts.targetSlot.empty() ? current : opts.targetSlot;
+    bool slotted = !current.empty() && varOr(vars, "slot-count", "0") != "0";
+    bool otherSlot = slotted && target != current;
+
+    // bootloader sorts before radio, which is the order flash-all uses
+    vector<const FlashImage*> firmware, physical, logical;
+    for (const FlashImage& img : images) {
+        const string& p = img.partition;
+        if (p == "super_empty") {
+            plan.warnings.push_back("super_empty.img skipped: super layout changes are not planned");
+            continue;
+        }
+        // Logical partitions of the inactive slot may not exist yet, so the
+        // current slot's entry answers for both
+        vector<string> names = { p };
+        if (slotted && isYes(vars, "has-slot:" + p)) names = { p + "_" + target, p + "_" + current };
+        auto known = [&](const string& prefix, bool needYes) {
+            for (const string& n : names)
+                if (needYes ? isYes(vars, prefix + n) : vars.count(prefix + n) > 0) return true;
+            return false;
+        };
+        if (p == "bootloader" || p == "radio") firmware.push_back(&img);
+        else if (known("is-logical:", true)) logical.push_back(&img);
+        else {
+            if (!known("partition-size:", false)) plan.warnings.push_back("device reports no partition " + p);
+            physical.push_back(&img);
+        }
+    }
+    sort(firmware.begin(), firmware.end(), [](auto a, auto b) { return a->partition < b->partition; });
+
+    FastbootMode mode = isYes(vars, "is-userspace") ? FastbootMode::Userspace : FastbootMode::Bootloader;
+    string base = "fastboot -s " + serial + (otherSlot ? " --slot " + target : "");
+    auto add = [&](FlashStep step) {
+        step.mode = mode;
+        step.timeoutSeconds = step.estSeconds * kTimeoutFactor + kTimeoutSlackSec;
+        plan.estSeconds += step.estSeconds;
+        plan.steps.push_back(step);
+    };
+    auto switchTo = [&](FastbootMode wanted) {
+        if (mode == wanted) return;
+        bool toBootloader = wanted == FastbootMode::Bootloader;
+        add({ toBootloader ? "reboot-bootloader" : "reboot-fastboot", "", "", mode, 0,
+            toBootloader ? kRebootBootloaderSec : kRebootFastbootSec,
+            "fastboot -s " + serial + (toBootloader ? " reboot bootloader" : " reboot fastboot") });
+        mode = wanted;
+        plan.modeSwitches++;
+    };
+    auto flash = [&](const FlashImage& img) {
+        double mb = img.size / (1024.0 * 1024.0);
+        add({ "flash", img.partition, img.path, mode, img.size, mb / opts.usbMBps + mb / opts.writeMBps,
+            base + " flash " + img.partition + " " + hostQuote(img.path) });
+    };
+
+    auto rebootBootloader = [&] {
+        add({ "reboot-bootloader", "", "", mode, 0, kRebootBootloaderSec, "fastboot -s " + serial + " reboot bootloader" });
+    };
+
+    // A new bootloader (and its partition table) only takes effect after a
+    // reboot; a mode switch or the final reboot counts, so only reboot
+    // explicitly when more bootloader-mode flashing follows.
+    if (!firmware.empty()) {
+        switchTo(FastbootMode::Bootloader);
+        for (size_t i = 0; i < firmware.size(); i++) {
+            if (i > 0) rebootBootloader();
+            flash(*firmware[i]);
+        }
+    }
+    if (!logical.empty()) {
+        if (firmware.empty()) for (const FlashImage* img : physical) flash(*img);
+        switchTo(FastbootMode::Userspace);
+        if (!firmware.empty()) for (const FlashImage* img : physical) flash(*img);
+        for (const FlashImage* img : logical) flash(*img);
+    } else {
+        if (!firmware.empty() && !physical.empty()) rebootBootloader();
+        for (const FlashImage* img : physical) flash(*img);
+    }
+    if (otherSlot) {
+        add({ "set-active", "", "", mode, 0, kSetActiveSec, "fastboot -s " + serial + " set_active " + target });
+        plan.slotSwitches = 1;
+    }
+    if (opts.reboot) add({ "reboot", "", "", mode, 0, kRebootSec, "fastboot -s " + serial + " reboot" });
+    return plan;
+}
+
+// ===== Execution =====
+// Pull an image into the page cache so its download starts at USB speed.
+static void readAhead(const string& path) {
+    ifstream in(path, ios::binary);
+    vector<char> buf(1 << 20);
+    while (in && !shutdownRequested()) in.read(buf.data(), (streamsize)buf.size());
+}
+
+bool executeFlashPlan(const FlashPlan& plan, size_t& failedStep, string& error) {
+    if (!plan.ok) {
+        error = plan.warnings.empty() ? "plan is not executable" : plan.warnings.front();
+        return false;
+    }
+    future<void> prefetch;
+    size_t prefetched = 0;  // steps before this index are warmed or need no image
+    for (size_t i = 0; i < plan.steps.size(); i++) {
+        const FlashStep& step = plan.steps[i];
+        // Overlap: warm the next image while this step runs on the device
+        for (size_t j = max(i + 1, prefetched); j < plan.steps.size(); j++) {
+            if (plan.steps[j].action != "flash") continue;
+            if (prefetch.valid()) prefetch.wait();
+            prefetch = async(launch::async, readAhead, plan.steps[j].image);
+            prefetched = j + 1;
+            break;
+        }
+        TraceSpan span("flash", step.partition.empty() ? step.action : step.action + " " + step.partition);
+        span.arg("serial", plan.serial);
+        string out;
+        int rc = runCommandStreaming(step.command + " 2>&1", [&out](const char* data, size_t size) {
+            out.append(data, size);
+            return !shutdownRequested();
+        }, (int)(step.timeoutSeconds * 1000));
+        size_t failed = out.find("FAILED");
+        if (shutdownRequested() || rc != 0 || failed != string::npos) {
+            failedStep = i;
+            if (shutdownRequested()) error = "cancelled";
+            else if (rc == kProcessTimedOut) error = "timed out after " + to_string((int)step.timeoutSeconds) + " s";
+            else if (failed != string::npos) error = out.substr(failed);
+            else error = "fastboot exited with " + to_string(rc);
+            while (!error.empty() && (error.back() == '\n' || error.back() == '\r')) error.pop_back();
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+// FlashPlanner.h
+// Orders a firmware flash for one device from its "getvar all" state:
+// partitions are grouped by the fastboot mode they need (bootloader or
+// fastbootd), the mode is switched at most once after firmware updates,
+// images go to the target slot directly so the slot is switched at most
+// once, and every step carries a time estimate.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+struct FlashImage {
+    std::string partition;         // file stem: "boot", "system", "bootloader" ...
+    std::string path;
+    uint64_t size = 0;
+};
+
+// *.img files below `dir` (recursively), one per partition. android-info.txt
+// "require board=" lines are returned in `boards`.
+bool loadFlashManifest(const std::string& dir, std::vector<FlashImage>& images, std::vector<std::string>& boards,
+    std::string& error);
+
+enum class FastbootMode { Bootloader, Userspace };
+
+struct FlashStep {
+    std::string action;            // "flash", "reboot-bootloader", "reboot-fastboot", "set-active", "reboot"
+    std::string partition;
+    std::string image;
+    FastbootMode mode = FastbootMode::Bootloader;  // mode the step runs in
+    uint64_t bytes = 0;
+    double estSeconds = 0.0;
+    std::string command;           // fastboot command line
+    double timeoutSeconds = 0.0;   // the step is killed and fails after this
+};
+
+struct FlashPlanOptions {
+    std::string targetSlot;        // "" = current slot
+    bool reboot = true;            // reboot into Android at the end
+    double usbMBps = 40.0;         // download rate estimate
+    double writeMBps = 120.0;      // storage write rate estimate
+};
+
+struct FlashPlan {
+    std::string serial;
+    std::vector<FlashStep> steps;
+    int modeSwitches = 0;
+    int slotSwitches = 0;
+    double estSeconds = 0.0;
+    std::vector<std::string> warnings;
+    bool ok = true;                // false when the plan must not be executed
+};
+
+// Devices to plan for: the serials given with -s, else (or with --all) what
+// `listFastboot` reports. "adb devices" does not show devices in fastboot.
+std::vector<std::string> flashTargets(const std::vector<std::string>& serials, bool all,
+    const std::function<std::vector<std::string>()>& listFastboot);
+
+FlashPlan planFlash(const std::string& serial, const std::vector<FlashImage>& images,
+    const std::map<std::string, std::string>& vars, const std::vector<std::string>& boards,
+    const FlashPlanOptions& opts);
+
+// Run a plan, reading the next image ahead while the current one flashes.
+// A step fails on a non-zero fastboot exit, a FAILED reply or its timeout
+// (fastboot waits forever for a device that never shows up). Stops at the
+// first failing step; `failedStep` is its index.
+bool executeFlashPlan(const FlashPlan& plan, size_t& failedStep, std::string& error);
@@ -0,0 +1,122 @@
+// FlashPlannerTests.cpp
+// planFlash ordering, slot handling and timeouts; executeFlashPlan failure
+// detection.
+
+#include "FlashPlanner.h"
+#include "SelfTest.h"
+
+using namespace std;
+
+static vector<FlashImage> pixelImages() {
+    return { { "bootloader", "bootloader.img", 8u << 20 }, { "radio", "radio.img", 80u << 20 },
+        { "boot", "boot.img", 64u << 20 }, { "system", "system.img", 1024u << 20 } };
+}
+
+static map<string, string> bootloaderVars() {
+    return { { "product", "blueline" }, { "current-slot", "a" }, { "slot-count", "2" },
+        { "has-slot:boot", "yes" }, { "has-slot:system", "yes" },
+        { "partition-size:boot_a", "0x4000000" }, { "is-logical:system_a", "yes" } };
+}
+
+static vector<string> actions(const FlashPlan& plan) {
+    vector<string> out;
+    for (const FlashStep& s : plan.steps) out.push_back(s.partition.empty() ? s.action : s.action + " " + s.partition);
+    return out;
+}
+
+SELFTEST(flash_plan_targets_explicit_serials) {
+    auto listed = [] { return vector<string>{ "LISTED" }; };
+    vector<string> targets = flashTargets({ "ABC" }, false, listed);
+    CHECK(targets == vector<string>({ "ABC" }));
+    CHECK(flashTargets({}, false, listed) == vector<string>({ "LISTED" }));
+    CHECK(flashTargets({ "ABC" }, true, listed) == vector<string>({ "LISTED" }));
+    FlashPlan plan = planFlash(targets[0], pixelImages(), bootloaderVars(), {}, FlashPlanOptions());
+    CHECK_EQ(plan.serial, "ABC");
+}
+
+SELFTEST(flash_plan_without_vars_is_not_executable) {
+    FlashPlan plan = planFlash("S", pixelImages(), {}, {}, FlashPlanOptions());
+    CHECK(!plan.ok);
+    CHECK(plan.steps.empty());
+}
+
+SELFTEST(flash_plan_rejects_other_board) {
+    FlashPlan plan = planFlash("S", pixelImages(), bootloaderVars(), { "oriole" }, FlashPlanOptions());
+    CHECK(!plan.ok);
+    CHECK(!plan.warnings.empty());
+}
+
+SELFTEST(flash_plan_firmware_then_one_switch_to_fastbootd) {
+    FlashPlan plan = planFlash("S", pixelImages(), bootloaderVars(), { "blueline" }, FlashPlanOptions());
+    CHECK(plan.ok);
+    vector<string> want = { "flash bootloader", "reboot-bootloader", "flash radio", "reboot-fastboot",
+        "flash boot", "flash system", "reboot" };
+    CHECK(actions(plan) == want);
+    CHECK_EQ(plan.modeSwitches, 1);
+    CHECK_EQ(plan.slotSwitches, 0);
+    CHECK(plan.steps[4].mode == FastbootMode::Userspace);
+}
+
+SELFTEST(flash_plan_stays_in_fastbootd) {
+    map<string, string> vars = bootloaderVars();
+    vars["is-userspace"] = "yes";
+    FlashPlan plan = planFlash("S", { { "system", "system.img", 1u << 20 } }, vars, {}, FlashPlanOptions());
+    CHECK_EQ(plan.modeSwitches, 0);
+    CHECK(actions(plan) == vector<string>({ "flash system", "reboot" }));
+}
+
+SELFTEST(flash_plan_other_slot_switches_once) {
+    FlashPlanOptions opts;
+    opts.targetSlot = "b";
+    opts.reboot = false;
+    FlashPlan plan = planFlash("S", { { "boot", "boot.img", 1u << 20 } }, bootloaderVars(), {}, opts);
+    CHECK_EQ(plan.slotSwitches, 1);
+    CHECK(actions(plan) == vector<string>({ "flash boot", "set-active" }));
+    CHECK(plan.steps[0].command.find("--slot b") != string::npos);
+    CHECK(plan.steps[1].command.find("set_active b") != string::npos);
+}
+
+SELFTEST(flash_plan_steps_have_timeouts_above_estimate) {
+    FlashPlan plan = planFlash("S", pixelImages(), bootloaderVars(), {}, FlashPlanOptions());
+    for (const FlashStep& s : plan.steps) CHECK(s.timeoutSeconds > s.estSeconds * 2 + 30);
+}
+
+static FlashPlan scriptedPlan(const vector<string>& commands, double timeoutSeconds) {
+    FlashPlan plan;
+    plan.serial = "S";
+    for (const string& c : commands) {
+        FlashStep step;
+        step.action = "reboot";
+        step.command = c;
+        step.timeoutSeconds = timeoutSeconds;
+        plan.steps.push_back(step);
+    }
+    return plan;
+}
+
+SELFTEST(flash_execute_stops_on_exit_code) {
+    size_t failed = 99;
+    string error;
+    CHECK(!executeFlashPlan(scriptedPlan({ "echo ok", "exit 3", "echo never" }, 30), failed, error));
+    CHECK_EQ(failed, (size_t)1);
+    CHECK_EQ(error, "fastboot exited with 3");
+}
+
+SELFTEST(flash_execute_stops_on_failed_reply) {
+    size_t failed = 99;
+    string error;
+    CHECK(!executeFlashPlan(scriptedPlan({ "echo FAILED remote: locked" }, 30), failed, error));
+    CHECK_EQ(failed, (size_t)0);
+    CHECK(error.rfind("FAILED", 0) == 0);
+}
+
+#ifndef _WIN32
+SELFTEST(flash_execute_times_out_waiting_step) {
+    size_t failed = 99;
+    string error;
+    FlashPlan plan = scriptedPlan({ "echo '< waiting for any device >'; sleep 30" }, 0.3);
+    CHECK(!executeFlashPlan(plan, failed, error));
+    CHECK_EQ(failed, (size_t)0);
+    CHECK(error.find("timed out") != string::npos);
+}
+#endif
@@ -0,0 +1,338 @@
+// IoBackend.cpp
+// FileAppender backends. io_uring is used when the kernel allows it
+// (io_uring_setup may be missing or blocked by seccomp); any failure there
+// falls back to plain pwrite for the rest of the appender's life.
+
+#include "IoBackend.h"
+
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define ADFXT_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+using namespace std;
+
+static const size_t kChunkSize = 64 * 1024;
+static const int kChunks = 4;
+
+// ===== io_uring ring (raw syscalls) =====
+#ifdef ADFXT_HAVE_IO_URING
+class Uring {
+public:
+    bool setup(unsigned entries) {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+        if (fd < 0) return false;
+
+        sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        singleMmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap) sqSize = cqSize = max(sqSize, cqSize);
+
+        sqPtr = mmap(nullptr, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqPtr == MAP_FAILED) return fail();
+        cqPtr = singleMmap ? sqPtr
+            : mmap(nullptr, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqPtr == MAP_FAILED) return fail();
+        sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+        sqes = (io_uring_sqe*)mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return fail();
+
+        char* sq = (char*)sqPtr;
+        char* cq = (char*)cqPtr;
+        sqTail = (unsigned*)(sq + p.sq_off.tail);
+        sqMask = *(unsigned*)(sq + p.sq_off.ring_mask);
+        sqArray = (unsigned*)(sq + p.sq_off.array);
+        cqHead = (unsigned*)(cq + p.cq_off.head);
+        cqTail = (unsigned*)(cq + p.cq_off.tail);
+        cqMask = *(unsigned*)(cq + p.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+        capacity = p.sq_entries;
+        return true;
+    }
+
+    ~Uring() { fail(); }
+
+    bool registerBuffers(const iovec* iov, unsigned count) {
+        return syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, iov, count) == 0;
+    }
+
+    // Next free SQE (zeroed); caller submits with submitAndWait.
+    io_uring_sqe* next() {
+        unsigned tail = *sqTail + queued;
+        unsigned idx = tail & sqMask;
+        io_uring_sqe* sqe = &sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sqArray[idx] = idx;
+        queued++;
+        return sqe;
+    }
+
+    // Submit queued SQEs, wait for all their completions and return their
+    // results in submission order (user_data carries the index).
+    bool submitAndWait(vector<int>& results) {
+        unsigned count = queued;
+        __atomic_store_n(sqTail, *sqTail + count, __ATOMIC_RELEASE);
+        queued = 0;
+        results.assign(count, 0);
+
+        unsigned done = 0;
+        unsigned toSubmit = count;
+        while (done < count) {
+            int rc = (int)syscall(__NR_io_uring_enter, fd, toSubmit, count - done, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (rc < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            toSubmit -= min<unsigned>(toSubmit, (unsigned)rc);
+            unsigned head = *cqHead;
+            while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+                io_uring_cqe* cqe = &cqes[head & cqMask];
+                if (cqe->user_data < count) results[cqe->user_data] = cqe->res;
+                head++;
+                done++;
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        }
+        return true;
+    }
+
+    unsigned size() const { return capacity; }
+
+private:
+    bool fail() {
+        if (sqes && sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqPtr && cqPtr != MAP_FAILED && !singleMmap) munmap(cqPtr, cqSize);
+        if (sqPtr && sqPtr != MAP_FAILED) munmap(sqPtr, sqSize);
+        if (fd >= 0) close(fd);
+        sqes = nullptr;
+        sqPtr = cqPtr = nullptr;
+        fd = -1;
+        return false;
+    }
+
+    int fd = -1;
+    void* sqPtr = nullptr;
+    void* cqPtr = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqSize = 0, cqSize = 0, sqesSize = 0;
+    bool singleMmap = false;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+    unsigned capacity = 0;
+    unsigned queued = 0;
+};
+#endif
+
+// ===== Appender state =====
+struct FileAppender::Impl {
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+    uint64_t offset = 0;
+#endif
+    vector<char> staging;  // kChunks * kChunkSize
+    size_t used = 0;
+#ifdef ADFXT_HAVE_IO_URING
+    unique_ptr<Uring> ring;
+#endif
+
+    bool writeStaged(bool sync, string& error);
+};
+
+#ifdef _WIN32
+bool FileAppender::Impl::writeStaged(bool sync, string& error) {
+    size_t pos = 0;
+    while (pos < used) {
+        DWORD wrote = 0;
+        if (!WriteFile(file, staging.data() + pos, (DWORD)(used - pos), &wrote, nullptr)) {
+            error = "WriteFile failed (" + to_string(GetLastError()) + ")";
+            return false;
+        }
+        pos += wrote;
+    }
+    used = 0;
+    if (sync && !FlushFileBuffers(file)) {
+        error = "FlushFileBuffers failed (" + to_string(GetLastError()) + ")";
+        return false;
+    }
+    return true;
+}
+#else
+static bool pwriteAll(int fd, const char* data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t n = pwrite(fd, data, size, (off_t)offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return true;
+}
+
+static bool dataSync(int fd) {
+#ifdef __APPLE__
+    return fsync(fd) == 0;
+#else
+    return fdatasync(fd) == 0;
+#endif
+}
+
+bool FileAppender::Impl::writeStaged(bool sync, string& error) {
+#ifdef ADFXT_HAVE_IO_URING
+    if (ring && used > 0) {
+        // One WRITE_FIXED per registered chunk, linked so they land in
+        // order, with the fdatasync linked after the last write.
+        unsigned writes = 0;
+        vector<size_t> lengths;
+        for (size_t pos = 0; pos < used; pos += kChunkSize) {
+            size_t len = min(kChunkSize, used - pos);
+            io_uring_sqe* sqe = ring->next();
+            sqe->opcode = IORING_OP_WRITE_FIXED;
+            sqe->fd = fd;
+            sqe->addr = (uint64_t)(uintptr_t)(staging.data() + pos);
+            sqe->len = (uint32_t)len;
+            sqe->off = offset + pos;
+            sqe->buf_index = (uint16_t)(pos / kChunkSize);
+            sqe->flags = (sync || pos + len < used) ? IOSQE_IO_LINK : 0;
+            sqe->user_data = writes++;
+            lengths.push_back(len);
+        }
+        if (sync) {
+            io_uring_sqe* sqe = ring->next();
+            sqe->opcode = IORING_OP_FSYNC;
+            sqe->fd = fd;
+            sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+            sqe->user_data = writes;
+        }
+
+        vector<int> results;
+        bool ok = ring->submitAndWait(results);
+        for (unsigned i = 0; ok && i < writes; i++)
+            ok = results[i] == (int)lengths[i];
+        if (ok && sync) ok = results[writes] == 0;
+        if (ok) {
+            offset += used;
+            used = 0;
+            return true;
+        }
+        // Short write, cancelled link or ring error: redo synchronously
+        ring.reset();
+    }
+#endif
+    if (!pwriteAll(fd, staging.data(), used, offset)) {
+        error = string("write failed: ") + strerror(errno);
+        return false;
+    }
+    offset += used;
+    used = 0;
+    if (sync && !dataSync(fd)) {
+        error = string("fdatasync failed: ") + strerror(errno);
+        return false;
+    }
+    return true;
+}
+#endif
+
+// ===== FileAppender =====
+FileAppender::FileAppender(const string& path) : impl(new Impl) {
+    impl->staging.resize(kChunks * kChunkSize);
+#ifdef _WIN32
+    impl->file = CreateFileA(path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, nullptr,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+    impl->fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (impl->fd < 0) return;
+    struct stat st;
+    if (fstat(impl->fd, &st) == 0) impl->offset = (uint64_t)st.st_size;
+
+#ifdef ADFXT_HAVE_IO_URING
+    auto ring = make_unique<Uring>();
+    if (ring->setup(16)) {
+        iovec iov[kChunks];
+        for (int i = 0; i < kChunks; i++) {
+            iov[i].iov_base = impl->staging.data() + (size_t)i * kChunkSize;
+            iov[i].iov_len = kChunkSize;
+        }
+        if (ring->registerBuffers(iov, kChunks)) impl->ring = move(ring);
+    }
+#endif
+#endif
+}
+
+FileAppender::~FileAppender() {
+    string ignored;
+    if (isOpen() && impl->used > 0) impl->writeStaged(false, ignored);
+#ifdef _WIN32
+    if (impl->file != INVALID_HANDLE_VALUE) CloseHandle(impl->file);
+#else
+#ifdef ADFXT_HAVE_IO_URING
+    impl->ring.reset();
+#endif
+    if (impl->fd >= 0) close(impl->fd);
+#endif
+}
+
+bool FileAppender::isOpen() const {
+#ifdef _WIN32
+    return impl->file != INVALID_HANDLE_VALUE;
+#else
+    return impl->fd >= 0;
+#endif
+}
+
+bool FileAppender::append(const char* data, size_t size) {
+    if (!isOpen()) return false;
+    string error;
+    while (size > 0) {
+        if (impl->used == impl->staging.size() && !impl->writeStaged(false, error)) return false;
+        size_t n = min(size, impl->staging.size() - impl->used);
+        memcpy(impl->staging.data() + impl->used, data, n);
+        impl->used += n;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool FileAppender::commit(string& error) {
+    if (!isOpen()) {
+        error = "file is not open";
+        return false;
+    }
+    return impl->writeStaged(true, error);
+}
+
+const char* FileAppender::backendName() const {
+#ifdef _WIN32
+    return "win32";
+#else
+#ifdef ADFXT_HAVE_IO_URING
+    if (impl->ring) return "io_uring";
+#endif
+    return "pwrite";
+#endif
+}
@@ -0,0 +1,42 @@
+// IoBackend.h
+// Batched, durable file appends. Data is staged in memory and written in
+// one submission per commit, with the data sync chained after the writes.
+//   Linux:   io_uring (raw syscalls, no liburing) with registered staging
+//            buffers and write -> fdatasync links
+//   POSIX:   pwrite + fdatasync
+//   Windows: WriteFile + FlushFileBuffers
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+class FileAppender {
+public:
+    // Opens (creating if needed) `path` for appending.
+    explicit FileAppender(const std::string& path);
+    ~FileAppender();
+
+    FileAppender(const FileAppender&) = delete;
+    FileAppender& operator=(const FileAppender&) = delete;
+
+    bool isOpen() const;
+
+    // Stage bytes; they may be written early when staging fills up, but are
+    // only durable after commit().
+    bool append(const char* data, size_t size);
+    bool append(const std::string& data) { return append(data.data(), data.size()); }
+
+    // Write everything staged and sync it to disk in one submission.
+    bool commit(std::string& error);
+
+    // "io_uring", "pwrite" or "win32"
+    const char* backendName() const;
+
+    struct Impl;
+
+private:
+    std::unique_ptr<Impl> impl;
+};
@@ -0,0 +1,29 @@
+// Json.h
+// Minimal JSON string escaping for line-oriented output.
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+inline std::string jsonEscape(const std::string& s) {
+    std::string out;
+    out.reserve(s.size() + 2);
+    for (unsigned char c : s) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            }
+            else out += (char)c;
+        }
+    }
+    return out;
+}
@@ -0,0 +1,483 @@
+// Lease.cpp
+// Lease manager, the daemon around it and the client call.
+
+#include "Lease.h"
+#include "Adb.h"
+#include "Collectors.h"
+#include "Net.h"
+#include "Shutdown.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+static const size_t kLatencySamples = 10000;
+static const int kInventoryMisses = 3;  // consecutive listings without a device before it is dropped
+
+const vector<string>& leaseAttributeNames() {
+    static const vector<string> names = { "serial", "model", "device", "brand", "sdk", "release" };
+    return names;
+}
+
+// ===== Bitsets =====
+void LeaseManager::setBit(Bits& bits, size_t slot, bool on) {
+    if (bits.size() <= slot / 64) bits.resize(slot / 64 + 1, 0);
+    if (on) bits[slot / 64] |= 1ull << (slot % 64);
+    else bits[slot / 64] &= ~(1ull << (slot % 64));
+}
+
+bool LeaseManager::testBit(const Bits& bits, size_t slot) {
+    return slot / 64 < bits.size() && (bits[slot / 64] >> (slot % 64) & 1);
+}
+
+void LeaseManager::indexDevice(size_t slot, bool add) {
+    for (auto& [key, value] : slots[slot].attrs) {
+        Bits& bits = index[key][value];
+        setBit(bits, slot, add);
+        if (!add && all_of(bits.begin(), bits.end(), [](uint64_t w) { return w == 0; })) index[key].erase(value);
+    }
+}
+
+// ===== Inventory =====
+void LeaseManager::updateDevice(const string& serial, const map<string, string>& attrs) {
+    lock_guard<mutex> lock(m);
+    map<string, string> full = attrs;
+    full["serial"] = serial;
+    auto it = slotOf.find(serial);
+    if (it != slotOf.end()) {
+        size_t slot = it->second;
+        if (slots[slot].attrs == full) return;
+        indexDevice(slot, false);
+        slots[slot].attrs = full;
+        indexDevice(slot, true);
+        offer(slot);
+        return;
+    }
+    size_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else {
+        slot = slots.size();
+        slots.emplace_back();
+    }
+    // A device back from a disconnect stays with the lease it had
+    string leaseId;
+    for (auto& [id, lease] : leases)
+        if (lease.serial == serial) leaseId = id;
+    slots[slot] = { serial, full, leaseId, true };
+    slotOf[serial] = slot;
+    indexDevice(slot, true);
+    setBit(available, slot, leaseId.empty());
+    offer(slot);
+}
+
+void LeaseManager::removeDevice(const string& serial) {
+    lock_guard<mutex> lock(m);
+    auto it = slotOf.find(serial);
+    if (it == slotOf.end()) return;
+    size_t slot = it->second;
+    indexDevice(slot, false);
+    setBit(available, slot, false);
+    slots[slot] = Device();
+    slotOf.erase(it);
+    freeSlots.push_back(slot);
+}
+
+vector<string> LeaseManager::devices() const {
+    lock_guard<mutex> lock(m);
+    vector<string> out;
+    for (auto& [serial, slot] : slotOf) out.push_back(serial);
+    sort(out.begin(), out.end());
+    return out;
+}
+
+// ===== Requests =====
+uint64_t LeaseManager::acquire(const LeaseRequest& request, GrantFn onGrant, string& error) {
+    auto t0 = Clock::now();
+    for (auto& [key, value] : request.attrs)
+        if (find(leaseAttributeNames().begin(), leaseAttributeNames().end(), key) == leaseAttributeNames().end()) {
+            error = "unknown attribute " + key;
+            return 0;
+        }
+    if (request.ttlSec <= 0) {
+        error = "ttl must be positive";
+        return 0;
+    }
+
+    lock_guard<mutex> lock(m);
+    uint64_t ticket = nextTicket++;
+    // free & attr1 & attr2 ...; the first set bit is the device
+    Bits candidates = available;
+    for (auto& [key, value] : request.attrs) {
+        const Bits* bits = nullptr;
+        auto byKey = index.find(key);
+        if (byKey != index.end()) {
+            auto match = byKey->second.find(value);
+            if (match != byKey->second.end()) bits = &match->second;
+        }
+        if (!bits) {
+            candidates.clear();
+            break;
+        }
+        for (size_t w = 0; w < candidates.size(); w++) candidates[w] &= w < bits->size() ? (*bits)[w] : 0;
+    }
+    for (size_t w = 0; w < candidates.size(); w++) {
+        if (!candidates[w]) continue;
+        size_t bit = 0;
+        while (!(candidates[w] >> bit & 1)) bit++;
+        Lease lease = grant(w * 64 + bit, request);
+        recordLatency(chrono::duration<double, micro>(Clock::now() - t0).count());
+        onGrant(lease);
+        return ticket;
+    }
+
+    // Queue under the request's shape; equal shapes share one FIFO
+    string key;
+    for (auto& [k, v] : request.attrs) key += k + "=" + v + "\n";
+    Group& group = groups[key];
+    if (group.attrs.empty()) group.attrs.assign(request.attrs.begin(), request.attrs.end());
+    group.waiters.push_back({ ticket, request, move(onGrant) });
+    groupOf[ticket] = key;
+    counters.queued++;
+    counters.waiting++;
+    recordLatency(chrono::duration<double, micro>(Clock::now() - t0).count());
+    return ticket;
+}
+
+bool LeaseManager::cancel(uint64_t ticket) {
+    lock_guard<mutex> lock(m);
+    auto it = groupOf.find(ticket);
+    if (it == groupOf.end()) return false;
+    auto group = groups.find(it->second);
+    deque<Waiter>& waiters = group->second.waiters;
+    waiters.erase(find_if(waiters.begin(), waiters.end(), [&](const Waiter& w) { return w.ticket == ticket; }));
+    if (waiters.empty()) groups.erase(group);
+    groupOf.erase(it);
+    counters.waiting--;
+    return true;
+}
+
+bool LeaseManager::groupMatches(const Group& group, size_t slot) const {
+    for (auto& [key, value] : group.attrs) {
+        auto byKey = index.find(key);
+        if (byKey == index.end()) return false;
+        auto bits = byKey->second.find(value);
+        if (bits == byKey->second.end() || !testBit(bits->second, slot)) return false;
+    }
+    return true;
+}
+
+Lease LeaseManager::grant(size_t slot, const LeaseRequest& request) {
+    if (!leaseSalt) leaseSalt = random_device()() | 1;
+    char id[32];
+    snprintf(id, sizeof(id), "%08x%06llx", leaseSalt, (unsigned long long)++leaseCounter);
+    Lease lease{ id, slots[slot].serial, request.owner, request.ttlSec,
+        Clock::now() + chrono::seconds(request.ttlSec) };
+    leases[lease.id] = lease;
+    deadlines.insert({ lease.expires, lease.id });
+    slots[slot].leaseId = lease.id;
+    setBit(available, slot, false);
+    counters.granted++;
+    return lease;
+}
+
+void LeaseManager::offer(size_t slot) {
+    if (!testBit(available, slot)) return;
+    Group* best = nullptr;
+    for (auto& [key, group] : groups)
+        if ((!best || group.waiters.front().ticket < best->waiters.front().ticket) && groupMatches(group, slot))
+            best = &group;
+    if (!best) return;
+
+    Waiter waiter = move(best->waiters.front());
+    best->waiters.pop_front();
+    string key = groupOf[waiter.ticket];
+    groupOf.erase(waiter.ticket);
+    if (best->waiters.empty()) groups.erase(key);
+    counters.waiting--;
+    waiter.onGrant(grant(slot, waiter.request));
+}
+
+void LeaseManager::endLease(const string& leaseId) {
+    auto it = leases.find(leaseId);
+    if (it == leases.end()) return;
+    deadlines.erase({ it->second.expires, leaseId });
+    auto slot = slotOf.find(it->second.serial);
+    leases.erase(it);
+    if (slot == slotOf.end()) return;
+    slots[slot->second].leaseId.clear();
+    setBit(available, slot->second, true);
+    offer(slot->second);
+}
+
+// ===== Lease lifetime =====
+bool LeaseManager::heartbeat(const string& leaseId, Lease& renewed) {
+    lock_guard<mutex> lock(m);
+    auto it = leases.find(leaseId);
+    if (it == leases.end()) return false;
+    deadlines.erase({ it->second.expires, leaseId });
+    it->second.expires = Clock::now() + chrono::seconds(it->second.ttlSec);
+    deadlines.insert({ it->second.expires, leaseId });
+    renewed = it->second;
+    return true;
+}
+
+bool LeaseManager::release(const string& leaseId) {
+    lock_guard<mutex> lock(m);
+    if (!leases.count(leaseId)) return false;
+    endLease(leaseId);
+    counters.released++;
+    return true;
+}
+
+size_t LeaseManager::expire(Clock::time_point now) {
+    lock_guard<mutex> lock(m);
+    size_t n = 0;
+    while (!deadlines.empty() && deadlines.begin()->first <= now) {
+        endLease(deadlines.begin()->second);
+        n++;
+    }
+    counters.expired += n;
+    return n;
+}
+
+// ===== Reporting =====
+void LeaseManager::recordLatency(double us) {
+    if (latencies.size() < kLatencySamples) latencies.push_back((float)us);
+    else latencies[latencyPos++ % kLatencySamples] = (float)us;
+}
+
+vector<string> LeaseManager::describe() const {
+    lock_guard<mutex> lock(m);
+    vector<string> lines;
+    auto now = Clock::now();
+    for (auto& [serial, slot] : slotOf) {
+        const Device& d = slots[slot];
+        string line = "device " + serial + " state=" + (d.leaseId.empty() ? "free" : "leased");
+        for (auto& [key, value] : d.attrs)
+            if (key != "serial") line += " " + key + "=" + (value.find(' ') != string::npos ? "\"" + value + "\"" : value);
+        auto lease = leases.find(d.leaseId);
+        if (lease != leases.end())
+            line += " lease=" + lease->first + " owner=" + (lease->second.owner.empty() ? "-" : lease->second.owner) +
+                " expires_in=" + to_string(chrono::duration_cast<chrono::seconds>(lease->second.expires - now).count());
+        lines.push_back(line);
+    }
+    for (auto& [id, lease] : leases)
+        if (!slotOf.count(lease.serial))
+            lines.push_back("device " + lease.serial + " state=disconnected lease=" + id + " owner=" +
+                (lease.owner.empty() ? "-" : lease.owner) + " expires_in=" +
+                to_string(chrono::duration_cast<chrono::seconds>(lease.expires - now).count()));
+    sort(lines.begin(), lines.end());
+    return lines;
+}
+
+LeaseStats LeaseManager::stats() const {
+    lock_guard<mutex> lock(m);
+    LeaseStats st = counters;
+    vector<float> sorted = latencies;
+    sort(sorted.begin(), sorted.end());
+    if (!sorted.empty()) {
+        st.matchP50Us = sorted[sorted.size() / 2];
+        st.matchP99Us = sorted[min(sorted.size() - 1, sorted.size() * 99 / 100)];
+    }
+    return st;
+}
+
+// ===== Protocol =====
+vector<string> splitLeaseWords(const string& line) {
+    vector<string> words;
+    string word;
+    bool quoted = false, any = false;
+    for (char c : line) {
+        if (c == '"') {
+            quoted = !quoted;
+            any = true;
+        }
+        else if ((c == ' ' || c == '\t') && !quoted) {
+            if (any) words.push_back(word);
+            word.clear();
+            any = false;
+        }
+        else {
+            word += c;
+            any = true;
+        }
+    }
+    if (any) words.push_back(word);
+    return words;
+}
+
+static string handleRequest(LeaseManager& manager, const vector<string>& words) {
+    string verb = words[0];
+    transform(verb.begin(), verb.end(), verb.begin(), [](unsigned char c) { return (char)toupper(c); });
+
+    if (verb == "ACQUIRE") {
+        LeaseRequest request;
+        int waitSec = 0;
+        for (size_t i = 1; i < words.size(); i++) {
+            size_t eq = words[i].find('=');
+            if (eq == string::npos) return "ERR expected KEY=VALUE: " + words[i];
+            string key = words[i].substr(0, eq), value = words[i].substr(eq + 1);
+            if (key == "ttl") request.ttlSec = atoi(value.c_str());
+            else if (key == "wait") waitSec = atoi(value.c_str());
+            else if (key == "owner") request.owner = value;
+            else request.attrs[key] = value;
+        }
+
+        struct Pending {
+            mutex m;
+            condition_variable cv;
+            bool granted = false;
+            Lease lease;
+        };
+        auto pending = make_shared<Pending>();
+        string error;
+        uint64_t ticket = manager.acquire(request, [pending](const Lease& lease) {
+            lock_guard<mutex> lock(pending->m);
+            pending->lease = lease;
+            pending->granted = true;
+            pending->cv.notify_all();
+        }, error);
+        if (!ticket) return "ERR " + error;
+
+        bool granted;
+        {
+            unique_lock<mutex> lock(pending->m);
+            granted = pending->cv.wait_until(lock, Clock::now() + chrono::seconds(waitSec),
+                [&] { return pending->granted || shutdownRequested(); }) && pending->granted;
+        }
+        // cancel() takes the manager lock, so never while holding ours
+        if (!granted && manager.cancel(ticket)) return "ERR no matching device free";
+        lock_guard<mutex> lock(pending->m);
+        const Lease& lease = pending->lease;
+        return "OK lease=" + lease.id + " serial=" + lease.serial + " ttl=" + to_string(lease.ttlSec);
+    }
+    if ((verb == "HEARTBEAT" || verb == "RELEASE") && words.size() == 2) {
+        Lease lease;
+        if (verb == "RELEASE") return manager.release(words[1]) ? "OK" : "ERR unknown-lease";
+        return manager.heartbeat(words[1], lease) ? "OK ttl=" + to_string(lease.ttlSec) : "ERR unknown-lease";
+    }
+    if (verb == "STATUS") {
+        string out;
+        for (const string& line : manager.describe()) out += line + "\n";
+        LeaseStats st = manager.stats();
+        char stats[256];
+        snprintf(stats, sizeof(stats),
+            "stats granted=%llu queued=%llu waiting=%llu expired=%llu released=%llu match_p50_us=%.1f match_p99_us=%.1f",
+            (unsigned long long)st.granted, (unsigned long long)st.queued, (unsigned long long)st.waiting,
+            (unsigned long long)st.expired, (unsigned long long)st.released, st.matchP50Us, st.matchP99Us);
+        return out + stats + "\nEND";
+    }
+    return "ERR unknown command " + words[0];
+}
+
+static void serveClient(shared_ptr<LeaseManager> manager, SocketHandle sock) {
+    string buffer, line;
+    while (recvLine(sock, buffer, line)) {
+        vector<string> words = splitLeaseWords(line);
+        if (words.empty()) continue;
+        string reply = handleRequest(*manager, words);
+        if (!sendAll(sock, reply + "\n")) {
+            // The client is gone; do not leave a device leased to nobody
+            if (reply.compare(0, 9, "OK lease=") == 0) manager->release(splitLeaseWords(reply)[1].substr(6));
+            break;
+        }
+    }
+    closeSocket(sock);
+}
+
+// ===== Daemon =====
+int runLeaseDaemon(int port, int refreshMs) {
+    string error;
+    SocketHandle listener = tcpListen(port, error);
+    if (listener == kNoSocket) {
+        cerr << "[FAIL] " << error << "\n";
+        return 1;
+    }
+    // Shared with detached client threads, which may outlive this frame
+    auto manager = make_shared<LeaseManager>();
+
+    thread inventory([manager, refreshMs] {
+        struct Tracked {
+            int misses = 0;
+            bool described = false;    // props collected; retried every round until then
+        };
+        map<string, Tracked> known;
+        while (!shutdownRequested()) {
+            vector<string> now = listDevices();
+            for (const string& serial : now) {
+                bool added = !known.count(serial);
+                Tracked& t = known[serial];
+                t.misses = 0;
+                if (t.described) continue;
+                DeviceSnapshot snap = collectDevice(serial, { "props" });
+                map<string, string> attrs;
+                for (auto [attr, prop] : { pair<const char*, const char*>("model", "ro.product.model"),
+                         { "device", "ro.product.device" }, { "brand", "ro.product.brand" },
+                         { "sdk", "ro.build.version.sdk" }, { "release", "ro.build.version.release" } }) {
+                    auto it = snap.props.find(prop);
+                    if (it != snap.props.end() && !it->second.empty()) attrs[attr] = it->second;
+                }
+                t.described = !attrs.empty();
+                manager->updateDevice(serial, attrs);
+                if (added) cerr << "[OK] lease: device " << serial << " available\n";
+                if (!t.described && added) cerr << "[WARN] lease: no properties from " << serial << " yet, matching by serial only\n";
+            }
+            // One missed listing is often a USB hiccup; drop a device only
+            // after several in a row
+            for (auto it = known.begin(); it != known.end();) {
+                if (find(now.begin(), now.end(), it->first) != now.end() || ++it->second.misses < kInventoryMisses) {
+                    ++it;
+                    continue;
+                }
+                manager->removeDevice(it->first);
+                cerr << "[WARN] lease: device " << it->first << " disconnected\n";
+                it = known.erase(it);
+            }
+            for (int waited = 0; waited < refreshMs && !shutdownRequested(); waited += 50)
+                this_thread::sleep_for(chrono::milliseconds(50));
+        }
+    });
+    thread reaper([manager] {
+        while (!shutdownRequested()) {
+            manager->expire(Clock::now());
+            this_thread::sleep_for(chrono::milliseconds(50));
+        }
+    });
+
+    cerr << "[OK] lease daemon listening on 127.0.0.1:" << port << "\n";
+    while (!shutdownRequested()) {
+        SocketHandle client = tcpAccept(listener);
+        if (client == kNoSocket) continue;
+        thread(serveClient, manager, client).detach();
+    }
+    closeSocket(listener);
+    inventory.join();
+    reaper.join();
+    return 0;
+}
+
+bool leaseCall(int port, const string& line, int timeoutMs, vector<string>& reply, string& error) {
+    SocketHandle sock = tcpConnect("127.0.0.1", port, timeoutMs, error);
+    if (sock == kNoSocket) return false;
+    bool ok = sendAll(sock, line + "\n");
+    string buffer, answer;
+    bool multi = line.compare(0, 6, "STATUS") == 0;
+    while (ok && (ok = recvLine(sock, buffer, answer))) {
+        if (multi && answer == "END") break;
+        reply.push_back(answer);
+        if (!multi) break;
+    }
+    closeSocket(sock);
+    if (!ok) error = "no reply from the lease daemon on port " + to_string(port);
+    return ok;
+}
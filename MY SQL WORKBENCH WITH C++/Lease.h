@@ -0,0 +1,145 @@
+// Lease.h
+// Device leasing for CI. The manager keeps the device inventory indexed by
+// attribute (one bitset of device slots per attribute value) next to a
+// bitset of free devices, so matching a request is a few word-wise ANDs.
+// Waiting requests are grouped by their attribute set; a device that comes
+// free is offered to the group with the oldest waiting request among the
+// groups it matches, so the cost follows the number of distinct request
+// shapes, not the queue length. Leases expire unless renewed by heartbeats.
+//
+// Daemon protocol (text lines over TCP on 127.0.0.1):
+//   ACQUIRE [ttl=SEC] [wait=SEC] [owner=NAME] [model=..] [sdk=..] ...
+//       -> OK lease=ID serial=SERIAL ttl=SEC | ERR reason
+//       (waits up to `wait` seconds for a matching device)
+//   HEARTBEAT ID  -> OK ttl=SEC | ERR unknown-lease
+//   RELEASE ID    -> OK | ERR unknown-lease
+//   STATUS        -> "device ..." and "stats ..." lines, then END
+// Values containing spaces are double-quoted: model="Pixel 3".
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Attributes a request can match on.
+const std::vector<std::string>& leaseAttributeNames();
+
+struct LeaseRequest {
+    std::map<std::string, std::string> attrs;  // exact matches, all required
+    std::string owner;
+    int ttlSec = 600;
+};
+
+struct Lease {
+    std::string id;
+    std::string serial;
+    std::string owner;
+    int ttlSec = 0;
+    std::chrono::steady_clock::time_point expires;
+};
+
+struct LeaseStats {
+    uint64_t granted = 0;
+    uint64_t queued = 0;           // requests that had to wait
+    uint64_t expired = 0;
+    uint64_t released = 0;
+    uint64_t waiting = 0;          // requests waiting now
+    double matchP50Us = 0;         // time to match or queue one request
+    double matchP99Us = 0;
+};
+
+class LeaseManager {
+public:
+    using GrantFn = std::function<void(const Lease&)>;
+
+    // Add a device or refresh its attributes.
+    void updateDevice(const std::string& serial, const std::map<std::string, std::string>& attrs);
+    // The device left. Its lease (if any) runs on until released or expired
+    // and is still held by the device if it comes back.
+    void removeDevice(const std::string& serial);
+    std::vector<std::string> devices() const;
+
+    // Grant a matching free device now or queue the request. `onGrant` runs
+    // under the manager's lock (it must not call back into the manager).
+    // Returns a ticket for cancel(), or 0 with `error` for a bad request.
+    uint64_t acquire(const LeaseRequest& request, GrantFn onGrant, std::string& error);
+    // Withdraw a waiting request; false if it was already granted.
+    bool cancel(uint64_t ticket);
+
+    bool heartbeat(const std::string& leaseId, Lease& renewed);
+    bool release(const std::string& leaseId);
+    // Reclaim leases whose time ran out; returns how many.
+    size_t expire(std::chrono::steady_clock::time_point now);
+
+    // One line per device: serial, attributes, free/leased, lease and owner.
+    std::vector<std::string> describe() const;
+    LeaseStats stats() const;
+
+private:
+    using Bits = std::vector<uint64_t>;
+
+    struct Device {
+        std::string serial;
+        std::map<std::string, std::string> attrs;
+        std::string leaseId;           // "" = free
+        bool present = false;
+    };
+
+    struct Waiter {
+        uint64_t ticket = 0;
+        LeaseRequest request;
+        GrantFn onGrant;
+    };
+
+    struct Group {
+        std::vector<std::pair<std::string, std::string>> attrs;
+        std::deque<Waiter> waiters;    // tickets are increasing, so the front is the oldest
+    };
+
+    static void setBit(Bits& bits, size_t slot, bool on);
+    static bool testBit(const Bits& bits, size_t slot);
+    void indexDevice(size_t slot, bool add);
+    bool groupMatches(const Group& group, size_t slot) const;
+    Lease grant(size_t slot, const LeaseRequest& request);
+    void offer(size_t slot);           // hand a free device to the oldest matching waiter
+    void endLease(const std::string& leaseId);
+    void recordLatency(double us);
+
+    mutable std::mutex m;
+    std::vector<Device> slots;
+    std::unordered_map<std::string, size_t> slotOf;
+    std::vector<size_t> freeSlots;     // reusable slot numbers
+    Bits available;                    // present and not leased
+    std::unordered_map<std::string, std::unordered_map<std::string, Bits>> index;  // attr -> value -> slots
+    std::map<std::string, Group> groups;                // by canonical attribute string
+    std::unordered_map<uint64_t, std::string> groupOf;  // waiting ticket -> group
+    std::unordered_map<std::string, Lease> leases;
+    std::set<std::pair<std::chrono::steady_clock::time_point, std::string>> deadlines;
+    uint64_t nextTicket = 1;
+    uint64_t leaseCounter = 0;
+    uint32_t leaseSalt = 0;
+    LeaseStats counters;
+    std::vector<float> latencies;      // ring of recent match times, us
+    size_t latencyPos = 0;
+};
+
+// Serve the protocol on 127.0.0.1:port until shutdown. The inventory is
+// refreshed from adb every `refreshMs`; a device is dropped after missing
+// three listings in a row.
+int runLeaseDaemon(int port, int refreshMs);
+
+// Send one request line to the daemon and collect the reply (every line up
+// to END for STATUS), waiting up to `timeoutMs` for it.
+bool leaseCall(int port, const std::string& line, int timeoutMs, std::vector<std::string>& reply,
+    std::string& error);
+
+// Split "KEY=VALUE" / KEY="VALUE WITH SPACES" words.
+std::vector<std::string> splitLeaseWords(const std::string& line);
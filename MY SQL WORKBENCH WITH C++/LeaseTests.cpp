@@ -0,0 +1,176 @@
+// LeaseTests.cpp
+// LeaseManager matching, queueing and hand-off, lease lifetime across
+// disconnects, and the allocation benchmark (selftest --bench).
+
+#include "Lease.h"
+#include "SelfTest.h"
+
+#include <iostream>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+// Requests the manager and records what it granted
+struct Grants {
+    vector<Lease> leases;
+
+    uint64_t acquire(LeaseManager& manager, const map<string, string>& attrs, int ttlSec = 600) {
+        LeaseRequest request;
+        request.attrs = attrs;
+        request.ttlSec = ttlSec;
+        string error;
+        return manager.acquire(request, [this](const Lease& lease) { leases.push_back(lease); }, error);
+    }
+};
+
+static void addPixels(LeaseManager& manager) {
+    manager.updateDevice("A", { { "model", "Pixel 3" }, { "sdk", "31" } });
+    manager.updateDevice("B", { { "model", "Pixel 4" }, { "sdk", "33" } });
+}
+
+SELFTEST(lease_grants_exact_match) {
+    LeaseManager manager;
+    addPixels(manager);
+    Grants g;
+    CHECK(g.acquire(manager, { { "model", "Pixel 4" } }));
+    CHECK(g.acquire(manager, { { "sdk", "31" } }));
+    CHECK_EQ(g.leases.size(), (size_t)2);
+    CHECK_EQ(g.leases[0].serial, "B");
+    CHECK_EQ(g.leases[1].serial, "A");
+    CHECK(g.leases[0].id != g.leases[1].id);
+}
+
+SELFTEST(lease_rejects_bad_requests) {
+    LeaseManager manager;
+    addPixels(manager);
+    LeaseRequest request;
+    string error;
+    request.attrs["colour"] = "red";
+    CHECK_EQ(manager.acquire(request, [](const Lease&) {}, error), 0u);
+    CHECK_EQ(error, "unknown attribute colour");
+    request.attrs.clear();
+    request.ttlSec = 0;
+    CHECK_EQ(manager.acquire(request, [](const Lease&) {}, error), 0u);
+}
+
+SELFTEST(lease_release_hands_off_to_oldest_waiter) {
+    LeaseManager manager;
+    manager.updateDevice("A", { { "model", "Pixel 3" }, { "sdk", "31" } });
+    Grants g;
+    g.acquire(manager, {});
+    // Two shapes that both match A; the older ticket wins
+    uint64_t first = g.acquire(manager, { { "sdk", "31" } });
+    g.acquire(manager, { { "model", "Pixel 3" } });
+    CHECK_EQ(g.leases.size(), (size_t)1);
+    CHECK_EQ(manager.stats().waiting, 2u);
+
+    CHECK(manager.release(g.leases[0].id));
+    CHECK_EQ(g.leases.size(), (size_t)2);
+    CHECK_EQ(manager.stats().waiting, 1u);
+    CHECK(!manager.cancel(first));
+    CHECK(!manager.release(g.leases[0].id));
+}
+
+SELFTEST(lease_cancel_withdraws_waiter) {
+    LeaseManager manager;
+    manager.updateDevice("A", {});
+    Grants g;
+    g.acquire(manager, {});
+    uint64_t ticket = g.acquire(manager, { { "serial", "A" } });
+    CHECK(manager.cancel(ticket));
+    CHECK(!manager.cancel(ticket));
+    manager.release(g.leases[0].id);
+    CHECK_EQ(g.leases.size(), (size_t)1);
+    CHECK_EQ(manager.stats().waiting, 0u);
+}
+
+SELFTEST(lease_expiry_frees_device) {
+    LeaseManager manager;
+    manager.updateDevice("A", {});
+    Grants g;
+    g.acquire(manager, {}, 1);
+    g.acquire(manager, {});
+    CHECK_EQ(manager.expire(Clock::now()), (size_t)0);
+    CHECK_EQ(manager.expire(Clock::now() + chrono::seconds(2)), (size_t)1);
+    CHECK_EQ(g.leases.size(), (size_t)2);
+    CHECK_EQ(g.leases[1].serial, "A");
+}
+
+SELFTEST(lease_survives_disconnect) {
+    LeaseManager manager;
+    manager.updateDevice("A", { { "model", "Pixel 3" } });
+    Grants g;
+    g.acquire(manager, {});
+    manager.removeDevice("A");
+    CHECK(manager.devices().empty());
+    Lease renewed;
+    CHECK(manager.heartbeat(g.leases[0].id, renewed));
+    vector<string> status = manager.describe();
+    CHECK_EQ(status.size(), (size_t)1);
+    CHECK(status[0].find("state=disconnected lease=" + g.leases[0].id) != string::npos);
+
+    // Back again: still leased, so a new request has to wait for it
+    manager.updateDevice("A", { { "model", "Pixel 3" } });
+    g.acquire(manager, { { "serial", "A" } });
+    CHECK_EQ(g.leases.size(), (size_t)1);
+    CHECK(manager.release(g.leases[0].id));
+    CHECK_EQ(g.leases.size(), (size_t)2);
+}
+
+SELFTEST(lease_of_gone_device_expires) {
+    LeaseManager manager;
+    manager.updateDevice("A", {});
+    Grants g;
+    g.acquire(manager, {}, 1);
+    manager.removeDevice("A");
+    CHECK_EQ(manager.expire(Clock::now() + chrono::seconds(2)), (size_t)1);
+    CHECK(manager.describe().empty());
+}
+
+// `devices` devices all leased, then `queued` requests over 60 shapes
+static void leaseAllThenQueue(LeaseManager& manager, Grants& g, int devices, int queued) {
+    const char* models[] = { "Pixel 3", "Pixel 4", "Pixel 5", "Pixel 6", "Pixel 7" };
+    for (int i = 0; i < devices; i++)
+        manager.updateDevice("D" + to_string(i), { { "model", models[i % 5] }, { "sdk", to_string(28 + i % 6) },
+            { "brand", i % 2 ? "google" : "other" } });
+    for (int i = 0; i < devices; i++) g.acquire(manager, {});
+    for (int i = 0; i < queued; i++)
+        g.acquire(manager, { { "model", models[i % 5] }, { "sdk", to_string(28 + i % 6) }, { "brand", i % 2 ? "google" : "other" } });
+}
+
+SELFTEST(lease_release_serves_queued_shapes) {
+    LeaseManager manager;
+    Grants g;
+    leaseAllThenQueue(manager, g, 120, 200);
+    CHECK_EQ(g.leases.size(), (size_t)120);
+    CHECK_EQ(manager.stats().waiting, 200u);
+
+    vector<string> ids;
+    for (const Lease& lease : g.leases) ids.push_back(lease.id);
+    for (const string& id : ids) CHECK(manager.release(id));
+    // Each released device matches exactly one shape, whose oldest waiter gets it
+    CHECK_EQ(g.leases.size(), (size_t)240);
+    CHECK_EQ(manager.stats().waiting, 80u);
+    for (size_t i = 120; i < g.leases.size(); i++) CHECK(!g.leases[i].serial.empty());
+}
+
+// Match latency from the manager's own stats and the mean release + hand-off
+SELFBENCH(lease_bench_allocation) {
+    const int devices = 3000, queued = 5000;
+    LeaseManager manager;
+    Grants g;
+    leaseAllThenQueue(manager, g, devices, queued);
+    LeaseStats st = manager.stats();
+    CHECK_EQ(g.leases.size(), (size_t)devices);
+    CHECK_EQ(st.waiting, (uint64_t)queued);
+
+    vector<string> ids;
+    for (const Lease& lease : g.leases) ids.push_back(lease.id);
+    auto t0 = Clock::now();
+    for (const string& id : ids) manager.release(id);
+    double handoffUs = chrono::duration<double, micro>(Clock::now() - t0).count() / devices;
+    CHECK_EQ(g.leases.size(), (size_t)devices * 2);
+
+    cerr << "    " << devices << " devices, " << queued << " queued: match p50 " << st.matchP50Us << " us, p99 "
+         << st.matchP99Us << " us; release + hand-off " << handoffUs << " us\n";
+}
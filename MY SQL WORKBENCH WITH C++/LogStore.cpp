@@ -0,0 +1,411 @@
+// LogStore.cpp
+// Segment format, index construction and the parallel search.
+//
+// Segment file (little-endian):
+//   "ADLS" | version u32 | lines u32 | raw size u32 | compressed size u32 |
+//   reserved u32 | first ms i64 | last ms i64 | tag bloom | pid bloom |
+//   trigram bitmap | compressed lines
+
+#include "LogStore.h"
+#include "Compress.h"
+#include "SerialDir.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <regex>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static const size_t kSegmentBytes = 4 << 20;
+static const size_t kBloomBits = 4096;
+static const int kBloomHashes = 3;
+static const int kTrigramBits = 19;
+static const size_t kHeaderBytes = 40;
+static const size_t kIndexBytes = kHeaderBytes + 2 * (kBloomBits / 8) + (1u << kTrigramBits) / 8;
+
+// ===== Index helpers =====
+static uint64_t fnv1a64(const char* p, size_t n) {
+    uint64_t h = 1469598103934665603ull;
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static void bloomAdd(uint8_t* bloom, const string& key) {
+    uint64_t h = fnv1a64(key.data(), key.size());
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;
+    for (int i = 0; i < kBloomHashes; i++) {
+        uint32_t bit = (h1 + i * h2) % kBloomBits;
+        bloom[bit / 8] |= 1 << (bit % 8);
+    }
+}
+
+static bool bloomMayContain(const uint8_t* bloom, const string& key) {
+    uint64_t h = fnv1a64(key.data(), key.size());
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;
+    for (int i = 0; i < kBloomHashes; i++) {
+        uint32_t bit = (h1 + i * h2) % kBloomBits;
+        if (!(bloom[bit / 8] & (1 << (bit % 8)))) return false;
+    }
+    return true;
+}
+
+static inline uint8_t lowerAscii(uint8_t c) {
+    return c >= 'A' && c <= 'Z' ? c + 32 : c;
+}
+
+static inline uint32_t trigramBit(uint8_t a, uint8_t b, uint8_t c) {
+    return ((uint32_t)a << 16 | (uint32_t)b << 8 | c) * 2654435761u >> (32 - kTrigramBits);
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+static void put64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+static uint32_t get32(const uint8_t* p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) v = v << 8 | p[i];
+    return v;
+}
+
+bool parseLogcatLine(const string& line, string& tag, int& pid) {
+    // date time pid tid level tag: message
+    size_t at = 0;
+    auto field = [&](string& out) {
+        at = line.find_first_not_of(' ', at);
+        if (at == string::npos) return false;
+        size_t end = line.find(' ', at);
+        if (end == string::npos) return false;
+        out = line.substr(at, end - at);
+        at = end;
+        return true;
+    };
+    string date, time, pidText, tid, level;
+    if (!field(date) || !field(time) || !field(pidText) || !field(tid) || !field(level) || level.size() != 1)
+        return false;
+    size_t start = line.find_first_not_of(' ', at);
+    size_t colon = line.find(": ", start);
+    if (start == string::npos || colon == string::npos) return false;
+    tag = line.substr(start, colon - start);
+    tag.erase(tag.find_last_not_of(' ') + 1);
+    pid = atoi(pidText.c_str());
+    return true;
+}
+
+// ===== Writer =====
+static int64_t nowMs() {
+    return chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+LogWriter::LogWriter(const string& root, const string& serial)
+    : dir((fs::path(root) / serialDirName(serial)).string()) {
+    error_code ec;
+    fs::create_directories(dir, ec);
+}
+
+LogWriter::~LogWriter() {
+    string error;
+    flush(error);
+}
+
+void LogWriter::append(const string& line) {
+    if (buffer.empty()) firstMs = nowMs();
+    lastMs = nowMs();
+    buffer += line;
+    buffer += '\n';
+    lines++;
+    if (buffer.size() >= kSegmentBytes) {
+        string error;
+        flush(error);
+    }
+}
+
+bool LogWriter::flush(string& error) {
+    if (buffer.empty()) return true;
+    vector<uint8_t> index(kIndexBytes, 0);
+    uint8_t* tagBloom = index.data() + kHeaderBytes;
+    uint8_t* pidBloom = tagBloom + kBloomBits / 8;
+    uint8_t* trigrams = pidBloom + kBloomBits / 8;
+
+    uint32_t lineCount = 0;
+    for (size_t start = 0; start < buffer.size();) {
+        size_t end = buffer.find('\n', start);
+        string line = buffer.substr(start, end - start);
+        string tag;
+        int pid;
+        if (parseLogcatLine(line, tag, pid)) {
+            bloomAdd(tagBloom, tag);
+            bloomAdd(pidBloom, to_string(pid));
+        }
+        lineCount++;
+        start = end + 1;
+    }
+    const uint8_t* text = (const uint8_t*)buffer.data();
+    for (size_t i = 0; i + 2 < buffer.size(); i++) {
+        uint32_t bit = trigramBit(lowerAscii(text[i]), lowerAscii(text[i + 1]), lowerAscii(text[i + 2]));
+        trigrams[bit / 8] |= 1 << (bit % 8);
+    }
+
+    vector<uint8_t> packed = lzCompress(text, buffer.size());
+    memcpy(index.data(), "ADLS", 4);
+    put32(index.data() + 4, 1);
+    put32(index.data() + 8, lineCount);
+    put32(index.data() + 12, (uint32_t)buffer.size());
+    put32(index.data() + 16, (uint32_t)packed.size());
+    put64(index.data() + 24, (uint64_t)firstMs);
+    put64(index.data() + 32, (uint64_t)lastMs);
+
+    char name[64];
+    snprintf(name, sizeof(name), "seg-%013lld-%04u.als", (long long)firstMs, seq++ % 10000);
+    fs::path path = fs::path(dir) / name;
+    {
+        ofstream out(path.string() + ".tmp", ios::binary | ios::trunc);
+        out.write((const char*)index.data(), index.size());
+        out.write((const char*)packed.data(), packed.size());
+        if (!out) {
+            error = "cannot write " + path.string();
+            return false;
+        }
+    }
+    error_code ec;
+    fs::rename(path.string() + ".tmp", path, ec);
+    if (ec) {
+        error = "cannot write " + path.string();
+        return false;
+    }
+    buffer.clear();
+    segments++;
+    return true;
+}
+
+// ===== Query analysis =====
+// Only the plain characters before the first group, class or escape are
+// analysed: text inside "(...)*", "(?!...)" or "[...]" is not guaranteed to
+// be in a match, and proving otherwise is not worth a regex parser. A char
+// followed by ?, * or {..} is optional and ends the run without joining it.
+string requiredLiteral(const string& re) {
+    if (re.find('|') != string::npos) return "";  // alternation: nothing is guaranteed
+    string best, run;
+    auto endRun = [&] {
+        if (run.size() > best.size()) best = run;
+        run.clear();
+    };
+    for (size_t i = 0; i < re.size(); i++) {
+        char c = re[i];
+        if (c == '(' || c == '[' || c == '\\') break;
+        if (c == '?' || c == '*' || c == '{') {
+            if (!run.empty()) run.pop_back();  // the atom before it may be absent
+            endRun();
+            if (c == '{') {
+                size_t close = re.find('}', i);
+                if (close == string::npos) return "";
+                i = close;
+            }
+            continue;
+        }
+        if (c == '+') {
+            endRun();  // required once, but what follows need not be adjacent
+            continue;
+        }
+        if (strchr(".^$)]}", c)) {
+            endRun();
+            continue;
+        }
+        run += c;
+    }
+    endRun();
+    return best;
+}
+
+// Byte of the literal least likely to occur in log text, to drive memchr.
+static size_t rarestByte(const string& literal) {
+    static const char* common = " eatoinsrhldcumfpgwybvk:.0123456789ETAOINSRHLDCUMFPGWYBVK";
+    size_t best = 0;
+    int bestRank = -1;
+    for (size_t i = 0; i < literal.size(); i++) {
+        const char* at = strchr(common, literal[i]);
+        int rank = at && literal[i] ? (int)(strlen(common) - (at - common)) : 1000;
+        if (rank > bestRank) {
+            bestRank = rank;
+            best = i;
+        }
+    }
+    return best;
+}
+
+// ===== Search =====
+namespace {
+struct Segment {
+    string serial;
+    fs::path path;
+};
+
+struct SegmentResult {
+    vector<LogMatch> matches;
+    uint64_t bytes = 0;
+    string error;
+};
+}
+
+static SegmentResult scanSegment(const Segment& seg, uint32_t rawSize, uint32_t packedSize, const LogQuery& q,
+    const string& literal, const regex* re) {
+    SegmentResult result;
+    ifstream in(seg.path, ios::binary);
+    in.seekg((streamoff)kIndexBytes);
+    vector<uint8_t> packed(packedSize);
+    in.read((char*)packed.data(), packed.size());
+    string text(rawSize, '\0');
+    if (!in || !lzDecompress(packed.data(), packed.size(), (uint8_t*)&text[0], rawSize)) {
+        result.error = "corrupt segment " + seg.path.string();
+        return result;
+    }
+    result.bytes = rawSize;
+
+    string lowered;
+    const string* haystack = &text;
+    if (q.ignoreCase && !literal.empty()) {
+        lowered = text;
+        for (char& c : lowered) c = (char)lowerAscii((uint8_t)c);
+        haystack = &lowered;
+    }
+
+    auto accept = [&](size_t start, size_t end) {
+        string line = text.substr(start, end - start);
+        if (!q.tag.empty() || q.pid >= 0) {
+            string tag;
+            int pid;
+            if (!parseLogcatLine(line, tag, pid)) return;
+            if (!q.tag.empty() && tag != q.tag) return;
+            if (q.pid >= 0 && pid != q.pid) return;
+        }
+        if (re && !regex_search(line, *re)) return;
+        result.matches.push_back({ seg.serial, seg.path.filename().string(), line });
+    };
+
+    const char* base = haystack->data();
+    size_t size = haystack->size();
+    if (literal.empty()) {
+        for (size_t start = 0; start < size;) {
+            const char* nl = (const char*)memchr(base + start, '\n', size - start);
+            size_t end = nl ? nl - base : size;
+            accept(start, end);
+            start = end + 1;
+        }
+        return result;
+    }
+
+    // memchr on the rarest byte (vectorised by the C runtime), then verify
+    size_t pivot = rarestByte(literal);
+    char pivotChar = literal[pivot];
+    size_t from = pivot;
+    while (from < size) {
+        const char* hit = (const char*)memchr(base + from, pivotChar, size - from);
+        if (!hit) break;
+        size_t at = hit - base;
+        size_t begin = at - pivot;
+        if (begin + literal.size() > size || memcmp(base + begin, literal.data(), literal.size()) != 0) {
+            from = at + 1;
+            continue;
+        }
+        size_t start = begin;
+        while (start > 0 && base[start - 1] != '\n') start--;
+        const char* nl = (const char*)memchr(base + begin, '\n', size - begin);
+        size_t end = nl ? nl - base : size;
+        accept(start, end);
+        from = end + 1 + pivot;  // one match per line
+    }
+    return result;
+}
+
+bool searchLogs(const string& root, const LogQuery& q, const function<void(const LogMatch&)>& onMatch,
+    LogSearchStats& stats, string& error) {
+    stats = LogSearchStats();
+    unique_ptr<regex> re;
+    string literal = q.pattern;
+    if (q.regex) {
+        try {
+            re = make_unique<regex>(q.pattern, q.ignoreCase ? regex::ECMAScript | regex::icase : regex::ECMAScript);
+        } catch (const regex_error& e) {
+            error = string("bad regex: ") + e.what();
+            return false;
+        }
+        literal = requiredLiteral(q.pattern);
+    }
+    string folded = literal;
+    for (char& c : folded) c = (char)lowerAscii((uint8_t)c);
+    if (q.ignoreCase) literal = folded;
+
+    vector<Segment> segments;
+    error_code ec;
+    for (auto& device : fs::directory_iterator(root, ec)) {
+        string serial = serialFromDirName(device.path().filename().string());
+        if (!device.is_directory() ||
+            (!q.serials.empty() && find(q.serials.begin(), q.serials.end(), serial) == q.serials.end()))
+            continue;
+        vector<fs::path> files;
+        for (auto& f : fs::directory_iterator(device.path(), ec))
+            if (f.path().extension() == ".als") files.push_back(f.path());
+        sort(files.begin(), files.end());
+        for (auto& f : files) segments.push_back({ serial, f });
+    }
+    if (ec && segments.empty()) {
+        error = "cannot read log store " + root;
+        return false;
+    }
+    sort(segments.begin(), segments.end(), [](const Segment& a, const Segment& b) {
+        return tie(a.serial, a.path) < tie(b.serial, b.path);
+    });
+
+    // Index pass: only the fixed-size header of each segment is read
+    ThreadPool pool(q.threads > 0 ? (size_t)q.threads : 0);
+    vector<future<SegmentResult>> scans;
+    vector<uint8_t> index(kIndexBytes);
+    for (const Segment& seg : segments) {
+        stats.segments++;
+        ifstream in(seg.path, ios::binary);
+        in.read((char*)index.data(), index.size());
+        if (!in || memcmp(index.data(), "ADLS", 4) != 0) continue;
+        const uint8_t* tagBloom = index.data() + kHeaderBytes;
+        const uint8_t* pidBloom = tagBloom + kBloomBits / 8;
+        const uint8_t* trigrams = pidBloom + kBloomBits / 8;
+        if ((!q.tag.empty() && !bloomMayContain(tagBloom, q.tag)) ||
+            (q.pid >= 0 && !bloomMayContain(pidBloom, to_string(q.pid)))) {
+            stats.prunedByFilter++;
+            continue;
+        }
+        bool possible = true;
+        for (size_t i = 0; possible && i + 2 < folded.size(); i++) {
+            uint32_t bit = trigramBit((uint8_t)folded[i], (uint8_t)folded[i + 1], (uint8_t)folded[i + 2]);
+            possible = (trigrams[bit / 8] >> (bit % 8)) & 1;
+        }
+        if (!possible) {
+            stats.prunedByTrigram++;
+            continue;
+        }
+        stats.scanned++;
+        uint32_t rawSize = get32(index.data() + 12), packedSize = get32(index.data() + 16);
+        scans.push_back(pool.submit([&q, &literal, re = re.get(), seg, rawSize, packedSize] {
+            return scanSegment(seg, rawSize, packedSize, q, literal, re);
+        }));
+    }
+
+    for (auto& scan : scans) {
+        SegmentResult r = scan.get();
+        stats.bytesScanned += r.bytes;
+        if (!r.error.empty() && error.empty()) error = r.error;
+        for (const LogMatch& m : r.matches) {
+            stats.matches++;
+            onMatch(m);
+        }
+    }
+    return error.empty();
+}
@@ -0,0 +1,78 @@
+// LogStore.h
+// Local logcat store: per-device immutable segments, each holding a block
+// of compressed "threadtime" lines behind a small index (tag and pid bloom
+// filters plus a trigram bitmap). Searches read only the indexes first and
+// decompress just the segments that can contain a match.
+//
+// Layout: <root>/<serial>/seg-<first ms>-<seq>.als
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Buffers lines for one device and seals a segment every ~4 MiB.
+class LogWriter {
+public:
+    LogWriter(const std::string& root, const std::string& serial);
+    ~LogWriter();
+
+    LogWriter(const LogWriter&) = delete;
+    LogWriter& operator=(const LogWriter&) = delete;
+
+    void append(const std::string& line);
+    // Seal whatever is buffered into a segment.
+    bool flush(std::string& error);
+
+    uint64_t linesWritten() const { return lines; }
+    uint64_t segmentsWritten() const { return segments; }
+
+private:
+    std::string dir;
+    std::string buffer;            // lines of the open segment
+    int64_t firstMs = 0;
+    int64_t lastMs = 0;
+    uint64_t lines = 0;
+    uint64_t segments = 0;
+    unsigned seq = 0;
+};
+
+// Tag and pid of a "threadtime" line:
+//   "10-18 12:00:01.123  1234  5678 I ActivityManager: message"
+bool parseLogcatLine(const std::string& line, std::string& tag, int& pid);
+
+struct LogQuery {
+    std::string pattern;
+    bool regex = false;            // ECMAScript regex instead of a literal
+    bool ignoreCase = false;
+    std::string tag;               // "" = any
+    int pid = -1;                  // -1 = any
+    std::vector<std::string> serials;  // empty = every device in the store
+    int threads = 0;               // 0 = one per core
+};
+
+struct LogMatch {
+    std::string serial;
+    std::string segment;
+    std::string line;
+};
+
+struct LogSearchStats {
+    uint64_t segments = 0;
+    uint64_t prunedByFilter = 0;   // tag/pid bloom said no
+    uint64_t prunedByTrigram = 0;  // trigram bitmap said no
+    uint64_t scanned = 0;
+    uint64_t bytesScanned = 0;     // decompressed bytes
+    uint64_t matches = 0;
+};
+
+// Matches are delivered in store order (device, then segment age).
+bool searchLogs(const std::string& root, const LogQuery& query,
+    const std::function<void(const LogMatch&)>& onMatch, LogSearchStats& stats, std::string& error);
+
+// Longest literal every match of `regex` must contain, taken from the plain
+// text before its first group, class or escape ("" if none is guaranteed,
+// e.g. with alternation). Used for pruning and prefiltering.
+std::string requiredLiteral(const std::string& regex);
@@ -0,0 +1,102 @@
+// LogStoreTests.cpp
+// requiredLiteral must never name text a match can lack; searchLogs must
+// find exactly what a plain regex scan of the same lines finds.
+
+#include "LogStore.h"
+#include "SelfTest.h"
+#include "SerialDir.h"
+
+#include <chrono>
+#include <filesystem>
+#include <regex>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+SELFTEST(log_required_literal_plain_text) {
+    CHECK_EQ(requiredLiteral("Start proc"), "Start proc");
+    CHECK_EQ(requiredLiteral("^Manager: .*died$"), "Manager: ");
+    CHECK_EQ(requiredLiteral("ab+cde"), "cde");
+    CHECK_EQ(requiredLiteral("abcd+e"), "abcd");
+}
+
+SELFTEST(log_required_literal_skips_optional_atoms) {
+    CHECK_EQ(requiredLiteral("Errors?Start"), "Error");
+    CHECK_EQ(requiredLiteral("xy*Start"), "Start");
+    CHECK_EQ(requiredLiteral("abc{0,1}Start"), "Start");
+    CHECK_EQ(requiredLiteral("abcde*?"), "abcd");
+}
+
+SELFTEST(log_required_literal_stops_at_groups_classes_escapes) {
+    CHECK_EQ(requiredLiteral("(Error)*Start"), "");
+    CHECK_EQ(requiredLiteral("Manager: (?!Start proc)"), "Manager: ");
+    CHECK_EQ(requiredLiteral("pid [0-9]+ Start"), "pid ");
+    CHECK_EQ(requiredLiteral("\\d+ ms Start"), "");
+    CHECK_EQ(requiredLiteral("Start|Stop"), "");
+}
+
+static const char* kLines[] = {
+    "10-18 12:00:01.123  1234  5678 I Manager: Start proc 42:com.example/u0a1",
+    "10-18 12:00:02.123  1234  5678 I Manager: Stop proc 42",
+    "10-18 12:00:03.123  2000  2001 E App: ErrorErrorStart failed",
+    "10-18 12:00:04.123  2000  2001 E App: Start now",
+    "10-18 12:00:05.123  2000  2001 W App: Error without a start",
+};
+
+SELFTEST(log_search_regex_matches_full_scan) {
+    fs::path root = fs::temp_directory_path() /
+        ("adfxt-selftest-logs-" + to_string(chrono::steady_clock::now().time_since_epoch().count()));
+    {
+        LogWriter writer(root.string(), "SER1");
+        for (const char* line : kLines) writer.append(line);
+        string error;
+        CHECK(writer.flush(error));
+    }
+
+    for (const char* pattern : { "(Error)*Start", "Manager: (?!Start proc)", "Error[A-Z]", "Start proc", "x?Stop" }) {
+        size_t want = 0;
+        regex re(pattern);
+        for (const char* line : kLines) want += regex_search(line, re) ? 1 : 0;
+
+        LogQuery q;
+        q.pattern = pattern;
+        q.regex = true;
+        q.threads = 1;
+        LogSearchStats stats;
+        string error;
+        size_t got = 0;
+        CHECK(searchLogs(root.string(), q, [&got](const LogMatch&) { got++; }, stats, error));
+        CHECK_EQ(got, want);
+        CHECK(want > 0);
+    }
+    error_code ec;
+    fs::remove_all(root, ec);
+}
+
+SELFTEST(log_network_serial_is_a_safe_directory) {
+    const string serial = "192.168.1.5:5555";
+    CHECK_EQ(serialDirName(serial), "192.168.1.5%3A5555");
+    CHECK_EQ(serialFromDirName(serialDirName(serial)), serial);
+    CHECK_EQ(serialFromDirName(serialDirName("a%b<c>|?*\"\\/")), "a%b<c>|?*\"\\/");
+
+    fs::path root = fs::temp_directory_path() /
+        ("adfxt-selftest-serial-" + to_string(chrono::steady_clock::now().time_since_epoch().count()));
+    {
+        LogWriter writer(root.string(), serial);
+        writer.append(kLines[0]);
+        string error;
+        CHECK(writer.flush(error));
+    }
+    CHECK(fs::is_directory(root / "192.168.1.5%3A5555"));
+    LogQuery q;
+    q.pattern = "Start proc";
+    q.serials = { serial };
+    q.threads = 1;
+    LogSearchStats stats;
+    string error;
+    vector<string> serials;
+    CHECK(searchLogs(root.string(), q, [&serials](const LogMatch& m) { serials.push_back(m.serial); }, stats, error));
+    CHECK(serials == vector<string>({ serial }));
+    error_code ec;
+    fs::remove_all(root, ec);
+}
@@ -0,0 +1,149 @@
+// MappedFile.cpp
+// CreateFileMapping on Windows, mmap elsewhere.
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+using namespace std;
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+static bool mapHandle(HANDLE file, uint64_t size, bool writable, void*& mapping, uint8_t*& base) {
+    if (size == 0) return true;
+    mapping = CreateFileMappingA(file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY,
+        (DWORD)(size >> 32), (DWORD)size, nullptr);
+    if (!mapping) return false;
+    base = (uint8_t*)MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+    return base != nullptr;
+}
+
+bool MappedFile::openRead(const string& path, string& error) {
+    close();
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER size;
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)) {
+        file = nullptr;
+        error = "cannot open " + path;
+        return false;
+    }
+    length = (uint64_t)size.QuadPart;
+    if (!mapHandle(file, length, false, mapping, base)) {
+        error = "cannot map " + path;
+        close();
+        return false;
+    }
+    opened = true;
+    return true;
+}
+
+bool MappedFile::create(const string& path, uint64_t size, string& error) {
+    close();
+    file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        file = nullptr;
+        error = "cannot create " + path;
+        return false;
+    }
+    writable = true;
+    length = size;
+    if (!mapHandle(file, length, true, mapping, base)) {  // mapping extends the file
+        error = "cannot map " + path;
+        close();
+        return false;
+    }
+    opened = true;
+    return true;
+}
+
+bool MappedFile::flush() {
+    if (!base || !writable) return true;
+    return FlushViewOfFile(base, 0) && FlushFileBuffers(file);
+}
+
+void MappedFile::close() {
+    if (base) UnmapViewOfFile(base);
+    if (mapping) CloseHandle(mapping);
+    if (file) CloseHandle(file);
+    base = nullptr;
+    mapping = nullptr;
+    file = nullptr;
+    length = 0;
+    opened = writable = false;
+}
+#else
+bool MappedFile::openRead(const string& path, string& error) {
+    close();
+    fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        error = "cannot open " + path + ": " + strerror(errno);
+        close();
+        return false;
+    }
+    length = (uint64_t)st.st_size;
+    if (length > 0) {
+        void* p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            error = "cannot map " + path + ": " + strerror(errno);
+            close();
+            return false;
+        }
+        base = (uint8_t*)p;
+        madvise(base, length, MADV_SEQUENTIAL);
+    }
+    opened = true;
+    return true;
+}
+
+bool MappedFile::create(const string& path, uint64_t size, string& error) {
+    close();
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)size) != 0) {
+        error = "cannot create " + path + ": " + strerror(errno);
+        close();
+        return false;
+    }
+    writable = true;
+    length = size;
+    if (length > 0) {
+        void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            error = "cannot map " + path + ": " + strerror(errno);
+            close();
+            return false;
+        }
+        base = (uint8_t*)p;
+    }
+    opened = true;
+    return true;
+}
+
+bool MappedFile::flush() {
+    if (!base || !writable) return true;
+    return msync(base, length, MS_SYNC) == 0;
+}
+
+void MappedFile::close() {
+    if (base) munmap(base, length);
+    if (fd >= 0) ::close(fd);
+    base = nullptr;
+    fd = -1;
+    length = 0;
+    opened = writable = false;
+}
+#endif
@@ -0,0 +1,43 @@
+// MappedFile.h
+// Memory-mapped input and output files for large images (OTA payloads,
+// partition images) so workers can read and write them without copies.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Map an existing file read-only.
+    bool openRead(const std::string& path, std::string& error);
+    // Create (or truncate) a file of `size` zero bytes and map it read-write.
+    bool create(const std::string& path, uint64_t size, std::string& error);
+
+    // Write dirty pages back to the file.
+    bool flush();
+    void close();
+
+    uint8_t* data() const { return base; }
+    uint64_t size() const { return length; }
+    bool isOpen() const { return opened; }
+
+private:
+    uint8_t* base = nullptr;
+    uint64_t length = 0;
+    bool opened = false;
+    bool writable = false;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
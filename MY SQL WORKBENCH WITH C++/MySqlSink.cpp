@@ -0,0 +1,92 @@
+// MySqlSink.cpp
+// The only translation unit that touches the MySQL connector.
+// Link: mysqlcppconn.lib + delayimp.lib, /DELAYLOAD:mysqlcppconn-10-vs14.dll
+
+#include "MySqlSink.h"
+
+#include <cppconn/driver.h>
+#include <cppconn/connection.h>
+#include <cppconn/prepared_statement.h>
+#include <cppconn/resultset.h>
+#include <mysql_driver.h>
+
+#include <atomic>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+static const char* kConnectorDll = "mysqlcppconn-10-vs14.dll";
+#else
+// The connector is linked normally here, so "loaded" means initialised
+static atomic<bool> driverStarted(false);
+#endif
+
+// Load the delay-loaded connector explicitly so a missing DLL becomes an
+// error message instead of a delay-load exception.
+static bool loadDriver(string& error) {
+#ifdef _WIN32
+    if (GetModuleHandleA(kConnectorDll) || LoadLibraryA(kConnectorDll)) return true;
+    error = string("Unable to load ") + kConnectorDll;
+    return false;
+#else
+    (void)error;
+    return true;
+#endif
+}
+
+bool mySqlDriverLoaded() {
+#ifdef _WIN32
+    return GetModuleHandleA(kConnectorDll) != nullptr;
+#else
+    return driverStarted.load();
+#endif
+}
+
+class MySqlSink : public RecordSink {
+public:
+    string describe() const override { return "MySQL database"; }
+
+    bool save(const DeviceRecord& rec, string& error) override {
+        if (!loadDriver(error)) return false;
+        try {
+            if (!con) {
+                sql::mysql::MySQL_Driver* driver = sql::mysql::get_mysql_driver_instance();
+#ifndef _WIN32
+                driverStarted = true;
+#endif
+                con.reset(driver->connect("tcp://127.0.0.1:3306", "root", "your_password")); // Set your password
+                con->setSchema("pixel_db");
+                insert.reset(con->prepareStatement(
+                    "INSERT INTO devices (serial, model, brand, device, android_version, sdk_version) VALUES (?, ?, ?, ?, ?, ?)"
+                ));
+            }
+
+            insert->setString(1, rec.serial);
+            insert->setString(2, rec.model);
+            insert->setString(3, rec.brand);
+            insert->setString(4, rec.device);
+            insert->setString(5, rec.androidVersion);
+            insert->setString(6, rec.sdkVersion);
+            insert->execute();
+            return true;
+        }
+        catch (const sql::SQLException& e) {
+            insert.reset();
+            con.reset();  // reconnect on the next record
+            error = string("SQL Error: ") + e.what();
+            return false;
+        }
+    }
+
+private:
+    unique_ptr<sql::Connection> con;
+    unique_ptr<sql::PreparedStatement> insert;
+};
+
+unique_ptr<RecordSink> makeMySqlSink() {
+    return unique_ptr<RecordSink>(new MySqlSink());
+}
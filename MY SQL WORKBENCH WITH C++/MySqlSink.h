@@ -0,0 +1,15 @@
+// MySqlSink.h
+// MySQL backend. The connector DLL is delay-loaded: nothing from it is mapped
+// until the first record is saved through this sink.
+
+#pragma once
+
+#include <memory>
+
+#include "Sinks.h"
+
+std::unique_ptr<RecordSink> makeMySqlSink();
+
+// True once the MySQL connector has been loaded into the process (off
+// Windows, where it is linked in, once its driver has been initialised).
+bool mySqlDriverLoaded();
@@ -0,0 +1,189 @@
+// Net.cpp
+// Socket plumbing shared by the Windows and POSIX builds.
+
+#include "Net.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+using NativeSocket = SOCKET;
+static const NativeSocket kInvalid = INVALID_SOCKET;
+#else
+using NativeSocket = int;
+static const NativeSocket kInvalid = -1;
+#endif
+
+static void ensureStarted() {
+#ifdef _WIN32
+    static once_flag started;
+    call_once(started, [] {
+        WSADATA data;
+        WSAStartup(MAKEWORD(2, 2), &data);
+    });
+#endif
+}
+
+static void setTimeouts(NativeSocket s, int timeoutMs) {
+#ifdef _WIN32
+    DWORD tv = (DWORD)timeoutMs;
+#else
+    timeval tv = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+#endif
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, (const char*)&tv, sizeof(tv));
+}
+
+// ===== TCP =====
+SocketHandle tcpConnect(const string& host, int port, int timeoutMs, string& error) {
+    ensureStarted();
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &found) != 0 || !found) {
+        error = "cannot resolve " + host;
+        return kNoSocket;
+    }
+    NativeSocket s = kInvalid;
+    for (addrinfo* a = found; a; a = a->ai_next) {
+        s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (s == kInvalid) continue;
+        setTimeouts(s, timeoutMs);
+        if (connect(s, a->ai_addr, (int)a->ai_addrlen) == 0) break;
+        closeSocket((SocketHandle)s);
+        s = kInvalid;
+    }
+    freeaddrinfo(found);
+    if (s == kInvalid) {
+        error = "cannot connect to " + host + ":" + to_string(port);
+        return kNoSocket;
+    }
+    int one = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+    return (SocketHandle)s;
+}
+
+bool sendAll(SocketHandle sock, const string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        int n = (int)send((NativeSocket)sock, data.data() + sent, (int)(data.size() - sent), 0);
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+SocketHandle tcpListen(int port, string& error) {
+    ensureStarted();
+    NativeSocket s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s == kInvalid) {
+        error = "cannot create socket";
+        return kNoSocket;
+    }
+    int one = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(s, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(s, SOMAXCONN) != 0) {
+        closeSocket((SocketHandle)s);
+        error = "cannot listen on 127.0.0.1:" + to_string(port);
+        return kNoSocket;
+    }
+    return (SocketHandle)s;
+}
+
+SocketHandle tcpAccept(SocketHandle listener) {
+    NativeSocket s = accept((NativeSocket)listener, nullptr, nullptr);
+    if (s == kInvalid) return kNoSocket;
+    int one = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+    return (SocketHandle)s;
+}
+
+bool recvLine(SocketHandle sock, string& buffer, string& line) {
+    size_t nl;
+    char chunk[4096];
+    while ((nl = buffer.find('\n')) == string::npos) {
+        int n = (int)recv((NativeSocket)sock, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.append(chunk, n);
+    }
+    line = buffer.substr(0, nl > 0 && buffer[nl - 1] == '\r' ? nl - 1 : nl);
+    buffer.erase(0, nl + 1);
+    return true;
+}
+
+void closeSocket(SocketHandle sock) {
+    if (sock == kNoSocket) return;
+#ifdef _WIN32
+    closesocket((NativeSocket)sock);
+#else
+    close((NativeSocket)sock);
+#endif
+}
+
+// ===== HTTP =====
+bool httpPost(const string& url, const string& contentType, const string& body, string& error) {
+    const string scheme = "http://";
+    if (url.compare(0, scheme.size(), scheme) != 0) {
+        error = "only http:// URLs are supported: " + url;
+        return false;
+    }
+    string rest = url.substr(scheme.size());
+    size_t slash = rest.find('/');
+    string hostPort = rest.substr(0, slash);
+    string path = slash == string::npos ? "/" : rest.substr(slash);
+    string host = hostPort;
+    int port = 80;
+    size_t colon = hostPort.rfind(':');
+    if (colon != string::npos && hostPort.find(']', colon) == string::npos) {
+        host = hostPort.substr(0, colon);
+        port = atoi(hostPort.c_str() + colon + 1);
+    }
+    if (host.size() > 2 && host.front() == '[') host = host.substr(1, host.size() - 2);
+
+    SocketHandle sock = tcpConnect(host, port, 5000, error);
+    if (sock == kNoSocket) return false;
+    string request = "POST " + path + " HTTP/1.1\r\nHost: " + hostPort +
+        "\r\nContent-Type: " + contentType +
+        "\r\nContent-Length: " + to_string(body.size()) +
+        "\r\nConnection: close\r\n\r\n" + body;
+    if (!sendAll(sock, request)) {
+        closeSocket(sock);
+        error = "send to " + url + " failed";
+        return false;
+    }
+    // Only the status line matters
+    string reply;
+    char buf[512];
+    int n;
+    while (reply.find("\r\n") == string::npos && (n = (int)recv((NativeSocket)sock, buf, sizeof(buf), 0)) > 0)
+        reply.append(buf, n);
+    closeSocket(sock);
+    size_t sp = reply.find(' ');
+    int status = sp == string::npos ? 0 : atoi(reply.c_str() + sp + 1);
+    if (status < 200 || status >= 300) {
+        error = url + " answered " + (status ? to_string(status) : string("nothing"));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,29 @@
+// Net.h
+// Minimal blocking TCP helpers over Winsock / BSD sockets: a client, a
+// loopback listener with line reads, and a plain HTTP/1.1 POST for local
+// webhooks (no TLS, no redirects).
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Native socket handle widened to a common type; kNoSocket when invalid.
+using SocketHandle = intptr_t;
+constexpr SocketHandle kNoSocket = -1;
+
+SocketHandle tcpConnect(const std::string& host, int port, int timeoutMs, std::string& error);
+bool sendAll(SocketHandle sock, const std::string& data);
+void closeSocket(SocketHandle sock);
+
+// Listening socket on 127.0.0.1:port (local clients only).
+SocketHandle tcpListen(int port, std::string& error);
+SocketHandle tcpAccept(SocketHandle listener);
+
+// One '\n'-terminated line, CR/LF stripped. `buffer` carries bytes already
+// received past the previous line. False on EOF or error.
+bool recvLine(SocketHandle sock, std::string& buffer, std::string& line);
+
+// POST `body` to an http://host[:port]/path URL. True on a 2xx status.
+bool httpPost(const std::string& url, const std::string& contentType, const std::string& body,
+    std::string& error);
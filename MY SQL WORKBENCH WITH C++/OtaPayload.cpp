@@ -0,0 +1,377 @@
+// OtaPayload.cpp
+// payload.bin header, protobuf manifest decoding and parallel extraction.
+//
+// Only the fields needed for full OTAs are decoded; delta operations
+// (SOURCE_COPY, *BSDIFF, PUFFDIFF, ZUCCHINI) need the old images and are
+// rejected. XZ and BZ2 blobs go through liblzma / libbz2 loaded at runtime.
+
+#include "OtaPayload.h"
+#include "MappedFile.h"
+#include "Sha256.h"
+#include "SharedLibrary.h"
+#include "Shutdown.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// ===== Minimal protobuf reader =====
+namespace {
+struct ProtoReader {
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok = true;
+
+    ProtoReader(const uint8_t* data, size_t size) : p(data), end(data + size) {}
+
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p >= end) break;
+            uint8_t b = *p++;
+            v |= (uint64_t)(b & 0x7f) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        ok = false;
+        return 0;
+    }
+
+    // Next field; false at the end of the message or on malformed input.
+    bool next(uint32_t& field, int& wire) {
+        if (!ok || p >= end) return false;
+        uint64_t key = varint();
+        field = (uint32_t)(key >> 3);
+        wire = (int)(key & 7);
+        return ok;
+    }
+
+    ProtoReader message() {
+        uint64_t len = varint();
+        if (!ok || len > (uint64_t)(end - p)) {
+            ok = false;
+            return ProtoReader(p, 0);
+        }
+        ProtoReader sub(p, (size_t)len);
+        p += len;
+        return sub;
+    }
+
+    string bytes() {
+        ProtoReader sub = message();
+        return string((const char*)sub.p, sub.end - sub.p);
+    }
+
+    void skip(int wire) {
+        switch (wire) {
+        case 0: varint(); break;
+        case 1: p += 8; break;
+        case 2: message(); break;
+        case 5: p += 4; break;
+        default: ok = false;
+        }
+        if (p > end) ok = false;
+    }
+};
+}
+
+static bool parseOperation(ProtoReader r, PayloadOperation& op) {
+    uint32_t field;
+    int wire;
+    while (r.next(field, wire)) {
+        if (field == 1 && wire == 0) op.type = (int)r.varint();
+        else if (field == 2 && wire == 0) op.dataOffset = r.varint();
+        else if (field == 3 && wire == 0) op.dataLength = r.varint();
+        else if (field == 6 && wire == 2) {
+            ProtoReader e = r.message();
+            uint64_t start = 0, blocks = 0;
+            uint32_t f;
+            int w;
+            while (e.next(f, w)) {
+                if (f == 1 && w == 0) start = e.varint();
+                else if (f == 2 && w == 0) blocks = e.varint();
+                else e.skip(w);
+            }
+            if (!e.ok) return false;
+            op.dstExtents.push_back({ start, blocks });
+        }
+        else if (field == 8 && wire == 2) op.dataSha256 = r.bytes();
+        else r.skip(wire);
+    }
+    return r.ok;
+}
+
+static bool parsePartition(ProtoReader r, PayloadPartition& part) {
+    uint32_t field;
+    int wire;
+    while (r.next(field, wire)) {
+        if (field == 1 && wire == 2) part.name = r.bytes();
+        else if (field == 7 && wire == 2) {
+            ProtoReader info = r.message();
+            uint32_t f;
+            int w;
+            while (info.next(f, w)) {
+                if (f == 1 && w == 0) part.size = info.varint();
+                else if (f == 2 && w == 2) part.sha256 = info.bytes();
+                else info.skip(w);
+            }
+            if (!info.ok) return false;
+        }
+        else if (field == 8 && wire == 2) {
+            part.operations.emplace_back();
+            if (!parseOperation(r.message(), part.operations.back())) return false;
+        }
+        else r.skip(wire);
+    }
+    return r.ok;
+}
+
+static uint64_t readBigEndian(const uint8_t* p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+bool parsePayload(const uint8_t* data, size_t size, PayloadManifest& manifest, string& error) {
+    // "CrAU" | version u64 | manifest size u64 | signature size u32 | manifest | signature | blobs
+    if (size < 24 || memcmp(data, "CrAU", 4) != 0) {
+        error = "not an OTA payload (missing CrAU magic)";
+        return false;
+    }
+    manifest.version = readBigEndian(data + 4, 8);
+    if (manifest.version != 2) {
+        error = "unsupported payload version " + to_string(manifest.version);
+        return false;
+    }
+    uint64_t manifestSize = readBigEndian(data + 12, 8);
+    uint64_t signatureSize = readBigEndian(data + 20, 4);
+    if (manifestSize > size - 24 || signatureSize > size - 24 - manifestSize) {
+        error = "truncated payload header";
+        return false;
+    }
+    manifest.blobsOffset = 24 + manifestSize + signatureSize;
+
+    ProtoReader r(data + 24, (size_t)manifestSize);
+    uint32_t field;
+    int wire;
+    while (r.next(field, wire)) {
+        if (field == 3 && wire == 0) manifest.blockSize = (uint32_t)r.varint();
+        else if (field == 13 && wire == 2) {
+            manifest.partitions.emplace_back();
+            if (!parsePartition(r.message(), manifest.partitions.back())) r.ok = false;
+        }
+        else r.skip(wire);
+    }
+    if (!r.ok || manifest.blockSize == 0) {
+        error = "malformed payload manifest";
+        return false;
+    }
+    return true;
+}
+
+// ===== Decompressors =====
+// lzma_ret lzma_stream_buffer_decode(uint64_t* memlimit, uint32_t flags, const lzma_allocator*,
+//     const uint8_t* in, size_t* in_pos, size_t in_size, uint8_t* out, size_t* out_pos, size_t out_size)
+using LzmaBufferDecode = int (*)(uint64_t*, uint32_t, const void*, const uint8_t*, size_t*, size_t,
+    uint8_t*, size_t*, size_t);
+// int BZ2_bzBuffToBuffDecompress(char* dest, unsigned* destLen, char* source, unsigned sourceLen,
+//     int small, int verbosity)
+using Bz2BuffDecompress = int (*)(char*, unsigned*, char*, unsigned, int, int);
+
+static const SharedLibrary& lzmaLibrary() {
+    static SharedLibrary lib({
+#ifdef _WIN32
+        "liblzma.dll", "lzma.dll"
+#else
+        "liblzma.so.5", "liblzma.so", "liblzma.5.dylib"
+#endif
+    });
+    return lib;
+}
+
+static const SharedLibrary& bz2Library() {
+    static SharedLibrary lib({
+#ifdef _WIN32
+        "libbz2.dll", "bz2.dll"
+#else
+        "libbz2.so.1.0", "libbz2.so.1", "libbz2.so", "libbz2.1.0.dylib"
+#endif
+    });
+    return lib;
+}
+
+static bool decompress(int type, const uint8_t* in, size_t inSize, uint8_t* out, size_t outSize, string& error) {
+    if (type == (int)PayloadOp::ReplaceXz) {
+        auto decode = lzmaLibrary().function<LzmaBufferDecode>("lzma_stream_buffer_decode");
+        if (!decode) {
+            error = "REPLACE_XZ needs liblzma, which could not be loaded";
+            return false;
+        }
+        uint64_t memlimit = UINT64_MAX;
+        size_t inPos = 0, outPos = 0;
+        int rc = decode(&memlimit, 0, nullptr, in, &inPos, inSize, out, &outPos, outSize);
+        if (rc != 0 || outPos != outSize) {
+            error = "xz decode failed (" + to_string(rc) + ")";
+            return false;
+        }
+        return true;
+    }
+    auto decode = bz2Library().function<Bz2BuffDecompress>("BZ2_bzBuffToBuffDecompress");
+    if (!decode) {
+        error = "REPLACE_BZ needs libbz2, which could not be loaded";
+        return false;
+    }
+    if (inSize > UINT32_MAX || outSize > UINT32_MAX) {
+        error = "bzip2 blob too large";
+        return false;
+    }
+    unsigned produced = (unsigned)outSize;
+    int rc = decode((char*)out, &produced, (char*)in, (unsigned)inSize, 0, 0);
+    if (rc != 0 || produced != outSize) {
+        error = "bzip2 decode failed (" + to_string(rc) + ")";
+        return false;
+    }
+    return true;
+}
+
+// ===== Extraction =====
+static string runOperation(const PayloadOperation& op, const uint8_t* blobs, size_t blobsSize,
+    uint32_t blockSize, MappedFile& image, bool verify) {
+    if (op.type == (int)PayloadOp::Zero || op.type == (int)PayloadOp::Discard)
+        return "";  // freshly created images are already zero
+
+    if (op.type != (int)PayloadOp::Replace && op.type != (int)PayloadOp::ReplaceXz &&
+        op.type != (int)PayloadOp::ReplaceBz)
+        return "delta operation type " + to_string(op.type) + " (incremental OTAs need the source images)";
+
+    if (op.dataOffset > blobsSize || op.dataLength > blobsSize - op.dataOffset)
+        return "operation data outside the payload";
+    const uint8_t* blob = blobs + op.dataOffset;
+    if (verify && op.dataSha256.size() == 32) {
+        Sha256::Digest d = Sha256::of(blob, (size_t)op.dataLength);
+        if (memcmp(d.data(), op.dataSha256.data(), 32) != 0) return "operation data hash mismatch";
+    }
+
+    uint64_t total = 0;
+    for (auto& [start, blocks] : op.dstExtents) {
+        if (start > image.size() / blockSize || blocks > image.size() / blockSize - start)
+            return "extent outside the partition";
+        total += blocks * blockSize;
+    }
+
+    // Decompress straight into the image when the output is contiguous
+    vector<uint8_t> staging;
+    const uint8_t* src = blob;
+    if (op.type == (int)PayloadOp::Replace) {
+        total = min(total, op.dataLength);
+    } else if (op.dstExtents.size() == 1) {
+        string error;
+        uint8_t* dst = image.data() + op.dstExtents[0].first * blockSize;
+        return decompress(op.type, blob, (size_t)op.dataLength, dst, (size_t)total, error) ? "" : error;
+    } else {
+        staging.resize((size_t)total);
+        string error;
+        if (!decompress(op.type, blob, (size_t)op.dataLength, staging.data(), staging.size(), error)) return error;
+        src = staging.data();
+    }
+
+    uint64_t copied = 0;
+    for (auto& [start, blocks] : op.dstExtents) {
+        uint64_t n = min(blocks * blockSize, total - copied);
+        memcpy(image.data() + start * blockSize, src + copied, (size_t)n);
+        copied += n;
+        if (copied == total) break;
+    }
+    return "";
+}
+
+bool extractPayload(const uint8_t* payload, size_t payloadSize, const string& outDir, const ExtractOptions& opts,
+    vector<ExtractedImage>& images, string& error) {
+    PayloadManifest manifest;
+    if (!parsePayload(payload, payloadSize, manifest, error)) return false;
+    if (manifest.blobsOffset > payloadSize) {
+        error = "truncated payload";
+        return false;
+    }
+    const uint8_t* blobs = payload + manifest.blobsOffset;
+    size_t blobsSize = payloadSize - (size_t)manifest.blobsOffset;
+
+    vector<const PayloadPartition*> selected;
+    for (const PayloadPartition& part : manifest.partitions)
+        if (opts.partitions.empty() ||
+            find(opts.partitions.begin(), opts.partitions.end(), part.name) != opts.partitions.end())
+            selected.push_back(&part);
+    if (selected.empty()) {
+        error = "no matching partitions in payload";
+        return false;
+    }
+
+    error_code ec;
+    fs::create_directories(outDir, ec);
+    vector<unique_ptr<MappedFile>> outputs;
+    images.clear();
+    for (const PayloadPartition* part : selected) {
+        uint64_t size = part->size;
+        if (size == 0)  // older payloads: size from the furthest extent
+            for (auto& op : part->operations)
+                for (auto& [start, blocks] : op.dstExtents)
+                    size = max(size, (start + blocks) * manifest.blockSize);
+        ExtractedImage image;
+        image.partition = part->name;
+        image.path = (fs::path(outDir) / (part->name + ".img")).string();
+        image.size = size;
+        image.operations = part->operations.size();
+        outputs.push_back(make_unique<MappedFile>());
+        if (!outputs.back()->create(image.path, size, error)) return false;
+        images.push_back(image);
+    }
+
+    // Every operation of every partition is independent: one pool for all
+    ThreadPool pool(opts.threads > 0 ? (size_t)opts.threads : 0);
+    vector<future<string>> results;
+    for (size_t i = 0; i < selected.size(); i++) {
+        for (const PayloadOperation& op : selected[i]->operations) {
+            MappedFile* image = outputs[i].get();
+            const string& name = selected[i]->name;
+            results.push_back(pool.submit([&op, image, &name, blobs, blobsSize, &manifest, &opts]() -> string {
+                if (shutdownRequested()) return "cancelled";
+                string failure = runOperation(op, blobs, blobsSize, manifest.blockSize, *image, opts.verify);
+                return failure.empty() ? "" : name + ": " + failure;
+            }));
+        }
+    }
+    for (auto& r : results) {
+        string failure = r.get();
+        if (!failure.empty() && error.empty()) error = failure;
+    }
+    if (!error.empty()) return false;
+
+    if (opts.verify) {
+        vector<future<bool>> checks;
+        for (size_t i = 0; i < selected.size(); i++) {
+            checks.push_back(pool.submit([&, i] {
+                if (selected[i]->sha256.size() != 32) return false;
+                Sha256::Digest d = Sha256::of(outputs[i]->data(), (size_t)outputs[i]->size());
+                return memcmp(d.data(), selected[i]->sha256.data(), 32) == 0;
+            }));
+        }
+        for (size_t i = 0; i < checks.size(); i++) {
+            images[i].verified = checks[i].get();
+            if (!images[i].verified && selected[i]->sha256.size() == 32 && error.empty())
+                error = selected[i]->name + ": image hash mismatch";
+        }
+        if (!error.empty()) return false;
+    }
+    return true;
+}
+
+bool extractPayload(const string& payloadPath, const string& outDir, const ExtractOptions& opts,
+    vector<ExtractedImage>& images, string& error) {
+    MappedFile payload;
+    if (!payload.openRead(payloadPath, error)) return false;
+    return extractPayload(payload.data(), (size_t)payload.size(), outDir, opts, images, error);
+}
@@ -0,0 +1,73 @@
+// OtaPayload.h
+// A/B OTA payload.bin ("CrAU" v2) reader and full-OTA partition extractor.
+// Operations of every partition are executed in parallel on a thread pool
+// and written straight into memory-mapped output images.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// InstallOperation types from update_engine's update_metadata.proto.
+enum class PayloadOp : int {
+    Replace = 0,
+    ReplaceBz = 1,
+    SourceCopy = 4,
+    SourceBsdiff = 5,
+    Zero = 6,
+    Discard = 7,
+    ReplaceXz = 8,
+    Puffdiff = 9,
+    BrotliBsdiff = 10,
+    Zucchini = 11
+};
+
+struct PayloadOperation {
+    int type = 0;
+    uint64_t dataOffset = 0;       // relative to the payload's data blobs
+    uint64_t dataLength = 0;
+    std::vector<std::pair<uint64_t, uint64_t>> dstExtents;  // start block, block count
+    std::string dataSha256;        // raw 32 bytes, may be empty
+};
+
+struct PayloadPartition {
+    std::string name;
+    uint64_t size = 0;             // new_partition_info.size
+    std::string sha256;            // new_partition_info.hash, raw
+    std::vector<PayloadOperation> operations;
+};
+
+struct PayloadManifest {
+    uint64_t version = 0;
+    uint32_t blockSize = 4096;
+    uint64_t blobsOffset = 0;      // absolute offset of the data blobs
+    std::vector<PayloadPartition> partitions;
+};
+
+// Parse the header and manifest of a payload held in memory.
+bool parsePayload(const uint8_t* data, size_t size, PayloadManifest& manifest, std::string& error);
+
+struct ExtractedImage {
+    std::string partition;
+    std::string path;
+    uint64_t size = 0;
+    size_t operations = 0;
+    bool verified = false;         // image hash matched new_partition_info
+};
+
+struct ExtractOptions {
+    std::vector<std::string> partitions;  // empty = all
+    int threads = 0;                       // 0 = one per core
+    bool verify = false;                   // check operation and image hashes
+};
+
+// Extract raw images (<outDir>/<partition>.img) from `payloadPath`. The
+// images are returned in manifest order for the flashing pipeline.
+bool extractPayload(const std::string& payloadPath, const std::string& outDir, const ExtractOptions& opts,
+    std::vector<ExtractedImage>& images, std::string& error);
+
+// Same, for a payload already mapped or embedded in a larger file.
+bool extractPayload(const uint8_t* payload, size_t payloadSize, const std::string& outDir,
+    const ExtractOptions& opts, std::vector<ExtractedImage>& images, std::string& error);
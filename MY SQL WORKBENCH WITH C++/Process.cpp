@@ -0,0 +1,510 @@
+// Process.cpp
+// Child-process executor: CreateProcess + job objects on Windows,
+// posix_spawn + process groups elsewhere.
+
+#include "Process.h"
+#include "Spawner.h"
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+using namespace std;
+
+// ===== Registry of running children =====
+#ifdef _WIN32
+using ChildHandle = HANDLE;  // job object owning the child tree
+#else
+using ChildHandle = pid_t;   // process group id
+#endif
+
+struct ChildEntry {
+    ChildHandle handle;
+    bool cancelled = false;
+};
+
+static mutex registryMutex;
+static map<uint64_t, ChildEntry> running;
+static uint64_t nextChildId = 1;
+static bool intakeOpen = true;
+
+// Returns 0 when intake is closed.
+static uint64_t registerChild(ChildHandle h) {
+    lock_guard<mutex> lock(registryMutex);
+    if (!intakeOpen) return 0;
+    uint64_t id = nextChildId++;
+    running[id] = { h };
+    return id;
+}
+
+// Returns true if the child was cancelled while it ran.
+static bool unregisterChild(uint64_t id) {
+    lock_guard<mutex> lock(registryMutex);
+    auto it = running.find(id);
+    bool cancelled = it != running.end() && it->second.cancelled;
+    if (it != running.end()) running.erase(it);
+    return cancelled;
+}
+
+static void killChild(ChildHandle h) {
+#ifdef _WIN32
+    TerminateJobObject(h, 1);
+#else
+    kill(-h, SIGTERM);
+#endif
+}
+
+void closeProcessIntake() {
+    lock_guard<mutex> lock(registryMutex);
+    intakeOpen = false;
+}
+
+int cancelAllProcesses() {
+    lock_guard<mutex> lock(registryMutex);
+    for (auto& [id, child] : running) {
+        child.cancelled = true;
+        killChild(child.handle);
+    }
+    return (int)running.size();
+}
+
+int processesInFlight() {
+    lock_guard<mutex> lock(registryMutex);
+    return (int)running.size();
+}
+
+// ===== Timeouts =====
+// Runs `onExpire` (which kills the child) if not disarmed within timeoutMs.
+// No thread is started without a timeout.
+class Watchdog {
+public:
+    Watchdog(int timeoutMs, function<void()> onExpire) {
+        if (timeoutMs <= 0) return;
+        timer = thread([this, timeoutMs, onExpire] {
+            unique_lock<mutex> lock(m);
+            if (!cv.wait_for(lock, chrono::milliseconds(timeoutMs), [this] { return disarmed; })) {
+                expired = true;
+                onExpire();
+            }
+        });
+    }
+    ~Watchdog() { disarm(); }
+
+    // True if the timeout fired before this call.
+    bool disarm() {
+        {
+            lock_guard<mutex> lock(m);
+            disarmed = true;
+        }
+        cv.notify_all();
+        if (timer.joinable()) timer.join();
+        return expired;
+    }
+
+private:
+    mutex m;
+    condition_variable cv;
+    bool disarmed = false;
+    bool expired = false;
+    thread timer;
+};
+
+// ===== Platform spawn =====
+int runProcess(const string& cmd, string& output) {
+    return runProcessStreaming(cmd, [&output](const char* data, size_t size) {
+        output.append(data, size);
+        return true;
+    });
+}
+
+#ifdef _WIN32
+// Starts `cmd` suspended inside `job` with the given std handles. Only those
+// handles are inherited: a bare bInheritHandles=TRUE would also hand this
+// child the pipe ends of every other spawn in flight, and their readers would
+// then wait for this child to exit before seeing EOF.
+static bool spawnInJob(const string& cmd, HANDLE job, HANDLE in, HANDLE out, HANDLE err,
+    PROCESS_INFORMATION& pi) {
+    HANDLE inherit[3];
+    DWORD count = 0;
+    for (HANDLE h : { in, out, err }) {
+        DWORD flags = 0;
+        if (!h || h == INVALID_HANDLE_VALUE || !GetHandleInformation(h, &flags) || !(flags & HANDLE_FLAG_INHERIT))
+            continue;
+        bool seen = false;
+        for (DWORD i = 0; i < count; i++) seen = seen || inherit[i] == h;
+        if (!seen) inherit[count++] = h;
+    }
+
+    SIZE_T size = 0;
+    InitializeProcThreadAttributeList(nullptr, 1, 0, &size);
+    vector<char> storage(size);
+    auto attrs = (LPPROC_THREAD_ATTRIBUTE_LIST)storage.data();
+    if (!InitializeProcThreadAttributeList(attrs, 1, 0, &size)) return false;
+    if (count > 0 && !UpdateProcThreadAttribute(attrs, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST,
+            inherit, count * sizeof(HANDLE), nullptr, nullptr)) {
+        DeleteProcThreadAttributeList(attrs);
+        return false;
+    }
+
+    STARTUPINFOEXA si = {};
+    si.StartupInfo.cb = sizeof(si);
+    si.StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+    si.StartupInfo.hStdInput = in;
+    si.StartupInfo.hStdOutput = out;
+    si.StartupInfo.hStdError = err;
+    si.lpAttributeList = attrs;
+
+    string line = "cmd.exe /c " + cmd;
+    vector<char> cmdLine(line.begin(), line.end());
+    cmdLine.push_back('\0');
+
+    BOOL ok = CreateProcessA(nullptr, cmdLine.data(), nullptr, nullptr, count > 0,
+        CREATE_SUSPENDED | EXTENDED_STARTUPINFO_PRESENT, nullptr, nullptr, &si.StartupInfo, &pi);
+    DeleteProcThreadAttributeList(attrs);
+    return ok != FALSE;
+}
+
+int runProcessStreaming(const string& cmd, const function<bool(const char*, size_t)>& onData,
+    const function<void()>& onStarted, int timeoutMs) {
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), nullptr, TRUE };
+    HANDLE readEnd, writeEnd;
+    if (!CreatePipe(&readEnd, &writeEnd, &sa, 0)) return -1;
+    SetHandleInformation(readEnd, HANDLE_FLAG_INHERIT, 0);
+
+    HANDLE job = CreateJobObjectA(nullptr, nullptr);
+    PROCESS_INFORMATION pi = {};
+    bool ok = job && spawnInJob(cmd, job, GetStdHandle(STD_INPUT_HANDLE), writeEnd,
+        GetStdHandle(STD_ERROR_HANDLE), pi);
+    CloseHandle(writeEnd);
+    if (!ok) {
+        if (job) CloseHandle(job);
+        CloseHandle(readEnd);
+        return -1;
+    }
+    AssignProcessToJobObject(job, pi.hProcess);
+
+    uint64_t id = registerChild(job);
+    if (id == 0) {
+        TerminateJobObject(job, 1);
+    }
+    ResumeThread(pi.hThread);
+    CloseHandle(pi.hThread);
+    if (onStarted) onStarted();
+    Watchdog watchdog(timeoutMs, [job] { TerminateJobObject(job, 1); });
+
+    char buffer[4096];
+    DWORD got;
+    while (ReadFile(readEnd, buffer, sizeof(buffer), &got, nullptr) && got > 0) {
+        if (!onData(buffer, got)) {
+            TerminateJobObject(job, 1);
+            break;
+        }
+    }
+    CloseHandle(readEnd);
+    bool timedOut = watchdog.disarm();
+
+    WaitForSingleObject(pi.hProcess, INFINITE);
+    DWORD code = 1;
+    GetExitCodeProcess(pi.hProcess, &code);
+    CloseHandle(pi.hProcess);
+
+    bool cancelled = id == 0 || unregisterChild(id);
+    CloseHandle(job);
+    if (cancelled) return -1;
+    return timedOut ? kProcessTimedOut : (int)code;
+}
+#else
+// Both ends are close-on-exec so concurrent spawns do not inherit them (a
+// child holding another child's write end delays that reader's EOF); the
+// dup2 in the file actions clears the flag on the child's own copy.
+static bool cloexecPipe(int fds[2]) {
+#ifdef __linux__
+    return pipe2(fds, O_CLOEXEC) == 0;
+#else
+    if (pipe(fds) != 0) return false;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#endif
+}
+
+// Fallback when the pre-forked spawner is unavailable, and the only path for
+// sessions (the spawner does not forward stdin). `stdinFd` is null unless
+// the caller wants to write to the child.
+static bool spawnDirect(const string& cmd, pid_t& pid, int& stdoutFd, int* stdinFd = nullptr) {
+    int fds[2], in[2] = { -1, -1 };
+    if (!cloexecPipe(fds)) return false;
+    if (stdinFd && !cloexecPipe(in)) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+    posix_spawn_file_actions_addclose(&actions, fds[1]);
+    if (stdinFd) {
+        posix_spawn_file_actions_adddup2(&actions, in[0], STDIN_FILENO);
+        posix_spawn_file_actions_addclose(&actions, in[0]);
+        posix_spawn_file_actions_addclose(&actions, in[1]);
+    }
+
+    // Own process group so cancellation reaches the whole tree; reset the
+    // signal mask because the shutdown thread blocks SIGINT/SIGTERM.
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t empty, defaults;
+    sigemptyset(&empty);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGTERM);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_setsigmask(&attr, &empty);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    char* argv[] = { (char*)"sh", (char*)"-c", (char*)cmd.c_str(), nullptr };
+    int rc = posix_spawn(&pid, "/bin/sh", &actions, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    close(fds[1]);
+    if (stdinFd) close(in[0]);
+    if (rc != 0) {
+        close(fds[0]);
+        if (stdinFd) close(in[1]);
+        return false;
+    }
+    stdoutFd = fds[0];
+    if (stdinFd) *stdinFd = in[1];
+    return true;
+}
+
+int runProcessStreaming(const string& cmd, const function<bool(const char*, size_t)>& onData,
+    const function<void()>& onStarted, int timeoutMs) {
+    pid_t pid;
+    int stdoutFd;
+    int statusFd = -1;  // set when the spawner owns the child
+    if (!spawnViaHelper(cmd, pid, stdoutFd, statusFd) && !spawnDirect(cmd, pid, stdoutFd))
+        return -1;
+
+    uint64_t id = registerChild(pid);
+    if (id == 0) kill(-pid, SIGTERM);
+    if (onStarted) onStarted();
+    Watchdog watchdog(timeoutMs, [pid] { kill(-pid, SIGKILL); });
+
+    char buffer[4096];
+    ssize_t got;
+    while ((got = read(stdoutFd, buffer, sizeof(buffer))) != 0) {
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (!onData(buffer, (size_t)got)) {
+            kill(-pid, SIGTERM);
+            break;
+        }
+    }
+    close(stdoutFd);
+    bool timedOut = watchdog.disarm();
+
+    int status = -1;
+    if (statusFd >= 0) {
+        int32_t raw;
+        size_t have = 0;
+        while (have < sizeof(raw)) {
+            ssize_t n = read(statusFd, (char*)&raw + have, sizeof(raw) - have);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            have += (size_t)n;
+        }
+        if (have == sizeof(raw)) status = raw;
+        close(statusFd);
+    }
+    else {
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    }
+
+    bool cancelled = id == 0 || unregisterChild(id);
+    if (cancelled || status == -1) return -1;
+    if (timedOut) return kProcessTimedOut;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+#endif
+
+// ===== Sessions =====
+bool ProcessSession::readLine(string& line, int timeoutMs) {
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+    auto left = [&] {
+        return (int)chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+    };
+    size_t nl;
+    while ((nl = pending.find('\n')) == string::npos) {
+        char buffer[4096];
+#ifdef _WIN32
+        // Anonymous pipes have no overlapped reads: poll until data arrives
+        DWORD avail = 0;
+        while (timeoutMs > 0 && stdoutRead && PeekNamedPipe((HANDLE)stdoutRead, nullptr, 0, nullptr, &avail, nullptr) &&
+            avail == 0 && left() > 0)
+            Sleep(5);
+        if (timeoutMs > 0 && avail == 0 && left() <= 0 && process) {
+            timedOut = true;
+            TerminateJobObject((HANDLE)job, 1);
+            return false;
+        }
+        DWORD got = 0;
+        if (!stdoutRead || !ReadFile((HANDLE)stdoutRead, buffer, sizeof(buffer), &got, nullptr) || got == 0)
+            return false;
+#else
+        if (timeoutMs > 0 && stdoutFd >= 0) {
+            pollfd p = { stdoutFd, POLLIN, 0 };
+            int ready = poll(&p, 1, max(0, left()));
+            if (ready < 0 && errno == EINTR) continue;
+            if (ready == 0) {
+                timedOut = true;
+                kill(-pid, SIGKILL);
+                return false;
+            }
+        }
+        ssize_t got = stdoutFd < 0 ? 0 : read(stdoutFd, buffer, sizeof(buffer));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+#endif
+        pending.append(buffer, (size_t)got);
+    }
+    line = pending.substr(0, nl > 0 && pending[nl - 1] == '\r' ? nl - 1 : nl);
+    pending.erase(0, nl + 1);
+    return true;
+}
+
+#ifdef _WIN32
+bool ProcessSession::start(const string& cmd) {
+    pending.clear();
+    timedOut = false;
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), nullptr, TRUE };
+    HANDLE outRead, outWrite, inRead, inWrite;
+    if (!CreatePipe(&outRead, &outWrite, &sa, 0)) return false;
+    if (!CreatePipe(&inRead, &inWrite, &sa, 0)) {
+        CloseHandle(outRead);
+        CloseHandle(outWrite);
+        return false;
+    }
+    SetHandleInformation(outRead, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(inWrite, HANDLE_FLAG_INHERIT, 0);
+
+    HANDLE jobHandle = CreateJobObjectA(nullptr, nullptr);
+    PROCESS_INFORMATION pi = {};
+    bool ok = jobHandle && spawnInJob(cmd, jobHandle, inRead, outWrite, GetStdHandle(STD_ERROR_HANDLE), pi);
+    CloseHandle(outWrite);
+    CloseHandle(inRead);
+    if (!ok) {
+        if (jobHandle) CloseHandle(jobHandle);
+        CloseHandle(outRead);
+        CloseHandle(inWrite);
+        return false;
+    }
+    AssignProcessToJobObject(jobHandle, pi.hProcess);
+    id = registerChild(jobHandle);
+    if (id == 0) TerminateJobObject(jobHandle, 1);
+    ResumeThread(pi.hThread);
+    CloseHandle(pi.hThread);
+
+    job = jobHandle;
+    process = pi.hProcess;
+    stdinWrite = inWrite;
+    stdoutRead = outRead;
+    return id != 0;
+}
+
+bool ProcessSession::writeLine(const string& line) {
+    string data = line + "\n";
+    const char* p = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+        DWORD wrote = 0;
+        if (!stdinWrite || !WriteFile((HANDLE)stdinWrite, p, (DWORD)left, &wrote, nullptr)) return false;
+        p += wrote;
+        left -= wrote;
+    }
+    return true;
+}
+
+int ProcessSession::finish() {
+    if (!process) return -1;
+    CloseHandle((HANDLE)stdinWrite);
+    // Whatever the child still prints is not wanted
+    char buffer[4096];
+    DWORD got;
+    while (ReadFile((HANDLE)stdoutRead, buffer, sizeof(buffer), &got, nullptr) && got > 0) {}
+    CloseHandle((HANDLE)stdoutRead);
+    WaitForSingleObject((HANDLE)process, INFINITE);
+    DWORD code = 1;
+    GetExitCodeProcess((HANDLE)process, &code);
+    CloseHandle((HANDLE)process);
+    bool cancelled = id == 0 || unregisterChild(id);
+    CloseHandle((HANDLE)job);
+    job = process = stdinWrite = stdoutRead = nullptr;
+    if (timedOut) return kProcessTimedOut;
+    return cancelled ? -1 : (int)code;
+}
+#else
+bool ProcessSession::start(const string& cmd) {
+    pending.clear();
+    timedOut = false;
+    pid_t child;
+    if (!spawnDirect(cmd, child, stdoutFd, &stdinFd)) return false;
+    pid = child;
+    id = registerChild(pid);
+    if (id == 0) kill(-pid, SIGTERM);
+    return id != 0;
+}
+
+bool ProcessSession::writeLine(const string& line) {
+    string data = line + "\n";
+    const char* p = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+        ssize_t n = stdinFd < 0 ? -1 : write(stdinFd, p, left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        left -= (size_t)n;
+    }
+    return true;
+}
+
+int ProcessSession::finish() {
+    if (pid < 0) return -1;
+    close(stdinFd);
+    char buffer[4096];
+    ssize_t got;
+    while ((got = read(stdoutFd, buffer, sizeof(buffer))) != 0 && (got > 0 || errno == EINTR)) {}
+    close(stdoutFd);
+    int status = -1;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    bool cancelled = id == 0 || unregisterChild(id);
+    pid = stdinFd = stdoutFd = -1;
+    if (timedOut) return kProcessTimedOut;
+    if (cancelled || status == -1) return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+#endif
@@ -0,0 +1,72 @@
+// Process.h
+// Child-process executor used by runCommand. Tracks every running child so
+// shutdown can stop intake and cancel whatever is still in flight.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Run `cmd` through the platform shell, appending its stdout to `output`.
+// Returns the exit code, or -1 if the child could not be started, the
+// executor is closed, or the child was cancelled.
+int runProcess(const std::string& cmd, std::string& output);
+
+// Exit code of a child killed because it outlived its timeout.
+const int kProcessTimedOut = -2;
+
+// Same, but hands stdout to `onData` as it arrives (binary safe). Returning
+// false from the callback kills the child. `onStarted`, if set, runs once the
+// child is running, before any output is read. A child still running after
+// `timeoutMs` (0 = no limit) is killed and kProcessTimedOut returned.
+int runProcessStreaming(const std::string& cmd,
+    const std::function<bool(const char* data, size_t size)>& onData,
+    const std::function<void()>& onStarted = nullptr, int timeoutMs = 0);
+
+// Refuse new children from now on (running ones are left alone).
+void closeProcessIntake();
+
+// Kill every running child (and its process tree). Returns how many were hit.
+int cancelAllProcesses();
+
+// Children currently running.
+int processesInFlight();
+
+// A child kept running for a request/response exchange over its stdin and
+// stdout, e.g. one "adb shell" answering many queries. It is registered like
+// every other child, so shutdown cancels it.
+class ProcessSession {
+public:
+    ProcessSession() = default;
+    ~ProcessSession() { finish(); }
+
+    ProcessSession(const ProcessSession&) = delete;
+    ProcessSession& operator=(const ProcessSession&) = delete;
+
+    bool start(const std::string& cmd);
+    bool writeLine(const std::string& line);
+    // Next line without its CR/LF; false once the output ends. A line that
+    // takes longer than `timeoutMs` (0 = no limit) also returns false and
+    // kills the child, so finish() cannot hang on it.
+    bool readLine(std::string& line, int timeoutMs = 0);
+    // Close stdin and wait for the child. Exit code, -1 if cancelled, or
+    // kProcessTimedOut after a readLine timeout.
+    int finish();
+
+private:
+    std::string pending;
+    uint64_t id = 0;
+    bool timedOut = false;
+#ifdef _WIN32
+    void* job = nullptr;
+    void* process = nullptr;
+    void* stdinWrite = nullptr;
+    void* stdoutRead = nullptr;
+#else
+    int pid = -1;
+    int stdinFd = -1;
+    int stdoutFd = -1;
+#endif
+};
@@ -0,0 +1,263 @@
+// RateLimiter.cpp
+// Token-bucket limiter on new adb sessions and transfers, tuned per adb server.
+//
+// Tuning comes from the ADB_RATE_LIMIT environment variable, one entry per host:
+//   ADB_RATE_LIMIT="127.0.0.1:5037=20/8,4/2,8;10.0.0.5:5037=10/4,2/1,4"
+// meaning sessionsPerSec/sessionBurst,transfersPerSec/transferBurst,maxInFlight.
+// A host of "*" changes the defaults for every server.
+
+#include "RateLimiter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// ===== TokenBucket =====
+TokenBucket::TokenBucket(double ratePerSec, double burst)
+    : rate(ratePerSec), capacity(burst), tokens(burst), last(chrono::steady_clock::now()) {}
+
+void TokenBucket::reset(double ratePerSec, double burst) {
+    refill();
+    rate = ratePerSec;
+    capacity = burst;
+    tokens = min(tokens, capacity);
+}
+
+void TokenBucket::refill() {
+    auto now = chrono::steady_clock::now();
+    double elapsed = chrono::duration<double>(now - last).count();
+    last = now;
+    tokens = min(capacity, tokens + elapsed * rate);
+}
+
+bool TokenBucket::tryTake(double cost) {
+    refill();
+    if (tokens < cost) return false;
+    tokens -= cost;
+    return true;
+}
+
+chrono::steady_clock::duration TokenBucket::timeUntil(double cost) {
+    refill();
+    if (tokens >= cost || rate <= 0.0) return chrono::steady_clock::duration::zero();
+    auto wait = chrono::duration<double>((cost - tokens) / rate);
+    return chrono::duration_cast<chrono::steady_clock::duration>(wait);
+}
+
+// ===== BandwidthLimiter =====
+// Burst of a quarter second keeps several streams moving without letting one
+// of them overshoot the cap.
+BandwidthLimiter::BandwidthLimiter(double bytesPerSec)
+    : rate(bytesPerSec), bucket(bytesPerSec, max(bytesPerSec / 4.0, 64.0 * 1024.0)) {}
+
+void BandwidthLimiter::consume(size_t bytes) {
+    if (rate <= 0.0) return;
+    const double slice = max(rate / 4.0, 64.0 * 1024.0);
+    double left = (double)bytes;
+    while (left > 0.0) {
+        double cost = min(left, slice);
+        chrono::steady_clock::duration wait;
+        {
+            lock_guard<mutex> lock(m);
+            wait = bucket.timeUntil(cost);
+            if (wait == chrono::steady_clock::duration::zero() && bucket.tryTake(cost)) {
+                left -= cost;
+                continue;
+            }
+        }
+        this_thread::sleep_for(max(wait, chrono::steady_clock::duration(chrono::milliseconds(1))));
+    }
+}
+
+// ===== Per-host state =====
+struct AdbRateLimiter::Permit::Host {
+    mutex m;
+    condition_variable cv;
+    RateLimitConfig cfg;
+    TokenBucket sessions;
+    TokenBucket transfers;
+    RateLimitStats stats;
+
+    explicit Host(const RateLimitConfig& c)
+        : cfg(c),
+          sessions(c.sessionsPerSec, c.sessionBurst),
+          transfers(c.transfersPerSec, c.transferBurst) {}
+};
+
+// ===== Permit =====
+AdbRateLimiter::Permit::Permit(Permit&& other) noexcept : owner(other.owner) {
+    other.owner = nullptr;
+}
+
+AdbRateLimiter::Permit& AdbRateLimiter::Permit::operator=(Permit&& other) noexcept {
+    if (this != &other) {
+        release();
+        owner = other.owner;
+        other.owner = nullptr;
+    }
+    return *this;
+}
+
+AdbRateLimiter::Permit::~Permit() { release(); }
+
+void AdbRateLimiter::Permit::release() {
+    if (!owner) return;
+    {
+        lock_guard<mutex> lock(owner->m);
+        owner->stats.inFlight--;
+    }
+    // Slot and token waiters share the cv; a single wakeup could go to a
+    // token waiter that still cannot run while a slot waiter sleeps on
+    owner->cv.notify_all();
+    owner = nullptr;
+}
+
+// ===== Config parsing =====
+static bool parseRateSpec(const string& spec, RateLimitConfig& cfg) {
+    // "20/8,4/2,8"
+    double sr, sb, tr, tb;
+    int inflight;
+    char c1, c2, c3, c4;
+    istringstream ss(spec);
+    if (!(ss >> sr >> c1 >> sb >> c2 >> tr >> c3 >> tb >> c4 >> inflight)) return false;
+    if (c1 != '/' || c2 != ',' || c3 != '/' || c4 != ',') return false;
+    if (sr <= 0 || sb < 1 || tr <= 0 || tb < 1 || inflight < 1) return false;
+    cfg = { sr, sb, tr, tb, inflight };
+    return true;
+}
+
+// ===== AdbRateLimiter =====
+AdbRateLimiter::AdbRateLimiter() {
+    const char* env = getenv("ADB_RATE_LIMIT");
+    if (!env) return;
+
+    istringstream entries(env);
+    string entry;
+    while (getline(entries, entry, ';')) {
+        size_t eq = entry.rfind('=');
+        if (eq == string::npos) continue;
+        string host = entry.substr(0, eq);
+        RateLimitConfig cfg;
+        if (!parseRateSpec(entry.substr(eq + 1), cfg)) continue;
+        if (host == "*") defaults = cfg;
+        else hosts[host] = make_unique<Permit::Host>(cfg);
+    }
+}
+
+AdbRateLimiter& AdbRateLimiter::instance() {
+    static AdbRateLimiter limiter;
+    return limiter;
+}
+
+AdbRateLimiter::Permit::Host& AdbRateLimiter::hostFor(const string& host) {
+    lock_guard<mutex> lock(mapMutex);
+    auto& slot = hosts[host];
+    if (!slot) slot = make_unique<Permit::Host>(defaults);
+    return *slot;
+}
+
+void AdbRateLimiter::configure(const string& host, const RateLimitConfig& cfg) {
+    Permit::Host& h = hostFor(host);
+    {
+        lock_guard<mutex> lock(h.m);
+        h.cfg = cfg;
+        h.sessions.reset(cfg.sessionsPerSec, cfg.sessionBurst);
+        h.transfers.reset(cfg.transfersPerSec, cfg.transferBurst);
+    }
+    h.cv.notify_all();
+}
+
+AdbRateLimiter::Permit AdbRateLimiter::acquire(const string& host, AdbOp op, double cost) {
+    Permit::Host& h = hostFor(host);
+    auto start = chrono::steady_clock::now();
+    bool waited = false;
+
+    unique_lock<mutex> lock(h.m);
+    TokenBucket& bucket = (op == AdbOp::Transfer) ? h.transfers : h.sessions;
+    cost = min(cost, op == AdbOp::Transfer ? h.cfg.transferBurst : h.cfg.sessionBurst);
+
+    while (true) {
+        if (h.stats.inFlight < h.cfg.maxInFlight && bucket.tryTake(cost)) break;
+
+        if (!waited) {
+            waited = true;
+            h.stats.queueDepth++;
+            h.stats.maxQueueDepth = max(h.stats.maxQueueDepth, h.stats.queueDepth);
+        }
+        if (h.stats.inFlight >= h.cfg.maxInFlight) {
+            h.cv.wait(lock);  // woken by Permit::release
+        }
+        else {
+            h.cv.wait_for(lock, bucket.timeUntil(cost));
+        }
+    }
+
+    h.stats.granted++;
+    h.stats.inFlight++;
+    if (waited) {
+        h.stats.queueDepth--;
+        h.stats.delayed++;
+        h.stats.totalWaitUs += chrono::duration_cast<chrono::microseconds>(
+            chrono::steady_clock::now() - start).count();
+    }
+    return Permit(&h);
+}
+
+RateLimitStats AdbRateLimiter::stats(const string& host) {
+    Permit::Host& h = hostFor(host);
+    lock_guard<mutex> lock(h.m);
+    return h.stats;
+}
+
+map<string, RateLimitStats> AdbRateLimiter::allStats() {
+    map<string, RateLimitStats> out;
+    lock_guard<mutex> lock(mapMutex);
+    for (auto& [host, h] : hosts) {
+        lock_guard<mutex> hostLock(h->m);
+        out[host] = h->stats;
+    }
+    return out;
+}
+
+// ===== Command inspection =====
+static vector<string> splitWords(const string& cmd) {
+    vector<string> words;
+    istringstream ss(cmd);
+    string w;
+    while (ss >> w) words.push_back(w);
+    return words;
+}
+
+string adbServerFor(const string& cmd) {
+    const char* envHost = getenv("ANDROID_ADB_SERVER_ADDRESS");
+    const char* envPort = getenv("ANDROID_ADB_SERVER_PORT");
+    string host = envHost ? envHost : "127.0.0.1";
+    string port = envPort ? envPort : "5037";
+
+    vector<string> words = splitWords(cmd);
+    for (size_t i = 1; i + 1 < words.size(); i++) {
+        if (words[i] == "-H") host = words[i + 1];
+        else if (words[i] == "-P") port = words[i + 1];
+    }
+    if (host == "localhost") host = "127.0.0.1";
+    return host + ":" + port;
+}
+
+AdbOp classifyAdbCommand(const string& cmd) {
+    // exec-out carries tar streams and other bulk output
+    static const char* transfers[] = { "push", "pull", "sync", "install", "install-multiple", "sideload", "exec-out" };
+    vector<string> words = splitWords(cmd);
+    for (size_t i = 1; i < words.size(); i++) {
+        const string& w = words[i];
+        if (w == "-s" || w == "-H" || w == "-P" || w == "-t") { i++; continue; }
+        if (!w.empty() && w[0] == '-') continue;
+        for (const char* t : transfers)
+            if (w == t) return AdbOp::Transfer;
+        return AdbOp::Session;  // first real subcommand decides
+    }
+    return AdbOp::Session;
+}
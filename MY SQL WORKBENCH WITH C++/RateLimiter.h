@@ -0,0 +1,122 @@
+// RateLimiter.h
+// Token-bucket limiter that keeps each adb server in its efficient operating range.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// ===== Kinds of adb work that are limited separately =====
+enum class AdbOp {
+    Session,  // adb shell / getprop / devices ...
+    Transfer  // adb push / pull / sync / install / exec-out
+};
+
+// ===== Per-host tuning =====
+struct RateLimitConfig {
+    double sessionsPerSec = 20.0;   // refill rate for new sessions
+    double sessionBurst = 8.0;      // bucket size for sessions
+    double transfersPerSec = 4.0;   // refill rate for new transfers
+    double transferBurst = 2.0;     // bucket size for transfers
+    int maxInFlight = 8;            // concurrent adb children per server
+};
+
+// ===== Queue-depth metrics =====
+struct RateLimitStats {
+    uint64_t granted = 0;       // permits handed out
+    uint64_t delayed = 0;       // permits that had to wait
+    uint64_t totalWaitUs = 0;   // summed wait time of delayed permits
+    int queueDepth = 0;         // callers currently waiting
+    int maxQueueDepth = 0;      // high-water mark of queueDepth
+    int inFlight = 0;           // permits currently held
+};
+
+// ===== Simple token bucket (not thread safe, guarded by the owner) =====
+class TokenBucket {
+public:
+    TokenBucket(double ratePerSec = 1.0, double burst = 1.0);
+
+    void reset(double ratePerSec, double burst);
+    bool tryTake(double cost = 1.0);
+    // Time until `cost` tokens are available (zero when they already are).
+    std::chrono::steady_clock::duration timeUntil(double cost = 1.0);
+
+private:
+    void refill();
+
+    double rate;
+    double capacity;
+    double tokens;
+    std::chrono::steady_clock::time_point last;
+};
+
+// ===== Byte-rate cap shared by concurrent transfers =====
+class BandwidthLimiter {
+public:
+    // 0 = unlimited.
+    explicit BandwidthLimiter(double bytesPerSec = 0.0);
+
+    // Blocks until `bytes` more fit under the cap.
+    void consume(size_t bytes);
+    bool limited() const { return rate > 0.0; }
+
+private:
+    std::mutex m;
+    double rate;
+    TokenBucket bucket;
+};
+
+// ===== Limiter shared by every adb call in the process =====
+class AdbRateLimiter {
+public:
+    // RAII handle for one in-flight adb child; releases its slot on destruction.
+    class Permit {
+    public:
+        Permit() = default;
+        Permit(Permit&& other) noexcept;
+        Permit& operator=(Permit&& other) noexcept;
+        Permit(const Permit&) = delete;
+        Permit& operator=(const Permit&) = delete;
+        ~Permit();
+
+        explicit operator bool() const { return owner != nullptr; }
+        void release();
+
+    private:
+        friend class AdbRateLimiter;
+        struct Host;
+        explicit Permit(Host* h) : owner(h) {}
+        Host* owner = nullptr;
+    };
+
+    static AdbRateLimiter& instance();
+
+    // Tune one adb server, e.g. configure("127.0.0.1:5037", cfg).
+    void configure(const std::string& host, const RateLimitConfig& cfg);
+
+    // Blocks until the host has a token and a free in-flight slot.
+    Permit acquire(const std::string& host, AdbOp op, double cost = 1.0);
+
+    RateLimitStats stats(const std::string& host);
+    std::map<std::string, RateLimitStats> allStats();
+
+private:
+    AdbRateLimiter();
+    Permit::Host& hostFor(const std::string& host);
+
+    std::mutex mapMutex;
+    std::map<std::string, std::unique_ptr<Permit::Host>> hosts;
+    RateLimitConfig defaults;
+};
+
+// "host:port" of the adb server a command talks to (honours -H/-P and
+// ANDROID_ADB_SERVER_ADDRESS / ANDROID_ADB_SERVER_PORT).
+std::string adbServerFor(const std::string& cmd);
+
+// Session or Transfer, based on the adb subcommand.
+AdbOp classifyAdbCommand(const std::string& cmd);
@@ -0,0 +1,66 @@
+// SelfTest.cpp
+// Case registry and runner for SelfTest.h.
+
+#include "SelfTest.h"
+
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+struct SelfTestCase {
+    const char* name;
+    void (*run)();
+    bool benchmark;
+};
+
+// Function-local so registrars in other files can run first
+static vector<SelfTestCase>& selfTests() {
+    static vector<SelfTestCase> cases;
+    return cases;
+}
+
+static vector<string>* currentFailures = nullptr;
+
+void registerSelfTest(const char* name, void (*run)(), bool benchmark) {
+    selfTests().push_back({ name, run, benchmark });
+}
+
+void selfTestFail(const char* file, int line, const string& what) {
+    string where = file;
+    size_t slash = where.find_last_of("/\\");
+    if (slash != string::npos) where = where.substr(slash + 1);
+    string message = where + ":" + to_string(line) + ": " + what;
+    if (currentFailures) currentFailures->push_back(message);
+    else cerr << "[FAIL] " << message << "\n";
+}
+
+int runSelfTests(const vector<string>& only, bool benchmarks) {
+    int passed = 0, failed = 0;
+    for (const SelfTestCase& test : selfTests()) {
+        if (test.benchmark != benchmarks) continue;
+        string name = test.name;
+        bool wanted = only.empty();
+        for (const string& prefix : only) wanted = wanted || name.rfind(prefix, 0) == 0;
+        if (!wanted) continue;
+
+        vector<string> failures;
+        currentFailures = &failures;
+        auto t0 = chrono::steady_clock::now();
+        test.run();
+        auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - t0).count();
+        currentFailures = nullptr;
+
+        if (failures.empty()) {
+            passed++;
+            cerr << "[OK] " << name << " (" << ms << " ms)\n";
+        }
+        else {
+            failed++;
+            cerr << "[FAIL] " << name << "\n";
+            for (const string& f : failures) cerr << "    " << f << "\n";
+        }
+    }
+    cerr << passed << " passed, " << failed << " failed\n";
+    return failed == 0 && passed > 0 ? 0 : 1;
+}
@@ -0,0 +1,55 @@
+// SelfTest.h
+// Unit tests built into the tool and run with "selftest [NAME...]". Each
+// module's cases live in <Module>Tests.cpp, registered with SELFTEST and
+// checked with CHECK / CHECK_EQ; a failed check is reported and the case
+// carries on. Benchmarks (SELFBENCH) sit next to the cases but only run with
+// "selftest --bench"; they print their figures and may take a while.
+
+#pragma once
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+void registerSelfTest(const char* name, void (*run)(), bool benchmark = false);
+
+// Record a failed check in the case that is running.
+void selfTestFail(const char* file, int line, const std::string& what);
+
+// Run every case (or benchmark) whose name starts with one of `only` (all
+// when empty) and print one [OK]/[FAIL] line per case. Returns 0 if all of
+// them passed.
+int runSelfTests(const std::vector<std::string>& only, bool benchmarks = false);
+
+struct SelfTestRegistrar {
+    SelfTestRegistrar(const char* name, void (*run)(), bool benchmark = false) {
+        registerSelfTest(name, run, benchmark);
+    }
+};
+
+#define SELFTEST(name)                                                      \
+    static void selftest_##name();                                          \
+    static SelfTestRegistrar selftestRegistrar_##name(#name, selftest_##name); \
+    static void selftest_##name()
+
+#define SELFBENCH(name)                                                     \
+    static void selfbench_##name();                                         \
+    static SelfTestRegistrar selfbenchRegistrar_##name(#name, selfbench_##name, true); \
+    static void selfbench_##name()
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) selfTestFail(__FILE__, __LINE__, #cond);               \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                          \
+    do {                                                                    \
+        auto actual_ = (actual);                                            \
+        auto expected_ = (expected);                                        \
+        if (!(actual_ == expected_)) {                                      \
+            std::ostringstream what_;                                       \
+            what_ << #actual " == " #expected ": got " << actual_           \
+                  << ", want " << expected_;                                \
+            selfTestFail(__FILE__, __LINE__, what_.str());                  \
+        }                                                                   \
+    } while (0)
@@ -0,0 +1,37 @@
+// SerialDir.h
+// Device serials as directory names. Network devices ("192.168.1.5:5555")
+// and some emulators have serials Windows cannot use as a name, so such
+// characters (and '%' itself) are written as %XX, reversibly.
+
+#pragma once
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+inline std::string serialDirName(const std::string& serial) {
+    std::string out;
+    for (unsigned char c : serial) {
+        if (c < 0x20 || std::string("<>:\"/\\|?*%").find((char)c) != std::string::npos) {
+            char buf[4];
+            snprintf(buf, sizeof(buf), "%%%02X", c);
+            out += buf;
+        }
+        else out += (char)c;
+    }
+    return out;
+}
+
+inline std::string serialFromDirName(const std::string& name) {
+    std::string out;
+    for (size_t i = 0; i < name.size(); i++) {
+        if (name[i] == '%' && i + 2 < name.size() && isxdigit((unsigned char)name[i + 1]) &&
+            isxdigit((unsigned char)name[i + 2])) {
+            out += (char)strtol(name.substr(i + 1, 2).c_str(), nullptr, 16);
+            i += 2;
+        }
+        else out += name[i];
+    }
+    return out;
+}
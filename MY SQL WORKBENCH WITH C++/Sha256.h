@@ -0,0 +1,34 @@
+// Sha256.h
+// Portable SHA-256 (FIPS 180-4) for manifests and image verification.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class Sha256 {
+public:
+    using Digest = std::array<uint8_t, 32>;
+
+    Sha256() { reset(); }
+
+    void reset();
+    void update(const void* data, size_t size);
+    Digest finish();
+
+    static Digest of(const void* data, size_t size);
+    static std::string hex(const Digest& d);
+
+private:
+    void block(const uint8_t* p);
+
+    uint32_t state[8];
+    uint64_t length;
+    uint8_t buffer[64];
+    size_t buffered;
+};
+
+// Hex SHA-256 of a file, or "" if it cannot be read.
+std::string sha256File(const std::string& path);
@@ -0,0 +1,44 @@
+// SharedLibrary.cpp
+// LoadLibrary / dlopen wrapper.
+
+#include "SharedLibrary.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+using namespace std;
+
+SharedLibrary::SharedLibrary(initializer_list<const char*> names) {
+    for (const char* candidate : names) {
+#ifdef _WIN32
+        handle = (void*)LoadLibraryA(candidate);
+#else
+        handle = dlopen(candidate, RTLD_NOW | RTLD_LOCAL);
+#endif
+        if (handle) {
+            name = candidate;
+            return;
+        }
+    }
+}
+
+SharedLibrary::~SharedLibrary() {
+    if (!handle) return;
+#ifdef _WIN32
+    FreeLibrary((HMODULE)handle);
+#else
+    dlclose(handle);
+#endif
+}
+
+void* SharedLibrary::symbol(const char* symbolName) const {
+    if (!handle) return nullptr;
+#ifdef _WIN32
+    return (void*)GetProcAddress((HMODULE)handle, symbolName);
+#else
+    return dlsym(handle, symbolName);
+#endif
+}
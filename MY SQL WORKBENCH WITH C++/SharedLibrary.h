@@ -0,0 +1,31 @@
+// SharedLibrary.h
+// Optional runtime dependencies (liblzma, libbz2, libcrypto ...) loaded on
+// first use, so the tool still starts and degrades when they are missing.
+
+#pragma once
+
+#include <initializer_list>
+#include <string>
+
+class SharedLibrary {
+public:
+    // Tries each file name in turn; isLoaded() tells whether one worked.
+    explicit SharedLibrary(std::initializer_list<const char*> names);
+    ~SharedLibrary();
+
+    SharedLibrary(const SharedLibrary&) = delete;
+    SharedLibrary& operator=(const SharedLibrary&) = delete;
+
+    bool isLoaded() const { return handle != nullptr; }
+    const std::string& loadedName() const { return name; }
+
+    // Address of an exported function, or nullptr.
+    void* symbol(const char* symbolName) const;
+
+    template <typename Fn>
+    Fn function(const char* symbolName) const { return reinterpret_cast<Fn>(symbol(symbolName)); }
+
+private:
+    void* handle = nullptr;
+    std::string name;
+};
@@ -0,0 +1,165 @@
+// Shutdown.cpp
+// Signal-aware shutdown path shared by interactive and batch runs.
+
+#include "Shutdown.h"
+#include "Process.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+using namespace std;
+
+struct ShutdownHook {
+    int id;
+    string name;
+    function<void()> stop;
+    function<bool(ShutdownClock::time_point)> drain;
+};
+
+static atomic<bool> requested{ false };
+static mutex hooksMutex;
+static condition_variable hooksIdle;
+static vector<ShutdownHook> hooks;
+static map<int, int> hooksBusy;  // id -> calls of its stop/drain in progress
+static int nextHookId = 1;
+static mutex finishMutex;
+static bool finished = false;
+static chrono::milliseconds signalDeadline{ 10000 };
+
+int registerShutdownHook(const string& name, function<void()> stop,
+    function<bool(ShutdownClock::time_point)> drain) {
+    lock_guard<mutex> lock(hooksMutex);
+    int id = nextHookId++;
+    hooks.push_back({ id, name, move(stop), move(drain) });
+    return id;
+}
+
+void unregisterShutdownHook(int id) {
+    unique_lock<mutex> lock(hooksMutex);
+    // The owner is about to go away: let a stop/drain already running on
+    // the signal thread finish first
+    hooksIdle.wait(lock, [id] { return !hooksBusy.count(id); });
+    for (auto it = hooks.begin(); it != hooks.end(); ++it) {
+        if (it->id == id) {
+            hooks.erase(it);
+            return;
+        }
+    }
+}
+
+static vector<ShutdownHook> snapshotHooks() {
+    lock_guard<mutex> lock(hooksMutex);
+    return hooks;
+}
+
+// Run one of `hook`'s callbacks unless it was unregistered in the meantime.
+template <typename Call>
+static void callHook(const ShutdownHook& hook, Call call) {
+    {
+        lock_guard<mutex> lock(hooksMutex);
+        if (none_of(hooks.begin(), hooks.end(), [&](const ShutdownHook& h) { return h.id == hook.id; })) return;
+        hooksBusy[hook.id]++;
+    }
+    call();
+    {
+        lock_guard<mutex> lock(hooksMutex);
+        if (--hooksBusy[hook.id] == 0) hooksBusy.erase(hook.id);
+    }
+    hooksIdle.notify_all();
+}
+
+bool shutdownRequested() { return requested.load(); }
+
+void requestShutdown() {
+    if (requested.exchange(true)) return;
+
+    closeProcessIntake();
+    for (auto& h : snapshotHooks())
+        if (h.stop) callHook(h, [&] { h.stop(); });
+    cancelAllProcesses();
+}
+
+void finishShutdown(chrono::milliseconds deadline) {
+    lock_guard<mutex> lock(finishMutex);
+    if (finished) return;
+    finished = true;
+
+    auto until = ShutdownClock::now() + deadline;
+    vector<ShutdownHook> snapshot = snapshotHooks();
+    for (auto it = snapshot.rbegin(); it != snapshot.rend(); ++it) {
+        if (!it->drain) continue;
+        callHook(*it, [&] {
+            if (!it->drain(until)) cerr << "[WARN] " << it->name << " did not drain before the shutdown deadline\n";
+        });
+    }
+    cout.flush();
+    cerr.flush();
+    fflush(nullptr);
+}
+
+// Runs on the signal thread: the full shutdown, then exit.
+static void shutdownFromSignal() {
+    requestShutdown();
+    finishShutdown(signalDeadline);
+#ifdef _WIN32
+    ExitProcess(130);
+#else
+    _Exit(130);
+#endif
+}
+
+#ifdef _WIN32
+static BOOL WINAPI consoleHandler(DWORD type) {
+    switch (type) {
+    case CTRL_C_EVENT:
+    case CTRL_BREAK_EVENT:
+    case CTRL_CLOSE_EVENT:
+    case CTRL_SHUTDOWN_EVENT:
+        shutdownFromSignal();  // handler already runs on its own thread
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+void installShutdownHandlers(chrono::milliseconds deadline) {
+    signalDeadline = deadline;
+    SetConsoleCtrlHandler(consoleHandler, TRUE);
+}
+#else
+void installShutdownHandlers(chrono::milliseconds deadline) {
+    signalDeadline = deadline;
+
+    // Block the signals process-wide (threads inherit the mask) and take
+    // them synchronously on one thread, so shutdown code is not limited to
+    // async-signal-safe calls.
+    static sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &set, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    thread([] {
+        int sig = 0;
+        while (sigwait(&set, &sig) != 0) {}
+        shutdownFromSignal();
+    }).detach();
+}
+#endif
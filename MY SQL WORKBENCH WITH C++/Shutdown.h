@@ -0,0 +1,38 @@
+// Shutdown.h
+// Signal-aware shutdown: stop intake, cancel in-flight children, then drain
+// and flush every registered component within a deadline.
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+
+using ShutdownClock = std::chrono::steady_clock;
+
+// Install SIGINT/SIGTERM (or console Ctrl-C/close) handling. Call first thing
+// in main(), before any thread exists. On a signal, the whole shutdown runs
+// on a dedicated thread and the process exits with code 130.
+void installShutdownHandlers(std::chrono::milliseconds deadline = std::chrono::seconds(10));
+
+bool shutdownRequested();
+
+// Phase 1: refuse new work and cancel running adb/fastboot children.
+void requestShutdown();
+
+// Phase 2: run drain hooks in reverse registration order, sharing one
+// deadline, then flush stdout/stderr. Runs at most once; later callers wait
+// for the first to finish.
+void finishShutdown(std::chrono::milliseconds deadline = std::chrono::seconds(10));
+
+// Components register how they stop accepting work and how they drain.
+// `stop` runs in phase 1 and must be quick; `drain` gets the shared deadline
+// and returns false if it had to give up. Returns an id for unregistering.
+int registerShutdownHook(const std::string& name,
+    std::function<void()> stop,
+    std::function<bool(ShutdownClock::time_point deadline)> drain);
+
+// Waits for a stop/drain of this hook that is already running (on the signal
+// thread), so the owner can be destroyed right after. Must not be called
+// from the hook's own callbacks.
+void unregisterShutdownHook(int id);
@@ -0,0 +1,106 @@
+// SingleFlight.h
+// Collapses identical concurrent requests into one execution: callers asking
+// for a key that is already in flight wait for that execution and share its
+// result. An optional TTL keeps finished results around briefly.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+
+template <typename V>
+class SingleFlight {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        uint64_t executions = 0;  // times fn actually ran
+        uint64_t shared = 0;      // callers that joined an in-flight run
+        uint64_t cacheHits = 0;   // callers served from the TTL cache
+    };
+
+    // Run fn for `key` unless an identical run is in flight or cached.
+    // Exceptions from fn reach every caller that shared the run.
+    V run(const std::string& key, const std::function<V()>& fn, Clock::duration ttl = Clock::duration::zero()) {
+        std::unique_lock<std::mutex> lock(m);
+        auto now = Clock::now();
+
+        auto cached = cache.find(key);
+        if (cached != cache.end()) {
+            if (cached->second.expires > now) {
+                counters.cacheHits++;
+                return cached->second.value;
+            }
+            cache.erase(cached);
+        }
+
+        auto running = inflight.find(key);
+        if (running != inflight.end()) {
+            counters.shared++;
+            std::shared_future<V> result = running->second;
+            lock.unlock();
+            return result.get();
+        }
+
+        std::promise<V> promise;
+        inflight[key] = promise.get_future().share();
+        counters.executions++;
+        lock.unlock();
+
+        try {
+            V value = fn();
+            lock.lock();
+            inflight.erase(key);
+            if (ttl > Clock::duration::zero()) {
+                if (cache.size() >= kSweepAt) sweep(Clock::now());
+                cache[key] = { value, Clock::now() + ttl };
+            }
+            lock.unlock();
+            promise.set_value(value);
+            return value;
+        }
+        catch (...) {
+            lock.lock();
+            inflight.erase(key);
+            lock.unlock();
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+    }
+
+    // Drop a cached result (an in-flight run is left alone).
+    void forget(const std::string& key) {
+        std::lock_guard<std::mutex> lock(m);
+        cache.erase(key);
+    }
+
+    Stats stats() {
+        std::lock_guard<std::mutex> lock(m);
+        return counters;
+    }
+
+private:
+    struct Entry {
+        V value;
+        Clock::time_point expires;
+    };
+
+    static constexpr size_t kSweepAt = 1024;
+
+    void sweep(Clock::time_point now) {
+        for (auto it = cache.begin(); it != cache.end();) {
+            if (it->second.expires <= now) it = cache.erase(it);
+            else ++it;
+        }
+    }
+
+    std::mutex m;
+    std::map<std::string, std::shared_future<V>> inflight;
+    std::map<std::string, Entry> cache;
+    Stats counters;
+};
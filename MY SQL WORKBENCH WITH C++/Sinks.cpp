@@ -0,0 +1,124 @@
+// Sinks.cpp
+// Sink registry and the built-in details.txt backend.
+
+#include "Sinks.h"
+#include "Json.h"
+#include "MySqlSink.h"
+#include "Spool.h"
+
+#include <fstream>
+#include <map>
+#include <mutex>
+
+using namespace std;
+
+// ===== details.txt =====
+// Truncated by the first save of the run; later records are appended after a
+// blank line so "--all --sink file" keeps every device.
+class TextFileSink : public RecordSink {
+public:
+    explicit TextFileSink(const string& path) : path(path) {}
+
+    string describe() const override { return path; }
+
+    bool save(const DeviceRecord& rec, string& error) override {
+        ofstream file(path, started ? ios::app : ios::trunc);
+        if (!file.is_open()) {
+            error = "Unable to open " + path + " for writing";
+            return false;
+        }
+        if (started) file << "\n";
+        started = true;
+        file << "Serial: " << rec.serial << "\n";
+        file << "Model: " << rec.model << "\n";
+        file << "Brand: " << rec.brand << "\n";
+        file << "Device: " << rec.device << "\n";
+        file << "Android Version: " << rec.androidVersion << "\n";
+        file << "SDK Version: " << rec.sdkVersion << "\n";
+        if (rec.enrichment) {
+            file << "Marketing Name: " << rec.enrichment->marketingName << "\n";
+            file << "SoC: " << rec.enrichment->soc << "\n";
+            file << "Release Year: " << rec.enrichment->releaseYear << "\n";
+        }
+        file.close();
+        if (!file) {
+            error = "Write to " + path + " failed";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    string path;
+    bool started = false;
+};
+
+// ===== devices.spool =====
+// One JSON object per line, group-committed so concurrent saves share a sync.
+// Spool is thread-safe, so info saves from every device thread at once.
+class SpoolSink : public RecordSink {
+public:
+    explicit SpoolSink(const string& path) : path(path), spool(path) {}
+
+    string describe() const override { return path + " (" + spool.backendName() + ")"; }
+
+    bool concurrentSaves() const override { return true; }
+
+    bool save(const DeviceRecord& rec, string& error) override {
+        if (!spool.isOpen()) {
+            error = "Unable to open " + path + " for writing";
+            return false;
+        }
+        string line = "{\"serial\":\"" + jsonEscape(rec.serial) +
+            "\",\"model\":\"" + jsonEscape(rec.model) +
+            "\",\"brand\":\"" + jsonEscape(rec.brand) +
+            "\",\"device\":\"" + jsonEscape(rec.device) +
+            "\",\"android_version\":\"" + jsonEscape(rec.androidVersion) +
+            "\",\"sdk_version\":\"" + jsonEscape(rec.sdkVersion) + "\"}";
+        return spool.append(line, error);
+    }
+
+private:
+    string path;
+    Spool spool;
+};
+
+// ===== Registry =====
+static mutex registryMutex;
+
+static map<string, SinkFactory>& registry() {
+    static map<string, SinkFactory> factories = {
+        { "file", [] { return unique_ptr<RecordSink>(new TextFileSink("details.txt")); } },
+        { "mysql", makeMySqlSink },
+        { "spool", [] { return unique_ptr<RecordSink>(new SpoolSink("devices.spool")); } },
+    };
+    return factories;
+}
+
+void registerSink(const string& name, SinkFactory factory) {
+    lock_guard<mutex> lock(registryMutex);
+    registry()[name] = move(factory);
+}
+
+unique_ptr<RecordSink> createSink(const string& name) {
+    SinkFactory factory;
+    {
+        lock_guard<mutex> lock(registryMutex);
+        auto it = registry().find(name);
+        if (it == registry().end()) return nullptr;
+        factory = it->second;
+    }
+    return factory();
+}
+
+bool sinkExists(const string& name) {
+    lock_guard<mutex> lock(registryMutex);
+    return registry().count(name) != 0;
+}
+
+vector<string> sinkNames() {
+    lock_guard<mutex> lock(registryMutex);
+    vector<string> names;
+    for (auto& entry : registry()) names.push_back(entry.first);
+    return names;
+}
@@ -0,0 +1,51 @@
+// Sinks.h
+// Persistence backends behind a small plugin interface. Backends are created
+// by name on first use, so a run that never asks for "mysql" never loads the
+// MySQL connector (or the libssl/libcrypto it pulls in).
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "DeviceCatalog.h"
+
+// ===== One collected device =====
+struct DeviceRecord {
+    std::string serial;
+    std::string model;
+    std::string brand;
+    std::string device;
+    std::string androidVersion;
+    std::string sdkVersion;
+    const DeviceEnrichment* enrichment = nullptr;  // from lookupDevice(device)
+};
+
+// ===== Backend interface =====
+class RecordSink {
+public:
+    virtual ~RecordSink() = default;
+
+    // Where records go, for status messages ("MySQL database", "details.txt").
+    virtual std::string describe() const = 0;
+
+    // Persist one record; on failure fill `error` and return false.
+    virtual bool save(const DeviceRecord& rec, std::string& error) = 0;
+
+    // True if save() may run on several threads at once. Such sinks are
+    // saved straight from the collecting threads instead of the write queue.
+    virtual bool concurrentSaves() const { return false; }
+};
+
+using SinkFactory = std::function<std::unique_ptr<RecordSink>()>;
+
+// Add or replace a backend.
+void registerSink(const std::string& name, SinkFactory factory);
+
+// New backend instance, or nullptr for an unknown name.
+std::unique_ptr<RecordSink> createSink(const std::string& name);
+
+bool sinkExists(const std::string& name);
+std::vector<std::string> sinkNames();
@@ -0,0 +1,257 @@
+// Spawner.cpp
+// Request/response over a socketpair: the parent sends a length-prefixed
+// command, the spawner forks a short-lived waiter that posix_spawns the
+// command and reports "pid, then wait status" on a status pipe, and the
+// spawner passes the stdout and status read ends back with SCM_RIGHTS.
+
+#include "Spawner.h"
+
+#ifdef _WIN32
+
+bool startSpawner() { return false; }
+
+bool spawnViaHelper(const std::string&, int&, int&, int&) { return false; }
+
+#else
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+using namespace std;
+
+static int spawnerSock = -1;
+static mutex spawnerMutex;
+
+// ===== Small I/O helpers =====
+static bool writeFully(int fd, const void* data, size_t len) {
+    const char* p = (const char*)data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool readFully(int fd, void* data, size_t len) {
+    char* p = (char*)data;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static void setCloexec(int fd) {
+    fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+}
+
+static bool cloexecPipe(int fds[2]) {
+    if (pipe(fds) != 0) return false;
+    setCloexec(fds[0]);
+    setCloexec(fds[1]);
+    return true;
+}
+
+// ===== Spawner side =====
+
+// Runs in the per-request waiter: spawn the command, report pid, wait,
+// report status.
+static void runWaiter(const string& cmd, int outWrite, int statusWrite) {
+    signal(SIGCHLD, SIG_DFL);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, outWrite, STDOUT_FILENO);
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t empty, defaults;
+    sigemptyset(&empty);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGTERM);
+    sigaddset(&defaults, SIGHUP);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_setsigmask(&attr, &empty);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    char* argv[] = { (char*)"sh", (char*)"-c", (char*)cmd.c_str(), nullptr };
+    pid_t pid;
+    int32_t reportPid = -1;
+    if (posix_spawn(&pid, "/bin/sh", &actions, &attr, argv, environ) == 0) reportPid = pid;
+    close(outWrite);
+    writeFully(statusWrite, &reportPid, sizeof(reportPid));
+    if (reportPid < 0) _exit(1);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    int32_t raw = status;
+    writeFully(statusWrite, &raw, sizeof(raw));
+    _exit(0);
+}
+
+// Reply to one request: the two fds, or a bare byte when the spawn failed.
+static bool sendReply(int sock, int fd1, int fd2) {
+    char byte = 0;
+    iovec iov = { &byte, 1 };
+    alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))];
+    memset(control, 0, sizeof(control));
+
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (fd1 >= 0) {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(2 * sizeof(int));
+        int fds[2] = { fd1, fd2 };
+        memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+    }
+
+    ssize_t n;
+    while ((n = sendmsg(sock, &msg, 0)) < 0 && errno == EINTR) {}
+    return n == 1;
+}
+
+[[noreturn]] static void spawnerLoop(int sock) {
+    // Ctrl-C goes to the whole foreground group; the spawner stays up until
+    // the parent closes the socket.
+    signal(SIGINT, SIG_IGN);
+    signal(SIGHUP, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGCHLD, SIG_IGN);  // waiters are reaped automatically
+
+    while (true) {
+        uint32_t len;
+        if (!readFully(sock, &len, sizeof(len)) || len > (1u << 20)) _exit(0);
+        string cmd(len, '\0');
+        if (!readFully(sock, &cmd[0], len)) _exit(0);
+
+        int out[2], status[2];
+        bool ok = cloexecPipe(out);
+        if (ok && !cloexecPipe(status)) {
+            close(out[0]);
+            close(out[1]);
+            ok = false;
+        }
+        if (!ok) {
+            if (!sendReply(sock, -1, -1)) _exit(0);
+            continue;
+        }
+
+        pid_t waiter = fork();
+        if (waiter == 0) {
+            close(sock);
+            close(out[0]);
+            close(status[0]);
+            runWaiter(cmd, out[1], status[1]);
+        }
+        close(out[1]);
+        close(status[1]);  // if the fork failed the parent just reads EOF here
+        bool sent = sendReply(sock, out[0], status[0]);
+        close(out[0]);
+        close(status[0]);
+        if (!sent) _exit(0);
+    }
+}
+
+// ===== Parent side =====
+bool startSpawner() {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return false;
+    setCloexec(sv[0]);
+    setCloexec(sv[1]);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        spawnerLoop(sv[1]);
+    }
+    close(sv[1]);
+    spawnerSock = sv[0];
+    return true;
+}
+
+// 1 = got both fds, 0 = this spawn failed, -1 = spawner gone.
+static int receiveReply(int sock, int& fd1, int& fd2) {
+    char byte;
+    iovec iov = { &byte, 1 };
+    alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))];
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n;
+    while ((n = recvmsg(sock, &msg, 0)) < 0 && errno == EINTR) {}
+    if (n != 1) return -1;
+    cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+    if (!cm || cm->cmsg_type != SCM_RIGHTS || cm->cmsg_len != CMSG_LEN(2 * sizeof(int))) return 0;
+    int fds[2];
+    memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+    fd1 = fds[0];
+    fd2 = fds[1];
+    setCloexec(fd1);
+    setCloexec(fd2);
+    return 1;
+}
+
+bool spawnViaHelper(const string& cmd, int& pid, int& stdoutFd, int& statusFd) {
+    int outFd = -1, stFd = -1;
+    {
+        lock_guard<mutex> lock(spawnerMutex);
+        if (spawnerSock < 0) return false;
+        uint32_t len = (uint32_t)cmd.size();
+        int reply = -1;
+        if (writeFully(spawnerSock, &len, sizeof(len)) &&
+            writeFully(spawnerSock, cmd.data(), cmd.size()))
+            reply = receiveReply(spawnerSock, outFd, stFd);
+        if (reply < 0) {
+            // Spawner is gone; everything falls back to direct spawning
+            close(spawnerSock);
+            spawnerSock = -1;
+        }
+        if (reply <= 0) return false;
+    }
+
+    int32_t childPid = -1;
+    if (!readFully(stFd, &childPid, sizeof(childPid)) || childPid <= 0) {
+        close(outFd);
+        close(stFd);
+        return false;
+    }
+    pid = childPid;
+    stdoutFd = outFd;
+    statusFd = stFd;
+    return true;
+}
+
+#endif
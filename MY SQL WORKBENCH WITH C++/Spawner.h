@@ -0,0 +1,19 @@
+// Spawner.h
+// Pre-forked spawn helper (POSIX). A tiny process is forked at startup, while
+// the tool is still small and single threaded; later adb/fastboot children
+// are created by it instead of by the (possibly large, multithreaded) main
+// process, so spawn latency does not grow with our RSS or fd count.
+// On Windows these are no-ops and Process.cpp uses CreateProcess directly.
+
+#pragma once
+
+#include <string>
+
+// Fork the spawner. Call first thing in main(), before any thread exists.
+bool startSpawner();
+
+// Run "/bin/sh -c cmd" through the spawner. On success `pid` is the child
+// (and its process group), `stdoutFd` reads its stdout and `statusFd`
+// yields the raw wait status (4 bytes) once it exits. False if the spawner
+// is not running or the spawn failed; the caller then spawns directly.
+bool spawnViaHelper(const std::string& cmd, int& pid, int& stdoutFd, int& statusFd);
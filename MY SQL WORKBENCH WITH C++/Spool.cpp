@@ -0,0 +1,57 @@
+// Spool.cpp
+// Leader/follower group commit on top of FileAppender.
+
+#include "Spool.h"
+
+using namespace std;
+
+Spool::Spool(const string& path) : file(path) {}
+
+bool Spool::append(const string& record, string& error) {
+    unique_lock<mutex> lock(m);
+    pending.push_back(record);
+    uint64_t myBatch = openBatch;
+
+    while (durableBatch < myBatch) {
+        if (leaderActive) {
+            committed.wait(lock);
+            continue;
+        }
+
+        // Become the leader: close the open batch and commit it
+        leaderActive = true;
+        vector<string> batch;
+        batch.swap(pending);
+        uint64_t batchId = openBatch++;
+        lock.unlock();
+
+        string batchError;
+        bool ok = true;
+        for (const string& r : batch) {
+            ok = ok && file.append(r) && file.append("\n", 1);
+        }
+        ok = ok ? file.commit(batchError) : (batchError = "write failed", false);
+
+        lock.lock();
+        counters.commits++;
+        if (ok) counters.records += batch.size();
+        else failures.push_back({ batchId, batchError });
+        if (failures.size() > 64) failures.erase(failures.begin());
+        durableBatch = batchId;
+        leaderActive = false;
+        committed.notify_all();
+    }
+
+    for (auto& f : failures) {
+        if (f.first == myBatch) {
+            error = f.second;
+            return false;
+        }
+    }
+    return true;
+}
+
+Spool::Stats Spool::stats() {
+    lock_guard<mutex> lock(m);
+    return counters;
+}
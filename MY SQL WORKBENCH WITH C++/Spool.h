@@ -0,0 +1,43 @@
+// Spool.h
+// Durable append-only spool with group commit: concurrent appenders are
+// batched so one write + data sync covers everyone who arrived meanwhile.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "IoBackend.h"
+
+class Spool {
+public:
+    explicit Spool(const std::string& path);
+
+    bool isOpen() const { return file.isOpen(); }
+
+    // Append one record (a trailing newline is added) and return once it is
+    // on disk. False if the batch it was part of failed to commit.
+    bool append(const std::string& record, std::string& error);
+
+    struct Stats {
+        uint64_t records = 0;
+        uint64_t commits = 0;  // write+sync submissions
+    };
+    Stats stats();
+
+    const char* backendName() const { return file.backendName(); }
+
+private:
+    FileAppender file;
+    std::mutex m;
+    std::condition_variable committed;
+    std::vector<std::string> pending;
+    uint64_t openBatch = 1;       // batch new records join
+    uint64_t durableBatch = 0;    // last batch on disk (or failed)
+    bool leaderActive = false;
+    std::vector<std::pair<uint64_t, std::string>> failures;  // batch -> error
+    Stats counters;
+};
@@ -0,0 +1,200 @@
+// Telemetry.cpp
+// Binary telemetry decoding, helper deployment and the text fallback.
+
+#include "Telemetry.h"
+#include "Adb.h"
+#include "Collectors.h"
+#include "Shutdown.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <thread>
+
+using namespace std;
+
+enum { kRecHello = 0, kRecSample = 1 };
+static const size_t kSamplePayload = 8 + 4 * 4 + 8 * 4;
+
+static uint16_t get16(const unsigned char* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+
+static uint32_t get32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get64(const unsigned char* p) {
+    return (uint64_t)get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+// ===== Decoder =====
+bool TelemetryDecoder::feed(const char* data, size_t size, vector<TelemetrySample>& out) {
+    pending.append(data, size);
+    size_t pos = 0;
+    while (pending.size() - pos >= 2) {
+        const unsigned char* p = (const unsigned char*)pending.data() + pos;
+        size_t len = get16(p);
+        if (len < 2) return false;
+        if (pending.size() - pos < 2 + len) break;
+
+        uint8_t type = p[2];
+        uint8_t flags = p[3];
+        const unsigned char* body = p + 4;
+        if (type == kRecHello) {
+            if (len < 2 + 8 || memcmp(body, "ADFX", 4) != 0) return false;
+            if (get32(body + 4) != (uint32_t)kProbeVersion) return false;
+            helloSeen = true;
+        }
+        else if (type == kRecSample) {
+            if (!helloSeen || len < 2 + kSamplePayload) return false;
+            TelemetrySample s;
+            s.serial = serial;
+            s.deviceTimeNs = get64(body);
+            if (flags & (1 << 0)) s.batteryLevel = (int32_t)get32(body + 8);
+            if (flags & (1 << 1)) s.batteryTempDeciC = (int32_t)get32(body + 12);
+            if (flags & (1 << 2)) s.batteryVoltageMv = (int32_t)get32(body + 16);
+            if (flags & (1 << 3)) s.batteryStatus = (int32_t)get32(body + 20);
+            if (flags & (1 << 4)) s.uptimeMs = (int64_t)get64(body + 24);
+            if (flags & (1 << 5)) s.memAvailKb = (int64_t)get64(body + 32);
+            if (flags & (1 << 6)) {
+                s.dataAvailKb = (int64_t)get64(body + 40);
+                s.dataTotalKb = (int64_t)get64(body + 48);
+            }
+            out.push_back(move(s));
+        }
+        // unknown record types are skipped for forward compatibility
+        pos += 2 + len;
+    }
+    pending.erase(0, pos);
+    return true;
+}
+
+// ===== Helper deployment =====
+static mutex probeMutex;
+static set<string> probeReady;
+
+static bool probeVersionOk(const string& serial) {
+    string out = runCommand("adb -s " + serial + " shell " + kProbeDevicePath + " --version");
+    return out == "adfxt_probe " + to_string(kProbeVersion);
+}
+
+bool ensureProbe(const string& serial, string& error) {
+    {
+        lock_guard<mutex> lock(probeMutex);
+        if (probeReady.count(serial)) return true;
+    }
+    if (!probeVersionOk(serial)) {
+        const char* env = getenv("ADFXT_PROBE");
+        string local = env ? env : "adfxt_probe";
+        if (!ifstream(local, ios::binary).good()) {
+            error = "helper binary " + local + " not found";
+            return false;
+        }
+        string output;
+        if (runCommandStatus("adb -s " + serial + " push " + hostQuote(local) + " " + kProbeDevicePath, output) != 0) {
+            error = "could not push helper " + local + (output.empty() ? "" : ": " + output);
+            return false;
+        }
+        runCommand("adb -s " + serial + " shell chmod 755 " + kProbeDevicePath);
+        if (!probeVersionOk(serial)) {
+            error = "helper did not start on the device";
+            return false;
+        }
+    }
+    lock_guard<mutex> lock(probeMutex);
+    probeReady.insert(serial);
+    return true;
+}
+
+// ===== Streaming =====
+// True if the helper delivered every sample asked for (all of them up to
+// Ctrl-C for count 0) or the consumer stopped early. A stream that dies,
+// whatever it sent so far, is a failure so the caller can fall back.
+static bool streamFromProbe(const string& serial, int intervalMs, int count,
+    const function<bool(const TelemetrySample&)>& onSample, TelemetryStats& stats) {
+    TelemetryDecoder decoder(serial);
+    vector<TelemetrySample> batch;
+    bool ok = true;
+    bool stopped = false;
+    int received = 0;
+
+    string cmd = "adb -s " + serial + " exec-out " + kProbeDevicePath +
+        " -i " + to_string(intervalMs) + " -n " + to_string(count);
+    int rc = runCommandStreaming(cmd, [&](const char* data, size_t size) {
+        auto t0 = chrono::steady_clock::now();
+        stats.bytes += size;
+        batch.clear();
+        ok = decoder.feed(data, size, batch);
+        stats.decodeNs += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t0).count();
+        if (!ok) return false;
+        for (const TelemetrySample& s : batch) {
+            stats.samples++;
+            received++;
+            if (!onSample(s)) {
+                stopped = true;
+                return false;
+            }
+        }
+        return true;
+    });
+    if (stopped || shutdownRequested()) return true;
+    return ok && rc == 0 && decoder.sawHello() && count > 0 && received >= count;
+}
+
+static bool streamFromShell(const string& serial, int intervalMs, int count,
+    const function<bool(const TelemetrySample&)>& onSample, TelemetryStats& stats) {
+    static const vector<string> collectors = { "battery", "uptime", "storage" };
+    for (int n = 0; count == 0 || n < count; n++) {
+        if (shutdownRequested()) return true;
+        if (n > 0) this_thread::sleep_for(chrono::milliseconds(intervalMs));
+
+        string script = buildCollectorScript(collectors);
+        string output = runCommand("adb -s " + serial + " shell \"" + script + "\"");
+        auto t0 = chrono::steady_clock::now();
+        stats.bytes += output.size();
+
+        DeviceSnapshot snap;
+        demuxCollectorOutput(output, collectors, snap);
+        if (snap.missing.size() == collectors.size()) return false;
+
+        TelemetrySample s;
+        s.serial = serial;
+        if (snap.uptimeSec >= 0) {
+            s.uptimeMs = (int64_t)(snap.uptimeSec * 1000.0);
+            s.deviceTimeNs = (uint64_t)(snap.uptimeSec * 1e9);
+        }
+        s.batteryLevel = snap.batteryLevel;
+        if (snap.batteryTempDeciC != INT32_MIN) s.batteryTempDeciC = snap.batteryTempDeciC;
+        s.batteryVoltageMv = snap.batteryVoltageMv;
+        s.batteryStatus = snap.batteryStatus;
+        s.dataAvailKb = snap.dataAvailKb;
+        s.dataTotalKb = snap.dataTotalKb;
+        stats.decodeNs += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t0).count();
+
+        stats.samples++;
+        if (!onSample(s)) return true;
+    }
+    return true;
+}
+
+bool streamTelemetry(const string& serial, int intervalMs, int count, bool allowProbe,
+    const function<bool(const TelemetrySample&)>& onSample, TelemetryStats* stats) {
+    TelemetryStats local;
+    TelemetryStats& st = stats ? *stats : local;
+    if (intervalMs < 1) intervalMs = 1;
+
+    string error;
+    if (allowProbe && ensureProbe(serial, error)) {
+        st.usedProbe = true;
+        uint64_t before = st.samples;
+        if (streamFromProbe(serial, intervalMs, count, onSample, st)) return true;
+        // Helper broke mid-stream: finish the remaining samples over text
+        st.probeFailed = true;
+        if (count > 0) {
+            count -= (int)(st.samples - before);
+            if (count <= 0) return true;
+        }
+    }
+    return streamFromShell(serial, intervalMs, count, onSample, st);
+}
@@ -0,0 +1,76 @@
+// Telemetry.h
+// Telemetry samples streamed from the on-device helper (helper/adfxt_probe.c)
+// as length-prefixed binary records over "adb exec-out", with the text-shell
+// collectors as the fallback when the helper is unavailable.
+//
+// Wire format, little-endian, one record after another:
+//   u16 length (bytes that follow)  u8 type  u8 flags  payload
+//   type 0 (hello):  "ADFX" u32 version
+//   type 1 (sample): u64 boottime_ns
+//                    i32 battery_level  i32 battery_temp_decic
+//                    i32 battery_voltage_mv  i32 battery_status
+//                    u64 uptime_ms  u64 mem_avail_kb
+//                    u64 data_avail_kb  u64 data_total_kb
+//   flags: bit set per field present (same order as the payload, from bit 0;
+//   the two data_* fields share bit 6).
+
+#pragma once
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct TelemetrySample {
+    std::string serial;
+    uint64_t deviceTimeNs = 0;          // CLOCK_BOOTTIME on the device
+    int batteryLevel = -1;
+    int batteryTempDeciC = INT_MIN;
+    int batteryVoltageMv = -1;
+    int batteryStatus = -1;
+    int64_t uptimeMs = -1;
+    int64_t memAvailKb = -1;
+    int64_t dataAvailKb = -1;
+    int64_t dataTotalKb = -1;
+};
+
+struct TelemetryStats {
+    uint64_t bytes = 0;        // bytes received from the device
+    uint64_t samples = 0;
+    uint64_t decodeNs = 0;     // host time spent decoding/parsing
+    bool usedProbe = false;
+    bool probeFailed = false;  // helper stream ended early; the rest came over text
+};
+
+// Incremental decoder; records may be split across reads.
+class TelemetryDecoder {
+public:
+    explicit TelemetryDecoder(const std::string& serial) : serial(serial) {}
+
+    // Decode what is complete so far. False on a malformed stream.
+    bool feed(const char* data, size_t size, std::vector<TelemetrySample>& out);
+
+    bool sawHello() const { return helloSeen; }
+
+private:
+    std::string serial;
+    std::string pending;
+    bool helloSeen = false;
+};
+
+// Version the host expects from "adfxt_probe --version".
+constexpr int kProbeVersion = 2;
+constexpr const char* kProbeDevicePath = "/data/local/tmp/adfxt_probe";
+
+// Push the helper to the device unless the right version is already there.
+// The local binary comes from ADFXT_PROBE or ./adfxt_probe. Checked once per
+// device per process.
+bool ensureProbe(const std::string& serial, std::string& error);
+
+// Deliver `count` samples (0 = until the callback returns false or shutdown)
+// every `intervalMs`. Uses the helper when allowed and available, otherwise
+// the text collectors.
+bool streamTelemetry(const std::string& serial, int intervalMs, int count, bool allowProbe,
+    const std::function<bool(const TelemetrySample&)>& onSample, TelemetryStats* stats = nullptr);
@@ -0,0 +1,476 @@
+// TestRunner.cpp
+// "am instrument" output parsing, sharding and the per-device workers.
+
+#include "TestRunner.h"
+#include "Adb.h"
+#include "Process.h"
+#include "Shutdown.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+// ===== Output parsing =====
+void InstrumentationParser::feed(const char* data, size_t size, const function<void(const Status&)>& onStatus) {
+    partial.append(data, size);
+    size_t start = 0, nl;
+    while ((nl = partial.find('\n', start)) != string::npos) {
+        size_t end = nl > start && partial[nl - 1] == '\r' ? nl - 1 : nl;
+        line(partial.substr(start, end - start), onStatus);
+        start = nl + 1;
+    }
+    partial.erase(0, start);
+}
+
+void InstrumentationParser::finish(const function<void(const Status&)>& onStatus) {
+    if (!partial.empty()) line(partial, onStatus);
+    partial.clear();
+}
+
+void InstrumentationParser::line(const string& text, const function<void(const Status&)>& onStatus) {
+    static const string kStatus = "INSTRUMENTATION_STATUS: ";
+    static const string kStatusCode = "INSTRUMENTATION_STATUS_CODE: ";
+    static const string kResult = "INSTRUMENTATION_RESULT: ";
+    static const string kCode = "INSTRUMENTATION_CODE: ";
+
+    auto keyValue = [&](const string& rest, map<string, string>& into) {
+        size_t eq = rest.find('=');
+        string& slot = into[rest.substr(0, eq)];
+        slot = eq == string::npos ? string() : rest.substr(eq + 1);
+        lastValue = &slot;
+    };
+    if (text.compare(0, kStatusCode.size(), kStatusCode) == 0) {
+        Status status;
+        status.code = atoi(text.c_str() + kStatusCode.size());
+        status.values.swap(current);
+        lastValue = nullptr;
+        onStatus(status);
+    }
+    else if (text.compare(0, kStatus.size(), kStatus) == 0) keyValue(text.substr(kStatus.size()), current);
+    else if (text.compare(0, kResult.size(), kResult) == 0) keyValue(text.substr(kResult.size()), resultValues);
+    else if (text.compare(0, kCode.size(), kCode) == 0) {
+        resultValues["code"] = text.substr(kCode.size());
+        haveResult = true;
+        lastValue = nullptr;
+    }
+    else if (lastValue) {
+        // Stack traces and streams span lines
+        *lastValue += '\n';
+        *lastValue += text;
+    }
+}
+
+static string testId(const map<string, string>& values) {
+    auto cls = values.find("class"), test = values.find("test");
+    if (cls == values.end() || test == values.end()) return "";
+    return cls->second + "#" + test->second;
+}
+
+static string joined(const vector<string>& items, const char* sep) {
+    string out;
+    for (size_t i = 0; i < items.size(); i++) out += (i ? sep : "") + items[i];
+    return out;
+}
+
+bool listInstrumentationTests(const string& serial, const string& runner, const vector<string>& classes,
+    vector<string>& tests, string& error) {
+    string cmd = "adb -s " + serial + " shell am instrument -w -r -e log true";
+    if (!classes.empty()) cmd += " -e class " + hostQuote("'" + joined(classes, ",") + "'");
+    cmd += " " + hostQuote(runner);
+    string output = runCommand(cmd);
+
+    InstrumentationParser parser;
+    set<string> seen;
+    auto onStatus = [&](const InstrumentationParser::Status& s) {
+        string id = testId(s.values);
+        if (s.code == 1 && !id.empty() && seen.insert(id).second) tests.push_back(id);
+    };
+    parser.feed(output.data(), output.size(), onStatus);
+    parser.finish(onStatus);
+    if (tests.empty()) {
+        auto msg = parser.result().find("shortMsg");
+        error = msg != parser.result().end() ? msg->second
+            : output.find("INSTRUMENTATION_FAILED") != string::npos ? "instrumentation failed: " + runner
+            : "no tests found for " + runner;
+        return false;
+    }
+    return true;
+}
+
+// ===== History =====
+map<string, double> loadTestHistory(const string& path) {
+    map<string, double> history;
+    ifstream in(path);
+    string line;
+    while (getline(in, line)) {
+        size_t tab = line.find('\t');
+        if (tab != string::npos) history[line.substr(0, tab)] = atof(line.c_str() + tab + 1);
+    }
+    return history;
+}
+
+bool saveTestHistory(const string& path, const map<string, double>& history) {
+    ofstream out(path + ".tmp", ios::trunc);
+    for (auto& [test, ms] : history) out << test << "\t" << (int64_t)ms << "\n";
+    out.close();
+    if (!out) return false;
+    remove(path.c_str());
+    return rename((path + ".tmp").c_str(), path.c_str()) == 0;
+}
+
+// ===== Scheduling =====
+namespace {
+struct Outcome {
+    string status;               // passed, failed, skipped; "" = no result
+    bool started = false;        // reported its start
+    int64_t ms = 0;
+    string message;
+};
+
+// Per-device deques under one lock; scheduling is per batch, so the lock
+// is taken a handful of times a minute per device.
+class Scheduler {
+public:
+    Scheduler(const vector<string>& serials, const vector<string>& tests, const vector<double>& expected,
+        const TestRunOptions& opts)
+        : tests(tests), expected(expected), opts(opts), attempts(tests.size(), 0), decided(tests.size(), false) {
+        // Longest first onto the least loaded device
+        vector<size_t> order(tests.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+        stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return expected[a] > expected[b]; });
+        for (const string& s : serials) {
+            queues[s];
+            load[s] = 0;
+        }
+        working.insert(serials.begin(), serials.end());
+        spread(order);
+    }
+
+    // Next batch for `device`; false when nothing is left for it.
+    bool next(const string& device, vector<size_t>& batch, TestRunStats& stats) {
+        unique_lock<mutex> lock(m);
+        batch.clear();
+        while (!shutdownRequested()) {
+            takeRetries(device, false, batch);
+            if (batch.empty()) takeFrom(device, true, batch);
+            if (batch.empty()) {
+                // Steal from the back (the shortest tests) of the most loaded queue
+                const string* victim = nullptr;
+                for (auto& [serial, q] : queues)
+                    if (serial != device && !q.empty() && (!victim || load[serial] > load[*victim])) victim = &serial;
+                if (victim) {
+                    takeFrom(*victim, false, batch);
+                    stats.steals++;
+                }
+            }
+            // Retries meant for another device, but nobody else is left to run them
+            if (batch.empty() && running == 0) takeRetries(device, true, batch);
+            if (!batch.empty()) {
+                running++;
+                return true;
+            }
+            if (running == 0) return false;
+            changed.wait(lock);   // a running batch may still produce retries
+        }
+        return false;
+    }
+
+    // Record a batch's outcomes; tests without one are retried elsewhere
+    // (device trouble, or never getting to start, does not count as an
+    // attempt).
+    void complete(const string& device, const vector<size_t>& batch, const vector<Outcome>& outcomes,
+        bool deviceFailed, map<string, double>& history, vector<TestResult>& results,
+        const function<void(const TestResult&)>& onResult, TestRunStats& stats) {
+        lock_guard<mutex> lock(m);
+        running--;
+        vector<size_t> orphans;
+        for (size_t i = 0; i < batch.size(); i++) {
+            size_t t = batch[i];
+            const Outcome& o = outcomes[i];
+            if (deviceFailed || (o.status.empty() && !o.started)) {
+                orphans.push_back(t);
+                continue;
+            }
+            attempts[t]++;
+            stats.testMs += o.ms;
+            if (o.status == "passed" || o.status == "failed") {
+                double& h = history[tests[t]];
+                h = h > 0 ? 0.5 * h + 0.5 * (double)o.ms : (double)o.ms;
+            }
+            if ((o.status.empty() || o.status == "failed") && attempts[t] <= opts.retries) {
+                retry.push_back({ t, device });
+                stats.retries++;
+                continue;
+            }
+            TestResult r;
+            r.test = tests[t];
+            r.status = o.status.empty() ? "error" : o.status == "passed" && attempts[t] > 1 ? "flaky" : o.status;
+            r.device = device;
+            r.attempts = attempts[t];
+            r.ms = o.ms;
+            r.message = o.message;
+            decided[t] = true;
+            results.push_back(r);
+            onResult(r);
+        }
+        spread(orphans, device);
+        changed.notify_all();
+    }
+
+    // A device is done or gave up; anything left in its queue goes to the others.
+    void retire(const string& device) {
+        lock_guard<mutex> lock(m);
+        working.erase(device);
+        vector<size_t> left(queues[device].begin(), queues[device].end());
+        queues[device].clear();
+        load[device] = 0;
+        spread(left, device);
+        changed.notify_all();
+    }
+
+    bool isDecided(size_t t) const { return decided[t]; }
+
+private:
+    struct Retry {
+        size_t test;
+        string avoid;
+    };
+
+    // Longest first onto the least loaded working device (other than `avoid`
+    // when possible).
+    void spread(vector<size_t> items, const string& avoid = "") {
+        stable_sort(items.begin(), items.end(), [&](size_t a, size_t b) { return expected[a] > expected[b]; });
+        for (size_t t : items) {
+            const string* lightest = nullptr;
+            for (const string& s : working)
+                if ((s != avoid || working.size() == 1) && (!lightest || load[s] < load[*lightest])) lightest = &s;
+            if (!lightest) {
+                retry.push_back({ t, avoid });   // nobody left; next() hands these to whoever asks
+                continue;
+            }
+            queues[*lightest].push_back(t);
+            load[*lightest] += expected[t];
+        }
+    }
+
+    bool full(const vector<size_t>& batch, double ms, double limitMs) const {
+        return batch.size() >= opts.maxBatch || ms >= limitMs;
+    }
+
+    // Guided sizing: about half of what the queue holds, so the tail of
+    // every queue stays small enough to be stolen and rebalanced, but not
+    // so little that "am instrument" startup dominates.
+    void takeFrom(const string& owner, bool front, vector<size_t>& batch) {
+        deque<size_t>& q = queues[owner];
+        double limit = max(min((double)opts.batchMs, load[owner] / 2), (double)opts.batchMs / 4);
+        double ms = 0;
+        while (!q.empty() && (batch.empty() || !full(batch, ms, limit))) {
+            size_t t = front ? q.front() : q.back();
+            if (front) q.pop_front();
+            else q.pop_back();
+            batch.push_back(t);
+            ms += expected[t];
+            load[owner] -= expected[t];
+        }
+    }
+
+    void takeRetries(const string& device, bool anyDevice, vector<size_t>& batch) {
+        double ms = 0;
+        for (auto it = retry.begin(); it != retry.end() && !full(batch, ms, (double)opts.batchMs);) {
+            if (!anyDevice && it->avoid == device && working.size() > 1) {
+                ++it;
+                continue;
+            }
+            batch.push_back(it->test);
+            ms += expected[it->test];
+            it = retry.erase(it);
+        }
+    }
+
+    const vector<string>& tests;
+    const vector<double>& expected;
+    const TestRunOptions& opts;
+    mutex m;
+    condition_variable changed;
+    map<string, deque<size_t>> queues;
+    map<string, double> load;        // expected ms left in each queue
+    deque<Retry> retry;
+    vector<int> attempts;
+    vector<bool> decided;
+    int running = 0;                 // batches in flight
+    set<string> working;             // devices still taking batches
+};
+}
+
+// One "am instrument" call; outcomes are indexed like `batch`.
+static bool runBatch(const string& serial, const TestRunOptions& opts, const vector<string>& ids,
+    int64_t timeoutMs, vector<Outcome>& outcomes) {
+    outcomes.assign(ids.size(), Outcome());
+    map<string, size_t> index;
+    for (size_t i = 0; i < ids.size(); i++) index[ids[i]] = i;
+
+    string cmd = "adb -s " + serial + " shell am instrument -w -r -e class " +
+        hostQuote("'" + joined(ids, ",") + "'") + " " + hostQuote(opts.runner);
+    InstrumentationParser parser;
+    auto started = chrono::steady_clock::now();
+    bool sawStatus = false;
+    auto onStatus = [&](const InstrumentationParser::Status& s) {
+        sawStatus = true;
+        auto it = index.find(testId(s.values));
+        if (it == index.end()) return;
+        Outcome& o = outcomes[it->second];
+        if (s.code == 1) {
+            started = chrono::steady_clock::now();
+            o.started = true;
+            return;
+        }
+        o.ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - started).count();
+        o.status = s.code == 0 ? "passed" : s.code == -3 || s.code == -4 ? "skipped" : "failed";
+        auto stack = s.values.find("stack");
+        if (stack != s.values.end()) o.message = stack->second.substr(0, stack->second.find('\n'));
+    };
+    auto onData = [&](const char* data, size_t size) {
+        parser.feed(data, size, onStatus);
+        return !shutdownRequested();
+    };
+    int rc = opts.run ? opts.run(cmd, onData, (int)timeoutMs) : runCommandStreaming(cmd, onData, (int)timeoutMs);
+    parser.finish(onStatus);
+
+    // Tests that never reported: the process crashed, hung or was cut short
+    auto msg = parser.result().find("shortMsg");
+    for (Outcome& o : outcomes)
+        if (o.status.empty())
+            o.message = rc == kProcessTimedOut ? "timed out after " + to_string(timeoutMs / 1000) + " s"
+                : msg != parser.result().end() ? msg->second : "no result from instrumentation";
+    return sawStatus || parser.finished();
+}
+
+vector<TestResult> runShardedTests(const vector<string>& serials, const vector<string>& tests,
+    const TestRunOptions& opts, map<string, double>& history, const function<void(const TestResult&)>& onResult,
+    TestRunStats& stats) {
+    auto wallStart = chrono::steady_clock::now();
+
+    // Unknown tests are assumed to take the median known duration
+    vector<double> known;
+    for (const string& t : tests) {
+        auto it = history.find(t);
+        if (it != history.end() && it->second > 0) known.push_back(it->second);
+    }
+    sort(known.begin(), known.end());
+    double fallback = known.empty() ? 1000.0 : known[known.size() / 2];
+    vector<double> expected;
+    for (const string& t : tests) {
+        auto it = history.find(t);
+        expected.push_back(it != history.end() && it->second > 0 ? it->second : fallback);
+    }
+
+    Scheduler scheduler(serials, tests, expected, opts);
+    vector<TestResult> results;
+    mutex statsMutex;
+    vector<thread> workers;
+    for (const string& serial : serials) {
+        stats.busyMs[serial] = 0;
+        workers.emplace_back([&, serial] {
+            int failures = 0;
+            vector<size_t> batch;
+            vector<Outcome> outcomes;
+            while (scheduler.next(serial, batch, stats)) {
+                vector<string> ids;
+                double batchExpectedMs = 0;
+                for (size_t t : batch) {
+                    ids.push_back(tests[t]);
+                    batchExpectedMs += expected[t];
+                }
+                int64_t timeoutMs = opts.batchTimeoutMs > 0 ? opts.batchTimeoutMs : (int64_t)(3 * batchExpectedMs) + 60000;
+                auto t0 = chrono::steady_clock::now();
+                bool ok = runBatch(serial, opts, ids, timeoutMs, outcomes);
+                int64_t ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - t0).count();
+                {
+                    lock_guard<mutex> lock(statsMutex);
+                    stats.busyMs[serial] += ms;
+                    stats.batches++;
+                }
+                scheduler.complete(serial, batch, outcomes, !ok, history, results, onResult, stats);
+                // Two dead batches in a row: leave the rest to the other devices
+                failures = ok ? 0 : failures + 1;
+                if (failures >= 2) break;
+            }
+            scheduler.retire(serial);
+        });
+    }
+    for (auto& w : workers) w.join();
+
+    for (size_t t = 0; t < tests.size(); t++)
+        if (!scheduler.isDecided(t)) {
+            TestResult r;
+            r.test = tests[t];
+            r.status = "error";
+            r.message = shutdownRequested() ? "not run: interrupted" : "not run: no device could run it";
+            results.push_back(r);
+            onResult(r);
+        }
+    sort(results.begin(), results.end(), [](const TestResult& a, const TestResult& b) { return a.test < b.test; });
+    stats.wallMs = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - wallStart).count();
+    return results;
+}
+
+// ===== Report =====
+static string xmlEscape(const string& s) {
+    string out;
+    for (char c : s) {
+        switch (c) {
+        case '&': out += "&amp;"; break;
+        case '<': out += "&lt;"; break;
+        case '>': out += "&gt;"; break;
+        case '"': out += "&quot;"; break;
+        default: out += c;
+        }
+    }
+    return out;
+}
+
+bool writeJUnitReport(const string& path, const vector<TestResult>& results, const TestRunStats& stats,
+    string& error) {
+    size_t failures = 0, errors = 0, skipped = 0;
+    for (const TestResult& r : results) {
+        failures += r.status == "failed";
+        errors += r.status == "error";
+        skipped += r.status == "skipped";
+    }
+    ostringstream xml;
+    xml << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<testsuite name=\"instrumentation\" tests=\"" << results.size() << "\" failures=\"" << failures
+        << "\" errors=\"" << errors << "\" skipped=\"" << skipped << "\" time=\"" << stats.wallMs / 1000.0 << "\">\n";
+    for (const TestResult& r : results) {
+        size_t hash = r.test.find('#');
+        xml << "  <testcase classname=\"" << xmlEscape(r.test.substr(0, hash)) << "\" name=\""
+            << xmlEscape(hash == string::npos ? r.test : r.test.substr(hash + 1)) << "\" time=\"" << r.ms / 1000.0 << "\"";
+        if (r.status == "passed") {
+            xml << "/>\n";
+            continue;
+        }
+        xml << ">\n";
+        if (r.status == "failed") xml << "    <failure message=\"" << xmlEscape(r.message) << "\"/>\n";
+        else if (r.status == "error") xml << "    <error message=\"" << xmlEscape(r.message) << "\"/>\n";
+        else if (r.status == "skipped") xml << "    <skipped/>\n";
+        else if (r.status == "flaky") xml << "    <system-out>flaky: passed on attempt " << r.attempts << "</system-out>\n";
+        xml << "  </testcase>\n";
+    }
+    xml << "</testsuite>\n";
+
+    ofstream out(path, ios::trunc);
+    out << xml.str();
+    if (!out) {
+        error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
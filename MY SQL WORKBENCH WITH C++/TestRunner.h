@@ -0,0 +1,96 @@
+// TestRunner.h
+// Instrumentation tests ("am instrument -r") sharded across devices.
+// Tests are first spread over per-device queues by expected duration
+// (longest first onto the least loaded device), using the durations
+// recorded by earlier runs. Each device then runs batches from the front of
+// its own queue and, once that is empty, steals from the back of the most
+// loaded queue. A failed test is retried on another device; passing on a
+// retry marks it flaky.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// Incremental parser for "am instrument -r" output.
+class InstrumentationParser {
+public:
+    struct Status {
+        int code = 0;                           // 1 start, 0 ok, -1 error, -2 failure, -3 ignored, -4 assumption
+        std::map<std::string, std::string> values;  // class, test, stack, ...
+    };
+
+    // Complete status blocks go to `onStatus`.
+    void feed(const char* data, size_t size, const std::function<void(const Status&)>& onStatus);
+    void finish(const std::function<void(const Status&)>& onStatus);
+
+    // INSTRUMENTATION_RESULT values and code, once seen.
+    bool finished() const { return haveResult; }
+    const std::map<std::string, std::string>& result() const { return resultValues; }
+
+private:
+    void line(const std::string& text, const std::function<void(const Status&)>& onStatus);
+
+    std::string partial;
+    std::map<std::string, std::string> current;
+    std::map<std::string, std::string> resultValues;
+    std::string* lastValue = nullptr;           // continuation lines append here
+    bool haveResult = false;
+};
+
+// "pkg.Class#method" of every test the runner would run, without running
+// them ("-e log true"). `classes` narrows the run ("-e class").
+bool listInstrumentationTests(const std::string& serial, const std::string& runner,
+    const std::vector<std::string>& classes, std::vector<std::string>& tests, std::string& error);
+
+struct TestResult {
+    std::string test;            // "pkg.Class#method"
+    std::string status;          // passed, failed, flaky, skipped, error
+    std::string device;          // device of the final attempt
+    int attempts = 0;
+    int64_t ms = 0;              // duration of the final attempt
+    std::string message;         // first line of the failure, if any
+};
+
+struct TestRunOptions {
+    std::string runner;          // "com.example.test/androidx.test.runner.AndroidJUnitRunner"
+    int retries = 1;             // extra attempts for a failed test, on another device
+    int64_t batchMs = 20000;     // longest expected duration per "am instrument" call;
+                                 // a quarter of it is the shortest
+    size_t maxBatch = 25;        // tests per call
+    int64_t batchTimeoutMs = 0;  // kill a call running longer; 0 = 3x its expected time + 60 s
+    // Runs one "am instrument" command line, as runCommandStreaming does
+    // (which is used when unset); the self-tests plug in simulated devices.
+    std::function<int(const std::string& cmd, const std::function<bool(const char*, size_t)>& onData,
+        int timeoutMs)> run;
+};
+
+struct TestRunStats {
+    int64_t wallMs = 0;
+    int64_t testMs = 0;          // sum of every attempt
+    uint64_t batches = 0;
+    uint64_t steals = 0;
+    uint64_t retries = 0;
+    std::map<std::string, int64_t> busyMs;  // per device
+};
+
+// Expected test durations in ms, a "test<TAB>ms" file kept across runs.
+std::map<std::string, double> loadTestHistory(const std::string& path);
+bool saveTestHistory(const std::string& path, const std::map<std::string, double>& history);
+
+// Run `tests` on `serials` and return one merged result per test. `history`
+// seeds the sharding and is updated with the new durations. A test still
+// running when its call times out is failed and retried like a crash; the
+// tests queued behind it in that call go back to the queues. `onResult`
+// sees each final result as it is decided (called from device threads,
+// one at a time).
+std::vector<TestResult> runShardedTests(const std::vector<std::string>& serials,
+    const std::vector<std::string>& tests, const TestRunOptions& opts, std::map<std::string, double>& history,
+    const std::function<void(const TestResult&)>& onResult, TestRunStats& stats);
+
+// JUnit XML report of merged results.
+bool writeJUnitReport(const std::string& path, const std::vector<TestResult>& results,
+    const TestRunStats& stats, std::string& error);
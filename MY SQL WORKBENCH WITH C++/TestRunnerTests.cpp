@@ -0,0 +1,140 @@
+// TestRunnerTests.cpp
+// runShardedTests against simulated devices: "am instrument -r" output is
+// produced in-process with real sleeps, so sharding, stealing, retries and
+// batch timeouts run exactly as they do against adb.
+
+#include "Process.h"
+#include "SelfTest.h"
+#include "TestRunner.h"
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <set>
+#include <thread>
+
+using namespace std;
+
+struct SimTest {
+    string cls;
+    string method;
+    int ms;
+};
+
+// 4 classes x 12 methods, 20-260 ms each (6.7 s in total)
+static vector<SimTest> simSuite() {
+    vector<SimTest> suite;
+    for (int c = 0; c < 4; c++)
+        for (int m = 0; m < 12; m++)
+            suite.push_back({ "com.ex.Suite" + to_string(c) + "Test", "test" + to_string(m), 20 + 30 * ((c * 7 + m * 3) % 9) });
+    return suite;
+}
+
+static vector<string> ids(const vector<SimTest>& suite) {
+    vector<string> out;
+    for (const SimTest& t : suite) out.push_back(t.cls + "#" + t.method);
+    return out;
+}
+
+// Answers "am instrument" command lines for the tests they name, in suite
+// order. Tests in `hang` never finish; devices in `slowMs` take that long
+// for every test.
+static TestRunOptions simulatedDevices(const vector<SimTest>& suite, const set<string>& hang,
+    const map<string, int>& slowMs = {}) {
+    TestRunOptions opts;
+    opts.runner = "com.ex.test/androidx.test.runner.AndroidJUnitRunner";
+    opts.run = [suite, hang, slowMs](const string& cmd, const function<bool(const char*, size_t)>& onData, int timeoutMs) {
+        auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs > 0 ? timeoutMs : 3600000);
+        auto emit = [&](const SimTest& t, int code) {
+            string block = "INSTRUMENTATION_STATUS: class=" + t.cls + "\nINSTRUMENTATION_STATUS: test=" + t.method +
+                "\nINSTRUMENTATION_STATUS_CODE: " + to_string(code) + "\n";
+            return onData(block.data(), block.size());
+        };
+        for (const SimTest& t : suite) {
+            string id = t.cls + "#" + t.method;
+            size_t at = cmd.find(id);
+            if (at == string::npos || isalnum((unsigned char)cmd[at + id.size()])) continue;
+            if (!emit(t, 1)) return -1;
+            int ms = t.ms;
+            for (auto& [serial, slow] : slowMs)
+                if (cmd.find("-s " + serial + " ") != string::npos) ms = slow;
+            auto done = hang.count(id) ? chrono::steady_clock::time_point::max()
+                : chrono::steady_clock::now() + chrono::milliseconds(ms);
+            if (done > deadline) {
+                this_thread::sleep_until(deadline);
+                return kProcessTimedOut;
+            }
+            this_thread::sleep_until(done);
+            if (!emit(t, 0)) return -1;
+        }
+        string result = "INSTRUMENTATION_RESULT: stream=OK\nINSTRUMENTATION_CODE: -1\n";
+        onData(result.data(), result.size());
+        return 0;
+    };
+    return opts;
+}
+
+static vector<TestResult> runSimulated(const vector<string>& serials, const vector<SimTest>& suite,
+    const TestRunOptions& opts, TestRunStats& stats) {
+    map<string, double> history;
+    return runShardedTests(serials, ids(suite), opts, history, [](const TestResult&) {}, stats);
+}
+
+SELFTEST(test_runner_hung_test_times_out) {
+    vector<SimTest> suite = { { "com.ex.A", "t1", 10 }, { "com.ex.A", "t2", 10 }, { "com.ex.A", "hangs", 10 },
+        { "com.ex.A", "t4", 10 }, { "com.ex.B", "t1", 10 }, { "com.ex.B", "t2", 10 } };
+    TestRunOptions opts = simulatedDevices(suite, { "com.ex.A#hangs" });
+    opts.batchTimeoutMs = 300;
+    opts.retries = 1;
+    TestRunStats stats;
+    auto t0 = chrono::steady_clock::now();
+    vector<TestResult> results = runSimulated({ "SIM1", "SIM2" }, suite, opts, stats);
+    CHECK(chrono::steady_clock::now() - t0 < chrono::seconds(5));
+
+    CHECK_EQ(results.size(), suite.size());
+    for (const TestResult& r : results) {
+        if (r.test == "com.ex.A#hangs") {
+            CHECK_EQ(r.status, "error");
+            CHECK_EQ(r.attempts, 2);
+            CHECK(r.message.find("timed out") != string::npos);
+        }
+        else {
+            CHECK_EQ(r.status, "passed");
+            CHECK_EQ(r.attempts, 1);
+        }
+    }
+}
+
+SELFTEST(test_runner_idle_device_steals) {
+    // Equal expected times split the tests evenly; SIM1 is 100x slower, so
+    // SIM2 runs out of work and must take tests queued for SIM1
+    vector<SimTest> suite;
+    for (int i = 0; i < 8; i++) suite.push_back({ "com.ex.A", "t" + to_string(i), 1 });
+    TestRunOptions opts = simulatedDevices(suite, {}, { { "SIM1", 100 } });
+    opts.batchMs = 100;
+    TestRunStats stats;
+    vector<TestResult> results = runSimulated({ "SIM1", "SIM2" }, suite, opts, stats);
+    size_t onFast = 0;
+    for (const TestResult& r : results) {
+        CHECK_EQ(r.status, "passed");
+        onFast += r.device == "SIM2";
+    }
+    CHECK(stats.steals > 0);
+    CHECK(onFast > suite.size() / 2);
+}
+
+// Wall time of the 48-test suite on one device and on four
+SELFBENCH(test_runner_bench_sharding) {
+    vector<SimTest> suite = simSuite();
+    TestRunOptions opts = simulatedDevices(suite, {});
+    TestRunStats one, four;
+    vector<TestResult> a = runSimulated({ "SIM1" }, suite, opts, one);
+    vector<TestResult> b = runSimulated({ "SIM1", "SIM2", "SIM3", "SIM4" }, suite, opts, four);
+    for (const vector<TestResult>* results : { &a, &b }) {
+        size_t passed = 0;
+        for (const TestResult& r : *results) passed += r.status == "passed";
+        CHECK_EQ(passed, suite.size());
+    }
+    cerr << "    48 tests: 1 device " << one.wallMs << " ms, 4 devices " << four.wallMs << " ms ("
+        << four.batches << " batches, " << four.steals << " steals)\n";
+}
@@ -0,0 +1,554 @@
+// TimeSeries.cpp
+// Gorilla bit packing, block files and rollups.
+//
+// Block (little-endian), appended to its period file:
+//   "TSB1" | columns u8 | resolution u8 | reserved u16 | rows u32 |
+//   payload bytes u32 | min ts i64 | max ts i64 | payload
+// Raw blocks have one column (the value); rollup blocks four (min, max,
+// sum, count) with the bucket start as the timestamp.
+
+#include "TimeSeries.h"
+#include "CivilDate.h"
+#include "SerialDir.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static const size_t kHeaderBytes = 32;
+static const int kRollupColumns = 4;
+static const int64_t kDayMs = 86400000;
+
+// Gorilla uses two-hour blocks; at 1 Hz that is 7200 points.
+static size_t blockLimit(Resolution res) {
+    return res == Resolution::Raw ? 7200 : res == Resolution::Minute ? 1440 : 744;
+}
+
+static int64_t bucketMs(Resolution res) {
+    return res == Resolution::Minute ? 60000 : 3600000;
+}
+
+// ===== Bit packing =====
+// Both expect x != 0.
+static int leadingZeros(uint64_t x) {
+    int n = 0;
+    for (int shift = 32; shift > 0; shift >>= 1)
+        if (!(x >> (64 - shift))) {
+            n += shift;
+            x <<= shift;
+        }
+    return n;
+}
+
+static int trailingZeros(uint64_t x) {
+    int n = 0;
+    for (int shift = 32; shift > 0; shift >>= 1)
+        if (!(x << (64 - shift))) {
+            n += shift;
+            x >>= shift;
+        }
+    return n;
+}
+
+static uint64_t bitsOf(double v) {
+    uint64_t u;
+    memcpy(&u, &v, sizeof(u));
+    return u;
+}
+
+static double doubleOf(uint64_t u) {
+    double v;
+    memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+GorillaEncoder::GorillaEncoder(int columns) : cols(columns) {}
+
+void GorillaEncoder::writeBits(uint64_t value, int bits) {
+    while (bits > 0) {
+        if (bitPos == 0) out.push_back(0);
+        int take = min(bits, 8 - bitPos);
+        uint8_t chunk = (uint8_t)((value >> (bits - take)) & ((1u << take) - 1));
+        out.back() |= (uint8_t)(chunk << (8 - bitPos - take));
+        bitPos = (bitPos + take) % 8;
+        bits -= take;
+    }
+}
+
+void GorillaEncoder::append(int64_t tsMs, const double* values) {
+    if (points == 0) {
+        writeBits((uint64_t)tsMs, 64);
+        for (size_t c = 0; c < cols.size(); c++) {
+            cols[c].prev = bitsOf(values[c]);
+            writeBits(cols[c].prev, 64);
+        }
+        prevTs = tsMs;
+        points++;
+        return;
+    }
+
+    // Delta-of-delta: a regular sampler mostly costs a single bit
+    int64_t delta = tsMs - prevTs;
+    int64_t dod = delta - prevDelta;
+    if (dod == 0) writeBits(0, 1);
+    else if (dod >= -63 && dod <= 64) {
+        writeBits(0x2, 2);
+        writeBits((uint64_t)(dod + 63), 7);
+    }
+    else if (dod >= -255 && dod <= 256) {
+        writeBits(0x6, 3);
+        writeBits((uint64_t)(dod + 255), 9);
+    }
+    else if (dod >= -2047 && dod <= 2048) {
+        writeBits(0xE, 4);
+        writeBits((uint64_t)(dod + 2047), 12);
+    }
+    else {
+        writeBits(0xF, 4);
+        writeBits((uint64_t)dod, 64);
+    }
+    prevTs = tsMs;
+    prevDelta = delta;
+
+    // XOR with the previous value; reuse the last leading/trailing window when it fits
+    for (size_t c = 0; c < cols.size(); c++) {
+        Column& col = cols[c];
+        uint64_t bits = bitsOf(values[c]);
+        uint64_t x = bits ^ col.prev;
+        col.prev = bits;
+        if (x == 0) {
+            writeBits(0, 1);
+            continue;
+        }
+        int leading = min(leadingZeros(x), 31);
+        int trailing = trailingZeros(x);
+        if (col.leading >= 0 && leading >= col.leading && trailing >= col.trailing) {
+            writeBits(0x2, 2);
+            writeBits(x >> col.trailing, 64 - col.leading - col.trailing);
+        }
+        else {
+            int meaningful = 64 - leading - trailing;
+            writeBits(0x3, 2);
+            writeBits((uint64_t)leading, 5);
+            writeBits((uint64_t)(meaningful - 1), 6);
+            writeBits(x >> trailing, meaningful);
+            col.leading = leading;
+            col.trailing = trailing;
+        }
+    }
+    points++;
+}
+
+namespace {
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size) : data(data), bits(size * 8) {}
+
+    bool read(int n, uint64_t& value) {
+        if (pos + n > bits) return false;
+        value = 0;
+        while (n > 0) {
+            int offset = (int)(pos % 8);
+            int take = min(n, 8 - offset);
+            uint8_t byte = data[pos / 8];
+            value = value << take | ((byte >> (8 - offset - take)) & ((1u << take) - 1));
+            pos += take;
+            n -= take;
+        }
+        return true;
+    }
+
+    // Number of leading 1 bits, up to `max`
+    bool ones(int max, int& count) {
+        count = 0;
+        uint64_t bit;
+        while (count < max) {
+            if (!read(1, bit)) return false;
+            if (!bit) break;
+            count++;
+        }
+        return true;
+    }
+
+private:
+    const uint8_t* data;
+    size_t bits;
+    size_t pos = 0;
+};
+}
+
+bool gorillaDecode(const uint8_t* data, size_t size, int columns, size_t count,
+    vector<int64_t>& timestamps, vector<double>& values) {
+    BitReader in(data, size);
+    vector<uint64_t> prev(columns);
+    vector<int> leading(columns, 0), trailing(columns, 0);
+    int64_t ts = 0, delta = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t v;
+        if (i == 0) {
+            if (!in.read(64, v)) return false;
+            ts = (int64_t)v;
+        }
+        else {
+            int prefix;
+            if (!in.ones(4, prefix)) return false;
+            static const int widths[] = { 0, 7, 9, 12, 64 };
+            static const int64_t bias[] = { 0, 63, 255, 2047, 0 };
+            int64_t dod = 0;
+            if (prefix > 0) {
+                if (!in.read(widths[prefix], v)) return false;
+                dod = (int64_t)v - bias[prefix];
+            }
+            delta += dod;
+            ts += delta;
+        }
+        timestamps.push_back(ts);
+
+        for (int c = 0; c < columns; c++) {
+            if (i == 0) {
+                if (!in.read(64, prev[c])) return false;
+            }
+            else {
+                int prefix;
+                if (!in.ones(2, prefix)) return false;
+                if (prefix == 1) {
+                    if (!in.read(64 - leading[c] - trailing[c], v)) return false;
+                    prev[c] ^= v << trailing[c];
+                }
+                else if (prefix == 2) {
+                    uint64_t lead, len;
+                    if (!in.read(5, lead) || !in.read(6, len) || !in.read((int)len + 1, v)) return false;
+                    leading[c] = (int)lead;
+                    trailing[c] = 64 - (int)lead - (int)len - 1;
+                    if (trailing[c] < 0) return false;
+                    prev[c] ^= v << trailing[c];
+                }
+            }
+            values.push_back(doubleOf(prev[c]));
+        }
+    }
+    return true;
+}
+
+// ===== Periods =====
+static int64_t floorDiv(int64_t a, int64_t b) {
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+static const char* resolutionPrefix(Resolution res) {
+    return res == Resolution::Raw ? "raw" : res == Resolution::Minute ? "1m" : "1h";
+}
+
+// Raw data is filed per UTC day, rollups per UTC month.
+static string periodFile(Resolution res, int64_t tsMs) {
+    int64_t y;
+    int m, d;
+    civilFromDays(floorDiv(tsMs, kDayMs), y, m, d);
+    char name[32];
+    if (res == Resolution::Raw) snprintf(name, sizeof(name), "raw-%04lld%02d%02d.tsb", (long long)y, m, d);
+    else snprintf(name, sizeof(name), "%s-%04lld%02d.tsb", resolutionPrefix(res), (long long)y, m);
+    return name;
+}
+
+// [start, end) covered by a period file name; false if it is not one.
+static bool periodRange(const string& name, Resolution res, int64_t& start, int64_t& end) {
+    string prefix = string(resolutionPrefix(res)) + "-";
+    size_t digits = res == Resolution::Raw ? 8 : 6;
+    if (name.size() != prefix.size() + digits + 4 || name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - 4, 4, ".tsb") != 0)
+        return false;
+    string num = name.substr(prefix.size(), digits);
+    if (num.find_first_not_of("0123456789") != string::npos) return false;
+    int64_t y = stoll(num.substr(0, 4));
+    int m = stoi(num.substr(4, 2));
+    if (res == Resolution::Raw) {
+        int64_t day = daysFromCivil(y, m, stoi(num.substr(6, 2)));
+        start = day * kDayMs;
+        end = start + kDayMs;
+    }
+    else {
+        start = daysFromCivil(y, m, 1) * kDayMs;
+        end = (m == 12 ? daysFromCivil(y + 1, 1, 1) : daysFromCivil(y, m + 1, 1)) * kDayMs;
+    }
+    return true;
+}
+
+bool parseResolution(const string& text, Resolution& res) {
+    if (text == "raw") res = Resolution::Raw;
+    else if (text == "1m") res = Resolution::Minute;
+    else if (text == "1h") res = Resolution::Hour;
+    else return false;
+    return true;
+}
+
+// ===== Store =====
+// "SERIAL/metric" -> root/SERIAL/metric, the serial made safe as a name
+static fs::path seriesDir(const string& root, const string& series) {
+    size_t slash = series.find('/');
+    if (slash == string::npos) return fs::path(root) / series;
+    return fs::path(root) / serialDirName(series.substr(0, slash)) / series.substr(slash + 1);
+}
+
+struct TimeSeriesStore::OpenBlock {
+    OpenBlock(Resolution res, const string& file)
+        : res(res), file(file), enc(res == Resolution::Raw ? 1 : kRollupColumns) {}
+
+    void append(int64_t ts, const double* row) {
+        minTs = enc.count() ? min(minTs, ts) : ts;
+        maxTs = enc.count() ? max(maxTs, ts) : ts;
+        enc.append(ts, row);
+    }
+
+    int columns() const { return res == Resolution::Raw ? 1 : kRollupColumns; }
+
+    bool decode(vector<int64_t>& ts, vector<double>& values) const {
+        return gorillaDecode(enc.bytes().data(), enc.bytes().size(), columns(), enc.count(), ts, values);
+    }
+
+    Resolution res;
+    string file;
+    GorillaEncoder enc;
+    int64_t minTs = 0;
+    int64_t maxTs = 0;
+};
+
+TimeSeriesStore::TimeSeriesStore(const string& root) : root(root), queue("time-series store") {}
+
+TimeSeriesStore::~TimeSeriesStore() {
+    string error;
+    flush(error);
+}
+
+void TimeSeriesStore::append(const string& series, int64_t tsMs, double value) {
+    lock_guard<mutex> lock(m);
+    unique_ptr<OpenBlock>& block = open[series];
+    string file = periodFile(Resolution::Raw, tsMs);
+    if (block && (block->file != file || block->enc.count() >= blockLimit(Resolution::Raw)))
+        seal(series, move(block));
+    if (!block) block = make_unique<OpenBlock>(Resolution::Raw, file);
+    block->append(tsMs, &value);
+}
+
+void TimeSeriesStore::seal(const string& series, unique_ptr<OpenBlock> block) {
+    shared_ptr<OpenBlock> sealed(move(block));
+    sealing.push_back({ series, sealed });
+    bool queued = queue.submit([this, series, sealed] {
+        lock_guard<mutex> lock(m);
+        persist(series, sealed.get());
+        sealing.erase(find_if(sealing.begin(), sealing.end(),
+            [&](const auto& s) { return s.second == sealed; }));
+    });
+    if (!queued) {
+        // Shutting down: the queue no longer takes work, write it here
+        sealing.pop_back();
+        persist(series, sealed.get());
+    }
+}
+
+// Write a sealed raw block and fold it into the rollups.
+void TimeSeriesStore::persist(const string& series, const OpenBlock* block) {
+    writeBlock(series, *block);
+    vector<int64_t> ts;
+    vector<double> values;
+    block->decode(ts, values);
+    for (Resolution res : { Resolution::Minute, Resolution::Hour }) {
+        int64_t width = bucketMs(res);
+        for (size_t i = 0; i < ts.size();) {
+            int64_t bucket = floorDiv(ts[i], width) * width;
+            double row[kRollupColumns] = { values[i], values[i], 0, 0 };
+            for (; i < ts.size() && floorDiv(ts[i], width) * width == bucket; i++) {
+                row[0] = min(row[0], values[i]);
+                row[1] = max(row[1], values[i]);
+                row[2] += values[i];
+                row[3] += 1;
+            }
+            addRollup(series, res, bucket, row);
+        }
+    }
+}
+
+void TimeSeriesStore::addRollup(const string& series, Resolution res, int64_t bucket, const double* row) {
+    unique_ptr<OpenBlock>& block = rollups[{ series, res }];
+    string file = periodFile(res, bucket);
+    if (block && (block->file != file || block->enc.count() >= blockLimit(res))) {
+        writeBlock(series, *block);
+        block.reset();
+    }
+    if (!block) block = make_unique<OpenBlock>(res, file);
+    block->append(bucket, row);
+}
+
+void TimeSeriesStore::writeBlock(const string& series, const OpenBlock& block) {
+    fs::path dir = seriesDir(root, series);
+    error_code ec;
+    fs::create_directories(dir, ec);
+
+    const vector<uint8_t>& payload = block.enc.bytes();
+    uint8_t header[kHeaderBytes] = { 'T', 'S', 'B', '1' };
+    header[4] = (uint8_t)block.columns();
+    header[5] = (uint8_t)block.res;
+    auto put = [&](size_t at, uint64_t v, int bytes) {
+        for (int i = 0; i < bytes; i++) header[at + i] = (uint8_t)(v >> (8 * i));
+    };
+    put(8, block.enc.count(), 4);
+    put(12, payload.size(), 4);
+    put(16, (uint64_t)block.minTs, 8);
+    put(24, (uint64_t)block.maxTs, 8);
+
+    ofstream out(dir / block.file, ios::binary | ios::app);
+    out.write((const char*)header, sizeof(header));
+    out.write((const char*)payload.data(), payload.size());
+    if (!out && writeError.empty()) writeError = "cannot write " + (dir / block.file).string();
+}
+
+bool TimeSeriesStore::flush(string& error) {
+    {
+        lock_guard<mutex> lock(m);
+        for (auto& [series, block] : open)
+            if (block) seal(series, move(block));
+        open.clear();
+    }
+    queue.drain(ShutdownClock::time_point::max());
+    lock_guard<mutex> lock(m);
+    for (auto& [key, block] : rollups)
+        if (block) writeBlock(key.first, *block);
+    rollups.clear();
+    error = writeError;
+    return writeError.empty();
+}
+
+bool TimeSeriesStore::query(const string& series, int64_t fromMs, int64_t toMs, Resolution res,
+    vector<SeriesPoint>& out, string& error, SeriesQueryStats* stats) {
+    SeriesQueryStats local;
+    SeriesQueryStats& st = stats ? *stats : local;
+    int columns = res == Resolution::Raw ? 1 : kRollupColumns;
+    vector<int64_t> ts;
+    vector<double> values;   // `columns` per row
+
+    auto overlaps = [&](int64_t lo, int64_t hi) { return lo < toMs && hi >= fromMs; };
+    auto addRows = [&](const OpenBlock& block) {
+        if (!overlaps(block.minTs, block.maxTs)) return;
+        st.blocksDecoded++;
+        st.bytesDecoded += block.enc.bytes().size();
+        block.decode(ts, values);
+    };
+
+    lock_guard<mutex> lock(m);
+    // Sealed blocks on disk; the header alone decides whether to decode
+    error_code ec;
+    for (auto& entry : fs::directory_iterator(seriesDir(root, series), ec)) {
+        int64_t start, end;
+        if (!periodRange(entry.path().filename().string(), res, start, end) || !overlaps(start, end - 1)) continue;
+        st.files++;
+        ifstream in(entry.path(), ios::binary);
+        uint8_t header[kHeaderBytes];
+        while (in.read((char*)header, sizeof(header))) {
+            auto get = [&](size_t at, int bytes) {
+                uint64_t v = 0;
+                for (int i = bytes - 1; i >= 0; i--) v = v << 8 | header[at + i];
+                return v;
+            };
+            if (memcmp(header, "TSB1", 4) != 0 || header[4] != columns) {
+                error = "corrupt block in " + entry.path().string();
+                return false;
+            }
+            st.blocks++;
+            uint32_t rows = (uint32_t)get(8, 4), size = (uint32_t)get(12, 4);
+            if (!overlaps((int64_t)get(16, 8), (int64_t)get(24, 8))) {
+                in.seekg(size, ios::cur);
+                continue;
+            }
+            vector<uint8_t> payload(size);
+            if (!in.read((char*)payload.data(), size) || !gorillaDecode(payload.data(), size, columns, rows, ts, values)) {
+                error = "corrupt block in " + entry.path().string();
+                return false;
+            }
+            st.blocksDecoded++;
+            st.bytesDecoded += size;
+        }
+    }
+
+    // Blocks still in memory. Raw blocks not yet folded into the rollups
+    // are rolled up here.
+    vector<const OpenBlock*> raw;
+    for (auto& [name, block] : sealing)
+        if (name == series) raw.push_back(block.get());
+    auto it = open.find(series);
+    if (it != open.end() && it->second) raw.push_back(it->second.get());
+    if (res == Resolution::Raw) {
+        for (const OpenBlock* block : raw) addRows(*block);
+    }
+    else {
+        auto roll = rollups.find({ series, res });
+        if (roll != rollups.end() && roll->second) addRows(*roll->second);
+        int64_t width = bucketMs(res);
+        for (const OpenBlock* block : raw) {
+            vector<int64_t> rts;
+            vector<double> rvalues;
+            block->decode(rts, rvalues);
+            for (size_t i = 0; i < rts.size(); i++) {
+                ts.push_back(floorDiv(rts[i], width) * width);
+                values.insert(values.end(), { rvalues[i], rvalues[i], rvalues[i], 1.0 });
+            }
+        }
+    }
+
+    // Rows in time order; rollup rows for the same bucket are merged
+    vector<size_t> order(ts.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return ts[a] < ts[b]; });
+    out.clear();
+    for (size_t i : order) {
+        if (ts[i] < fromMs || ts[i] >= toMs) continue;
+        const double* row = &values[i * columns];
+        if (res == Resolution::Raw) {
+            out.push_back({ ts[i], row[0], row[0], row[0], 1 });
+            continue;
+        }
+        if (out.empty() || out.back().tsMs != ts[i]) {
+            out.push_back({ ts[i], row[0], row[1], row[2], (uint64_t)row[3] });
+            continue;
+        }
+        SeriesPoint& p = out.back();
+        p.min = min(p.min, row[0]);
+        p.max = max(p.max, row[1]);
+        p.avg += row[2];
+        p.count += (uint64_t)row[3];
+    }
+    if (res != Resolution::Raw)
+        for (SeriesPoint& p : out) p.avg = p.count ? p.avg / p.count : 0;  // avg held the sum so far
+    return true;
+}
+
+vector<string> TimeSeriesStore::listSeries() const {
+    vector<string> names;
+    error_code ec;
+    for (auto& device : fs::directory_iterator(root, ec)) {
+        if (!device.is_directory()) continue;
+        for (auto& metric : fs::directory_iterator(device.path(), ec))
+            if (metric.is_directory())
+                names.push_back(serialFromDirName(device.path().filename().string()) + "/" + metric.path().filename().string());
+    }
+    lock_guard<mutex> lock(m);
+    for (auto& entry : open) names.push_back(entry.first);
+    sort(names.begin(), names.end());
+    names.erase(unique(names.begin(), names.end()), names.end());
+    return names;
+}
+
+size_t TimeSeriesStore::dropRawBefore(int64_t ms) {
+    size_t dropped = 0;
+    lock_guard<mutex> lock(m);
+    error_code ec;
+    for (auto& device : fs::recursive_directory_iterator(root, ec)) {
+        int64_t start, end;
+        if (device.is_regular_file() && periodRange(device.path().filename().string(), Resolution::Raw, start, end) &&
+            end <= ms && fs::remove(device.path(), ec))
+            dropped++;
+    }
+    return dropped;
+}
@@ -0,0 +1,118 @@
+// TimeSeries.h
+// Local time-series store for telemetry. Points are packed Gorilla-style:
+// delta-of-delta timestamps and XOR-compressed doubles, a few bits per
+// sample for slowly changing values. Each series keeps one open block in
+// memory. Sealed blocks are appended to period files, raw data per UTC day
+// and rollups per UTC month. Sealing runs on a background queue, which also
+// folds the block into 1-minute and 1-hour min/max/sum/count rollups.
+//
+// Layout: <root>/<serial>/<metric>/raw-YYYYMMDD.tsb, 1m-YYYYMM.tsb, 1h-YYYYMM.tsb
+// Series names are "<serial>/<metric>".
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "WriteQueue.h"
+
+// Bit-packed stream of (timestamp, column values) rows.
+class GorillaEncoder {
+public:
+    explicit GorillaEncoder(int columns = 1);
+
+    void append(int64_t tsMs, const double* values);
+    size_t count() const { return points; }
+    const std::vector<uint8_t>& bytes() const { return out; }
+
+private:
+    void writeBits(uint64_t value, int bits);
+
+    struct Column {
+        uint64_t prev = 0;
+        int leading = -1;   // -1 = no window yet
+        int trailing = 0;
+    };
+
+    std::vector<uint8_t> out;
+    int bitPos = 0;         // bits used in out.back()
+    size_t points = 0;
+    int64_t prevTs = 0;
+    int64_t prevDelta = 0;
+    std::vector<Column> cols;
+};
+
+// Decodes `count` rows; `values` receives columns * count doubles. False on
+// a truncated stream.
+bool gorillaDecode(const uint8_t* data, size_t size, int columns, size_t count,
+    std::vector<int64_t>& timestamps, std::vector<double>& values);
+
+enum class Resolution { Raw, Minute, Hour };
+
+// One row of a query. Raw rows have min = max = avg = the value, count 1.
+struct SeriesPoint {
+    int64_t tsMs = 0;
+    double min = 0;
+    double max = 0;
+    double avg = 0;
+    uint64_t count = 0;
+};
+
+struct SeriesQueryStats {
+    uint64_t files = 0;
+    uint64_t blocks = 0;        // block headers read
+    uint64_t blocksDecoded = 0;
+    uint64_t bytesDecoded = 0;
+};
+
+class TimeSeriesStore {
+public:
+    explicit TimeSeriesStore(const std::string& root);
+    // Seals every open block and waits for the background writes.
+    ~TimeSeriesStore();
+
+    TimeSeriesStore(const TimeSeriesStore&) = delete;
+    TimeSeriesStore& operator=(const TimeSeriesStore&) = delete;
+
+    // Points may arrive slightly out of order; blocks record their min and
+    // max timestamp rather than assuming the first and last.
+    void append(const std::string& series, int64_t tsMs, double value);
+
+    // Seal all open blocks and wait until they are on disk.
+    bool flush(std::string& error);
+
+    // Rows with fromMs <= ts < toMs, oldest first. Only blocks whose time
+    // range overlaps are decoded. Open (unsealed) blocks are included.
+    bool query(const std::string& series, int64_t fromMs, int64_t toMs, Resolution res,
+        std::vector<SeriesPoint>& out, std::string& error, SeriesQueryStats* stats = nullptr);
+
+    std::vector<std::string> listSeries() const;
+
+    // Delete raw day files that end before `ms`. Rollups are kept.
+    size_t dropRawBefore(int64_t ms);
+
+private:
+    struct OpenBlock;
+
+    // All called with m held.
+    void seal(const std::string& series, std::unique_ptr<OpenBlock> block);
+    void persist(const std::string& series, const OpenBlock* block);
+    void writeBlock(const std::string& series, const OpenBlock& block);
+    void addRollup(const std::string& series, Resolution res, int64_t bucketMs, const double* row);
+
+    std::string root;
+    mutable std::mutex m;
+    std::map<std::string, std::unique_ptr<OpenBlock>> open;     // raw blocks by series
+    // Sealed raw blocks waiting for the queue; still visible to queries.
+    std::vector<std::pair<std::string, std::shared_ptr<OpenBlock>>> sealing;
+    std::map<std::pair<std::string, Resolution>, std::unique_ptr<OpenBlock>> rollups;
+    std::string writeError;
+    WriteQueue queue;
+};
+
+// "raw", "1m", "1h"
+bool parseResolution(const std::string& text, Resolution& res);
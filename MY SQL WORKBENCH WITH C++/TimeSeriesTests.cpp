@@ -0,0 +1,132 @@
+// TimeSeriesTests.cpp
+// Gorilla encoder/decoder round trips and a store write/query cycle.
+
+#include "CivilDate.h"
+#include "SelfTest.h"
+#include "TimeSeries.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <random>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Bit-exact, so NaN payloads and -0.0 count too
+static bool sameBits(double a, double b) {
+    return memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+static void checkRoundTrip(const vector<int64_t>& ts, const vector<double>& values, int columns) {
+    GorillaEncoder enc(columns);
+    for (size_t i = 0; i < ts.size(); i++) enc.append(ts[i], &values[i * columns]);
+    CHECK_EQ(enc.count(), ts.size());
+
+    vector<int64_t> gotTs;
+    vector<double> gotValues;
+    CHECK(gorillaDecode(enc.bytes().data(), enc.bytes().size(), columns, ts.size(), gotTs, gotValues));
+    CHECK(gotTs == ts);
+    CHECK_EQ(gotValues.size(), values.size());
+    size_t mismatches = 0;
+    for (size_t i = 0; i < values.size() && i < gotValues.size(); i++)
+        mismatches += sameBits(values[i], gotValues[i]) ? 0 : 1;
+    CHECK_EQ(mismatches, (size_t)0);
+}
+
+SELFTEST(ts_gorilla_round_trip_regular_samples) {
+    vector<int64_t> ts;
+    vector<double> values;
+    for (int i = 0; i < 1000; i++) {
+        ts.push_back(1760000000000LL + i * 1000);
+        values.push_back(i < 500 ? 85.0 : 84.0 + (i % 7) * 0.5);
+    }
+    checkRoundTrip(ts, values, 1);
+}
+
+SELFTEST(ts_gorilla_round_trip_irregular_and_special_values) {
+    mt19937_64 rng(42);
+    vector<int64_t> ts;
+    vector<double> values = { 0.0, -0.0, numeric_limits<double>::quiet_NaN(), numeric_limits<double>::infinity(),
+        -numeric_limits<double>::infinity(), numeric_limits<double>::denorm_min(), numeric_limits<double>::max(),
+        -1e300, 1e-300 };
+    int64_t t = 1760000000000LL;
+    for (size_t i = 0; i < values.size(); i++) ts.push_back(t += 1000);
+    for (int i = 0; i < 2000; i++) {
+        // Jitter, gaps of hours, duplicates and small steps backwards
+        int64_t step = (int64_t)(rng() % 5 == 0 ? rng() % 36000000 : 1000 + rng() % 50) - (rng() % 20 == 0 ? 3000 : 0);
+        ts.push_back(t += step);
+        uint64_t bits = rng();
+        double v;
+        memcpy(&v, &bits, sizeof(v));
+        values.push_back(i % 3 == 0 ? v : ldexp((double)(rng() % 100000), -(int)(rng() % 40)));
+    }
+    checkRoundTrip(ts, values, 1);
+}
+
+SELFTEST(ts_gorilla_round_trip_columns) {
+    vector<int64_t> ts;
+    vector<double> values;
+    for (int i = 0; i < 300; i++) {
+        ts.push_back(1760000000000LL + i * 60000);
+        values.insert(values.end(), { 10.0 + i, 3.0, 100.0 - i * 0.25, (double)(i * i) });
+    }
+    checkRoundTrip(ts, values, 4);
+}
+
+SELFTEST(ts_gorilla_truncated_stream_fails) {
+    GorillaEncoder enc;
+    for (int i = 0; i < 100; i++) {
+        double v = sin(i * 0.1);
+        enc.append(1760000000000LL + i * 1000, &v);
+    }
+    vector<int64_t> ts;
+    vector<double> values;
+    CHECK(!gorillaDecode(enc.bytes().data(), enc.bytes().size() / 2, 1, enc.count(), ts, values));
+}
+
+SELFTEST(ts_civil_dates_round_trip) {
+    CHECK_EQ(daysFromCivil(1970, 1, 1), (int64_t)0);
+    CHECK_EQ(daysFromCivil(2000, 3, 1), (int64_t)11017);
+    CHECK_EQ(daysFromCivil(1969, 12, 31), (int64_t)-1);
+    for (int64_t day = -800000; day <= 800000; day += 97) {
+        int64_t y;
+        int m, d;
+        civilFromDays(day, y, m, d);
+        CHECK(m >= 1 && m <= 12 && d >= 1 && d <= 31);
+        CHECK_EQ(daysFromCivil(y, m, d), day);
+    }
+}
+
+SELFTEST(ts_store_query_raw_and_rollup) {
+    fs::path root = fs::temp_directory_path() /
+        ("adfxt-selftest-tsdb-" + to_string(chrono::steady_clock::now().time_since_epoch().count()));
+    const int64_t start = 1760000040000LL - 1760000040000LL % 60000;  // minute aligned
+    {
+        TimeSeriesStore store(root.string());
+        for (int i = 0; i < 180; i++) store.append("SER1/battery_level", start + i * 1000, 100.0 - i / 60);
+        string error;
+        CHECK(store.flush(error));
+    }
+
+    TimeSeriesStore store(root.string());
+    vector<SeriesPoint> raw, minutes;
+    string error;
+    CHECK(store.query("SER1/battery_level", start, start + 180000, Resolution::Raw, raw, error));
+    CHECK_EQ(raw.size(), (size_t)180);
+    if (raw.size() == 180) {
+        CHECK_EQ(raw.front().tsMs, start);
+        CHECK_EQ(raw.back().avg, 98.0);
+    }
+    CHECK(store.query("SER1/battery_level", start, start + 180000, Resolution::Minute, minutes, error));
+    CHECK_EQ(minutes.size(), (size_t)3);
+    if (minutes.size() == 3) {
+        CHECK_EQ(minutes[1].count, (uint64_t)60);
+        CHECK_EQ(minutes[1].min, 99.0);
+        CHECK_EQ(minutes[1].max, 99.0);
+    }
+    error_code ec;
+    fs::remove_all(root, ec);
+}
@@ -0,0 +1,194 @@
+// Trace.cpp
+// Event buffer and the Chrome JSON writer.
+
+#include "Trace.h"
+#include "Json.h"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+using namespace std;
+
+namespace {
+struct Event {
+    char phase;                  // X complete, i instant, C counter
+    string category;
+    string name;
+    string serial;               // "" = host
+    DeviceClock clock = DeviceClock::Realtime;
+    int64_t tsNs = 0;            // host steady, or the device clock
+    int64_t durNs = 0;
+    int tid = 0;
+    string args;                 // JSON object body, without braces
+};
+}
+
+static atomic<bool> enabled{ false };
+static mutex traceMutex;
+static string tracePath;
+static int64_t originNs = 0;
+static vector<Event> events;
+static unordered_map<thread::id, int> threadLanes;
+
+static int laneOfThisThread() {
+    // traceMutex held
+    auto it = threadLanes.find(this_thread::get_id());
+    if (it != threadLanes.end()) return it->second;
+    int lane = (int)threadLanes.size() + 1;
+    threadLanes[this_thread::get_id()] = lane;
+    return lane;
+}
+
+static void record(Event e) {
+    lock_guard<mutex> lock(traceMutex);
+    if (e.serial.empty()) e.tid = laneOfThisThread();
+    events.push_back(move(e));
+}
+
+bool startTrace(const string& path) {
+    lock_guard<mutex> lock(traceMutex);
+    if (!ofstream(path).good()) return false;
+    tracePath = path;
+    originNs = hostSteadyNs();
+    enabled = true;
+    return true;
+}
+
+bool traceEnabled() {
+    return enabled;
+}
+
+// ===== Host spans =====
+TraceSpan::TraceSpan(const char* category, const string& text) : category(category) {
+    if (!enabled) return;
+    active = true;
+    name = text.size() > 120 ? text.substr(0, 117) + "..." : text;
+    startNs = hostSteadyNs();
+}
+
+TraceSpan::~TraceSpan() {
+    if (!active) return;
+    Event e;
+    e.phase = 'X';
+    e.category = category;
+    e.name = move(name);
+    e.tsNs = startNs;
+    e.durNs = hostSteadyNs() - startNs;
+    for (auto& [key, value] : args)
+        e.args += (e.args.empty() ? "\"" : ",\"") + jsonEscape(key) + "\":\"" + jsonEscape(value) + "\"";
+    record(move(e));
+}
+
+void TraceSpan::arg(const string& key, const string& value) {
+    if (active) args[key] = value;
+}
+
+// ===== Device events =====
+void traceDeviceInstant(const string& serial, DeviceClock clock, int64_t deviceNs, const char* category,
+    const string& name, const map<string, string>& args) {
+    if (!enabled) return;
+    Event e;
+    e.phase = 'i';
+    e.category = category;
+    e.name = name;
+    e.serial = serial;
+    e.clock = clock;
+    e.tsNs = deviceNs;
+    for (auto& [key, value] : args)
+        e.args += (e.args.empty() ? "\"" : ",\"") + jsonEscape(key) + "\":\"" + jsonEscape(value) + "\"";
+    record(move(e));
+}
+
+void traceDeviceCounter(const string& serial, DeviceClock clock, int64_t deviceNs, const string& name,
+    const map<string, double>& values) {
+    if (!enabled) return;
+    Event e;
+    e.phase = 'C';
+    e.category = "device";
+    e.name = name;
+    e.serial = serial;
+    e.clock = clock;
+    e.tsNs = deviceNs;
+    char buf[64];
+    for (auto& [key, value] : values) {
+        snprintf(buf, sizeof(buf), "%.17g", value);
+        e.args += (e.args.empty() ? "\"" : ",\"") + jsonEscape(key) + "\":" + buf;
+    }
+    record(move(e));
+}
+
+// ===== Export =====
+static string micros(int64_t ns) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.3f", (double)ns / 1000.0);
+    return buf;
+}
+
+bool finishTrace(const map<string, ClockModel>& clocks, string& error, size_t* dropped) {
+    lock_guard<mutex> lock(traceMutex);
+    if (!enabled) return true;
+    enabled = false;
+
+    // Host is pid 1; devices follow in serial order
+    map<string, int> pids;
+    for (const Event& e : events)
+        if (!e.serial.empty()) pids[e.serial] = 0;
+    int nextPid = 2;
+    for (auto& [serial, pid] : pids) pid = nextPid++;
+
+    ofstream out(tracePath, ios::trunc);
+    out << "{\"traceEvents\":[\n";
+    out << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"args\":{\"name\":\"host\"}}";
+    for (auto& [serial, pid] : pids)
+        out << ",\n{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << pid << ",\"args\":{\"name\":\"device "
+            << jsonEscape(serial) << "\"}}";
+
+    size_t lost = 0;
+    for (const Event& e : events) {
+        int64_t hostNs = e.tsNs;
+        int pid = 1;
+        if (!e.serial.empty()) {
+            auto model = clocks.find(e.serial);
+            if (model == clocks.end() || !model->second.valid) {
+                lost++;
+                continue;
+            }
+            hostNs = model->second.toHostNs(e.clock, e.tsNs);
+            pid = pids[e.serial];
+        }
+        out << ",\n{\"ph\":\"" << e.phase << "\",\"cat\":\"" << jsonEscape(e.category) << "\",\"name\":\""
+            << jsonEscape(e.name) << "\",\"pid\":" << pid << ",\"tid\":" << e.tid << ",\"ts\":"
+            << micros(hostNs - originNs);
+        if (e.phase == 'X') out << ",\"dur\":" << micros(e.durNs);
+        if (e.phase == 'i') out << ",\"s\":\"t\"";
+        out << ",\"args\":{" << e.args << "}}";
+    }
+    out << "\n],\n\"displayTimeUnit\":\"ms\",\n\"metadata\":{\"clock_sync\":{";
+    bool first = true;
+    for (auto& [serial, model] : clocks) {
+        if (!model.valid) continue;
+        // Device clock to this file's ts: us = (device ns + shift ns) / 1000,
+        // exact around the middle of the run; drift applies away from it
+        char drift[32];
+        snprintf(drift, sizeof(drift), "%.3f", model.realtime.drift * 1e6);
+        out << (first ? "" : ",") << "\n\"" << jsonEscape(serial) << "\":{\"source\":\"" << jsonEscape(model.source)
+            << "\",\"boottime_shift_ns\":" << model.boottime.offsetNs - originNs
+            << ",\"realtime_shift_ns\":" << model.realtime.offsetNs - originNs
+            << ",\"drift_ppm\":" << drift
+            << ",\"uncertainty_us\":" << micros(model.minRttNs / 2) << ",\"exchanges\":" << model.exchanges << "}";
+        first = false;
+    }
+    out << "}}}\n";
+    out.close();
+    events.clear();
+    if (dropped) *dropped = lost;
+    if (!out) {
+        error = "cannot write " + tracePath;
+        return false;
+    }
+    return true;
+}
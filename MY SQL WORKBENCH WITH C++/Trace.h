@@ -0,0 +1,50 @@
+// Trace.h
+// Trace of the tool's own work in the Chrome JSON trace format (open it in
+// ui.perfetto.dev or chrome://tracing). Host spans such as adb calls and
+// flash steps are timed on the host steady clock. Device events keep their
+// device timestamps until export, when the ClockModels put them on the same
+// timeline. Each device gets its own process lane. Everything is a no-op
+// until startTrace().
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Clock.h"
+
+bool startTrace(const std::string& path);
+bool traceEnabled();
+
+// Host span from construction to destruction, on the calling thread's lane.
+class TraceSpan {
+public:
+    TraceSpan(const char* category, const std::string& name);
+    ~TraceSpan();
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    void arg(const std::string& key, const std::string& value);
+
+private:
+    bool active = false;
+    const char* category;
+    std::string name;
+    std::map<std::string, std::string> args;
+    int64_t startNs = 0;
+};
+
+// Device events, stamped by one of the device clocks.
+void traceDeviceInstant(const std::string& serial, DeviceClock clock, int64_t deviceNs, const char* category,
+    const std::string& name, const std::map<std::string, std::string>& args = {});
+void traceDeviceCounter(const std::string& serial, DeviceClock clock, int64_t deviceNs, const std::string& name,
+    const std::map<std::string, double>& values);
+
+// Write the trace. Device events of serials without a valid model are left
+// out and counted in `dropped`. The models also go into the file's metadata
+// ("clock_sync"), so a perfetto trace from the same device can be shifted
+// onto this timeline by its boottime offset.
+bool finishTrace(const std::map<std::string, ClockModel>& clocks, std::string& error, size_t* dropped = nullptr);
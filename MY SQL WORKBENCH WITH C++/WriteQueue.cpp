@@ -0,0 +1,79 @@
+// WriteQueue.cpp
+// Single-worker persistence queue with deadline-bounded draining.
+
+#include "WriteQueue.h"
+
+#include <iostream>
+
+using namespace std;
+
+WriteQueue::WriteQueue(const string& queueName) : name(queueName) {
+    worker = thread(&WriteQueue::workerLoop, this);
+    hookId = registerShutdownHook(name,
+        [this] { close(); },
+        [this](ShutdownClock::time_point deadline) { return drain(deadline); });
+}
+
+WriteQueue::~WriteQueue() {
+    unregisterShutdownHook(hookId);
+    close();
+    drain(ShutdownClock::time_point::max());
+    {
+        lock_guard<mutex> lock(m);
+        exiting = true;
+    }
+    workAvailable.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+bool WriteQueue::submit(function<void()> job) {
+    {
+        lock_guard<mutex> lock(m);
+        if (closed) return false;
+        jobs.push_back(move(job));
+    }
+    workAvailable.notify_one();
+    return true;
+}
+
+void WriteQueue::close() {
+    lock_guard<mutex> lock(m);
+    closed = true;
+}
+
+bool WriteQueue::drain(ShutdownClock::time_point deadline) {
+    unique_lock<mutex> lock(m);
+    auto done = [this] { return jobs.empty() && !busy; };
+    if (deadline == ShutdownClock::time_point::max()) {
+        idle.wait(lock, done);
+        return true;
+    }
+    return idle.wait_until(lock, deadline, done);
+}
+
+size_t WriteQueue::pending() {
+    lock_guard<mutex> lock(m);
+    return jobs.size() + (busy ? 1 : 0);
+}
+
+void WriteQueue::workerLoop() {
+    unique_lock<mutex> lock(m);
+    while (true) {
+        workAvailable.wait(lock, [this] { return exiting || !jobs.empty(); });
+        if (jobs.empty()) break;  // exiting with nothing left
+
+        function<void()> job = move(jobs.front());
+        jobs.pop_front();
+        busy = true;
+        lock.unlock();
+        try {
+            job();
+        }
+        catch (const exception& e) {
+            cerr << "[FAIL] " << name << ": " << e.what() << "\n";
+        }
+        lock.lock();
+        busy = false;
+        if (jobs.empty()) idle.notify_all();
+    }
+}
@@ -0,0 +1,49 @@
+// WriteQueue.h
+// Background queue for persistence work (MySQL inserts, file writes) that
+// drains on shutdown instead of being killed mid-write.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Shutdown.h"
+
+class WriteQueue {
+public:
+    // Registers itself with the shutdown path under `name`.
+    explicit WriteQueue(const std::string& name);
+    ~WriteQueue();
+
+    WriteQueue(const WriteQueue&) = delete;
+    WriteQueue& operator=(const WriteQueue&) = delete;
+
+    // False once intake is closed; the job is then not run.
+    bool submit(std::function<void()> job);
+
+    // Stop accepting new jobs.
+    void close();
+
+    // Wait until every accepted job has run, or the deadline passes.
+    bool drain(ShutdownClock::time_point deadline);
+
+    size_t pending();
+
+private:
+    void workerLoop();
+
+    std::string name;
+    int hookId = 0;
+    std::mutex m;
+    std::condition_variable workAvailable;
+    std::condition_variable idle;
+    std::deque<std::function<void()>> jobs;
+    bool closed = false;
+    bool busy = false;
+    bool exiting = false;
+    std::thread worker;
+};
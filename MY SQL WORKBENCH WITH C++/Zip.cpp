@@ -0,0 +1,552 @@
+// Zip.cpp
+// Central directory parsing, inflate and parallel extraction.
+
+#include "Zip.h"
+#include "Crc32.h"
+#include "MappedFile.h"
+#include "Shutdown.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static const size_t kWriteBuffer = 1 << 20;
+
+// ===== Inflate =====
+namespace {
+struct BitReader {
+    const uint8_t* p;
+    const uint8_t* end;
+    uint64_t buf = 0;
+    int count = 0;
+    size_t overrun = 0;            // zero bytes fed past the end of input
+
+    BitReader(const uint8_t* data, size_t size) : p(data), end(data + size) {}
+
+    void refill() {
+        while (count <= 56) {
+            uint64_t b = 0;
+            if (p < end) b = *p++;
+            else overrun++;
+            buf |= b << count;
+            count += 8;
+        }
+    }
+    uint32_t peek(int n) {
+        if (count < n) refill();
+        return (uint32_t)(buf & ((1ull << n) - 1));
+    }
+    void drop(int n) {
+        buf >>= n;
+        count -= n;
+    }
+    uint32_t bits(int n) {
+        uint32_t v = peek(n);
+        drop(n);
+        return v;
+    }
+    bool exhausted() const { return overrun * 8 > (size_t)count; }
+    void alignToByte() { drop(count & 7); }
+};
+
+// Canonical Huffman code with a 10-bit lookup table; longer codes are
+// decoded bit by bit from the counts.
+struct Huffman {
+    static const int kFastBits = 10;
+    uint16_t count[16];
+    uint16_t symbol[288];
+    uint16_t fast[1 << kFastBits];   // (length << 9) | symbol, 0 = slow path
+
+    bool build(const uint8_t* lengths, int n) {
+        memset(count, 0, sizeof(count));
+        for (int i = 0; i < n; i++) count[lengths[i]]++;
+        count[0] = 0;
+        int left = 1;
+        for (int len = 1; len < 16; len++) {
+            left = (left << 1) - count[len];
+            if (left < 0) return false;  // over-subscribed
+        }
+        uint16_t offs[16];
+        offs[1] = 0;
+        for (int len = 1; len < 15; len++) offs[len + 1] = offs[len] + count[len];
+        for (int i = 0; i < n; i++)
+            if (lengths[i]) symbol[offs[lengths[i]]++] = (uint16_t)i;
+
+        memset(fast, 0, sizeof(fast));
+        int code = 0, index = 0;
+        for (int len = 1; len <= kFastBits; len++) {
+            for (int k = 0; k < count[len]; k++, code++, index++) {
+                int rev = 0;
+                for (int b = 0; b < len; b++) rev |= ((code >> b) & 1) << (len - 1 - b);
+                for (int fill = rev; fill < (1 << kFastBits); fill += 1 << len)
+                    fast[fill] = (uint16_t)((len << 9) | symbol[index]);
+            }
+            code <<= 1;
+        }
+        return true;
+    }
+
+    int decode(BitReader& in) const {
+        uint32_t look = in.peek(15);
+        uint16_t e = fast[look & ((1 << kFastBits) - 1)];
+        if (e) {
+            in.drop(e >> 9);
+            return e & 0x1ff;
+        }
+        int code = 0, first = 0, index = 0;
+        for (int len = 1; len < 16; len++) {
+            code |= (look >> (len - 1)) & 1;
+            int c = count[len];
+            if (code - c < first) {
+                in.drop(len);
+                return symbol[index + (code - first)];
+            }
+            index += c;
+            first = (first + c) << 1;
+            code <<= 1;
+        }
+        return -1;
+    }
+};
+
+// Output with a sliding 32 KiB history, flushed to the sink in large chunks.
+struct Window {
+    static const size_t kHistory = 32768;
+    static const size_t kFlushAt = 4 << 20;
+    vector<uint8_t> buf;
+    size_t pos = 0;                // bytes in buf
+    uint64_t total = 0;            // bytes produced overall
+    const ByteSink& sink;
+    size_t flushed = 0;            // bytes of buf already handed to the sink
+
+    explicit Window(const ByteSink& sink) : buf(kFlushAt + 258 + kHistory), sink(sink) {}
+
+    bool flush(bool final) {
+        if (pos > flushed && !sink(buf.data() + flushed, pos - flushed)) return false;
+        flushed = pos;
+        if (!final && pos > kHistory) {
+            memmove(buf.data(), buf.data() + pos - kHistory, kHistory);
+            pos = flushed = kHistory;
+        }
+        return true;
+    }
+    bool room() { return pos < kFlushAt || flush(false); }
+};
+}
+
+static const uint16_t kLengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t kLengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t kDistBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t kDistExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static bool inflateBlock(BitReader& in, Window& w, const Huffman& lit, const Huffman& dist, string& error) {
+    for (;;) {
+        // Past the end the reader yields zero bits, which can decode as
+        // literals forever
+        if (in.exhausted()) {
+            error = "truncated deflate stream";
+            return false;
+        }
+        if (!w.room()) {
+            error = "cancelled";
+            return false;
+        }
+        int sym = lit.decode(in);
+        if (sym < 0) {
+            error = "bad literal/length code";
+            return false;
+        }
+        if (sym < 256) {
+            w.buf[w.pos++] = (uint8_t)sym;
+            w.total++;
+            continue;
+        }
+        if (sym == 256) return !in.exhausted() || (error = "truncated deflate stream", false);
+        sym -= 257;
+        if (sym >= 29) {
+            error = "bad length symbol";
+            return false;
+        }
+        size_t len = kLengthBase[sym] + in.bits(kLengthExtra[sym]);
+        int ds = dist.decode(in);
+        if (ds < 0 || ds >= 30) {
+            error = "bad distance code";
+            return false;
+        }
+        size_t d = kDistBase[ds] + in.bits(kDistExtra[ds]);
+        if (d > w.pos || d > w.total) {
+            error = "distance too far back";
+            return false;
+        }
+        uint8_t* out = w.buf.data() + w.pos;
+        const uint8_t* from = out - d;
+        if (d >= len) memcpy(out, from, len);
+        else for (size_t i = 0; i < len; i++) out[i] = from[i];  // overlapping run
+        w.pos += len;
+        w.total += len;
+    }
+}
+
+bool inflateRaw(const uint8_t* data, size_t size, const ByteSink& out, string& error) {
+    BitReader in(data, size);
+    Window w(out);
+    Huffman lit, dist;
+    bool last = false;
+    while (!last) {
+        last = in.bits(1);
+        int type = in.bits(2);
+        if (type == 0) {
+            in.alignToByte();
+            uint32_t len = in.bits(16);
+            uint32_t nlen = in.bits(16);
+            if ((len ^ 0xffff) != nlen) {
+                error = "bad stored block length";
+                return false;
+            }
+            // Drain whole bytes still in the bit buffer, then copy straight from input
+            uint32_t left = len;
+            while (left && in.count >= 8) {
+                if (!w.room()) {
+                    error = "cancelled";
+                    return false;
+                }
+                w.buf[w.pos++] = (uint8_t)in.bits(8);
+                left--;
+            }
+            while (left) {
+                if (!w.room()) {
+                    error = "cancelled";
+                    return false;
+                }
+                size_t n = min<size_t>({ left, (size_t)(in.end - in.p), Window::kFlushAt - w.pos });
+                if (n == 0) {
+                    error = "truncated deflate stream";
+                    return false;
+                }
+                memcpy(w.buf.data() + w.pos, in.p, n);
+                w.pos += n;
+                in.p += n;
+                left -= (uint32_t)n;
+            }
+            w.total += len;
+            if (in.exhausted()) {
+                error = "truncated deflate stream";
+                return false;
+            }
+            continue;
+        }
+        uint8_t lengths[320];
+        if (type == 1) {
+            int i = 0;
+            for (; i < 144; i++) lengths[i] = 8;
+            for (; i < 256; i++) lengths[i] = 9;
+            for (; i < 280; i++) lengths[i] = 7;
+            for (; i < 288; i++) lengths[i] = 8;
+            lit.build(lengths, 288);
+            for (i = 0; i < 30; i++) lengths[i] = 5;
+            dist.build(lengths, 30);
+        } else if (type == 2) {
+            static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+            int nlen = in.bits(5) + 257, ndist = in.bits(5) + 1, ncode = in.bits(4) + 4;
+            if (nlen > 286 || ndist > 30) {
+                error = "bad dynamic block header";
+                return false;
+            }
+            uint8_t codeLengths[19] = {};
+            for (int i = 0; i < ncode; i++) codeLengths[order[i]] = (uint8_t)in.bits(3);
+            Huffman lencode;
+            if (!lencode.build(codeLengths, 19)) {
+                error = "bad code length code";
+                return false;
+            }
+            int i = 0;
+            while (i < nlen + ndist) {
+                int sym = lencode.decode(in);
+                if (sym < 0) {
+                    error = "bad code length";
+                    return false;
+                }
+                if (sym < 16) {
+                    lengths[i++] = (uint8_t)sym;
+                    continue;
+                }
+                uint8_t value = 0;
+                int repeat;
+                if (sym == 16) {
+                    if (i == 0) {
+                        error = "repeat without previous length";
+                        return false;
+                    }
+                    value = lengths[i - 1];
+                    repeat = 3 + in.bits(2);
+                } else if (sym == 17) repeat = 3 + in.bits(3);
+                else repeat = 11 + in.bits(7);
+                if (i + repeat > nlen + ndist) {
+                    error = "too many code lengths";
+                    return false;
+                }
+                while (repeat--) lengths[i++] = value;
+            }
+            if (lengths[256] == 0 || !lit.build(lengths, nlen) || !dist.build(lengths + nlen, ndist)) {
+                error = "bad literal/distance code lengths";
+                return false;
+            }
+        } else {
+            error = "bad block type";
+            return false;
+        }
+        if (!inflateBlock(in, w, lit, dist, error)) return false;
+    }
+    return w.flush(true) || (error = "cancelled", false);
+}
+
+// ===== Central directory =====
+static uint16_t le16(const uint8_t* p) { return (uint16_t)(p[0] | p[1] << 8); }
+static uint32_t le32(const uint8_t* p) { return (uint32_t)le16(p) | (uint32_t)le16(p + 2) << 16; }
+static uint64_t le64(const uint8_t* p) { return (uint64_t)le32(p) | (uint64_t)le32(p + 4) << 32; }
+
+ZipArchive::ZipArchive() : file(make_unique<MappedFile>()) {}
+ZipArchive::~ZipArchive() = default;
+
+bool ZipArchive::open(const string& path, string& error) {
+    list.clear();
+    if (!file->openRead(path, error)) return false;
+    const uint8_t* base = file->data();
+    uint64_t size = file->size();
+
+    // End of central directory: last 22 bytes plus up to 64 KiB of comment
+    int64_t eocd = -1;
+    for (int64_t at = (int64_t)size - 22; at >= 0 && at >= (int64_t)size - 22 - 65535; at--) {
+        if (le32(base + at) == 0x06054b50) {
+            eocd = at;
+            break;
+        }
+    }
+    if (eocd < 0) {
+        error = path + ": not a zip archive";
+        return false;
+    }
+    uint64_t entries = le16(base + eocd + 10);
+    uint64_t cdSize = le32(base + eocd + 12);
+    uint64_t cdOffset = le32(base + eocd + 16);
+    // ZIP64 locator sits right before the classic record
+    if (eocd >= 20 && le32(base + eocd - 20) == 0x07064b50) {
+        uint64_t at = le64(base + eocd - 20 + 8);
+        if (at + 56 <= size && le32(base + at) == 0x06064b50) {
+            entries = le64(base + at + 32);
+            cdSize = le64(base + at + 40);
+            cdOffset = le64(base + at + 48);
+        }
+    }
+    if (cdOffset > size || cdSize > size - cdOffset) {
+        error = path + ": central directory outside the file";
+        return false;
+    }
+
+    const uint8_t* p = base + cdOffset;
+    const uint8_t* end = p + cdSize;
+    for (uint64_t i = 0; i < entries; i++) {
+        if (end - p < 46 || le32(p) != 0x02014b50) {
+            error = path + ": corrupt central directory";
+            return false;
+        }
+        ZipEntry e;
+        e.flags = le16(p + 8);
+        e.method = le16(p + 10);
+        e.crc32 = le32(p + 16);
+        e.compressedSize = le32(p + 20);
+        e.uncompressedSize = le32(p + 24);
+        uint16_t nameLen = le16(p + 28), extraLen = le16(p + 30), commentLen = le16(p + 32);
+        e.localHeaderOffset = le32(p + 42);
+        if ((size_t)(end - p) < 46u + nameLen + extraLen + commentLen) {
+            error = path + ": corrupt central directory";
+            return false;
+        }
+        e.name.assign((const char*)p + 46, nameLen);
+
+        // ZIP64 extra field: only the values that overflowed are present, in order
+        const uint8_t* x = p + 46 + nameLen;
+        const uint8_t* xend = x + extraLen;
+        while (xend - x >= 4) {
+            uint16_t id = le16(x), len = le16(x + 2);
+            const uint8_t* v = x + 4;
+            if (id == 0x0001 && v + len <= xend) {
+                const uint8_t* vend = v + len;
+                if (e.uncompressedSize == 0xffffffff && vend - v >= 8) { e.uncompressedSize = le64(v); v += 8; }
+                if (e.compressedSize == 0xffffffff && vend - v >= 8) { e.compressedSize = le64(v); v += 8; }
+                if (e.localHeaderOffset == 0xffffffff && vend - v >= 8) e.localHeaderOffset = le64(v);
+            }
+            x += 4 + len;
+        }
+        list.push_back(move(e));
+        p += 46 + nameLen + extraLen + commentLen;
+    }
+    return true;
+}
+
+const ZipEntry* ZipArchive::find(const string& name) const {
+    for (const ZipEntry& e : list)
+        if (e.name == name) return &e;
+    return nullptr;
+}
+
+bool ZipArchive::rawData(const ZipEntry& entry, const uint8_t*& data, string& error) const {
+    const uint8_t* base = file->data();
+    uint64_t size = file->size();
+    uint64_t at = entry.localHeaderOffset;
+    if (at > size || size - at < 30 || le32(base + at) != 0x04034b50) {
+        error = entry.name + ": bad local header";
+        return false;
+    }
+    uint64_t start = at + 30 + le16(base + at + 26) + le16(base + at + 28);
+    if (start > size || entry.compressedSize > size - start) {
+        error = entry.name + ": data outside the archive";
+        return false;
+    }
+    data = base + start;
+    return true;
+}
+
+bool ZipArchive::read(const ZipEntry& entry, const ByteSink& out, string& error) const {
+    if (entry.flags & 1) {
+        error = entry.name + ": encrypted entries are not supported";
+        return false;
+    }
+    const uint8_t* data;
+    if (!rawData(entry, data, error)) return false;
+
+    uint32_t crc = 0;
+    uint64_t produced = 0;
+    ByteSink check = [&](const uint8_t* chunk, size_t n) {
+        crc = crc32Update(crc, chunk, n);
+        produced += n;
+        return out(chunk, n);
+    };
+    if (entry.method == 0) {
+        // Stored: hand over in slices so the CRC and the writes interleave
+        for (uint64_t off = 0; off < entry.compressedSize; off += kWriteBuffer) {
+            size_t n = (size_t)min<uint64_t>(kWriteBuffer, entry.compressedSize - off);
+            if (!check(data + off, n)) {
+                error = entry.name + ": cancelled";
+                return false;
+            }
+        }
+    } else if (entry.method == 8) {
+        string why;
+        if (!inflateRaw(data, (size_t)entry.compressedSize, check, why)) {
+            error = entry.name + ": " + why;
+            return false;
+        }
+    } else {
+        error = entry.name + ": unsupported compression method " + to_string(entry.method);
+        return false;
+    }
+    if (produced != entry.uncompressedSize) {
+        error = entry.name + ": size mismatch";
+        return false;
+    }
+    if (crc != entry.crc32) {
+        error = entry.name + ": CRC-32 mismatch";
+        return false;
+    }
+    return true;
+}
+
+// ===== Parallel extraction =====
+static bool safeEntryName(const string& name) {
+    if (name.empty() || name[0] == '/' || name[0] == '\\' || name.find(':') != string::npos) return false;
+    for (const auto& part : fs::path(name))
+        if (part == "..") return false;
+    return true;
+}
+
+static bool isZipName(const string& name) {
+    if (name.size() < 4) return false;
+    string ext = name.substr(name.size() - 4);
+    transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)tolower(c); });
+    return ext == ".zip";
+}
+
+static string extractEntry(const ZipArchive& zip, const ZipEntry& entry, const fs::path& target) {
+    error_code ec;
+    fs::create_directories(target.parent_path(), ec);
+    FILE* out = fopen(target.string().c_str(), "wb");
+    if (!out) return "cannot create " + target.string();
+    vector<char> buffer(kWriteBuffer);
+    setvbuf(out, buffer.data(), _IOFBF, buffer.size());
+    string error;
+    bool ok = zip.read(entry, [&](const uint8_t* data, size_t n) {
+        return fwrite(data, 1, n, out) == n && !shutdownRequested();
+    }, error);
+    if (fclose(out) != 0 && ok) {
+        ok = false;
+        error = "write failed: " + target.string();
+    }
+    if (!ok) fs::remove(target, ec);
+    return ok ? "" : error;
+}
+
+bool extractZip(const string& zipPath, const string& outDir, const UnzipOptions& opts,
+    vector<UnzippedFile>& files, string& error) {
+    ThreadPool pool(opts.threads > 0 ? (size_t)opts.threads : 0);
+    files.clear();
+
+    // Level by level: entries of one archive in parallel, then the nested
+    // archives it contained, all on the same pool.
+    struct Pending {
+        string zip;
+        fs::path dir;
+        int depth;
+    };
+    vector<Pending> level = { { zipPath, fs::path(outDir), 0 } };
+    while (!level.empty()) {
+        vector<unique_ptr<ZipArchive>> archives;
+        vector<future<string>> results;
+        vector<UnzippedFile> produced;
+        vector<Pending> next;
+        for (const Pending& job : level) {
+            archives.push_back(make_unique<ZipArchive>());
+            ZipArchive& zip = *archives.back();
+            if (!zip.open(job.zip, error)) break;
+            for (const ZipEntry& entry : zip.entries()) {
+                if (entry.isDirectory()) continue;
+                if (!safeEntryName(entry.name)) {
+                    error = job.zip + ": unsafe entry name " + entry.name;
+                    break;
+                }
+                fs::path target = job.dir / fs::u8path(entry.name);
+                produced.push_back({ target.string(), entry.uncompressedSize, job.depth });
+                if (opts.nested && isZipName(entry.name))
+                    next.push_back({ target.string(), target.parent_path() / target.stem(), job.depth + 1 });
+                results.push_back(pool.submit([&zip, &entry, target] { return extractEntry(zip, entry, target); }));
+            }
+            if (!error.empty()) break;
+        }
+        // Always wait: running tasks reference the archives
+        for (auto& r : results) {
+            string failure = r.get();
+            if (!failure.empty() && error.empty()) error = failure;
+        }
+        if (!error.empty()) return false;
+
+        // Nested archives are replaced by their contents
+        for (UnzippedFile& f : produced)
+            if (none_of(next.begin(), next.end(), [&](const Pending& p) { return p.zip == f.path; }))
+                files.push_back(f);
+        archives.clear();  // unmap before deleting
+        error_code ec;
+        for (const Pending& job : level)
+            if (job.depth > 0) fs::remove(job.zip, ec);
+        level = move(next);
+    }
+    return true;
+}
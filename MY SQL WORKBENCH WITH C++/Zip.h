@@ -0,0 +1,70 @@
+// Zip.h
+// Zip archive reader (ZIP64 aware) with a built-in streaming inflater.
+// The central directory is parsed once from a memory-mapped file; entries
+// can then be inflated concurrently since each only reads its own bytes.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class MappedFile;
+
+// Receives decompressed bytes in order; return false to stop.
+using ByteSink = std::function<bool(const uint8_t* data, size_t size)>;
+
+// Raw DEFLATE (RFC 1951) stream -> sink.
+bool inflateRaw(const uint8_t* in, size_t inSize, const ByteSink& out, std::string& error);
+
+struct ZipEntry {
+    std::string name;
+    uint16_t method = 0;           // 0 stored, 8 deflated
+    uint16_t flags = 0;
+    uint32_t crc32 = 0;
+    uint64_t compressedSize = 0;
+    uint64_t uncompressedSize = 0;
+    uint64_t localHeaderOffset = 0;
+
+    bool isDirectory() const { return !name.empty() && name.back() == '/'; }
+};
+
+class ZipArchive {
+public:
+    ZipArchive();
+    ~ZipArchive();
+
+    bool open(const std::string& path, std::string& error);
+
+    const std::vector<ZipEntry>& entries() const { return list; }
+    const ZipEntry* find(const std::string& name) const;
+
+    // Compressed bytes of an entry inside the mapping (for stored entries
+    // these are the contents, e.g. an OTA's payload.bin).
+    bool rawData(const ZipEntry& entry, const uint8_t*& data, std::string& error) const;
+
+    // Decompress one entry into `out`, checking size and CRC-32. Safe to
+    // call for different entries from several threads.
+    bool read(const ZipEntry& entry, const ByteSink& out, std::string& error) const;
+
+private:
+    std::unique_ptr<MappedFile> file;
+    std::vector<ZipEntry> list;
+};
+
+struct UnzipOptions {
+    int threads = 0;               // 0 = one per core
+    bool nested = true;            // unpack *.zip entries into <name>/ and drop them
+};
+
+struct UnzippedFile {
+    std::string path;
+    uint64_t size = 0;
+    int depth = 0;                 // 0 = top-level archive
+};
+
+// Extract every entry of `zipPath` below `outDir` in parallel.
+bool extractZip(const std::string& zipPath, const std::string& outDir, const UnzipOptions& opts,
+    std::vector<UnzippedFile>& files, std::string& error);
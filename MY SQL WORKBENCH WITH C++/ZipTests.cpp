@@ -0,0 +1,251 @@
+// ZipTests.cpp
+// CRC-32 against its check value and a bitwise reference, inflateRaw on
+// stored, fixed and dynamic blocks (streams produced by zlib at level 9),
+// and ZipArchive on small archives built here, ZIP64 records included.
+
+#include "Crc32.h"
+#include "SelfTest.h"
+#include "Zip.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static const char kHello[] = "hello hello hello world";
+static const vector<uint8_t> kFixed = { 0xcb, 0x48, 0xcd, 0xc9, 0xc9, 0x57, 0xc8, 0x40, 0x22, 0xcb, 0xf3, 0x8b,
+    0x72, 0x52, 0x00 };
+
+static const char kSkewed[] = "bbadabaababacaabaaabacaadaacdbdbaabbcaabadbbbdabcd";
+static const vector<uint8_t> kDynamic = { 0x25, 0x8a, 0x81, 0x09, 0x00, 0x30, 0x0c, 0xc2, 0x6e, 0x4d, 0xf4,
+    0xff, 0x1b, 0xd6, 0x76, 0x20, 0x18, 0x8c, 0x4a, 0x91, 0x89, 0x64, 0x8b, 0x0f, 0x85, 0xd4, 0xae, 0xf1,
+    0xf6, 0xaa, 0xf3, 0x4c, 0x1f };
+
+static bool inflateTo(const vector<uint8_t>& in, string& out, string& error) {
+    out.clear();
+    return inflateRaw(in.data(), in.size(), [&out](const uint8_t* data, size_t size) {
+        out.append((const char*)data, size);
+        return true;
+    }, error);
+}
+
+// Non-final stored block followed by a final one
+static vector<uint8_t> storedStream(const string& a, const string& b) {
+    vector<uint8_t> out;
+    for (const string* part : { &a, &b }) {
+        uint16_t len = (uint16_t)part->size();
+        out.push_back(part == &b ? 1 : 0);
+        out.insert(out.end(), { (uint8_t)len, (uint8_t)(len >> 8), (uint8_t)~len, (uint8_t)(~len >> 8) });
+        out.insert(out.end(), part->begin(), part->end());
+    }
+    return out;
+}
+
+SELFTEST(zip_crc32_check_value) {
+    CHECK_EQ(crc32Update(0, "123456789", 9), 0xCBF43926u);
+    CHECK_EQ(crc32Update(0, "", 0), 0u);
+    CHECK_EQ(crc32Update(crc32Update(0, "12345", 5), "6789", 4), 0xCBF43926u);
+    CHECK_EQ(crc32Update(0, kHello, sizeof(kHello) - 1), 0x815ae626u);
+}
+
+SELFTEST(zip_crc32_slices_match_bitwise) {
+    vector<uint8_t> data(1000);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)(i * 131 + (i >> 3));
+    // Every alignment and a tail that is not a multiple of 8
+    for (size_t start = 0; start < 9; start++) {
+        uint32_t expected = 0xffffffff;
+        for (size_t i = start; i < data.size() - 3; i++) {
+            expected ^= data[i];
+            for (int bit = 0; bit < 8; bit++) expected = expected >> 1 ^ (0xEDB88320 & (0 - (expected & 1)));
+        }
+        CHECK_EQ(crc32Update(0, data.data() + start, data.size() - 3 - start), ~expected);
+    }
+}
+
+SELFTEST(zip_inflate_stored_blocks) {
+    string out, error;
+    CHECK(inflateTo(storedStream("stored ", "blocks"), out, error));
+    CHECK_EQ(out, "stored blocks");
+    CHECK(inflateTo(storedStream("", ""), out, error));
+    CHECK_EQ(out, "");
+
+    vector<uint8_t> bad = storedStream("abc", "d");
+    bad[3] ^= 1;  // NLEN no longer the complement of LEN
+    CHECK(!inflateTo(bad, out, error));
+    CHECK_EQ(error, "bad stored block length");
+}
+
+SELFTEST(zip_inflate_fixed_block) {
+    CHECK_EQ((kFixed[0] >> 1) & 3, 1);
+    string out, error;
+    CHECK(inflateTo(kFixed, out, error));
+    CHECK_EQ(out, kHello);
+}
+
+SELFTEST(zip_inflate_dynamic_block) {
+    CHECK_EQ((kDynamic[0] >> 1) & 3, 2);
+    string out, error;
+    CHECK(inflateTo(kDynamic, out, error));
+    CHECK_EQ(out, kSkewed);
+}
+
+SELFTEST(zip_inflate_truncated_input_fails) {
+    for (const vector<uint8_t>* stream : { &kFixed, &kDynamic }) {
+        for (size_t n = 0; n < stream->size(); n++) {
+            vector<uint8_t> cut(stream->begin(), stream->begin() + n);
+            string out, error;
+            CHECK(!inflateTo(cut, out, error));
+        }
+    }
+    vector<uint8_t> stored = storedStream("abc", "defgh");
+    stored.pop_back();
+    string out, error;
+    CHECK(!inflateTo(stored, out, error));
+    CHECK_EQ(error, "truncated deflate stream");
+}
+
+// ===== Archives =====
+static void put16(string& s, uint32_t v) { s += (char)v, s += (char)(v >> 8); }
+static void put32(string& s, uint32_t v) { put16(s, v), put16(s, v >> 16); }
+static void put64(string& s, uint64_t v) { put32(s, (uint32_t)v), put32(s, (uint32_t)(v >> 32)); }
+
+struct TestEntry {
+    string name;
+    uint16_t method;
+    string data;       // as stored in the archive
+    uint32_t crc;
+    uint64_t size;     // uncompressed
+};
+
+// One local header per entry, the central directory and its end record.
+// With `zip64` sizes and offsets live only in ZIP64 extra fields and records.
+static string buildZip(const vector<TestEntry>& entries, bool zip64) {
+    string zip, cd;
+    for (const TestEntry& e : entries) {
+        uint64_t offset = zip.size();
+        put32(zip, 0x04034b50);
+        put16(zip, zip64 ? 45 : 20);
+        put16(zip, 0);
+        put16(zip, e.method);
+        put32(zip, 0);
+        put32(zip, e.crc);
+        put32(zip, (uint32_t)e.data.size());
+        put32(zip, (uint32_t)e.size);
+        put16(zip, (uint32_t)e.name.size());
+        put16(zip, 0);
+        zip += e.name + e.data;
+
+        put32(cd, 0x02014b50);
+        put16(cd, zip64 ? 45 : 20);
+        put16(cd, zip64 ? 45 : 20);
+        put16(cd, 0);
+        put16(cd, e.method);
+        put32(cd, 0);
+        put32(cd, e.crc);
+        put32(cd, zip64 ? 0xffffffff : (uint32_t)e.data.size());
+        put32(cd, zip64 ? 0xffffffff : (uint32_t)e.size);
+        put16(cd, (uint32_t)e.name.size());
+        put16(cd, zip64 ? 28 : 0);
+        put16(cd, 0);
+        put16(cd, 0);
+        put16(cd, 0);
+        put32(cd, 0);
+        put32(cd, zip64 ? 0xffffffff : (uint32_t)offset);
+        cd += e.name;
+        if (zip64) {
+            put16(cd, 0x0001);
+            put16(cd, 24);
+            put64(cd, e.size);
+            put64(cd, e.data.size());
+            put64(cd, offset);
+        }
+    }
+    uint64_t cdOffset = zip.size();
+    zip += cd;
+    if (zip64) {
+        uint64_t at = zip.size();
+        put32(zip, 0x06064b50);
+        put64(zip, 44);
+        put16(zip, 45);
+        put16(zip, 45);
+        put32(zip, 0);
+        put32(zip, 0);
+        put64(zip, entries.size());
+        put64(zip, entries.size());
+        put64(zip, cd.size());
+        put64(zip, cdOffset);
+        put32(zip, 0x07064b50);
+        put32(zip, 0);
+        put64(zip, at);
+        put32(zip, 1);
+    }
+    put32(zip, 0x06054b50);
+    put16(zip, 0);
+    put16(zip, 0);
+    put16(zip, zip64 ? 0xffff : (uint32_t)entries.size());
+    put16(zip, zip64 ? 0xffff : (uint32_t)entries.size());
+    put32(zip, zip64 ? 0xffffffff : (uint32_t)cd.size());
+    put32(zip, zip64 ? 0xffffffff : (uint32_t)cdOffset);
+    put16(zip, 0);
+    return zip;
+}
+
+static vector<TestEntry> sampleEntries() {
+    return { { "stored.txt", 0, kHello, crc32Update(0, kHello, sizeof(kHello) - 1), sizeof(kHello) - 1 },
+        { "dir/dynamic.txt", 8, string(kDynamic.begin(), kDynamic.end()), crc32Update(0, kSkewed, sizeof(kSkewed) - 1),
+            sizeof(kSkewed) - 1 } };
+}
+
+// Opens `zip` from a temporary file and reads every entry, or fails with
+// the first error
+static bool readAll(const string& zip, map<string, string>& contents, string& error) {
+    fs::path path = fs::temp_directory_path() /
+        ("adfxt-selftest-" + to_string(chrono::steady_clock::now().time_since_epoch().count()) + ".zip");
+    ofstream(path, ios::binary) << zip;
+    bool ok;
+    {
+        ZipArchive archive;
+        ok = archive.open(path.string(), error);
+        for (size_t i = 0; ok && i < archive.entries().size(); i++) {
+            string& out = contents[archive.entries()[i].name];
+            ok = archive.read(archive.entries()[i], [&out](const uint8_t* data, size_t size) {
+                out.append((const char*)data, size);
+                return true;
+            }, error);
+        }
+    }
+    error_code ec;
+    fs::remove(path, ec);
+    return ok;
+}
+
+SELFTEST(zip_archive_reads_entries) {
+    for (bool zip64 : { false, true }) {
+        map<string, string> contents;
+        string error;
+        CHECK(readAll(buildZip(sampleEntries(), zip64), contents, error));
+        CHECK_EQ(contents.size(), (size_t)2);
+        CHECK_EQ(contents["stored.txt"], kHello);
+        CHECK_EQ(contents["dir/dynamic.txt"], kSkewed);
+    }
+}
+
+SELFTEST(zip_archive_detects_corrupt_entries) {
+    vector<TestEntry> entries = sampleEntries();
+    entries[1].crc ^= 0x100;
+    map<string, string> contents;
+    string error;
+    CHECK(!readAll(buildZip(entries, false), contents, error));
+    CHECK_EQ(error, "dir/dynamic.txt: CRC-32 mismatch");
+
+    entries = sampleEntries();
+    entries[0].size++;
+    CHECK(!readAll(buildZip(entries, true), contents, error));
+    CHECK_EQ(error, "stored.txt: size mismatch");
+
+    CHECK(!readAll("PK not really", contents, error));
+    CHECK(error.find("not a zip archive") != string::npos);
+}
@@ -0,0 +1,216 @@
+/*
+ * adfxt_probe.c
+ * On-device telemetry helper. Pushed once to /data/local/tmp and run over
+ * "adb exec-out"; writes length-prefixed binary records to stdout so the
+ * host decodes samples without any text parsing. Layout: see Telemetry.h.
+ *
+ * Build with the NDK, static so it runs on any API level:
+ *   $NDK/toolchains/llvm/prebuilt/<host>/bin/aarch64-linux-android21-clang \
+ *       -static -O2 -s -o adfxt_probe adfxt_probe.c
+ *
+ * Usage: adfxt_probe [-i interval_ms] [-n count]   (count 0 = until killed)
+ *        adfxt_probe --clock
+ *        adfxt_probe --version
+ *
+ * --clock answers every line read from stdin with
+ * "<line> <realtime_ns> <boottime_ns> <utc_offset_sec>\n", read right after
+ * the line arrives, for the host's round-trip clock alignment (Clock.h).
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/statfs.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PROBE_VERSION 2
+
+enum { REC_HELLO = 0, REC_SAMPLE = 1 };
+
+enum {
+    F_BATTERY_LEVEL = 1 << 0,
+    F_BATTERY_TEMP = 1 << 1,
+    F_BATTERY_VOLTAGE = 1 << 2,
+    F_BATTERY_STATUS = 1 << 3,
+    F_UPTIME = 1 << 4,
+    F_MEM_AVAIL = 1 << 5,
+    F_DATA = 1 << 6
+};
+
+static unsigned char *put16(unsigned char *p, uint16_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    return p + 2;
+}
+
+static unsigned char *put32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+    return p + 4;
+}
+
+static unsigned char *put64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+    return p + 8;
+}
+
+static int writeAll(const unsigned char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Small sysfs/procfs reads without stdio buffering. */
+static int readSmall(const char *path, char *buf, size_t size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n <= 0) return -1;
+    buf[n] = '\0';
+    return (int)n;
+}
+
+static int readLong(const char *path, long long *out) {
+    char buf[64];
+    if (readSmall(path, buf, sizeof(buf)) < 0) return 0;
+    *out = strtoll(buf, NULL, 10);
+    return 1;
+}
+
+/* BatteryManager.BATTERY_STATUS_* */
+static int batteryStatus(void) {
+    char buf[32];
+    if (readSmall("/sys/class/power_supply/battery/status", buf, sizeof(buf)) < 0) return -1;
+    if (strncmp(buf, "Charging", 8) == 0) return 2;
+    if (strncmp(buf, "Discharging", 11) == 0) return 3;
+    if (strncmp(buf, "Not charging", 12) == 0) return 4;
+    if (strncmp(buf, "Full", 4) == 0) return 5;
+    return 1;
+}
+
+static int memAvailableKb(long long *out) {
+    char buf[512];
+    if (readSmall("/proc/meminfo", buf, sizeof(buf)) < 0) return 0;
+    char *line = strstr(buf, "MemAvailable:");
+    if (!line) return 0;
+    *out = strtoll(line + 13, NULL, 10);
+    return 1;
+}
+
+static uint64_t boottimeNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int emitHello(void) {
+    unsigned char rec[2 + 2 + 4 + 4];
+    unsigned char *p = put16(rec, sizeof(rec) - 2);
+    *p++ = REC_HELLO;
+    *p++ = 0;
+    memcpy(p, "ADFX", 4);
+    p += 4;
+    put32(p, PROBE_VERSION);
+    return writeAll(rec, sizeof(rec));
+}
+
+static int emitSample(void) {
+    unsigned char rec[2 + 1 + 1 + 8 + 4 * 4 + 8 * 4];
+    long long level = 0, temp = 0, voltage = 0, memAvail = 0;
+    uint8_t flags = 0;
+
+    if (readLong("/sys/class/power_supply/battery/capacity", &level)) flags |= F_BATTERY_LEVEL;
+    if (readLong("/sys/class/power_supply/battery/temp", &temp)) flags |= F_BATTERY_TEMP;
+    if (readLong("/sys/class/power_supply/battery/voltage_now", &voltage)) flags |= F_BATTERY_VOLTAGE;
+    int status = batteryStatus();
+    if (status >= 0) flags |= F_BATTERY_STATUS;
+    if (memAvailableKb(&memAvail)) flags |= F_MEM_AVAIL;
+
+    struct timespec mono;
+    clock_gettime(CLOCK_BOOTTIME, &mono);
+    uint64_t uptimeMs = (uint64_t)mono.tv_sec * 1000 + (uint64_t)mono.tv_nsec / 1000000;
+    flags |= F_UPTIME;
+
+    struct statfs fs;
+    uint64_t dataAvailKb = 0, dataTotalKb = 0;
+    if (statfs("/data", &fs) == 0) {
+        dataAvailKb = (uint64_t)fs.f_bavail * (uint64_t)fs.f_bsize / 1024;
+        dataTotalKb = (uint64_t)fs.f_blocks * (uint64_t)fs.f_bsize / 1024;
+        flags |= F_DATA;
+    }
+
+    unsigned char *p = put16(rec, sizeof(rec) - 2);
+    *p++ = REC_SAMPLE;
+    *p++ = flags;
+    p = put64(p, boottimeNs());
+    p = put32(p, (uint32_t)(int32_t)level);
+    p = put32(p, (uint32_t)(int32_t)temp);
+    p = put32(p, (uint32_t)(int32_t)(voltage / 1000)); /* uV -> mV */
+    p = put32(p, (uint32_t)(int32_t)status);
+    p = put64(p, uptimeMs);
+    p = put64(p, (uint64_t)memAvail);
+    p = put64(p, dataAvailKb);
+    put64(p, dataTotalKb);
+    return writeAll(rec, sizeof(rec));
+}
+
+/* One reply per request line, unbuffered so each goes out immediately. */
+static int clockLoop(void) {
+    char line[256];
+    char reply[400];
+    while (fgets(line, sizeof(line), stdin)) {
+        struct timespec real;
+        clock_gettime(CLOCK_REALTIME, &real);
+        uint64_t boot = boottimeNs();
+        line[strcspn(line, "\r\n")] = '\0';
+        struct tm local;
+        time_t secs = real.tv_sec;
+        localtime_r(&secs, &local);
+        int n = snprintf(reply, sizeof(reply), "%s %llu %llu %ld\n", line,
+            (unsigned long long)real.tv_sec * 1000000000ull + (unsigned long long)real.tv_nsec,
+            (unsigned long long)boot, (long)local.tm_gmtoff);
+        if (writeAll((const unsigned char *)reply, (size_t)n) < 0) return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    long intervalMs = 1000;
+    long count = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--version") == 0) {
+            printf("adfxt_probe %d\n", PROBE_VERSION);
+            return 0;
+        }
+        if (strcmp(argv[i], "--clock") == 0) return clockLoop();
+        if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) intervalMs = atol(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) count = atol(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [-i interval_ms] [-n count] | --clock | --version\n", argv[0]);
+            return 2;
+        }
+    }
+    if (intervalMs < 1) intervalMs = 1;
+
+    if (emitHello() < 0) return 1;
+    for (long n = 0; count == 0 || n < count; n++) {
+        if (n > 0) {
+            struct timespec ts = { intervalMs / 1000, (intervalMs % 1000) * 1000000L };
+            while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {}
+        }
+        if (emitSample() < 0) return 1; /* host went away */
+    }
+    return 0;
+}
@@ -1,33 +1,75 @@
 ﻿// PixelDeviceInfo.cpp
 // Compile with: MSVC /std:c++17
-// Link: mysqlcppconn.lib, winmm.lib
+// Link: mysqlcppconn.lib (delay-loaded, see MySqlSink.cpp), winmm.lib
 
 #include <iostream>
+#include <filesystem>
 #include <fstream>
 #include <string>
 #include <sstream>
 #include <thread>
 #include <chrono>
 #include <cstdio>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
 
 #ifdef _WIN32
 #include <windows.h>
 #include <mmsystem.h>
+#include <psapi.h>
 #pragma comment(lib, "winmm.lib") // For PlaySound
+#else
+#include <sys/resource.h>
 #endif
 
-#include <cppconn/driver.h>
-#include <cppconn/connection.h>
-#include <cppconn/prepared_statement.h>
-#include <cppconn/resultset.h>
-#include <mysql_driver.h>
+#include "Adb.h"
+#include "Alerts.h"
+#include "Avb.h"
+#include "Bench.h"
+#include "Clock.h"
+#include "Collectors.h"
+#include "CrashWatcher.h"
+#include "DirPull.h"
+#include "DirSync.h"
+#include "Drift.h"
+#include "FlashPlanner.h"
+#include "Json.h"
+#include "Lease.h"
+#include "LogStore.h"
+#include "MySqlSink.h"
+#include "OtaPayload.h"
+#include "RateLimiter.h"
+#include "SelfTest.h"
+#include "Shutdown.h"
+#include "SerialDir.h"
+#include "Sinks.h"
+#include "Spawner.h"
+#include "Telemetry.h"
+#include "TestRunner.h"
+#include "TimeSeries.h"
+#include "Trace.h"
+#include "WriteQueue.h"
+#include "Zip.h"
 
 using namespace std;
 
+// Batch mode: no colors, no cosmetics, status messages on stderr
+static bool batchMode = false;
+
+ostream& statusOut() { return batchMode ? cerr : cout; }
+
 // ===== Console Colors =====
 #ifdef _WIN32
-void setColor(int color) { SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), color); }
-void resetColor() { SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), 7); }
+void setColor(int color) { if (!batchMode) SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), color); }
+void resetColor() { if (!batchMode) SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), 7); }
 #else
 void setColor(int color) {}
 void resetColor() {}
@@ -65,99 +107,1415 @@ void showProgressBar(const string& task, int duration) {
     cout << "] 100%\n";
 }
 
-// ===== Run shell command and capture output =====
-string runCommand(const string& cmd) {
-    char buffer[256];
-    string result;
-    FILE* pipe = _popen(cmd.c_str(), "r");
-    if (!pipe) return "";
-    while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
-        result += buffer;
+// ===== Save through a persistence backend =====
+// Concurrent sinks save from several threads; keep their status lines whole
+static mutex saveStatusMutex;
+
+void saveRecord(RecordSink& sink, const DeviceRecord& rec) {
+    string error;
+    bool ok = sink.save(rec, error);
+    lock_guard<mutex> lock(saveStatusMutex);
+    if (ok) {
+        setColor(10);
+        statusOut() << "[OK] Device info saved to " << sink.describe() << "\n";
+        resetColor();
+    }
+    else {
+        setColor(12);
+        cerr << "[FAIL] " << error << "\n";
+        resetColor();
     }
-    _pclose(pipe);
-    if (!result.empty())
-        result.erase(result.find_last_not_of(" \n\r\t") + 1);
-    return result;
 }
 
-// ===== Detect device =====
-bool detectDevice(string& serial) {
-    string devicesOutput = runCommand("adb devices");
-    istringstream ss(devicesOutput);
-    string line;
-    while (getline(ss, line)) {
-        line.erase(line.find_last_not_of(" \n\r\t") + 1);
-        if (line.find("\tdevice") != string::npos) {
-            serial = line.substr(0, line.find("\tdevice"));
+// ===== Batch mode =====
+// Non-interactive subcommands with machine-readable output. Nothing cosmetic
+// runs (no cls, sound, banner, progress bars or key wait) and the MySQL
+// driver is only touched when "--sink mysql" is given.
+
+struct BatchOptions {
+    string command;
+    vector<string> args;
+    vector<string> serials;
+    bool allDevices = false;
+    string format = "json";
+    vector<string> sinks;
+    bool stats = false;
+    bool timings = false;
+    vector<string> collectors = { "props" };
+    int intervalMs = 1000;
+    int count = 1;
+    bool textOnly = false;
+    bool watch = false;
+    bool bench = false;
+    string outDir;
+    int streams = 4;
+    double maxRate = 0.0;
+    vector<string> only;
+    bool verify = false;
+    int jobs = 0;
+    bool noCache = false;
+    string slot;
+    bool execute = false;
+    bool noReboot = false;
+    string tag;
+    int pid = -1;
+    bool ignoreCase = false;
+    bool regex = false;
+    string store;
+    string notify;
+    int keepRawDays = 0;
+    int retries = 1;
+    int port = 7391;
+    int ttlSec = 600;
+    int waitSec = 0;
+    int launches = 10;
+    int warmup = 1;
+    vector<string> modes = { "cold", "warm" };
+    string tracePath;
+    int samples = 32;
+    int64_t fromMs = 0;
+    int64_t toMs = INT64_MAX;
+    Resolution resolution = Resolution::Raw;
+};
+
+// Epoch milliseconds, "now", or a relative "-N" with s/m/h/d suffix.
+// Out-of-range numbers are rejected.
+static bool parseTimeArg(const string& value, int64_t& ms) {
+    int64_t now = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    if (value == "now") {
+        ms = now;
+        return true;
+    }
+    auto parseDigits = [](const string& digits, int64_t& n) {
+        if (digits.empty() || digits.find_first_not_of("0123456789") != string::npos) return false;
+        errno = 0;
+        long long parsed = strtoll(digits.c_str(), nullptr, 10);
+        if (errno == ERANGE) return false;
+        n = parsed;
+        return true;
+    };
+    if (value.size() > 2 && value[0] == '-') {
+        static const map<char, int64_t> units = { { 's', 1000 }, { 'm', 60000 }, { 'h', 3600000 }, { 'd', 86400000 } };
+        auto unit = units.find(value.back());
+        int64_t count;
+        if (unit == units.end() || !parseDigits(value.substr(1, value.size() - 2), count)) return false;
+        if (count > (INT64_MAX - now) / unit->second) return false;
+        ms = now - count * unit->second;
+        return true;
+    }
+    return parseDigits(value, ms);
+}
+
+static void printUsage(const char* argv0) {
+    cerr << "Usage: " << argv0 << " <command> [options]\n"
+        << "Commands:\n"
+        << "  devices                 list attached devices\n"
+        << "  info                    model, brand, device and Android version\n"
+        << "  getprop PROP...         raw property values\n"
+        << "  telemetry               battery/memory/storage samples from the on-device helper\n"
+        << "  crashes                 pull new tombstones/ANR traces and index them by signature\n"
+        << "  sync LOCAL REMOTE       push only files whose hash differs on the device\n"
+        << "  pull REMOTE             copy a device directory to --out DIR/<serial>\n"
+        << "  drift RULES             report devices that differ from a golden rules file\n"
+        << "  alerts RULES            fire and resolve alert rules as device fields change\n"
+        << "  test RUNNER             run instrumentation tests (pkg/runner) sharded over the devices\n"
+        << "  bench-app COMPONENT     time cold and warm launches of pkg/.Activity on every device\n"
+        << "  clock-sync              offset and drift of each device's clocks against the host\n"
+        << "  ota-extract PAYLOAD     raw partition images from a full OTA zip or payload.bin\n"
+        << "  unzip ZIP               extract a factory image zip, nested image zips included\n"
+        << "  avb-verify DIR          check vbmeta.img and the images it describes in DIR\n"
+        << "  flash-plan DIR          order a flash of DIR's images for devices in fastboot\n"
+        << "  logs capture            store logcat in compressed, indexed segments under --out DIR\n"
+        << "  logs grep PATTERN       search the stored logcat of every (or each -s) device\n"
+        << "  ts-query [SERIES]       read a series (SERIAL/metric) from --store; lists series without one\n"
+        << "  lease-daemon            lease devices to CI jobs over a local TCP port\n"
+        << "  lease acquire [KEY=VALUE...]  lease a device matching model, device, brand, sdk, release, serial\n"
+        << "  lease heartbeat|release ID    renew or return a lease\n"
+        << "  lease status            devices, leases and allocation stats of the daemon\n"
+        << "  selftest [NAME...]      run the built-in unit tests (those starting with NAME)\n"
+        << "Options:\n"
+        << "  -s SERIAL               target device (repeatable)\n"
+        << "  --all                   every attached device\n"
+        << "  --format json|tsv       output format (default json, one object per line)\n"
+        << "  --sink NAME             also persist info results: file, spool, mysql (repeatable)\n"
+        << "  --collect LIST          extra info collectors, comma separated or 'all':\n"
+        << "                          storage, battery, uptime, kernel, selinux\n"
+        << "  --interval MS           telemetry sample interval (default 1000)\n"
+        << "  --count N               telemetry samples per device, 0 = until Ctrl-C (default 1)\n"
+        << "  --text                  telemetry over text shell collectors, not the helper\n"
+        << "  --store DIR             telemetry: also record samples in this time-series store;\n"
+        << "                          ts-query: store to read (default tsdb)\n"
+        << "  --keep-raw DAYS         telemetry --store: delete raw samples older than DAYS (rollups stay)\n"
+        << "  --from T, --to T        ts-query: time range, epoch ms, 'now' or -N[s|m|h|d] (default all)\n"
+        << "  --resolution R          ts-query: raw, 1m or 1h (default raw)\n"
+        << "  --watch                 crashes/drift/alerts: keep polling every --interval;\n"
+        << "                          logs capture: follow logcat\n"
+        << "  --out DIR               output directory (crashes: crashes, pull: pull, ota-extract: images,\n"
+        << "                          unzip: firmware, logs: logs, test: test-results, bench-app: bench)\n"
+        << "  --streams N             pull: concurrent transfer streams per device (default 4)\n"
+        << "  --max-rate RATE         pull: total bytes/s across devices, K/M/G suffix (default no cap)\n"
+        << "  --only LIST             ota-extract: partitions to extract; test: classes to run\n"
+        << "                          (comma separated, default all)\n"
+        << "  --retries N             test: extra attempts for a failing test on another device (default 1)\n"
+        << "  --port N                lease-daemon/lease: TCP port on 127.0.0.1 (default 7391)\n"
+        << "  --ttl SEC               lease acquire: lease length without heartbeats (default 600)\n"
+        << "  --wait SEC              lease acquire: wait this long for a matching device (default 0)\n"
+        << "  --launches N            bench-app: recorded launches per mode and device (default 10)\n"
+        << "  --warmup N              bench-app: discarded launches before each mode (default 1)\n"
+        << "  --mode cold|warm|hot|both|all\n"
+        << "                          bench-app: launch kinds to time; both = cold and warm (default both)\n"
+        << "  --verify                ota-extract: check operation and image hashes\n"
+        << "  --jobs N                ota-extract/unzip/avb-verify/logs grep: worker threads (default one per core)\n"
+        << "  --no-cache              avb-verify: re-hash images verified before\n"
+        << "  --slot a|b              flash-plan: target slot (default the current one)\n"
+        << "  --execute               flash-plan: run the plan, not just print it\n"
+        << "  --no-reboot             flash-plan: stay in fastboot at the end\n"
+        << "  --notify URL|FILE       alerts: also deliver events in batches to an http:// webhook\n"
+        << "                          or append them to a JSON-lines file\n"
+        << "  --tag TAG, --pid PID    logs grep: only lines with this tag / process id\n"
+        << "  -i                      logs grep: ignore case\n"
+        << "  --regex                 logs grep: PATTERN is an ECMAScript regex, not a literal\n"
+        << "  --samples N             clock-sync: round trips per device (default 32)\n"
+        << "  --trace FILE            write a Chrome JSON trace of adb calls, flash steps and device\n"
+        << "                          telemetry/logcat events, aligned to host time\n"
+        << "  --stats                 print adb rate limiter and telemetry stats to stderr\n"
+        << "  --bench                 selftest: run the benchmarks instead of the unit tests\n"
+        << "  --timings               print startup time, peak memory and loaded backends to stderr\n"
+        << "Run without arguments for the interactive tool.\n";
+}
+
+static bool parseBatchArgs(int argc, char** argv, BatchOptions& opts) {
+    for (int i = 1; i < argc; i++) {
+        string a = argv[i];
+        auto next = [&](string& out) {
+            if (i + 1 >= argc) return false;
+            out = argv[++i];
             return true;
+        };
+        string value;
+        if (a == "-s") {
+            if (!next(value)) return false;
+            opts.serials.push_back(value);
+        }
+        else if (a == "--all") opts.allDevices = true;
+        else if (a == "--format") {
+            if (!next(opts.format) || (opts.format != "json" && opts.format != "tsv")) return false;
+        }
+        else if (a == "--sink") {
+            if (!next(value) || !sinkExists(value)) return false;
+            opts.sinks.push_back(value);
+        }
+        else if (a == "--stats") opts.stats = true;
+        else if (a == "--timings") opts.timings = true;
+        else if (a == "--text") opts.textOnly = true;
+        else if (a == "--watch") opts.watch = true;
+        else if (a == "--bench") opts.bench = true;
+        else if (a == "--out") {
+            if (!next(opts.outDir)) return false;
+        }
+        else if (a == "--verify") opts.verify = true;
+        else if (a == "--no-cache") opts.noCache = true;
+        else if (a == "--execute") opts.execute = true;
+        else if (a == "--no-reboot") opts.noReboot = true;
+        else if (a == "-i") opts.ignoreCase = true;
+        else if (a == "--regex") opts.regex = true;
+        else if (a == "--notify") {
+            if (!next(opts.notify)) return false;
+        }
+        else if (a == "--store") {
+            if (!next(opts.store)) return false;
+        }
+        else if (a == "--keep-raw") {
+            if (!next(value) || (opts.keepRawDays = atoi(value.c_str())) <= 0) return false;
+        }
+        else if (a == "--from" || a == "--to") {
+            if (!next(value) || !parseTimeArg(value, a == "--from" ? opts.fromMs : opts.toMs)) return false;
+        }
+        else if (a == "--resolution") {
+            if (!next(value) || !parseResolution(value, opts.resolution)) return false;
+        }
+        else if (a == "--tag") {
+            if (!next(opts.tag)) return false;
+        }
+        else if (a == "--pid") {
+            if (!next(value) || value.empty() || value.find_first_not_of("0123456789") != string::npos) return false;
+            opts.pid = atoi(value.c_str());
+        }
+        else if (a == "--slot") {
+            if (!next(opts.slot) || (opts.slot != "a" && opts.slot != "b")) return false;
+        }
+        else if (a == "--only") {
+            if (!next(value)) return false;
+            istringstream list(value);
+            string name;
+            while (getline(list, name, ','))
+                if (!name.empty()) opts.only.push_back(name);
         }
+        else if (a == "--jobs") {
+            if (!next(value) || (opts.jobs = atoi(value.c_str())) <= 0) return false;
+        }
+        else if (a == "--retries") {
+            if (!next(value) || value.empty() || value.find_first_not_of("0123456789") != string::npos) return false;
+            opts.retries = atoi(value.c_str());
+        }
+        else if (a == "--port" || a == "--ttl" || a == "--wait") {
+            if (!next(value) || value.empty() || value.find_first_not_of("0123456789") != string::npos) return false;
+            (a == "--port" ? opts.port : a == "--ttl" ? opts.ttlSec : opts.waitSec) = atoi(value.c_str());
+        }
+        else if (a == "--trace") {
+            if (!next(opts.tracePath)) return false;
+        }
+        else if (a == "--samples") {
+            if (!next(value) || (opts.samples = atoi(value.c_str())) <= 0) return false;
+        }
+        else if (a == "--launches" || a == "--warmup") {
+            if (!next(value) || value.empty() || value.find_first_not_of("0123456789") != string::npos) return false;
+            (a == "--launches" ? opts.launches : opts.warmup) = atoi(value.c_str());
+            if (opts.launches == 0) return false;
+        }
+        else if (a == "--mode") {
+            if (!next(value)) return false;
+            if (value == "both") opts.modes = { "cold", "warm" };
+            else if (value == "all") opts.modes = { "cold", "warm", "hot" };
+            else if (value == "cold" || value == "warm" || value == "hot") opts.modes = { value };
+            else return false;
+        }
+        else if (a == "--streams") {
+            if (!next(value) || (opts.streams = atoi(value.c_str())) <= 0) return false;
+        }
+        else if (a == "--max-rate") {
+            if (!next(value)) return false;
+            char* end = nullptr;
+            opts.maxRate = strtod(value.c_str(), &end);
+            switch (toupper((unsigned char)*end)) {
+            case 'G': opts.maxRate *= 1024.0;  // fall through
+            case 'M': opts.maxRate *= 1024.0;  // fall through
+            case 'K': opts.maxRate *= 1024.0; end++; break;
+            }
+            if (*end || opts.maxRate <= 0.0) return false;
+        }
+        else if (a == "--interval" || a == "--count") {
+            if (!next(value) || value.empty() || value.find_first_not_of("0123456789") != string::npos) return false;
+            (a == "--interval" ? opts.intervalMs : opts.count) = atoi(value.c_str());
+        }
+        else if (a == "--collect") {
+            if (!next(value)) return false;
+            if (value == "all") {
+                opts.collectors = collectorNames();
+                continue;
+            }
+            istringstream list(value);
+            string name;
+            while (getline(list, name, ',')) {
+                if (!collectorExists(name)) return false;
+                if (find(opts.collectors.begin(), opts.collectors.end(), name) == opts.collectors.end())
+                    opts.collectors.push_back(name);
+            }
+        }
+        else if (a.size() > 1 && a[0] == '-') return false;
+        else if (opts.command.empty()) opts.command = a;
+        else opts.args.push_back(a);
     }
-    return false;
+    return !opts.command.empty();
 }
 
-// ===== Fetch Android property =====
-string getProp(const string& prop) {
-    return runCommand("adb shell getprop " + prop);
+// One record per line: {"k":"v",...} or a tab-separated row.
+static void printRecord(const BatchOptions& opts, const vector<pair<string, string>>& fields) {
+    if (opts.format == "tsv") {
+        for (size_t i = 0; i < fields.size(); i++) {
+            string v = fields[i].second;
+            for (char& c : v)
+                if (c == '\t' || c == '\n') c = ' ';
+            cout << (i ? "\t" : "") << v;
+        }
+        cout << "\n";
+        return;
+    }
+    cout << "{";
+    for (size_t i = 0; i < fields.size(); i++)
+        cout << (i ? "," : "") << "\"" << jsonEscape(fields[i].first) << "\":\"" << jsonEscape(fields[i].second) << "\"";
+    cout << "}\n";
 }
 
-// ===== Save to MySQL =====
-void saveToDatabase(const string& serial, const string& model, const string& brand,
-    const string& device, const string& androidV, const string& sdk) {
-    try {
-        sql::mysql::MySQL_Driver* driver = sql::mysql::get_mysql_driver_instance();
-        unique_ptr<sql::Connection> con(driver->connect("tcp://127.0.0.1:3306", "root", "your_password")); // Set your password
-        con->setSchema("pixel_db");
+static void printLimiterStats() {
+    for (auto& [host, st] : AdbRateLimiter::instance().allStats()) {
+        cerr << "adb " << host << ": granted=" << st.granted << " delayed=" << st.delayed
+            << " max_queue=" << st.maxQueueDepth
+            << " avg_wait_us=" << (st.delayed ? st.totalWaitUs / st.delayed : 0) << "\n";
+    }
+    SharedCommandStats shared = sharedCommandStats();
+    cerr << "single-flight: executions=" << shared.executions << " shared=" << shared.shared
+        << " cache_hits=" << shared.cacheHits << "\n";
+}
 
-        unique_ptr<sql::PreparedStatement> pstmt(
-            con->prepareStatement(
-                "INSERT INTO devices (serial, model, brand, device, android_version, sdk_version) VALUES (?, ?, ?, ?, ?, ?)"
-            )
-        );
+// Typed collector results as output fields; unknown values stay empty.
+static void appendCollectorFields(const BatchOptions& opts, const DeviceSnapshot& snap,
+    vector<pair<string, string>>& fields) {
+    auto num = [](auto v, auto unset) { return v == unset ? string() : to_string(v); };
+    for (const string& name : opts.collectors) {
+        if (name == "storage") {
+            fields.push_back({ "data_total_kb", num(snap.dataTotalKb, -1) });
+            fields.push_back({ "data_used_kb", num(snap.dataUsedKb, -1) });
+            fields.push_back({ "data_avail_kb", num(snap.dataAvailKb, -1) });
+        }
+        else if (name == "battery") {
+            fields.push_back({ "battery_level", num(snap.batteryLevel, -1) });
+            string temp;
+            if (snap.batteryTempDeciC != INT32_MIN) {
+                temp = to_string(snap.batteryTempDeciC / 10) + "." + to_string(abs(snap.batteryTempDeciC % 10));
+                if (snap.batteryTempDeciC < 0 && snap.batteryTempDeciC > -10) temp = "-" + temp;
+            }
+            fields.push_back({ "battery_temp_c", temp });
+            fields.push_back({ "battery_voltage_mv", num(snap.batteryVoltageMv, -1) });
+            fields.push_back({ "battery_status", num(snap.batteryStatus, -1) });
+        }
+        else if (name == "uptime") {
+            fields.push_back({ "uptime_sec", snap.uptimeSec < 0 ? string() : to_string((int64_t)snap.uptimeSec) });
+        }
+        else if (name == "kernel") {
+            fields.push_back({ "kernel_version", snap.kernelVersion });
+        }
+        else if (name == "selinux") {
+            fields.push_back({ "selinux", snap.selinux });
+        }
+    }
+}
 
-        pstmt->setString(1, serial);
-        pstmt->setString(2, model);
-        pstmt->setString(3, brand);
-        pstmt->setString(4, device);
-        pstmt->setString(5, androidV);
-        pstmt->setString(6, sdk);
+// ===== telemetry subcommand =====
+static int runTelemetry(const BatchOptions& opts) {
+    mutex outMutex;
+    vector<thread> workers;
+    vector<TelemetryStats> stats(opts.serials.size());
+    bool allOk = true;
+    unique_ptr<TimeSeriesStore> store;
+    if (!opts.store.empty()) {
+        store = make_unique<TimeSeriesStore>(opts.store);
+        if (opts.keepRawDays > 0) {
+            int64_t now = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+            store->dropRawBefore(now - opts.keepRawDays * 86400000LL);
+        }
+    }
 
-        pstmt->execute();
+    for (size_t i = 0; i < opts.serials.size(); i++) {
+        workers.emplace_back([&, i] {
+            bool ok = streamTelemetry(opts.serials[i], opts.intervalMs, opts.count, !opts.textOnly,
+                [&](const TelemetrySample& s) {
+                    auto num = [](auto v, auto unset) { return v == unset ? string() : to_string(v); };
+                    lock_guard<mutex> lock(outMutex);
+                    printRecord(opts, { { "serial", s.serial },
+                        { "device_time_ns", to_string(s.deviceTimeNs) },
+                        { "battery_level", num(s.batteryLevel, -1) },
+                        { "battery_temp_decic", num(s.batteryTempDeciC, INT_MIN) },
+                        { "battery_voltage_mv", num(s.batteryVoltageMv, -1) },
+                        { "battery_status", num(s.batteryStatus, -1) },
+                        { "uptime_ms", num(s.uptimeMs, (int64_t)-1) },
+                        { "mem_avail_kb", num(s.memAvailKb, (int64_t)-1) },
+                        { "data_avail_kb", num(s.dataAvailKb, (int64_t)-1) },
+                        { "data_total_kb", num(s.dataTotalKb, (int64_t)-1) } });
+                    cout.flush();
+                    if (traceEnabled() && s.deviceTimeNs) {
+                        map<string, double> values;
+                        if (s.batteryLevel != -1) values["battery_level"] = s.batteryLevel;
+                        if (s.memAvailKb != -1) values["mem_avail_mb"] = s.memAvailKb / 1024.0;
+                        traceDeviceCounter(s.serial, DeviceClock::Boottime, (int64_t)s.deviceTimeNs, "telemetry", values);
+                    }
+                    if (store) {
+                        // Host receive time: the device clock is boot-relative
+                        int64_t now = chrono::duration_cast<chrono::milliseconds>(
+                            chrono::system_clock::now().time_since_epoch()).count();
+                        const string prefix = s.serial + "/";
+                        if (s.batteryLevel != -1) store->append(prefix + "battery_level", now, s.batteryLevel);
+                        if (s.batteryTempDeciC != INT_MIN)
+                            store->append(prefix + "battery_temp_c", now, s.batteryTempDeciC / 10.0);
+                        if (s.batteryVoltageMv != -1) store->append(prefix + "battery_voltage_mv", now, s.batteryVoltageMv);
+                        if (s.memAvailKb != -1) store->append(prefix + "mem_avail_kb", now, (double)s.memAvailKb);
+                        if (s.dataAvailKb != -1) store->append(prefix + "data_avail_kb", now, (double)s.dataAvailKb);
+                    }
+                    return !shutdownRequested();
+                }, &stats[i]);
+            lock_guard<mutex> lock(outMutex);
+            if (!ok) {
+                allOk = false;
+                cerr << "[FAIL] " << opts.serials[i] << ": no telemetry\n";
+            }
+            else if (stats[i].probeFailed) {
+                cerr << "[WARN] " << opts.serials[i] << ": helper stream ended early, continued over text\n";
+            }
+        });
+    }
+    for (auto& w : workers) w.join();
+    string error;
+    if (store && !store->flush(error)) {
+        allOk = false;
+        cerr << "[FAIL] " << error << "\n";
+    }
 
-        setColor(10);
-        cout << "[OK] Device info saved to MySQL database.\n";
-        resetColor();
+    if (opts.stats) {
+        printLimiterStats();
+        for (size_t i = 0; i < stats.size(); i++) {
+            const TelemetryStats& st = stats[i];
+            cerr << "telemetry " << opts.serials[i] << ": source=" << (st.probeFailed ? "helper+text" : st.usedProbe ? "helper" : "text")
+                << " samples=" << st.samples
+                << " bytes_per_sample=" << (st.samples ? st.bytes / st.samples : 0)
+                << " decode_ns_per_sample=" << (st.samples ? st.decodeNs / st.samples : 0) << "\n";
+        }
     }
-    catch (const sql::SQLException& e) {
-        setColor(12);
-        cerr << "[FAIL] SQL Error: " << e.what() << "\n";
-        resetColor();
+    return allOk ? 0 : 1;
+}
+
+// ===== crashes subcommand =====
+static int runCrashes(const BatchOptions& opts) {
+    CrashWatcher watcher(opts.outDir.empty() ? "crashes" : opts.outDir);
+    mutex outMutex;
+
+    do {
+        auto roundStart = chrono::steady_clock::now();
+        vector<thread> workers;
+        for (const string& serial : opts.serials) {
+            workers.emplace_back([&, serial] {
+                for (const CrashFile& cf : watcher.poll(serial)) {
+                    char hash[17];
+                    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)cf.signatureHash);
+                    lock_guard<mutex> lock(outMutex);
+                    printRecord(opts, { { "serial", cf.serial }, { "kind", cf.kind },
+                        { "remote", cf.remotePath }, { "local", cf.localPath },
+                        { "signature_hash", hash }, { "occurrences", to_string(cf.occurrences) },
+                        { "signature", cf.signature } });
+                    cout.flush();
+                }
+            });
+        }
+        for (auto& w : workers) w.join();
+
+        auto next = roundStart + chrono::milliseconds(opts.intervalMs);
+        while (opts.watch && !shutdownRequested() && chrono::steady_clock::now() < next)
+            this_thread::sleep_for(chrono::milliseconds(50));
+    } while (opts.watch && !shutdownRequested());
+
+    if (opts.stats) printLimiterStats();
+    return 0;
+}
+
+// ===== Polling rounds (drift, alerts) =====
+// Collect from every device at once, a single round or one every --interval
+// with --watch, and hand each device's fields to `onFields` on its own
+// thread. A device whose collection failed is skipped for the round: it
+// keeps its last state instead of having every field turn absent.
+// `afterRound` runs once all devices of a round are done.
+static void pollDevices(const BatchOptions& opts, const vector<string>& collectors, mutex& outMutex,
+    const function<void(const string& serial, const FieldMap& fields)>& onFields,
+    const function<void()>& afterRound = nullptr) {
+    do {
+        auto roundStart = chrono::steady_clock::now();
+        vector<thread> workers;
+        for (const string& serial : opts.serials) {
+            workers.emplace_back([&, serial] {
+                DeviceSnapshot snap = collectDevice(serial, collectors);
+                if (!snap.missing.empty()) {
+                    lock_guard<mutex> lock(outMutex);
+                    cerr << "[WARN] " << serial << ": collection failed, state unchanged\n";
+                    return;
+                }
+                onFields(serial, snapshotFields(snap));
+            });
+        }
+        for (auto& w : workers) w.join();
+        if (afterRound) afterRound();
+
+        auto next = roundStart + chrono::milliseconds(opts.intervalMs);
+        while (opts.watch && !shutdownRequested() && chrono::steady_clock::now() < next)
+            this_thread::sleep_for(chrono::milliseconds(50));
+    } while (opts.watch && !shutdownRequested());
+}
+
+// ===== drift subcommand =====
+static int runDrift(const BatchOptions& opts) {
+    DriftPlan plan;
+    string error;
+    if (!loadDriftRules(opts.args[0], plan, error)) {
+        cerr << "[FAIL] " << error << "\n";
+        return 2;
     }
+    // "changed" is an event; as a drift rule it would always pass
+    for (const DriftRule& rule : plan.rules)
+        if (rule.op == DriftRule::Op::Changed) {
+            cerr << "[FAIL] " << opts.args[0] << ":" << rule.line << ": \"changed\" rules are for alerts, not drift\n";
+            return 2;
+        }
+    DriftEngine engine(plan);
+    mutex outMutex;
+    pollDevices(opts, plan.collectors(), outMutex, [&](const string& serial, const FieldMap& fields) {
+        // Only rules whose fields changed since the last round are evaluated
+        vector<DriftChange> changes = engine.update(serial, fields);
+        lock_guard<mutex> lock(outMutex);
+        for (const DriftChange& c : changes) {
+            const DriftRule& rule = plan.rules[c.rule];
+            printRecord(opts, { { "serial", c.serial }, { "status", c.failing ? "drift" : "ok" },
+                { "field", plan.fields[rule.field] }, { "actual", c.present ? c.actual : "(absent)" },
+                { "rule", rule.text }, { "line", to_string(rule.line) } });
+        }
+        cout.flush();
+    });
+
+    set<string> drifted = engine.nonCompliant();
+    size_t unchecked = opts.serials.size() - engine.deviceCount();
+    if (unchecked) cerr << "[FAIL] " << unchecked << " device(s) could not be checked\n";
+    if (drifted.empty()) cerr << "[OK] " << engine.deviceCount() << " device(s) match the golden rules\n";
+    else {
+        cerr << "[WARN] " << drifted.size() << " of " << engine.deviceCount() << " device(s) drifted:";
+        for (const string& serial : drifted) cerr << " " << serial;
+        cerr << "\n";
+    }
+    if (opts.stats) {
+        printLimiterStats();
+        DriftStats st = engine.stats();
+        cerr << "drift: rules=" << plan.rules.size() << " fields=" << plan.fields.size()
+            << " updates=" << st.updates << " fields_changed=" << st.fieldsChanged
+            << " rules_evaluated=" << st.rulesEvaluated << "\n";
+    }
+    return drifted.empty() && !unchecked ? 0 : 1;
 }
 
-// ===== Save to details.txt =====
-void saveToTextFile(const string& serial, const string& model, const string& brand,
-    const string& device, const string& androidV, const string& sdk) {
-    ofstream file("details.txt");
-    if (file.is_open()) {
-        file << "Serial: " << serial << "\n";
-        file << "Model: " << model << "\n";
-        file << "Brand: " << brand << "\n";
-        file << "Device: " << device << "\n";
-        file << "Android Version: " << androidV << "\n";
-        file << "SDK Version: " << sdk << "\n";
-        file.close();
-        setColor(10);
-        cout << "[OK] Device info saved to details.txt\n";
-        resetColor();
+// ===== alerts subcommand =====
+static int runAlerts(const BatchOptions& opts) {
+    DriftPlan plan;
+    string error;
+    if (!loadDriftRules(opts.args[0], plan, error)) {
+        cerr << "[FAIL] " << error << "\n";
+        return 2;
+    }
+    AlertEngine engine(plan);
+    AlertNotifier notifier(opts.notify);
+    mutex outMutex;
+    pollDevices(opts, plan.collectors(), outMutex, [&](const string& serial, const FieldMap& fields) {
+        vector<AlertEvent> events = engine.update(serial, fields);
+        lock_guard<mutex> lock(outMutex);
+        for (const AlertEvent& e : events) {
+            printRecord(opts, { { "alert", e.alert }, { "serial", e.serial }, { "state", e.state },
+                { "field", e.field }, { "value", e.value }, { "previous", e.previous },
+                { "time_ms", to_string(e.timeMs) } });
+            notifier.add(e);
+        }
+        cout.flush();
+    }, [&notifier] { notifier.flush(); });  // one batch per round at most, besides full ones
+    notifier.drain();
+
+    size_t firing = engine.active().size();
+    if (firing) cerr << "[WARN] " << firing << " alert(s) firing\n";
+    else cerr << "[OK] no alerts firing\n";
+    if (opts.stats) {
+        printLimiterStats();
+        AlertStats st = engine.stats();
+        cerr << "alerts: rules=" << plan.rules.size() << " updates=" << st.updates
+            << " fields_changed=" << st.fieldsChanged << " rules_evaluated=" << st.rulesEvaluated
+            << " events=" << st.events << " delivered=" << notifier.delivered()
+            << " dropped=" << notifier.failed() << "\n";
+    }
+    // A notification that never arrived must not look like a clean run
+    if (notifier.failed()) {
+        cerr << "[FAIL] " << notifier.failed() << " alert event(s) not delivered to " << opts.notify << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+// ===== test subcommand =====
+static int runTests(const BatchOptions& opts) {
+    string outDir = opts.outDir.empty() ? "test-results" : opts.outDir;
+    error_code ec;
+    filesystem::create_directories(outDir, ec);
+    string historyPath = outDir + "/test-history.tsv";
+
+    TestRunOptions run;
+    run.runner = opts.args[0];
+    run.retries = opts.retries;
+    vector<string> tests;
+    string error;
+    if (!listInstrumentationTests(opts.serials[0], run.runner, opts.only, tests, error)) {
+        cerr << "[FAIL] " << error << "\n";
+        return 1;
+    }
+    statusOut() << tests.size() << " test(s) on " << opts.serials.size() << " device(s)\n";
+
+    map<string, double> history = loadTestHistory(historyPath);
+    TestRunStats stats;
+    vector<TestResult> results = runShardedTests(opts.serials, tests, run, history, [&](const TestResult& r) {
+        printRecord(opts, { { "test", r.test }, { "status", r.status }, { "device", r.device },
+            { "attempts", to_string(r.attempts) }, { "ms", to_string(r.ms) }, { "message", r.message } });
+        cout.flush();
+    }, stats);
+
+    if (!saveTestHistory(historyPath, history)) cerr << "[WARN] cannot write " << historyPath << "\n";
+    if (!writeJUnitReport(outDir + "/junit.xml", results, stats, error)) cerr << "[WARN] " << error << "\n";
+
+    map<string, size_t> counts;
+    for (const TestResult& r : results) counts[r.status]++;
+    bool ok = !counts["failed"] && !counts["error"];
+    cerr << (ok ? "[OK] " : "[FAIL] ") << counts["passed"] << " passed, " << counts["flaky"] << " flaky, "
+        << counts["failed"] << " failed, " << counts["error"] << " error, " << counts["skipped"] << " skipped in "
+        << stats.wallMs / 1000.0 << "s\n";
+    if (opts.stats) {
+        printLimiterStats();
+        cerr << "test: batches=" << stats.batches << " steals=" << stats.steals << " retries=" << stats.retries
+            << " test_ms=" << stats.testMs << " wall_ms=" << stats.wallMs;
+        for (auto& [serial, ms] : stats.busyMs) cerr << " busy_ms[" << serial << "]=" << ms;
+        cerr << "\n";
+    }
+    return ok ? 0 : 1;
+}
+
+// ===== clock-sync subcommand =====
+static int runClockSync(const BatchOptions& opts) {
+    mutex outMutex;
+    vector<thread> workers;
+    bool allOk = true;
+    for (const string& serial : opts.serials) {
+        workers.emplace_back([&, serial] {
+            // Spread over a few seconds so the drift is measurable
+            ClockSession session(serial);
+            string error;
+            bool ok = session.open(error) && session.burst(opts.samples, 100, error);
+            session.close();
+            ClockModel model = fitClockModel(serial, session.exchanges());
+            lock_guard<mutex> lock(outMutex);
+            if (!ok || !model.valid) {
+                cerr << "[FAIL] " << serial << ": " << (error.empty() ? "no clock samples" : error) << "\n";
+                allOk = false;
+                return;
+            }
+            int64_t wallMinusSteady = chrono::duration_cast<chrono::nanoseconds>(
+                chrono::system_clock::now().time_since_epoch()).count() - hostSteadyNs();
+            int64_t deviceReal = session.exchanges().back().deviceRealNs;
+            int64_t hostWall = model.realtime.toHost(deviceReal) + wallMinusSteady;
+            char buf[6][32];
+            snprintf(buf[0], sizeof(buf[0]), "%.3f", (deviceReal - hostWall) / 1e6);
+            snprintf(buf[1], sizeof(buf[1]), "%.3f", model.boottime.drift * 1e6);
+            snprintf(buf[2], sizeof(buf[2]), "%.3f", model.realtime.drift * 1e6);
+            snprintf(buf[3], sizeof(buf[3]), "%.3f", model.minRttNs / 1e6);
+            snprintf(buf[4], sizeof(buf[4]), "%.3f", model.minRttNs / 2e6);
+            snprintf(buf[5], sizeof(buf[5]), "%lld", (long long)((model.boottime.offsetNs + wallMinusSteady) / 1000000));
+            printRecord(opts, { { "serial", serial }, { "source", session.source() },
+                { "wall_clock_offset_ms", buf[0] }, { "boottime_drift_ppm", buf[1] },
+                { "realtime_drift_ppm", buf[2] }, { "rtt_min_ms", buf[3] }, { "uncertainty_ms", buf[4] },
+                { "booted_at_ms", buf[5] }, { "utc_offset_sec", to_string(model.utcOffsetSec) },
+                { "exchanges", to_string(model.exchanges) }, { "used", to_string(model.used) } });
+        });
+    }
+    for (auto& w : workers) w.join();
+    if (opts.stats) printLimiterStats();
+    return allOk ? 0 : 1;
+}
+
+// ===== bench-app subcommand =====
+static int runBenchApp(const BatchOptions& opts) {
+    string outDir = opts.outDir.empty() ? "bench" : opts.outDir;
+    error_code ec;
+    filesystem::create_directories(outDir, ec);
+    string tablePath = outDir + "/launch-benchmarks.tsv";
+
+    LaunchBenchOptions bench;
+    bench.component = opts.args[0];
+    bench.launches = opts.launches;
+    bench.warmup = opts.warmup;
+    bench.modes = opts.modes;
+    if (bench.component.find('/') == string::npos) {
+        cerr << "[FAIL] expected a component, e.g. com.example/.MainActivity\n";
+        return 2;
+    }
+
+    // Every device runs its own launch loop; only the sample list is shared
+    auto start = chrono::steady_clock::now();
+    vector<LaunchSample> samples;
+    mutex samplesMutex;
+    vector<thread> workers;
+    for (const string& serial : opts.serials) {
+        workers.emplace_back([&, serial] {
+            string model = getProp(serial, "ro.product.model");
+            runLaunchBenchmark(serial, model.empty() ? "unknown" : model, bench, [&](const LaunchSample& s) {
+                lock_guard<mutex> lock(samplesMutex);
+                samples.push_back(s);
+                if (!s.error.empty()) statusOut() << "[WARN] " << serial << " " << s.mode << " launch: " << s.error << "\n";
+            });
+        });
+    }
+    for (auto& w : workers) w.join();
+    int64_t wallMs = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+
+    vector<LaunchSummary> summaries = summarizeLaunches(bench.component, samples);
+    if (summaries.empty()) {
+        cerr << "[FAIL] no launch completed\n";
+        return 1;
+    }
+    map<string, LaunchSummary> baseline = loadBenchBaseline(tablePath, bench.component);
+    size_t regressions = 0;
+    auto ms = [](double v) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.1f", v);
+        return string(buf);
+    };
+    for (const LaunchSummary& s : summaries) {
+        vector<pair<string, string>> fields = { { "model", s.model }, { "mode", s.mode }, { "metric", s.metric },
+            { "n", to_string(s.n) }, { "mean_ms", ms(s.mean) }, { "stddev_ms", ms(s.stddev) },
+            { "p50_ms", ms(s.p50) }, { "p90_ms", ms(s.p90) }, { "p99_ms", ms(s.p99) },
+            { "ci_low_ms", ms(s.ciLow) }, { "ci_high_ms", ms(s.ciHigh) } };
+        auto base = baseline.find(benchKey(s));
+        if (base != baseline.end()) {
+            string verdict = compareToBaseline(s, base->second);
+            fields.push_back({ "baseline_p50_ms", ms(base->second.p50) });
+            fields.push_back({ "verdict", verdict });
+            if (verdict == "regression") {
+                regressions++;
+                cerr << "[WARN] " << s.model << " " << s.mode << " " << s.metric << " launch regressed: p50 "
+                    << ms(base->second.p50) << " -> " << ms(s.p50) << " ms\n";
+            }
+        }
+        printRecord(opts, fields);
+    }
+
+    string run = to_string(chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count());
+    string error;
+    if (!appendBenchTable(tablePath, run, summaries, error) ||
+        !appendLaunchSamples(outDir + "/launch-samples.tsv", run, samples, error))
+        cerr << "[WARN] " << error << "\n";
+
+    size_t failed = count_if(samples.begin(), samples.end(), [](const LaunchSample& s) { return !s.error.empty(); });
+    if (regressions) cerr << "[FAIL] " << regressions << " launch regression(s) against the previous run\n";
+    else cerr << "[OK] " << samples.size() - failed << " launch(es) timed on " << opts.serials.size()
+        << " device(s), run " << run << " added to " << tablePath << "\n";
+    if (opts.stats) {
+        printLimiterStats();
+        cerr << "bench-app: launches=" << samples.size() << " failed=" << failed << " summaries=" << summaries.size()
+            << " wall_ms=" << wallMs << "\n";
+    }
+    return regressions ? 1 : 0;
+}
+
+// ===== lease subcommands =====
+static int runLeaseClient(const BatchOptions& opts) {
+    const string& action = opts.args[0];
+    string line;
+    if (action == "acquire") {
+        line = "ACQUIRE ttl=" + to_string(opts.ttlSec) + " wait=" + to_string(opts.waitSec);
+        for (size_t i = 1; i < opts.args.size(); i++) {
+            const string& word = opts.args[i];
+            size_t eq = word.find('=');
+            if (eq == string::npos) {
+                cerr << "[FAIL] expected KEY=VALUE: " << word << "\n";
+                return 2;
+            }
+            // The shell already took the quotes off "model=Pixel 3"
+            bool spaced = word.find(' ') != string::npos;
+            line += " " + word.substr(0, eq + 1) + (spaced ? "\"" + word.substr(eq + 1) + "\"" : word.substr(eq + 1));
+        }
+    }
+    else if ((action == "heartbeat" || action == "release") && opts.args.size() == 2) {
+        line = (action == "heartbeat" ? "HEARTBEAT " : "RELEASE ") + opts.args[1];
+    }
+    else if (action == "status" && opts.args.size() == 1) {
+        line = "STATUS";
     }
     else {
-        setColor(12);
-        cerr << "[FAIL] Unable to open details.txt for writing\n";
-        resetColor();
+        cerr << "[FAIL] expected lease acquire|heartbeat|release|status\n";
+        return 2;
+    }
+
+    vector<string> reply;
+    string error;
+    if (!leaseCall(opts.port, line, (opts.waitSec + 10) * 1000, reply, error)) {
+        cerr << "[FAIL] " << error << "\n";
+        return 1;
+    }
+    if (action == "status") {
+        for (const string& text : reply) {
+            vector<string> words = splitLeaseWords(text);
+            vector<pair<string, string>> fields;
+            if (words.size() > 1 && words[0] == "device") fields.push_back({ "serial", words[1] });
+            for (size_t i = 1; i < words.size(); i++) {
+                size_t eq = words[i].find('=');
+                if (eq != string::npos) fields.push_back({ words[i].substr(0, eq), words[i].substr(eq + 1) });
+            }
+            if (words[0] == "device") printRecord(opts, fields);
+            else {
+                cerr << "lease:";
+                for (auto& [k, v] : fields) cerr << " " << k << "=" << v;
+                cerr << "\n";
+            }
+        }
+        return 0;
+    }
+    vector<string> words = splitLeaseWords(reply.empty() ? "" : reply[0]);
+    if (words.empty() || words[0] != "OK") {
+        cerr << "[FAIL] " << (reply.empty() ? "empty reply" : reply[0].substr(min<size_t>(4, reply[0].size()))) << "\n";
+        return 1;
+    }
+    if (action == "acquire") {
+        vector<pair<string, string>> fields;
+        for (size_t i = 1; i < words.size(); i++) {
+            size_t eq = words[i].find('=');
+            if (eq != string::npos) fields.push_back({ words[i].substr(0, eq), words[i].substr(eq + 1) });
+        }
+        printRecord(opts, fields);
+    }
+    else cerr << "[OK] " << action << " " << opts.args[1] << "\n";
+    return 0;
+}
+
+// ===== sync subcommand =====
+static int runSync(const BatchOptions& opts) {
+    const string& localDir = opts.args[0];
+    string remoteDir = opts.args[1];
+    while (remoteDir.size() > 1 && remoteDir.back() == '/') remoteDir.pop_back();
+
+    // Hashed once on the host, diffed against every device in parallel
+    SyncManifest manifest = buildHostManifest(localDir);
+    vector<SyncResult> results(opts.serials.size());
+    vector<thread> workers;
+    for (size_t i = 0; i < opts.serials.size(); i++)
+        workers.emplace_back([&, i] { results[i] = syncToDevice(opts.serials[i], localDir, remoteDir, manifest); });
+    for (auto& w : workers) w.join();
+
+    bool allOk = true;
+    for (const SyncResult& r : results) {
+        printRecord(opts, { { "serial", r.serial }, { "files", to_string(r.files) },
+            { "changed", to_string(r.changed) }, { "bytes_pushed", to_string(r.bytesPushed) },
+            { "extra_on_device", to_string(r.extraOnDevice) }, { "status", r.ok ? "ok" : r.error } });
+        if (!r.ok) allOk = false;
+    }
+    if (opts.stats) printLimiterStats();
+    return allOk ? 0 : 1;
+}
+
+// ===== pull subcommand =====
+static int runPull(const BatchOptions& opts) {
+    string remoteDir = opts.args[0];
+    while (remoteDir.size() > 1 && remoteDir.back() == '/') remoteDir.pop_back();
+    string outDir = opts.outDir.empty() ? "pull" : opts.outDir;
+
+    // One cap for every device: they usually share the host's USB bandwidth
+    BandwidthLimiter cap(opts.maxRate);
+    vector<PullResult> results(opts.serials.size());
+    vector<thread> workers;
+    for (size_t i = 0; i < opts.serials.size(); i++)
+        workers.emplace_back([&, i] {
+            results[i] = pullDirectory(opts.serials[i], remoteDir, outDir + "/" + serialDirName(opts.serials[i]),
+                opts.streams, &cap);
+        });
+    for (auto& w : workers) w.join();
+
+    bool allOk = true;
+    for (const PullResult& r : results) {
+        char rate[32];
+        snprintf(rate, sizeof(rate), "%.2f", r.seconds > 0 ? r.bytes / r.seconds / (1024.0 * 1024.0) : 0.0);
+        printRecord(opts, { { "serial", r.serial }, { "files", to_string(r.files) },
+            { "pulled", to_string(r.pulled) }, { "bytes", to_string(r.bytes) },
+            { "mib_per_sec", rate }, { "status", r.ok ? "ok" : r.error } });
+        if (!r.ok) allOk = false;
+    }
+    if (opts.stats) printLimiterStats();
+    return allOk ? 0 : 1;
+}
+
+// ===== ts-query subcommand =====
+static int runTsQuery(const BatchOptions& opts) {
+    TimeSeriesStore store(opts.store.empty() ? "tsdb" : opts.store);
+    if (opts.args.empty()) {
+        for (const string& name : store.listSeries()) printRecord(opts, { { "series", name } });
+        return 0;
+    }
+    vector<SeriesPoint> points;
+    SeriesQueryStats stats;
+    string error;
+    if (!store.query(opts.args[0], opts.fromMs, opts.toMs, opts.resolution, points, error, &stats)) {
+        cerr << "[FAIL] " << error << "\n";
+        return 1;
+    }
+    auto num = [](double v) {
+        char text[32];
+        snprintf(text, sizeof(text), "%.6g", v);
+        return string(text);
+    };
+    for (const SeriesPoint& p : points) {
+        if (opts.resolution == Resolution::Raw)
+            printRecord(opts, { { "ts_ms", to_string(p.tsMs) }, { "value", num(p.avg) } });
+        else
+            printRecord(opts, { { "ts_ms", to_string(p.tsMs) }, { "min", num(p.min) }, { "max", num(p.max) },
+                { "avg", num(p.avg) }, { "count", to_string(p.count) } });
+    }
+    if (opts.stats)
+        cerr << "ts-query: files=" << stats.files << " blocks=" << stats.blocks
+            << " blocks_decoded=" << stats.blocksDecoded << " bytes_decoded=" << stats.bytesDecoded << "\n";
+    return 0;
+}
+
+// ===== logs subcommands =====
+// Warnings and errors go on the device's trace lane; the rest would drown it
+static void traceLogcatLine(const string& serial, const string& line) {
+    istringstream in(line);
+    string date, clock, pid, tid, level, tag;
+    int pidValue;
+    int64_t localNs;
+    if (!(in >> date >> clock >> pid >> tid >> level) || (level != "W" && level != "E" && level != "F") ||
+        !parseLogcatLine(line, tag, pidValue) || !logcatLocalTimeNs(line, localNs))
+        return;
+    traceDeviceInstant(serial, DeviceClock::Local, localNs, "logcat", level + "/" + tag,
+        { { "pid", pid }, { "line", line } });
+}
+
+static int runLogsCapture(const BatchOptions& opts) {
+    string root = opts.outDir.empty() ? "logs" : opts.outDir;
+    mutex outMutex;
+    vector<thread> workers;
+    bool allOk = true;
+
+    for (const string& serial : opts.serials) {
+        workers.emplace_back([&, serial] {
+            LogWriter writer(root, serial);
+            string partial;
+            // -d dumps the current buffer and exits; --watch follows it
+            string cmd = "adb -s " + serial + " logcat -v threadtime" + (opts.watch ? "" : " -d");
+            int rc = runCommandStreaming(cmd, [&](const char* data, size_t size) {
+                partial.append(data, size);
+                size_t start = 0, nl;
+                while ((nl = partial.find('\n', start)) != string::npos) {
+                    size_t end = nl > start && partial[nl - 1] == '\r' ? nl - 1 : nl;
+                    if (end > start && partial.compare(start, 9, "---------") != 0) {
+                        writer.append(partial.substr(start, end - start));
+                        if (traceEnabled()) traceLogcatLine(serial, partial.substr(start, end - start));
+                    }
+                    start = nl + 1;
+                }
+                partial.erase(0, start);
+                return !shutdownRequested();
+            });
+            if (!partial.empty()) writer.append(partial);
+            string error;
+            bool ok = writer.flush(error);
+            // Ctrl-C ends a --watch capture; anything else is a failed logcat
+            if (ok && rc != 0 && !shutdownRequested()) {
+                ok = false;
+                error = "logcat exited with " + to_string(rc);
+            }
+            lock_guard<mutex> lock(outMutex);
+            printRecord(opts, { { "serial", serial }, { "lines", to_string(writer.linesWritten()) },
+                { "segments", to_string(writer.segmentsWritten()) }, { "status", ok ? "ok" : error } });
+            if (!ok) allOk = false;
+        });
+    }
+    for (auto& w : workers) w.join();
+    if (opts.stats) printLimiterStats();
+    return allOk ? 0 : 1;
+}
+
+static int runLogsGrep(const BatchOptions& opts) {
+    LogQuery query;
+    query.pattern = opts.args[1];
+    query.regex = opts.regex;
+    query.ignoreCase = opts.ignoreCase;
+    query.tag = opts.tag;
+    query.pid = opts.pid;
+    query.serials = opts.serials;
+    query.threads = opts.jobs;
+
+    LogSearchStats stats;
+    string error;
+    auto start = chrono::steady_clock::now();
+    bool ok = searchLogs(opts.outDir.empty() ? "logs" : opts.outDir, query, [&](const LogMatch& m) {
+        printRecord(opts, { { "serial", m.serial }, { "segment", m.segment }, { "line", m.line } });
+    }, stats, error);
+    if (!ok) cerr << "[FAIL] " << error << "\n";
+    if (opts.stats) {
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cerr << "logs: segments=" << stats.segments << " pruned_by_filter=" << stats.prunedByFilter
+            << " pruned_by_trigram=" << stats.prunedByTrigram << " scanned=" << stats.scanned
+            << " bytes_scanned=" << stats.bytesScanned << " matches=" << stats.matches
+            << " ms=" << (int64_t)ms << "\n";
+    }
+    return ok ? (stats.matches ? 0 : 1) : 2;
+}
+
+// ===== ota-extract subcommand =====
+static int runOtaExtract(const BatchOptions& opts) {
+    ExtractOptions extract;
+    extract.partitions = opts.only;
+    extract.threads = opts.jobs;
+    extract.verify = opts.verify;
+
+    // OTA zips store payload.bin uncompressed: extract straight from the mapping
+    vector<ExtractedImage> images;
+    string outDir = opts.outDir.empty() ? "images" : opts.outDir;
+    string error;
+    ZipArchive zip;
+    string zipError;
+    bool ok = false;
+    if (zip.open(opts.args[0], zipError)) {
+        const ZipEntry* entry = zip.find("payload.bin");
+        const uint8_t* payload = nullptr;
+        if (!entry) error = "no payload.bin in " + opts.args[0];
+        else if (entry->method != 0) error = "payload.bin is compressed; extract it with unzip first";
+        else if (zip.rawData(*entry, payload, error))
+            ok = extractPayload(payload, (size_t)entry->uncompressedSize, outDir, extract, images, error);
+    } else {
+        ok = extractPayload(opts.args[0], outDir, extract, images, error);
+    }
+    if (!ok) {
+        cerr << "[FAIL] " << error << "\n";
+        return 1;
+    }
+    for (const ExtractedImage& img : images)
+        printRecord(opts, { { "partition", img.partition }, { "path", img.path },
+            { "size", to_string(img.size) }, { "operations", to_string(img.operations) },
+            { "verified", img.verified ? "true" : "false" } });
+    return 0;
+}
+
+// ===== unzip subcommand =====
+static int runUnzip(const BatchOptions& opts) {
+    UnzipOptions unzip;
+    unzip.threads = opts.jobs;
+    vector<UnzippedFile> files;
+    string error;
+    if (!extractZip(opts.args[0], opts.outDir.empty() ? "firmware" : opts.outDir, unzip, files, error)) {
+        cerr << "[FAIL] " << error << "\n";
+        return 1;
+    }
+    for (const UnzippedFile& f : files)
+        printRecord(opts, { { "path", f.path }, { "size", to_string(f.size) }, { "depth", to_string(f.depth) } });
+    return 0;
+}
+
+// ===== avb-verify subcommand =====
+static int runAvbVerify(const BatchOptions& opts) {
+    AvbVerifyOptions verify;
+    verify.threads = opts.jobs;
+    verify.useCache = !opts.noCache;
+    vector<AvbCheck> checks;
+    string error;
+    if (!verifyAvb(opts.args[0], verify, checks, error)) {
+        cerr << "[FAIL] " << error << "\n";
+        return 1;
+    }
+    bool allOk = true;
+    for (const AvbCheck& c : checks) {
+        char seconds[32];
+        snprintf(seconds, sizeof(seconds), "%.3f", c.seconds);
+        printRecord(opts, { { "partition", c.partition }, { "kind", c.kind }, { "image", c.image },
+            { "status", c.ok ? "ok" : c.error }, { "cached", c.cached ? "true" : "false" },
+            { "bytes_hashed", to_string(c.bytesHashed) }, { "seconds", seconds } });
+        if (!c.ok) allOk = false;
+    }
+    if (opts.stats) cerr << "avb hash backend: " << avbHashBackend() << "\n";
+    return allOk ? 0 : 1;
+}
+
+// ===== flash-plan subcommand =====
+static int runFlashPlan(const BatchOptions& opts) {
+    vector<FlashImage> images;
+    vector<string> boards;
+    string error;
+    if (!loadFlashManifest(opts.args[0], images, boards, error)) {
+        cerr << "[FAIL] " << error << "\n";
+        return 1;
+    }
+    vector<string> serials = flashTargets(opts.serials, opts.allDevices, listFastbootDevices);
+    if (serials.empty()) {
+        cerr << "[FAIL] No device in fastboot mode.\n";
+        return 1;
+    }
+
+    FlashPlanOptions planOpts;
+    planOpts.targetSlot = opts.slot;
+    planOpts.reboot = !opts.noReboot;
+
+    // Devices are independent: fetch, plan and flash them all at once
+    vector<FlashPlan> plans(serials.size());
+    vector<string> failures(serials.size());
+    vector<thread> workers;
+    for (size_t i = 0; i < serials.size(); i++)
+        workers.emplace_back([&, i] {
+            plans[i] = planFlash(serials[i], images, getFastbootVars(serials[i]), boards, planOpts);
+            if (!opts.execute) return;
+            if (!plans[i].ok) {
+                failures[i] = "not flashed";
+                return;
+            }
+            size_t failedStep = 0;
+            if (!executeFlashPlan(plans[i], failedStep, failures[i]))
+                failures[i] = "step " + to_string(failedStep + 1) + ": " + failures[i];
+        });
+    for (auto& w : workers) w.join();
+
+    bool allOk = true;
+    for (size_t i = 0; i < plans.size(); i++) {
+        const FlashPlan& plan = plans[i];
+        for (size_t n = 0; n < plan.steps.size(); n++) {
+            const FlashStep& step = plan.steps[n];
+            char est[32];
+            snprintf(est, sizeof(est), "%.1f", step.estSeconds);
+            printRecord(opts, { { "serial", plan.serial }, { "step", to_string(n + 1) }, { "action", step.action },
+                { "partition", step.partition }, { "mode", step.mode == FastbootMode::Userspace ? "fastbootd" : "bootloader" },
+                { "bytes", to_string(step.bytes) }, { "est_seconds", est }, { "command", step.command } });
+        }
+        for (const string& w : plan.warnings) cerr << "[WARN] " << plan.serial << ": " << w << "\n";
+        cerr << (plan.ok && failures[i].empty() ? "[OK] " : "[FAIL] ") << plan.serial << ": " << plan.steps.size()
+            << " steps, " << plan.modeSwitches << " mode switches, " << plan.slotSwitches << " slot switches, ~"
+            << (int)(plan.estSeconds + 0.5) << " s" << (failures[i].empty() ? "" : " - " + failures[i]) << "\n";
+        if (!plan.ok || !failures[i].empty()) allOk = false;
     }
+    return allOk ? 0 : 1;
 }
 
-int main() {
+static const chrono::steady_clock::time_point processStart = chrono::steady_clock::now();
+
+static size_t peakResidentKb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc = {};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return pmc.PeakWorkingSetSize / 1024;
+    return 0;
+#else
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return (size_t)usage.ru_maxrss;
+#endif
+}
+
+// Makes the cost of optional backends visible: compare a run with and
+// without "--sink mysql".
+static void printTimings(chrono::steady_clock::time_point firstQuery) {
+    auto us = [](chrono::steady_clock::duration d) {
+        return chrono::duration_cast<chrono::microseconds>(d).count();
+    };
+    cerr << "startup_to_first_adb_us=" << us(firstQuery - processStart)
+        << " total_us=" << us(chrono::steady_clock::now() - processStart)
+        << " peak_rss_kb=" << peakResidentKb()
+        << " mysql_loaded=" << (mySqlDriverLoaded() ? "yes" : "no") << "\n";
+}
+
+// ===== devices / info / getprop =====
+static int runDevices(const BatchOptions& opts) {
+    for (const string& serial : listDevices())
+        printRecord(opts, { { "serial", serial } });
+    if (opts.stats) printLimiterStats();
+    return 0;
+}
+
+static string snapshotProp(const DeviceSnapshot& snap, const string& name) {
+    auto it = snap.props.find(name);
+    return it == snap.props.end() ? string() : it->second;
+}
+
+static DeviceRecord deviceRecordFrom(const DeviceSnapshot& snap) {
+    DeviceRecord rec;
+    rec.serial = snap.serial;
+    rec.model = snapshotProp(snap, "ro.product.model");
+    rec.brand = snapshotProp(snap, "ro.product.brand");
+    rec.device = snapshotProp(snap, "ro.product.device");
+    rec.androidVersion = snapshotProp(snap, "ro.build.version.release");
+    rec.sdkVersion = snapshotProp(snap, "ro.build.version.sdk");
+    rec.enrichment = lookupDevice(rec.device);
+    return rec;
+}
+
+static int runInfo(const BatchOptions& opts) {
+    // Backends are only created (and their libraries loaded) when asked for
+    unique_ptr<WriteQueue> persistQueue;
+    vector<shared_ptr<RecordSink>> queuedSinks, concurrentSinks;
+    if (!opts.sinks.empty()) {
+        persistQueue = make_unique<WriteQueue>("persistence queue");
+        for (const string& name : opts.sinks) {
+            shared_ptr<RecordSink> sink = createSink(name);
+            (sink->concurrentSaves() ? concurrentSinks : queuedSinks).push_back(sink);
+        }
+    }
+    bool getprop = opts.command == "getprop";
+
+    // Devices are collected at once; concurrent sinks save from the same
+    // threads, so their writes overlap and share commits
+    vector<DeviceSnapshot> snaps(opts.serials.size());
+    vector<char> collected(opts.serials.size(), 0);  // not vector<bool>: set from several threads
+    vector<thread> workers;
+    for (size_t i = 0; i < opts.serials.size(); i++)
+        workers.emplace_back([&, i] {
+            if (shutdownRequested()) return;
+            // One adb shell per device, however many collectors are enabled
+            snaps[i] = collectDevice(opts.serials[i], getprop ? vector<string>{ "props" } : opts.collectors);
+            collected[i] = 1;
+            if (getprop) return;
+            DeviceRecord rec = deviceRecordFrom(snaps[i]);
+            for (auto& sink : concurrentSinks) saveRecord(*sink, rec);
+        });
+    for (auto& w : workers) w.join();
+
+    for (size_t i = 0; i < opts.serials.size(); i++) {
+        if (!collected[i]) continue;
+        const DeviceSnapshot& snap = snaps[i];
+        if (getprop) {
+            vector<pair<string, string>> fields = { { "serial", opts.serials[i] } };
+            for (const string& name : opts.args) fields.push_back({ name, snapshotProp(snap, name) });
+            printRecord(opts, fields);
+            continue;
+        }
+
+        DeviceRecord rec = deviceRecordFrom(snap);
+        vector<pair<string, string>> fields = { { "serial", rec.serial }, { "model", rec.model },
+            { "brand", rec.brand }, { "device", rec.device },
+            { "android_version", rec.androidVersion }, { "sdk_version", rec.sdkVersion } };
+        if (rec.enrichment) {
+            fields.push_back({ "marketing_name", string(rec.enrichment->marketingName) });
+            fields.push_back({ "soc", string(rec.enrichment->soc) });
+            fields.push_back({ "release_year", to_string(rec.enrichment->releaseYear) });
+        }
+        else if (opts.format == "tsv") {
+            fields.insert(fields.end(), 3, { "", "" });  // keep columns aligned
+        }
+        appendCollectorFields(opts, snap, fields);
+        printRecord(opts, fields);
+
+        for (auto& sink : queuedSinks)
+            persistQueue->submit([sink, rec] { saveRecord(*sink, rec); });
+    }
+
+    if (opts.stats) printLimiterStats();
+    // Only our own queue: the global drain would also run the trace hook
+    // before runBatch has taken the clocks' last burst
+    if (persistQueue) {
+        persistQueue->close();
+        if (!persistQueue->drain(ShutdownClock::now() + chrono::seconds(10)))
+            cerr << "[WARN] persistence queue did not drain before the deadline\n";
+    }
+    return 0;
+}
+
+static int runLeaseDaemonCommand(const BatchOptions& opts) {
+    return runLeaseDaemon(opts.port, opts.intervalMs);
+}
+
+static int runSelfTestCommand(const BatchOptions& opts) {
+    return runSelfTests(opts.args, opts.bench);
+}
+
+// ===== Batch command table =====
+// One row per command. `sub` names a required first argument ("logs capture"
+// vs "logs grep"); argument counts include it, -1 means no upper bound.
+// Device commands get -s/--all resolved (or one device detected) first.
+struct BatchCommand {
+    const char* name;
+    const char* sub;
+    int minArgs;
+    int maxArgs;
+    bool devices;
+    int (*run)(const BatchOptions& opts);
+};
+
+static const BatchCommand batchCommands[] = {
+    // Offline: local files, the stores, or devices found another way
+    { "devices",      nullptr,   0,  0, false, runDevices },
+    { "ota-extract",  nullptr,   1,  1, false, runOtaExtract },
+    { "unzip",        nullptr,   1,  1, false, runUnzip },
+    { "avb-verify",   nullptr,   1,  1, false, runAvbVerify },
+    { "flash-plan",   nullptr,   1,  1, false, runFlashPlan },
+    { "logs",         "grep",    2,  2, false, runLogsGrep },
+    { "ts-query",     nullptr,   0,  1, false, runTsQuery },
+    { "lease-daemon", nullptr,   0,  0, false, runLeaseDaemonCommand },
+    { "lease",        nullptr,   1, -1, false, runLeaseClient },
+    { "selftest",     nullptr,   0, -1, false, runSelfTestCommand },
+    // Device commands
+    { "info",         nullptr,   0, -1, true,  runInfo },
+    { "getprop",      nullptr,   1, -1, true,  runInfo },
+    { "telemetry",    nullptr,   0, -1, true,  runTelemetry },
+    { "crashes",      nullptr,   0, -1, true,  runCrashes },
+    { "sync",         nullptr,   2,  2, true,  runSync },
+    { "pull",         nullptr,   1,  1, true,  runPull },
+    { "drift",        nullptr,   1,  1, true,  runDrift },
+    { "alerts",       nullptr,   1,  1, true,  runAlerts },
+    { "test",         nullptr,   1,  1, true,  runTests },
+    { "bench-app",    nullptr,   1,  1, true,  runBenchApp },
+    { "clock-sync",   nullptr,   0, -1, true,  runClockSync },
+    { "logs",         "capture", 1,  1, true,  runLogsCapture },
+};
+
+static const BatchCommand* findBatchCommand(const BatchOptions& opts) {
+    for (const BatchCommand& c : batchCommands) {
+        if (opts.command != c.name) continue;
+        if (c.sub && (opts.args.empty() || opts.args[0] != c.sub)) continue;
+        int n = (int)opts.args.size();
+        if (n < c.minArgs || (c.maxArgs >= 0 && n > c.maxArgs)) return nullptr;
+        return &c;
+    }
+    return nullptr;
+}
+
+// Set while a --trace run is aligning device clocks
+static ClockTracker* traceClocks = nullptr;
+
+static int runBatchCommand(BatchOptions& opts, char** argv) {
+    auto firstQuery = chrono::steady_clock::now();
+    const BatchCommand* command = findBatchCommand(opts);
+    if (!command) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    if (command->devices) {
+        if (opts.allDevices) opts.serials = listDevices();
+        else if (opts.serials.empty()) {
+            string serial;
+            if (detectDevice(serial)) opts.serials.push_back(serial);
+        }
+        if (opts.serials.empty()) {
+            cerr << "[FAIL] No device detected. Make sure USB Debugging is enabled.\n";
+            return 1;
+        }
+        // clock-sync runs its own exchanges
+        if (traceClocks && command->run != runClockSync) traceClocks->start(opts.serials);
+    }
+
+    int rc = command->run(opts);
+    if (opts.timings) printTimings(firstQuery);
+    return rc;
+}
+
+static int runBatch(int argc, char** argv) {
+    batchMode = true;
+    BatchOptions opts;
+    if (!parseBatchArgs(argc, argv, opts)) {
+        printUsage(argv[0]);
+        return 2;
+    }
+    if (opts.tracePath.empty()) return runBatchCommand(opts, argv);
+
+    if (!startTrace(opts.tracePath)) {
+        cerr << "[FAIL] cannot write " << opts.tracePath << "\n";
+        return 1;
+    }
+    ClockTracker clocks;
+    traceClocks = &clocks;
+    // Ctrl-C still leaves a trace of what ran, aligned with the exchanges so
+    // far; a normal exit writes it below, after the last burst
+    int hook = registerShutdownHook("trace", [] {}, [&clocks](ShutdownClock::time_point) {
+        if (!shutdownRequested()) return true;
+        string error;
+        return finishTrace(clocks.models(), error);
+    });
+    int rc = runBatchCommand(opts, argv);
+    unregisterShutdownHook(hook);
+    clocks.stop();
+    traceClocks = nullptr;
+
+    size_t dropped = 0;
+    string error;
+    if (!finishTrace(clocks.models(), error, &dropped)) cerr << "[WARN] " << error << "\n";
+    else cerr << "[OK] trace written to " << opts.tracePath << "\n";
+    if (dropped) cerr << "[WARN] " << dropped << " device event(s) left out: clock not aligned\n";
+    return rc;
+}
+
+int main(int argc, char** argv) {
+    startSpawner();  // must run before any thread is created
+    installShutdownHandlers();
+    if (argc > 1) return runBatch(argc, argv);
+
+    WriteQueue persistQueue("persistence queue");
+
 #ifdef _WIN32
     system("cls");
 #else
@@ -187,26 +1545,32 @@ int main() {
     cout << " Serial: " << serial << "\n";
     resetColor();
 
-    showProgressBar("[Step 2] Fetching Model", 800);
-    string model = getProp("ro.product.model");
+    // One adb shell for every property, as in batch mode
+    showProgressBar("[Step 2] Fetching Device Properties", 800);
+    DeviceSnapshot snap = collectDevice(serial, { "props" });
+    auto prop = [&snap](const string& name) {
+        auto it = snap.props.find(name);
+        return it == snap.props.end() ? string() : it->second;
+    };
+    string model = prop("ro.product.model");
+    string brand = prop("ro.product.brand");
+    string device = prop("ro.product.device");
+    string androidV = prop("ro.build.version.release");
+    string sdk = prop("ro.build.version.sdk");
 
-    showProgressBar("[Step 3] Fetching Brand", 800);
-    string brand = getProp("ro.product.brand");
+    DeviceRecord rec = { serial, model, brand, device, androidV, sdk };
+    rec.enrichment = lookupDevice(device);
 
-    showProgressBar("[Step 4] Fetching Device", 800);
-    string device = getProp("ro.product.device");
+    showProgressBar("[Step 3] Saving to MySQL Database", 1200);
+    shared_ptr<RecordSink> database = createSink("mysql");
+    persistQueue.submit([database, rec] { saveRecord(*database, rec); });
 
-    showProgressBar("[Step 5] Fetching Android Version", 800);
-    string androidV = getProp("ro.build.version.release");
+    showProgressBar("[Step 4] Saving to details.txt", 800);
+    shared_ptr<RecordSink> textFile = createSink("file");
+    persistQueue.submit([textFile, rec] { saveRecord(*textFile, rec); });
 
-    showProgressBar("[Step 6] Fetching SDK Version", 800);
-    string sdk = getProp("ro.build.version.sdk");
-
-    showProgressBar("[Step 7] Saving to MySQL Database", 1200);
-    saveToDatabase(serial, model, brand, device, androidV, sdk);
-
-    showProgressBar("[Step 8] Saving to details.txt", 800);
-    saveToTextFile(serial, model, brand, device, androidV, sdk);
+    // Let both saves report before the summary is printed
+    persistQueue.drain(ShutdownClock::now() + chrono::seconds(30));
 
     // ===== Display all details on console =====
     setColor(14); // Yellow
@@ -217,6 +1581,11 @@ int main() {
     cout << "Device             : " << device << "\n";
     cout << "Android Version    : " << androidV << "\n";
     cout << "SDK Version        : " << sdk << "\n";
+    if (rec.enrichment) {
+        cout << "Marketing Name     : " << rec.enrichment->marketingName << "\n";
+        cout << "SoC                : " << rec.enrichment->soc << "\n";
+        cout << "Release Year       : " << rec.enrichment->releaseYear << "\n";
+    }
     cout << "=========================================\n";
     resetColor();
 
@@ -228,5 +1597,6 @@ int main() {
     cin.get();
 
     PlaySound(NULL, 0, 0); // Stop background music
+    finishShutdown();
     return 0;
 }
\ No newline at end of file